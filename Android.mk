@@ -116,6 +116,8 @@ LOCAL_SRC_FILES:= \
 	rsAdapter.cpp \
 	rsAllocation.cpp \
 	rsAnimation.cpp \
+	rsCapture.cpp \
+	rsCommandBuffer.cpp \
 	rsComponent.cpp \
 	rsContext.cpp \
 	rsDevice.cpp \
@@ -208,6 +210,8 @@ LOCAL_SRC_FILES:= \
 	rsAdapter.cpp \
 	rsAllocation.cpp \
 	rsAnimation.cpp \
+	rsCapture.cpp \
+	rsCommandBuffer.cpp \
 	rsComponent.cpp \
 	rsContext.cpp \
 	rsDevice.cpp \
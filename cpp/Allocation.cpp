@@ -39,7 +39,7 @@ void Allocation::updateCacheInfo(sp<const Type> t) {
 
 Allocation::Allocation(void *id, sp<RS> rs, sp<const Type> t, uint32_t usage) :
     BaseObj(id, rs), mSelectedY(0), mSelectedZ(0), mSelectedLOD(0),
-    mSelectedFace(RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X) {
+    mSelectedFace(RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X), mMappedPtr(NULL) {
 
     if ((usage & ~(RS_ALLOCATION_USAGE_SCRIPT |
                    RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE |
@@ -166,6 +166,84 @@ void Allocation::generateMipmaps() {
     rsAllocationGenerateMipmaps(mRS->getContext(), getID());
 }
 
+void Allocation::generateMipmaps(RsMipmapFilter filter) {
+    rsAllocationGenerateMipmapsFiltered(mRS->getContext(), getID(), filter);
+}
+
+void * Allocation::map(size_t *stride, uint32_t lod, RsAllocationCubemapFace face) {
+    if (mMappedPtr) {
+        ALOGE("Allocation is already mapped.");
+        return NULL;
+    }
+    size_t s = 0;
+    // The command waits for its return value, which orders it after every
+    // launch already queued.
+    mMappedPtr = rsAllocationGetPointer(mRS->getContext(), getID(), lod, face, &s, sizeof(s));
+    if (mMappedPtr == NULL) {
+        ALOGE("Allocation has no mappable storage.");
+    }
+    if (stride) {
+        *stride = s;
+    }
+    return mMappedPtr;
+}
+
+void Allocation::unmap() {
+    if (!mMappedPtr) {
+        ALOGE("Allocation is not mapped.");
+        return;
+    }
+    mMappedPtr = NULL;
+    // Writes through the mapping only reached the script copy.
+    if (mUsage & (RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE |
+                  RS_ALLOCATION_USAGE_GRAPHICS_VERTEX |
+                  RS_ALLOCATION_USAGE_GRAPHICS_CONSTANTS)) {
+        rsAllocationSyncAll(mRS->getContext(), getID(), RS_ALLOCATION_USAGE_SCRIPT);
+    }
+}
+
+sp<Allocation> Allocation::createView(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
+                                      uint32_t lod, RsAllocationCubemapFace face) {
+    void *id = rsAllocationCreateView(mRS->getContext(), getID(), xoff, yoff, 0, lod, face,
+                                      w, h, 0);
+    if (id == 0) {
+        ALOGE("Allocation view creation failed.");
+        return NULL;
+    }
+    sp<const Type> t = Type::create(mRS, mType->getElement(), w, h, 0);
+    return new Allocation(id, mRS, t, RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED);
+}
+
+sp<Allocation> Allocation::createView(uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                                      uint32_t w, uint32_t h, uint32_t d) {
+    void *id = rsAllocationCreateView(mRS->getContext(), getID(), xoff, yoff, zoff, 0,
+                                      RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X, w, h, d);
+    if (id == 0) {
+        ALOGE("Allocation view creation failed.");
+        return NULL;
+    }
+    sp<const Type> t = Type::create(mRS, mType->getElement(), w, h, d);
+    return new Allocation(id, mRS, t, RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED);
+}
+
+sp<Allocation> Allocation::createFieldView(uint32_t subElement) {
+    const Element *e = mType->getElement().get();
+    if (subElement >= e->mVisibleElementMap.size()) {
+        ALOGE("Field view sub-element %u out of range.", subElement);
+        return NULL;
+    }
+    // The runtime counts the padding fields the builder inserted.
+    uint32_t field = e->mVisibleElementMap[subElement];
+    void *id = rsAllocationCreateFieldView(mRS->getContext(), getID(), field);
+    if (id == 0) {
+        ALOGE("Allocation field view creation failed.");
+        return NULL;
+    }
+    sp<const Type> t = Type::create(mRS, e->mElements[field], mType->getX(), mType->getY(),
+                                    mType->getZ());
+    return new Allocation(id, mRS, t, RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED);
+}
+
 void Allocation::copy1DRangeFrom(uint32_t off, size_t count, const void *data) {
 
     if(count < 1) {
@@ -324,6 +402,76 @@ android::sp<Allocation> Allocation::createTyped(sp<RS> rs, sp<const Type> type,
     return new Allocation(id, rs, type, usage);
 }
 
+android::sp<Allocation> Allocation::createStrided(sp<RS> rs, sp<const Type> type,
+                                                  uint32_t usage, void *pointer, size_t stride) {
+    return createStrided(rs, type, RS_ALLOCATION_MIPMAP_NONE, usage, pointer, &stride, NULL, 1);
+}
+
+android::sp<Allocation> Allocation::createStrided(sp<RS> rs, sp<const Type> type,
+                                                  RsAllocationMipmapControl mips, uint32_t usage,
+                                                  void *pointer, const size_t *strides,
+                                                  const size_t *offsets, uint32_t count) {
+    if (!pointer) {
+        ALOGE("Strided allocations require a pointer.");
+        return NULL;
+    }
+    void *id = rsAllocationCreateStrided(rs->getContext(), type->getID(), mips, usage,
+                                         (uintptr_t)pointer, strides, count * sizeof(size_t),
+                                         offsets, offsets ? count * sizeof(size_t) : 0);
+    if (id == 0) {
+        ALOGE("Allocation creation failed.");
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
+android::sp<Allocation> Allocation::createFromFile(sp<RS> rs, sp<const Type> type,
+                                                   const char *path, size_t offset,
+                                                   uint32_t flags) {
+    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED;
+    void *id = rsAllocationCreateFromFile(rs->getContext(), type->getID(), usage,
+                                          path, strlen(path), offset, flags);
+    if (id == 0) {
+        ALOGE("Allocation creation from %s failed.", path);
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
+android::sp<Allocation> Allocation::createSparse(sp<RS> rs, sp<const Type> type,
+                                                 uint32_t brickX, uint32_t brickY,
+                                                 uint32_t brickZ) {
+    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED;
+    void *id = rsAllocationCreateSparse(rs->getContext(), type->getID(), usage,
+                                        brickX, brickY, brickZ);
+    if (id == 0) {
+        ALOGE("Sparse allocation creation failed.");
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
+android::sp<Allocation> Allocation::createTiled(sp<RS> rs, sp<const Type> type,
+                                                uint32_t tileDim) {
+    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT;
+    void *id = rsAllocationCreateTiled(rs->getContext(), type->getID(), usage, tileDim);
+    if (id == 0) {
+        ALOGE("Tiled allocation creation failed.");
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
+android::sp<Allocation> Allocation::createFieldPlanes(sp<RS> rs, sp<const Type> type) {
+    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT;
+    void *id = rsAllocationCreateFieldPlanes(rs->getContext(), type->getID(), usage);
+    if (id == 0) {
+        ALOGE("Planar allocation creation failed.");
+        return NULL;
+    }
+    return new Allocation(id, rs, type, usage);
+}
+
 android::sp<Allocation> Allocation::createTyped(sp<RS> rs, sp<const Type> type,
                                                 uint32_t usage) {
     return createTyped(rs, type, RS_ALLOCATION_MIPMAP_NONE, usage);
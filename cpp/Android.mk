@@ -16,6 +16,7 @@ LOCAL_CFLAGS += $(local_cflags_for_rs_cpp)
 LOCAL_SRC_FILES:= \
 	RenderScript.cpp \
 	BaseObj.cpp \
+	CommandBuffer.cpp \
 	Element.cpp \
 	Type.cpp \
 	Allocation.cpp \
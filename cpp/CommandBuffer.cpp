@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RenderScript.h"
+#include <rs.h>
+
+using namespace android;
+using namespace RSC;
+
+CommandBuffer::CommandBuffer(void *id, sp<RS> rs) : BaseObj(id, rs) {
+}
+
+sp<CommandBuffer> CommandBuffer::create(sp<RS> rs) {
+    void *id = rsCommandBufferCreate(rs->getContext());
+    if (id == 0) {
+        ALOGE("CommandBuffer creation failed.");
+        return NULL;
+    }
+    return new CommandBuffer(id, rs);
+}
+
+void CommandBuffer::beginRecording() {
+    rsCommandBufferBeginRecording(mRS->getContext(), getID());
+}
+
+void CommandBuffer::endRecording() {
+    rsCommandBufferEndRecording(mRS->getContext(), getID());
+}
+
+uint32_t CommandBuffer::getCommandCount() {
+    return rsCommandBufferGetCommandCount(mRS->getContext(), getID());
+}
+
+void CommandBuffer::patch(uint32_t cmdIndex, const void *data, size_t len) {
+    rsCommandBufferPatch(mRS->getContext(), getID(), cmdIndex, data, len);
+}
+
+void CommandBuffer::submit() {
+    rsCommandBufferSubmit(mRS->getContext(), getID());
+}
@@ -36,6 +36,17 @@ void Script::forEach(uint32_t slot, sp<const Allocation> ain, sp<const Allocatio
     rsScriptForEach(mRS->getContext(), getID(), slot, in_id, out_id, usr, usrLen, NULL, 0);
 }
 
+void Script::forEach(uint32_t slot, sp<const Allocation> ain, sp<const Allocation> aout,
+                       const void *usr, size_t usrLen, const RsScriptCall *sc) const {
+    if ((ain == NULL) && (aout == NULL)) {
+        mRS->throwError("At least one of ain or aout is required to be non-null.");
+    }
+    void *in_id = BaseObj::getObjID(ain);
+    void *out_id = BaseObj::getObjID(aout);
+    rsScriptForEach(mRS->getContext(), getID(), slot, in_id, out_id, usr, usrLen,
+                    sc, sc ? sizeof(*sc) : 0);
+}
+
 
 Script::Script(void *id, sp<RS> rs) : BaseObj(id, rs) {
 }
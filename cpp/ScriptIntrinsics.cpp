@@ -28,11 +28,36 @@ ScriptIntrinsic::ScriptIntrinsic(sp<RS> rs, int id, sp<const Element> e)
     mID = rsScriptIntrinsicCreate(rs->getContext(), id, e->getID());
 }
 
+ScriptIntrinsic3DLUT::ScriptIntrinsic3DLUT(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_3DLUT, e) {
+
+}
+
+void ScriptIntrinsic3DLUT::setLUT(sp<Allocation> lut) {
+    Script::setVar(0, lut);
+}
+
+void ScriptIntrinsic3DLUT::setInterpolation(int32_t mode) {
+    Script::setVar(1, &mode, sizeof(mode));
+}
+
+void ScriptIntrinsic3DLUT::forEach(sp<Allocation> in, sp<Allocation> out) {
+    Script::forEach(0, in, out, NULL, 0);
+}
+
 ScriptIntrinsicBlend::ScriptIntrinsicBlend(sp<RS> rs, sp<const Element> e)
     : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_BLEND, e) {
 
 }
 
+void ScriptIntrinsicBlend::setAlphaMode(int32_t mode) {
+    Script::setVar(0, &mode, sizeof(mode));
+}
+
+void ScriptIntrinsicBlend::blend(uint32_t mode, sp<Allocation> in, sp<Allocation> out) {
+    Script::forEach(mode, in, out, NULL, 0);
+}
+
 void ScriptIntrinsicBlend::blendClear(sp<Allocation> in, sp<Allocation> out) {
     Script::forEach(0, in, out, NULL, 0);
 }
@@ -108,3 +133,148 @@ void ScriptIntrinsicBlur::blur(sp<Allocation> in, sp<Allocation> out) {
 void ScriptIntrinsicBlur::setRadius(float radius) {
     Script::setVar(0, &radius, sizeof(float));
 }
+
+void ScriptIntrinsicBlur::setMode(int32_t mode) {
+    Script::setVar(2, &mode, sizeof(mode));
+}
+
+ScriptIntrinsicColorPipeline::ScriptIntrinsicColorPipeline(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, e) {
+
+}
+
+void ScriptIntrinsicColorPipeline::setMatrix(const float *m) {
+    Script::setVar(0, m, sizeof(float) * 16);
+}
+
+void ScriptIntrinsicColorPipeline::setBias(float r, float g, float b, float a) {
+    float bias[4] = {r, g, b, a};
+    Script::setVar(1, bias, sizeof(bias));
+}
+
+void ScriptIntrinsicColorPipeline::setCurves(sp<Allocation> curves) {
+    Script::setVar(2, curves);
+}
+
+void ScriptIntrinsicColorPipeline::setClamp(bool clamp) {
+    int32_t v = clamp ? 1 : 0;
+    Script::setVar(3, &v, sizeof(v));
+}
+
+void ScriptIntrinsicColorPipeline::forEach(sp<Allocation> in, sp<Allocation> out) {
+    Script::forEach(0, in, out, NULL, 0);
+}
+
+ScriptIntrinsicYuvToRGB::ScriptIntrinsicYuvToRGB(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB, e) {
+
+}
+
+void ScriptIntrinsicYuvToRGB::setInput(sp<Allocation> in) {
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicYuvToRGB::setColorSpace(int32_t space, int32_t range) {
+    Script::setVar(1, &space, sizeof(space));
+    Script::setVar(2, &range, sizeof(range));
+}
+
+void ScriptIntrinsicYuvToRGB::setDownscale(int32_t scale) {
+    Script::setVar(3, &scale, sizeof(scale));
+}
+
+void ScriptIntrinsicYuvToRGB::forEach(sp<Allocation> out) {
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+ScriptIntrinsicMorphology::ScriptIntrinsicMorphology(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, e) {
+
+}
+
+void ScriptIntrinsicMorphology::setInput(sp<Allocation> in) {
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicMorphology::setRadius(int32_t rx, int32_t ry) {
+    int32_t r[2] = {rx, ry};
+    Script::setVar(1, r, sizeof(r));
+}
+
+void ScriptIntrinsicMorphology::setMask(sp<Allocation> mask) {
+    Script::setVar(2, mask);
+}
+
+void ScriptIntrinsicMorphology::erode(sp<Allocation> out) {
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicMorphology::dilate(sp<Allocation> out) {
+    Script::forEach(1, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicMorphology::open(sp<Allocation> out) {
+    Script::forEach(2, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicMorphology::close(sp<Allocation> out) {
+    Script::forEach(3, NULL, out, NULL, 0);
+}
+
+ScriptIntrinsicScan::ScriptIntrinsicScan(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_SCAN, e) {
+
+}
+
+void ScriptIntrinsicScan::setInput(sp<Allocation> in) {
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicScan::setOp(int32_t op, bool exclusive) {
+    int32_t e = exclusive ? 1 : 0;
+    Script::setVar(1, &op, sizeof(op));
+    Script::setVar(2, &e, sizeof(e));
+}
+
+void ScriptIntrinsicScan::scan(sp<Allocation> out) {
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+void ScriptIntrinsicScan::integral(sp<Allocation> out) {
+    Script::forEach(1, NULL, out, NULL, 0);
+}
+
+ScriptIntrinsicSort::ScriptIntrinsicSort(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_SORT, e) {
+
+}
+
+void ScriptIntrinsicSort::setKeys(sp<Allocation> keys) {
+    Script::setVar(0, keys);
+}
+
+void ScriptIntrinsicSort::setPayload(sp<Allocation> payload) {
+    Script::setVar(1, payload);
+}
+
+void ScriptIntrinsicSort::sort(sp<Allocation> out) {
+    Script::forEach(0, NULL, out, NULL, 0);
+}
+
+ScriptIntrinsicRgbToYuv::ScriptIntrinsicRgbToYuv(sp<RS> rs, sp<const Element> e)
+    : ScriptIntrinsic(rs, RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV, e) {
+
+}
+
+void ScriptIntrinsicRgbToYuv::setInput(sp<Allocation> in) {
+    Script::setVar(0, in);
+}
+
+void ScriptIntrinsicRgbToYuv::setColorSpace(int32_t space, int32_t range) {
+    Script::setVar(1, &space, sizeof(space));
+    Script::setVar(2, &range, sizeof(range));
+}
+
+void ScriptIntrinsicRgbToYuv::forEach(sp<Allocation> out) {
+    Script::forEach(0, NULL, out, NULL, 0);
+}
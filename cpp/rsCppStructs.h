@@ -41,6 +41,7 @@ class Type;
 class Allocation;
 class Script;
 class ScriptC;
+class CommandBuffer;
 
 class RS : public android::LightRefBase<RS> {
 
@@ -199,6 +200,8 @@ protected:
     uint32_t mCurrentDimZ;
     uint32_t mCurrentCount;
 
+    void *mMappedPtr;
+
     void * getIDSafe() const;
     void updateCacheInfo(sp<const Type> t);
 
@@ -224,6 +227,25 @@ public:
     void ioGetInput();
 
     void generateMipmaps();
+    void generateMipmaps(RsMipmapFilter filter);
+
+    // Returns a pointer to the storage of one LOD and face, after every
+    // command issued so far has completed.  Rows are *stride bytes apart.
+    // The allocation must not be used by a launch or copy until unmap().
+    void * map(size_t *stride, uint32_t lod = 0,
+               RsAllocationCubemapFace face = RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    void unmap();
+
+    // Returns an allocation aliasing a region of this one.  Kernels and
+    // copies on the view touch only the region, with no copy made.
+    sp<Allocation> createView(uint32_t xoff, uint32_t yoff, uint32_t w, uint32_t h,
+                              uint32_t lod = 0,
+                              RsAllocationCubemapFace face = RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    sp<Allocation> createView(uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                              uint32_t w, uint32_t h, uint32_t d);
+    // Returns an allocation of one sub-element of a planar allocation,
+    // sharing its plane.  Array sub-elements cannot be viewed.
+    sp<Allocation> createFieldView(uint32_t subElement);
 
     void copy1DRangeFrom(uint32_t off, size_t count, const void *data);
     void copy1DRangeFrom(uint32_t off, size_t count, sp<const Allocation> data, uint32_t dataOff);
@@ -260,6 +282,43 @@ public:
 
     static sp<Allocation> createTyped(sp<RS> rs, sp<const Type> type,
                                    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT);
+
+    // Wrap memory in place.  usage must include USAGE_SCRIPT and
+    // USAGE_SHARED.  Rows of the first form are stride bytes apart; in the
+    // second, strides[n] and offsets[n] give the row stride and the offset
+    // from pointer of LOD n, or of plane n of a YUV type.
+    static sp<Allocation> createStrided(sp<RS> rs, sp<const Type> type, uint32_t usage,
+                                        void *pointer, size_t stride);
+    static sp<Allocation> createStrided(sp<RS> rs, sp<const Type> type,
+                                        RsAllocationMipmapControl mips, uint32_t usage,
+                                        void *pointer, const size_t *strides,
+                                        const size_t *offsets, uint32_t count);
+
+    // Map the contents of a file starting at offset.  flags is a mask of
+    // RsAllocationFileFlags; read-only allocations can only be used as
+    // kernel inputs.  A writable file is extended if it is too short.
+    static sp<Allocation> createFromFile(sp<RS> rs, sp<const Type> type, const char *path,
+                                         size_t offset = 0,
+                                         uint32_t flags = RS_ALLOCATION_FILE_READ_ONLY);
+
+    // Reserve memory that is committed as it is first written.  Launches
+    // with RS_FOR_EACH_SKIP_UNALLOCATED in RsScriptCall::flags skip the
+    // bricks of brickX * brickY * brickZ cells that were never written.
+    static sp<Allocation> createSparse(sp<RS> rs, sp<const Type> type,
+                                       uint32_t brickX, uint32_t brickY = 1,
+                                       uint32_t brickZ = 1);
+
+    // Store a 2D type as tileDim x tileDim blocks of cells for kernels that
+    // read neighbouring rows.  tileDim is a power of two from 2 to 256.
+    // Copies convert to and from the usual row-major order; the storage
+    // cannot be accessed through getPointer.
+    static sp<Allocation> createTiled(sp<RS> rs, sp<const Type> type, uint32_t tileDim = 16);
+
+    // Store each field of a struct element in its own contiguous plane.
+    // Copies take and return packed structs as usual.  Kernels run over a
+    // single field through createFieldView.
+    static sp<Allocation> createFieldPlanes(sp<RS> rs, sp<const Type> type);
+
     static sp<Allocation> createSized(sp<RS> rs, sp<const Element> e, size_t count,
                                    uint32_t usage = RS_ALLOCATION_USAGE_SCRIPT);
     static sp<Allocation> createSized2D(sp<RS> rs, sp<const Element> e,
@@ -385,6 +444,8 @@ public:
     };
 
 private:
+    friend class Allocation;
+
     void updateVisibleSubElements();
 
     android::Vector<sp</*const*/ Element> > mElements;
@@ -577,6 +638,10 @@ protected:
     Script(void *id, sp<RS> rs);
     void forEach(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
             const void *v, size_t) const;
+    // sc restricts the launch or, through its LOD and face ranges, extends
+    // it over the mipmaps and cubemap faces of the allocations.
+    void forEach(uint32_t slot, sp<const Allocation> in, sp<const Allocation> out,
+            const void *v, size_t, const RsScriptCall *sc) const;
     void bindAllocation(sp<Allocation> va, uint32_t slot) const;
     void setVar(uint32_t index, const void *, size_t len) const;
     void setVar(uint32_t index, sp<const BaseObj> o) const;
@@ -641,9 +706,23 @@ class ScriptIntrinsic : public Script {
     ScriptIntrinsic(sp<RS> rs, int id, sp<const Element> e);
 };
 
+class ScriptIntrinsic3DLUT : public ScriptIntrinsic {
+ public:
+    ScriptIntrinsic3DLUT(sp<RS> rs, sp <const Element> e);
+    // The LUT is copied when it is set, so changes to its contents need
+    // another setLUT() to take effect.
+    void setLUT(sp<Allocation> lut);
+    // One of the Rs3DLUTInterpolation values.
+    void setInterpolation(int32_t mode);
+    void forEach(sp<Allocation> in, sp<Allocation> out);
+};
+
 class ScriptIntrinsicBlend : public ScriptIntrinsic {
  public:
     ScriptIntrinsicBlend(sp<RS> rs, sp <const Element> e);
+    // One of the RsBlendAlphaMode values; colors are premultiplied by
+    // default.
+    void setAlphaMode(int32_t mode);
     void blendClear(sp<Allocation> in, sp<Allocation> out);
     void blendSrc(sp<Allocation> in, sp<Allocation> out);
     void blendDst(sp<Allocation> in, sp<Allocation> out);
@@ -659,13 +738,126 @@ class ScriptIntrinsicBlend : public ScriptIntrinsic {
     void blendMultiply(sp<Allocation> in, sp<Allocation> out);
     void blendAdd(sp<Allocation> in, sp<Allocation> out);
     void blendSubtract(sp<Allocation> in, sp<Allocation> out);
+    // Runs any of the intrinsic's modes by number, including those without
+    // a named method above.
+    void blend(uint32_t mode, sp<Allocation> in, sp<Allocation> out);
 };
 
 class ScriptIntrinsicBlur : public ScriptIntrinsic {
  public:
     ScriptIntrinsicBlur(sp<RS> rs, sp <const Element> e);
     void blur(sp<Allocation> in, sp<Allocation> out);
+    // Up to 25 for the default gaussian mode, unlimited otherwise.
     void setRadius(float radius);
+    // One of RsBlurMode.  Elements other than uchar and uchar4 always
+    // use the float path, which supports every mode.
+    void setMode(int32_t mode);
+};
+
+class ScriptIntrinsicColorPipeline : public ScriptIntrinsic {
+ public:
+    ScriptIntrinsicColorPipeline(sp<RS> rs, sp <const Element> e);
+    // Column major, as for the color matrix intrinsic.
+    void setMatrix(const float *m);
+    // Added after the matrix, in normalized units.
+    void setBias(float r, float g, float b, float a);
+    // A 1D allocation of at least 2 entries; each channel of an entry
+    // holds that channel's curve.  Copied when set.
+    void setCurves(sp<Allocation> curves);
+    // Clamps results to 0..1; on by default.  Integer outputs always clamp.
+    void setClamp(bool clamp);
+    void forEach(sp<Allocation> in, sp<Allocation> out);
+};
+
+class ScriptIntrinsicMorphology : public ScriptIntrinsic {
+ public:
+    ScriptIntrinsicMorphology(sp<RS> rs, sp <const Element> e);
+    void setInput(sp<Allocation> in);
+    // A rectangle of (2 * rx + 1) by (2 * ry + 1) pixels; 1, 1 by default.
+    void setRadius(int32_t rx, int32_t ry);
+    // A uchar allocation with odd dimensions whose non zero entries form
+    // the structuring element, replacing the rectangle.  Copied when set;
+    // NULL goes back to the rectangle.
+    void setMask(sp<Allocation> mask);
+    void erode(sp<Allocation> out);
+    void dilate(sp<Allocation> out);
+    void open(sp<Allocation> out);
+    void close(sp<Allocation> out);
+};
+
+class ScriptIntrinsicScan : public ScriptIntrinsic {
+ public:
+    // e is the output and accumulator type: int, uint, long, ulong,
+    // float or double.
+    ScriptIntrinsicScan(sp<RS> rs, sp <const Element> e);
+    // A scalar allocation; float inputs need a float or double element.
+    void setInput(sp<Allocation> in);
+    // One of RsScanOp.  An exclusive scan leaves each element out of its
+    // own result.
+    void setOp(int32_t op, bool exclusive);
+    // Scans each row of the input.
+    void scan(sp<Allocation> out);
+    // Scans the rows and then the columns, giving a summed area table.
+    void integral(sp<Allocation> out);
+};
+
+class ScriptIntrinsicSort : public ScriptIntrinsic {
+ public:
+    // e is the key type: uint, int, float, ulong, long or double.
+    ScriptIntrinsicSort(sp<RS> rs, sp <const Element> e);
+    // A 1D allocation of keys, and optionally one entry per key that is
+    // reordered in place with them.
+    void setKeys(sp<Allocation> keys);
+    void setPayload(sp<Allocation> payload);
+    // Stable ascending sort; out may be the keys allocation.
+    void sort(sp<Allocation> out);
+};
+
+class ScriptIntrinsicYuvToRGB : public ScriptIntrinsic {
+ public:
+    ScriptIntrinsicYuvToRGB(sp<RS> rs, sp <const Element> e);
+    void setInput(sp<Allocation> in);
+    // Matrix and range are RsYuvColorSpace and RsYuvRange values.
+    void setColorSpace(int32_t space, int32_t range);
+    // Converts and box filters in one pass; out is 1/scale of the input.
+    void setDownscale(int32_t scale);
+    void forEach(sp<Allocation> out);
+};
+
+class ScriptIntrinsicRgbToYuv : public ScriptIntrinsic {
+ public:
+    ScriptIntrinsicRgbToYuv(sp<RS> rs, sp <const Element> e);
+    // in is a uchar4 or float4 allocation the size of out's luma plane.
+    void setInput(sp<Allocation> in);
+    void setColorSpace(int32_t space, int32_t range);
+    void forEach(sp<Allocation> out);
+};
+
+class CommandBuffer : public BaseObj {
+protected:
+    CommandBuffer(void *id, sp<RS> rs);
+
+public:
+    static sp<CommandBuffer> create(sp<RS> rs);
+
+    // Commands issued on the context between beginRecording() and
+    // endRecording() are stored in this buffer instead of being executed.
+    // Calls that return a value or wait for the RS thread are rejected
+    // while recording; patch() and releasing objects take effect at once.
+    // Recording requires an asynchronous context.
+    void beginRecording();
+    void endRecording();
+
+    // Number of commands recorded so far; the index of the last recorded
+    // command is getCommandCount() - 1.
+    uint32_t getCommandCount();
+
+    // Replaces the trailing len bytes of the data carried by a recorded
+    // command, e.g. the value of a setVar() or the params of an invoke().
+    void patch(uint32_t cmdIndex, const void *data, size_t len);
+
+    // Replays every recorded command on the RS thread as a single command.
+    void submit();
 };
 
 }
@@ -25,9 +25,14 @@ LOCAL_SRC_FILES:= \
 	rsCpuIntrinsicBlend.cpp \
 	rsCpuIntrinsicBlur.cpp \
 	rsCpuIntrinsicColorMatrix.cpp \
+	rsCpuIntrinsicColorPipeline.cpp \
 	rsCpuIntrinsicConvolve3x3.cpp \
 	rsCpuIntrinsicConvolve5x5.cpp \
 	rsCpuIntrinsicLUT.cpp \
+	rsCpuIntrinsicMorphology.cpp \
+	rsCpuIntrinsicRgbToYuv.cpp \
+	rsCpuIntrinsicScan.cpp \
+	rsCpuIntrinsicSort.cpp \
 	rsCpuIntrinsicYuvToRGB.cpp
 
 ifeq ($(ARCH_ARM_HAVE_NEON),true)
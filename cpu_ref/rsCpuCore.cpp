@@ -25,6 +25,7 @@
 #include <sys/resource.h>
 #include <sched.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -167,6 +168,13 @@ void RsdCpuReferenceImpl::launchThreads(WorkerCallback_t cbk, void *data) {
         return;
     }
 
+    launchWorkers(cbk, data);
+}
+
+void RsdCpuReferenceImpl::launchWorkers(WorkerCallback_t cbk, void *data) {
+    mWorkers.mLaunchData = data;
+    mWorkers.mLaunchCallback = cbk;
+
     mWorkers.mRunningCount = mWorkers.mCount;
     __sync_synchronize();
 
@@ -185,6 +193,17 @@ void RsdCpuReferenceImpl::launchThreads(WorkerCallback_t cbk, void *data) {
     }
 }
 
+void RsdCpuReferenceImpl::runWorkers(WorkerCallback_t cbk, void *data) {
+    if (mInForEach) {
+        // Relaunching the pool from one of its own workers would deadlock.
+        for (uint32_t idx = 0; idx < getThreadCount(); idx++) {
+            cbk(data, idx);
+        }
+        return;
+    }
+    launchWorkers(cbk, data);
+}
+
 
 void RsdCpuReferenceImpl::lockMutex() {
     pthread_mutex_lock(&gInitMutex);
@@ -301,6 +320,32 @@ RsdCpuReferenceImpl::~RsdCpuReferenceImpl() {
 
 typedef void (*rs_t)(const void *, void *, const void *, uint32_t, uint32_t, uint32_t, uint32_t);
 
+// Bytes of a file backed allocation requested ahead of the kernel.
+static const size_t kPrefetchBytes = 1024 * 1024;
+
+static void prefetchRows(const uint8_t *base, size_t stride, uint32_t yStart, uint32_t yEnd) {
+    static const uintptr_t pageMask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start = (uintptr_t)(base + stride * yStart) & ~pageMask;
+    uintptr_t end = (uintptr_t)(base + stride * yEnd);
+    if (end > start) {
+        madvise((void *)start, end - start, MADV_WILLNEED);
+    }
+}
+
+// Pages in the rows of the prefetch window starting at y.
+static void prefetchWindow(const MTLaunchStruct *mtls, uint32_t y) {
+    uint32_t yEnd = rsMin(mtls->yEnd, y + mtls->prefetchSlices * mtls->mSliceSize);
+    if (y >= yEnd) {
+        return;
+    }
+    if (mtls->prefetchIn) {
+        prefetchRows(mtls->fep.ptrIn, mtls->fep.yStrideIn, y, yEnd);
+    }
+    if (mtls->prefetchOut) {
+        prefetchRows(mtls->fep.ptrOut, mtls->fep.yStrideOut, y, yEnd);
+    }
+}
+
 static void wc_xy(void *usr, uint32_t idx) {
     MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
     RsForEachStubParamStruct p;
@@ -317,15 +362,18 @@ static void wc_xy(void *usr, uint32_t idx) {
         if (yEnd <= yStart) {
             return;
         }
+        if (mtls->prefetchSlices && !(slice % mtls->prefetchSlices)) {
+            prefetchWindow(mtls, yStart + mtls->prefetchSlices * mtls->mSliceSize);
+        }
 
         //ALOGE("usr idx %i, x %i,%i  y %i,%i", idx, mtls->xStart, mtls->xEnd, yStart, yEnd);
         //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
 
         for (p.y = yStart; p.y < yEnd; p.y++) {
-            p.out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * p.y) +
-                    (mtls->fep.eStrideOut * mtls->xStart);
-            p.in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * p.y) +
-                   (mtls->fep.eStrideIn * mtls->xStart);
+            p.out = mtls->fep.ptrOut + ((size_t)mtls->fep.yStrideOut * p.y) +
+                    ((size_t)mtls->fep.eStrideOut * mtls->xStart);
+            p.in = mtls->fep.ptrIn + ((size_t)mtls->fep.yStrideIn * p.y) +
+                   ((size_t)mtls->fep.eStrideIn * mtls->xStart);
             fn(&p, mtls->xStart, mtls->xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
         }
     }
@@ -351,17 +399,236 @@ static void wc_x(void *usr, uint32_t idx) {
         //ALOGE("usr slice %i idx %i, x %i,%i", slice, idx, xStart, xEnd);
         //ALOGE("usr ptr in %p,  out %p", mtls->fep.ptrIn, mtls->fep.ptrOut);
 
-        p.out = mtls->fep.ptrOut + (mtls->fep.eStrideOut * xStart);
-        p.in = mtls->fep.ptrIn + (mtls->fep.eStrideIn * xStart);
+        p.out = mtls->fep.ptrOut + ((size_t)mtls->fep.eStrideOut * xStart);
+        p.in = mtls->fep.ptrIn + ((size_t)mtls->fep.eStrideIn * xStart);
         fn(&p, xStart, xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
     }
 }
 
+static void wc_levels(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+
+    outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
+    uint32_t level = 0;
+    while (1) {
+        uint32_t slice = (uint32_t)__sync_fetch_and_add(&mtls->mSliceNum, 1);
+        if (slice >= mtls->levelSlices) {
+            return;
+        }
+        // Slices are handed out in increasing order so a worker only ever
+        // moves forward through the level table.
+        while (((level + 1) < mtls->levelCount) &&
+               (slice >= mtls->levels[level + 1].firstSlice)) {
+            level++;
+        }
+
+        const MTLaunchLevel *l = &mtls->levels[level];
+        uint32_t yStart = (slice - l->firstSlice) * mtls->mSliceSize;
+        uint32_t yEnd = rsMin(yStart + mtls->mSliceSize, rsMax((uint32_t)1, l->dimY));
+
+        p.lod = l->lod;
+        p.face = l->face;
+        p.dimX = l->dimX;
+        p.dimY = l->dimY;
+        p.ptrIn = l->ptrIn;
+        p.ptrOut = l->ptrOut;
+        p.yStrideIn = l->yStrideIn;
+        p.yStrideOut = l->yStrideOut;
+        for (p.y = yStart; p.y < yEnd; p.y++) {
+            p.out = l->ptrOut + (l->yStrideOut * p.y);
+            p.in = l->ptrIn + (l->yStrideIn * p.y);
+            fn(&p, 0, l->dimX, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+        }
+    }
+}
+
+void RsdCpuReferenceImpl::launchLevels(MTLaunchStruct *mtls) {
+    if (!mtls->levelCount) {
+        return;
+    }
+
+    // Size slices from the largest level, LOD sizes only shrink from there.
+    const size_t targetByteChunk = 16 * 1024;
+    const MTLaunchLevel *first = &mtls->levels[0];
+    size_t rowBytes = first->yStrideOut ? first->yStrideOut : first->yStrideIn;
+    uint32_t rows = 0;
+    for (uint32_t ct = 0; ct < mtls->levelCount; ct++) {
+        rows += rsMax((uint32_t)1, mtls->levels[ct].dimY);
+    }
+    uint32_t s1 = rows / ((mWorkers.mCount + 1) * 4);
+    uint32_t s2 = rowBytes ? (uint32_t)(targetByteChunk / rowBytes) : s1;
+    mtls->mSliceSize = rsMax((uint32_t)1, rsMin(s1, s2));
+
+    uint32_t slices = 0;
+    for (uint32_t ct = 0; ct < mtls->levelCount; ct++) {
+        MTLaunchLevel *l = &mtls->levels[ct];
+        l->firstSlice = slices;
+        slices += (rsMax((uint32_t)1, l->dimY) + mtls->mSliceSize - 1) / mtls->mSliceSize;
+    }
+    mtls->levelSlices = slices;
+    mtls->mSliceNum = 0;
+
+    if ((mWorkers.mCount >= 1) && (slices > 1) && mtls->isThreadable && !mInForEach) {
+        mInForEach = true;
+        launchWorkers(wc_levels, mtls);
+        mInForEach = false;
+    } else {
+        wc_levels(mtls, 0);
+    }
+}
+
+static void wc_bricks(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+
+    outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
+    const size_t dimY = rsMax((uint32_t)1, mtls->fep.dimY);
+    while (1) {
+        uint32_t slice = (uint32_t)__sync_fetch_and_add(&mtls->mSliceNum, 1);
+        if (slice >= mtls->brickCount) {
+            return;
+        }
+        if (!mtls->ain->getBrickWritten(slice)) {
+            continue;
+        }
+
+        uint32_t bx = slice % mtls->bricksX;
+        uint32_t by = (slice / mtls->bricksX) % mtls->bricksY;
+        uint32_t bz = slice / (mtls->bricksX * mtls->bricksY);
+        uint32_t xStart = rsMax(mtls->xStart, bx * mtls->brickX);
+        uint32_t xEnd = rsMin(mtls->xEnd, (bx + 1) * mtls->brickX);
+        uint32_t yStart = rsMax(mtls->yStart, by * mtls->brickY);
+        uint32_t yEnd = rsMin(mtls->yEnd, (by + 1) * mtls->brickY);
+        uint32_t zStart = rsMax(mtls->zStart, bz * mtls->brickZ);
+        uint32_t zEnd = rsMin(mtls->zEnd, (bz + 1) * mtls->brickZ);
+        if ((xStart >= xEnd) || (yStart >= yEnd) || (zStart >= zEnd)) {
+            continue;
+        }
+
+        for (p.z = zStart; p.z < zEnd; p.z++) {
+            for (p.y = yStart; p.y < yEnd; p.y++) {
+                size_t offset = dimY * p.z + p.y;
+                p.out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * offset) +
+                        ((size_t)mtls->fep.eStrideOut * xStart);
+                p.in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * offset) +
+                       ((size_t)mtls->fep.eStrideIn * xStart);
+                fn(&p, xStart, xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+            }
+        }
+        if (mtls->aout) {
+            mtls->aout->markWritten(xStart, yStart, zStart, xEnd, yEnd, zEnd);
+        }
+    }
+}
+
+void RsdCpuReferenceImpl::launchBricks(MTLaunchStruct *mtls) {
+    const size_t dimY = rsMax((uint32_t)1, mtls->fep.dimY);
+    const size_t dimZ = rsMax((uint32_t)1, mtls->fep.dimZ);
+    mtls->bricksX = (mtls->fep.dimX + mtls->brickX - 1) / mtls->brickX;
+    mtls->bricksY = (dimY + mtls->brickY - 1) / mtls->brickY;
+    uint32_t bricksZ = (dimZ + mtls->brickZ - 1) / mtls->brickZ;
+    mtls->brickCount = mtls->bricksX * mtls->bricksY * bricksZ;
+
+    mtls->mSliceNum = 0;
+    if ((mWorkers.mCount >= 1) && (mtls->brickCount > 1) && mtls->isThreadable && !mInForEach) {
+        mInForEach = true;
+        launchWorkers(wc_bricks, mtls);
+        mInForEach = false;
+    } else {
+        wc_bricks(mtls, 0);
+    }
+}
+
+// Offset of (x, y) in LOD 0 of an allocation in either layout.
+static inline size_t cellOffset(uint32_t tileDim, uint32_t dimX, size_t eStride, size_t yStride,
+                                uint32_t x, uint32_t y) {
+    if (!tileDim) {
+        return yStride * y + eStride * x;
+    }
+    size_t tilesX = (dimX + tileDim - 1) / tileDim;
+    size_t index = ((y / tileDim) * tilesX + (x / tileDim)) * tileDim * tileDim +
+                   (y % tileDim) * tileDim + (x % tileDim);
+    return index * eStride;
+}
+
+static void wc_tiles(void *usr, uint32_t idx) {
+    MTLaunchStruct *mtls = (MTLaunchStruct *)usr;
+    RsForEachStubParamStruct p;
+    memcpy(&p, &mtls->fep, sizeof(p));
+    p.lid = idx;
+
+    outer_foreach_t fn = (outer_foreach_t) mtls->kernel;
+    const uint32_t tile = mtls->tile;
+    while (1) {
+        uint32_t slice = (uint32_t)__sync_fetch_and_add(&mtls->mSliceNum, 1);
+        if (slice >= mtls->tileCount) {
+            return;
+        }
+
+        // Blocks are aligned to the layout, not to the start of the launch.
+        uint32_t tx = (mtls->xStart / tile) + (slice % mtls->tilesX);
+        uint32_t ty = (mtls->yStart / tile) + (slice / mtls->tilesX);
+        uint32_t xStart = rsMax(mtls->xStart, tx * tile);
+        uint32_t xEnd = rsMin(mtls->xEnd, (tx + 1) * tile);
+        uint32_t yStart = rsMax(mtls->yStart, ty * tile);
+        uint32_t yEnd = rsMin(mtls->yEnd, (ty + 1) * tile);
+
+        for (p.y = yStart; p.y < yEnd; p.y++) {
+            p.out = mtls->fep.ptrOut + cellOffset(mtls->tileDimOut, mtls->fep.dimX,
+                                                  mtls->fep.eStrideOut, mtls->fep.yStrideOut,
+                                                  xStart, p.y);
+            p.in = mtls->fep.ptrIn + cellOffset(mtls->tileDimIn, mtls->fep.dimX,
+                                                mtls->fep.eStrideIn, mtls->fep.yStrideIn,
+                                                xStart, p.y);
+            fn(&p, xStart, xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
+        }
+    }
+}
+
+void RsdCpuReferenceImpl::launchTiles(MTLaunchStruct *mtls) {
+    const uint32_t tile = mtls->tile;
+    mtls->tilesX = (mtls->xEnd - 1) / tile - mtls->xStart / tile + 1;
+    uint32_t tilesY = (mtls->yEnd - 1) / tile - mtls->yStart / tile + 1;
+    mtls->tileCount = mtls->tilesX * tilesY;
+    mtls->mSliceNum = 0;
+
+    if ((mWorkers.mCount >= 1) && (mtls->tileCount > 1) && mtls->isThreadable && !mInForEach) {
+        mInForEach = true;
+        launchWorkers(wc_tiles, mtls);
+        mInForEach = false;
+    } else {
+        wc_tiles(mtls, 0);
+    }
+}
+
 void RsdCpuReferenceImpl::launchThreads(const Allocation * ain, Allocation * aout,
                                      const RsScriptCall *sc, MTLaunchStruct *mtls) {
 
     //android::StopWatch kernel_time("kernel time");
 
+    if (aout && !mtls->isBrickLaunch) {
+        // Brick launches mark only the bricks they run.
+        aout->markWritten(mtls->xStart, mtls->yStart, mtls->zStart,
+                          mtls->xEnd, mtls->yEnd, mtls->zEnd);
+    }
+    if (mtls->isLevelLaunch) {
+        launchLevels(mtls);
+        return;
+    }
+    if (mtls->isBrickLaunch) {
+        launchBricks(mtls);
+        return;
+    }
+    if (mtls->isTileLaunch) {
+        launchTiles(mtls);
+        return;
+    }
+
     if ((mWorkers.mCount >= 1) && mtls->isThreadable && !mInForEach) {
         const size_t targetByteChunk = 16 * 1024;
         mInForEach = true;
@@ -382,6 +649,13 @@ void RsdCpuReferenceImpl::launchThreads(const Allocation * ain, Allocation * aou
                 mtls->mSliceSize = 1;
             }
 
+            if (mtls->prefetchIn || mtls->prefetchOut) {
+                size_t rowBytes = rsMax(mtls->fep.yStrideIn, mtls->fep.yStrideOut);
+                size_t sliceBytes = rowBytes * mtls->mSliceSize;
+                mtls->prefetchSlices = rsMax((size_t)1, kPrefetchBytes / sliceBytes);
+                prefetchWindow(mtls, mtls->yStart);
+            }
+
          //   mtls->mSliceSize = 2;
             launchThreads(wc_xy, mtls);
         } else {
@@ -416,12 +690,12 @@ void RsdCpuReferenceImpl::launchThreads(const Allocation * ain, Allocation * aou
         for (p.ar[0] = mtls->arrayStart; p.ar[0] < mtls->arrayEnd; p.ar[0]++) {
             for (p.z = mtls->zStart; p.z < mtls->zEnd; p.z++) {
                 for (p.y = mtls->yStart; p.y < mtls->yEnd; p.y++) {
-                    uint32_t offset = mtls->fep.dimY * mtls->fep.dimZ * p.ar[0] +
-                                      mtls->fep.dimY * p.z + p.y;
+                    size_t offset = (size_t)mtls->fep.dimY * mtls->fep.dimZ * p.ar[0] +
+                                    (size_t)mtls->fep.dimY * p.z + p.y;
                     p.out = mtls->fep.ptrOut + (mtls->fep.yStrideOut * offset) +
-                            (mtls->fep.eStrideOut * mtls->xStart);
+                            ((size_t)mtls->fep.eStrideOut * mtls->xStart);
                     p.in = mtls->fep.ptrIn + (mtls->fep.yStrideIn * offset) +
-                           (mtls->fep.eStrideIn * mtls->xStart);
+                           ((size_t)mtls->fep.eStrideIn * mtls->xStart);
                     fn(&p, mtls->xStart, mtls->xEnd, mtls->fep.eStrideIn, mtls->fep.eStrideOut);
                 }
             }
@@ -478,6 +752,16 @@ extern RsdCpuScriptImpl * rsdIntrinsic_YuvToRGB(RsdCpuReferenceImpl *ctx,
                                                 const Script *s, const Element *e);
 extern RsdCpuScriptImpl * rsdIntrinsic_Blend(RsdCpuReferenceImpl *ctx,
                                              const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_RgbToYuv(RsdCpuReferenceImpl *ctx,
+                                                const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_ColorPipeline(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Morphology(RsdCpuReferenceImpl *ctx,
+                                                  const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Scan(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
+extern RsdCpuScriptImpl * rsdIntrinsic_Sort(RsdCpuReferenceImpl *ctx,
+                                            const Script *s, const Element *e);
 
 RsdCpuReference::CpuScript * RsdCpuReferenceImpl::createIntrinsic(const Script *s,
                                     RsScriptIntrinsicID iid, Element *e) {
@@ -508,6 +792,21 @@ RsdCpuReference::CpuScript * RsdCpuReferenceImpl::createIntrinsic(const Script *
     case RS_SCRIPT_INTRINSIC_ID_BLEND:
         i = rsdIntrinsic_Blend(this, s, e);
         break;
+    case RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV:
+        i = rsdIntrinsic_RgbToYuv(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE:
+        i = rsdIntrinsic_ColorPipeline(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY:
+        i = rsdIntrinsic_Morphology(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_SCAN:
+        i = rsdIntrinsic_Scan(this, s, e);
+        break;
+    case RS_SCRIPT_INTRINSIC_ID_SORT:
+        i = rsdIntrinsic_Sort(this, s, e);
+        break;
 
     default:
         rsAssert(0);
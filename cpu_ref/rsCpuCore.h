@@ -46,6 +46,19 @@ typedef struct ScriptTLSStructRec {
     RsdCpuScriptImpl *mImpl;
 } ScriptTLSStruct;
 
+// One LOD/face pair of a launch covering several levels.
+typedef struct {
+    uint32_t lod;
+    RsAllocationCubemapFace face;
+    uint32_t dimX;
+    uint32_t dimY;
+    uint32_t firstSlice;
+    const uint8_t *ptrIn;
+    uint8_t *ptrOut;
+    size_t yStrideIn;
+    size_t yStrideOut;
+} MTLaunchLevel;
+
 typedef struct {
     RsForEachStubParamStruct fep;
 
@@ -69,6 +82,43 @@ typedef struct {
     uint32_t zEnd;
     uint32_t arrayStart;
     uint32_t arrayEnd;
+
+    // Set for file backed allocations read in order.  Every prefetchSlices
+    // slices, the worker that takes the slice asks the kernel to page in
+    // the rows of the following window.
+    bool prefetchIn;
+    bool prefetchOut;
+    uint32_t prefetchSlices;
+
+    // Set when skipping the unwritten bricks of a sparse input.  Each
+    // slice is one brick of the input.
+    bool isBrickLaunch;
+    uint32_t brickX;
+    uint32_t brickY;
+    uint32_t brickZ;
+    uint32_t bricksX;
+    uint32_t bricksY;
+    uint32_t brickCount;
+
+    // Set when the input or output is tiled.  Each slice is one tile x tile
+    // block of the launch, passed to the kernel a block row at a time so
+    // every run is contiguous in both layouts.  tileDimIn and tileDimOut
+    // are 0 for a linear layout.
+    bool isTileLaunch;
+    uint32_t tile;
+    uint32_t tileDimIn;
+    uint32_t tileDimOut;
+    uint32_t tilesX;
+    uint32_t tileCount;
+
+    // Set when RsScriptCall asked for a range of LODs or faces.  Slices are
+    // numbered across all levels so one launch covers every level; a slice
+    // never spans two of them.  levels must stay last, the setup only
+    // clears the struct up to it.
+    bool isLevelLaunch;
+    uint32_t levelCount;
+    uint32_t levelSlices;
+    MTLaunchLevel levels[Allocation::MAX_LOD * 6];
 } MTLaunchStruct;
 
 
@@ -85,16 +135,21 @@ public:
     bool init(uint32_t version_major, uint32_t version_minor, sym_lookup_t, script_lookup_t);
     virtual void setPriority(int32_t priority);
     virtual void launchThreads(WorkerCallback_t cbk, void *data);
+    virtual void launchWorkers(WorkerCallback_t cbk, void *data);
+    virtual void runWorkers(WorkerCallback_t cbk, void *data);
     static void * helperThreadProc(void *vrsc);
     RsdCpuScriptImpl * setTLS(RsdCpuScriptImpl *sc);
 
     Context * getContext() {return mRSC;}
-    uint32_t getThreadCount() const {
+    virtual uint32_t getThreadCount() const {
         return mWorkers.mCount + 1;
     }
 
     void launchThreads(const Allocation * ain, Allocation * aout,
                        const RsScriptCall *sc, MTLaunchStruct *mtls);
+    void launchLevels(MTLaunchStruct *mtls);
+    void launchBricks(MTLaunchStruct *mtls);
+    void launchTiles(MTLaunchStruct *mtls);
 
     virtual CpuScript * createScript(const ScriptC *s,
                                      char const *resName, char const *cacheDir,
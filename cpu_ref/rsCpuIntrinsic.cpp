@@ -26,9 +26,58 @@ RsdCpuScriptIntrinsic::RsdCpuScriptIntrinsic(RsdCpuReferenceImpl *ctx, const Scr
 
     mID = iid;
     mElement.set(e);
+    mPrepared = false;
+    mPass = 0;
+    mPassCount = 0;
+    mPassNext = 0;
+
+    const uint32_t threads = mCtx->getThreadCount();
+    mScratch = new void *[threads];
+    mScratchSize = new size_t[threads];
+    memset(mScratch, 0, threads * sizeof(void *));
+    memset(mScratchSize, 0, threads * sizeof(size_t));
 }
 
 RsdCpuScriptIntrinsic::~RsdCpuScriptIntrinsic() {
+    uint32_t threads = mCtx->getThreadCount();
+    for (size_t i = 0; i < threads; i++) {
+        free(mScratch[i]);
+    }
+    delete []mScratch;
+    delete []mScratchSize;
+}
+
+bool RsdCpuScriptIntrinsic::prepare(uint32_t slot) {
+    return true;
+}
+
+void RsdCpuScriptIntrinsic::runPassItem(uint32_t pass, uint32_t item, uint32_t lid) {
+}
+
+void RsdCpuScriptIntrinsic::wcPass(void *usr, uint32_t idx) {
+    RsdCpuScriptIntrinsic *cp = (RsdCpuScriptIntrinsic *)usr;
+    while (1) {
+        uint32_t item = (uint32_t)__sync_fetch_and_add(&cp->mPassNext, 1);
+        if (item >= cp->mPassCount) {
+            return;
+        }
+        cp->runPassItem(cp->mPass, item, idx);
+    }
+}
+
+void RsdCpuScriptIntrinsic::runPass(uint32_t pass, uint32_t count) {
+    mPass = pass;
+    mPassCount = count;
+    mPassNext = 0;
+    mCtx->runWorkers(wcPass, this);
+}
+
+void * RsdCpuScriptIntrinsic::getScratch(uint32_t lid, size_t bytes) {
+    if (bytes > mScratchSize[lid]) {
+        mScratch[lid] = realloc(mScratch[lid], bytes);
+        mScratchSize[lid] = bytes;
+    }
+    return mScratch[lid];
 }
 
 void RsdCpuScriptIntrinsic::invokeFunction(uint32_t slot, const void *params, size_t paramLength) {
@@ -80,8 +129,15 @@ void RsdCpuScriptIntrinsic::invokeForEach(uint32_t slot,
                                           uint32_t usrLen,
                                           const RsScriptCall *sc) {
 
+    mPrepared = prepare(slot);
+    if (!mPrepared) {
+        return;
+    }
+
     MTLaunchStruct mtls;
-    forEachMtlsSetup(ain, aout, usr, usrLen, sc, &mtls);
+    if (!forEachMtlsSetup(ain, aout, usr, usrLen, sc, &mtls)) {
+        return;
+    }
     mtls.script = this;
     mtls.fep.slot = slot;
 
@@ -95,6 +151,8 @@ void RsdCpuScriptIntrinsic::invokeForEach(uint32_t slot,
 
 void RsdCpuScriptIntrinsic::forEachKernelSetup(uint32_t slot, MTLaunchStruct *mtls) {
 
+    // Script groups launch the kernel even if this fails.
+    mPrepared = prepare(slot);
     mtls->script = this;
     mtls->fep.slot = slot;
     mtls->kernel = (void (*)())mRootPtr;
@@ -55,6 +55,28 @@ protected:
     outer_foreach_t mRootPtr;
     ObjectBaseRef<const Element> mElement;
 
+    // Runs before every launch, for intrinsics that work on the whole
+    // input at once.  Returns false, having reported any error, when the
+    // kernel should store nothing.
+    virtual bool prepare(uint32_t slot);
+    // False when the last prepare() failed; the kernel then stores nothing.
+    bool mPrepared;
+
+    // Calls runPassItem for items 0 to count - 1, spread over the workers.
+    void runPass(uint32_t pass, uint32_t count);
+    virtual void runPassItem(uint32_t pass, uint32_t item, uint32_t lid);
+
+    // A buffer of at least bytes for worker lid, kept between launches.
+    void * getScratch(uint32_t lid, size_t bytes);
+
+private:
+    static void wcPass(void *usr, uint32_t idx);
+
+    uint32_t mPass;
+    uint32_t mPassCount;
+    volatile int32_t mPassNext;
+    void **mScratch;
+    size_t *mScratchSize;
 };
 
 
@@ -30,26 +30,147 @@ public:
     virtual void populateScript(Script *);
     virtual void invokeFreeChildren();
 
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
 
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
     virtual ~RsdCpuScriptIntrinsic3DLUT();
     RsdCpuScriptIntrinsic3DLUT(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
     ObjectBaseRef<Allocation> mLUT;
+    int32_t mInterpolation;
+
+    // Normalized copy of the LUT taken when it is bound, one float4 per
+    // entry with no row padding, so any LUT format is read the same way
+    // and the corners of a cell sit at fixed offsets.
+    float4 *mTable;
+    // The entries as bound, also without row padding, for the 8 bit
+    // trilinear path.  Only kept for uchar4 LUTs.
+    uchar4 *mTable8;
+    uint32_t mTableDimX;
+    uint32_t mTableDimY;
+    uint32_t mTableDimZ;
+
+    // Element types of the current launch.
+    RsDataType mLUTType;
+    RsDataType mInType;
+    RsDataType mOutType;
 
     static void kernel(const RsForEachStubParamStruct *p,
                        uint32_t xstart, uint32_t xend,
                        uint32_t instep, uint32_t outstep);
+    static void kernelFloat(const RsdCpuScriptIntrinsic3DLUT *cp,
+                            const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
 };
 
 }
 }
 
 
+void RsdCpuScriptIntrinsic3DLUT::setGlobalVar(uint32_t slot, const void *data,
+                                              size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == 4);
+    int32_t v = ((const int32_t *)data)[0];
+    if ((v != RS_3DLUT_INTERPOLATION_TRILINEAR) && (v != RS_3DLUT_INTERPOLATION_TETRAHEDRAL)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "3DLUT: unknown interpolation");
+        return;
+    }
+    mInterpolation = v;
+}
+
 void RsdCpuScriptIntrinsic3DLUT::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 0);
-    mLUT.set(static_cast<Allocation *>(data));
+    Allocation *a = static_cast<Allocation *>(data);
+
+    free(mTable);
+    mTable = NULL;
+    free(mTable8);
+    mTable8 = NULL;
+    mLUTType = RS_TYPE_NONE;
+
+    if (a) {
+        RsDataType dt = getColorType(a->getType()->getElement());
+        if ((dt == RS_TYPE_NONE) || a->getIsTiled() || a->getHasFieldPlanes()) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                    "3DLUT must be a linear uchar4, ushort4, half4 or float4 allocation.");
+            mLUT.clear();
+            return;
+        }
+
+        // The copy reflects the contents at bind time; a LUT that is
+        // changed afterwards has to be set again.
+        const uint32_t dimX = a->mHal.drvState.lod[0].dimX;
+        const uint32_t dimY = rsMax(a->mHal.drvState.lod[0].dimY, 1u);
+        const uint32_t dimZ = rsMax(a->mHal.drvState.lod[0].dimZ, 1u);
+        const size_t strideY = a->mHal.drvState.lod[0].stride;
+        const size_t eSize = a->mHal.state.elementSizeBytes;
+        mTable = (float4 *)malloc((size_t)dimX * dimY * dimZ * sizeof(float4));
+        if (!mTable) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY, "3DLUT copy failed");
+            mLUT.clear();
+            return;
+        }
+        if (dt == RS_TYPE_UNSIGNED_8) {
+            mTable8 = (uchar4 *)malloc((size_t)dimX * dimY * dimZ * sizeof(uchar4));
+            if (!mTable8) {
+                mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY, "3DLUT copy failed");
+                free(mTable);
+                mTable = NULL;
+                mLUT.clear();
+                return;
+            }
+        }
+        float4 *d = mTable;
+        uchar4 *d8 = mTable8;
+        for (uint32_t z = 0; z < dimZ; z++) {
+            for (uint32_t y = 0; y < dimY; y++) {
+                const uint8_t *row = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr +
+                                     ((size_t)z * dimY + y) * strideY;
+                for (uint32_t x = 0; x < dimX; x++) {
+                    *(d++) = loadColor(row + x * eSize, dt);
+                }
+                if (d8) {
+                    memcpy(d8, row, dimX * sizeof(uchar4));
+                    d8 += dimX;
+                }
+            }
+        }
+        mTableDimX = dimX;
+        mTableDimY = dimY;
+        mTableDimZ = dimZ;
+        mLUTType = dt;
+    }
+    mLUT.set(a);
+}
+
+void RsdCpuScriptIntrinsic3DLUT::invokeForEach(uint32_t slot,
+                                               const Allocation * ain,
+                                               Allocation * aout,
+                                               const void * usr,
+                                               uint32_t usrLen,
+                                               const RsScriptCall *sc) {
+    if (!mLUT.get()) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "3DLUT executed without a LUT");
+        return;
+    }
+    mInType = getColorType(ain ? ain->getType()->getElement() : NULL);
+    mOutType = getColorType(aout ? aout->getType()->getElement() : NULL);
+    if ((mInType == RS_TYPE_NONE) || (mOutType == RS_TYPE_NONE)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "3DLUT input and output must be uchar4, ushort4, half4 or float4.");
+        return;
+    }
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
 }
 
 extern "C" void rsdIntrinsic3DLUT_K(void *dst, const void *src, const void *lut,
@@ -62,23 +183,32 @@ void RsdCpuScriptIntrinsic3DLUT::kernel(const RsForEachStubParamStruct *p,
                                       uint32_t instep, uint32_t outstep) {
     RsdCpuScriptIntrinsic3DLUT *cp = (RsdCpuScriptIntrinsic3DLUT *)p->usr;
 
+    // The fixed point and NEON paths below are trilinear and 8 bit only.
+    if ((cp->mInterpolation != RS_3DLUT_INTERPOLATION_TRILINEAR) ||
+        (cp->mLUTType != RS_TYPE_UNSIGNED_8) || (cp->mInType != RS_TYPE_UNSIGNED_8) ||
+        (cp->mOutType != RS_TYPE_UNSIGNED_8)) {
+        kernelFloat(cp, p, xstart, xend, instep, outstep);
+        return;
+    }
+
     uchar4 *out = (uchar4 *)p->out;
     uchar4 *in = (uchar4 *)p->in;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
 
-    const uchar *bp = (const uchar *)cp->mLUT->mHal.drvState.lod[0].mallocPtr;
+    // Reads the copy taken at bind time, like kernelFloat.
+    const uchar *bp = (const uchar *)cp->mTable8;
 
     int4 dims = {
-        cp->mLUT->mHal.drvState.lod[0].dimX - 1,
-        cp->mLUT->mHal.drvState.lod[0].dimY - 1,
-        cp->mLUT->mHal.drvState.lod[0].dimZ - 1,
+        (int)cp->mTableDimX - 1,
+        (int)cp->mTableDimY - 1,
+        (int)cp->mTableDimZ - 1,
         -1
     };
     const float4 m = (float4)(1.f / 255.f) * convert_float4(dims);
     const int4 coordMul = convert_int4(m * (float4)0x8000);
-    const size_t stride_y = cp->mLUT->mHal.drvState.lod[0].stride;
-    const size_t stride_z = stride_y * cp->mLUT->mHal.drvState.lod[0].dimY;
+    const size_t stride_y = cp->mTableDimX * sizeof(uchar4);
+    const size_t stride_z = stride_y * cp->mTableDimY;
 
     //ALOGE("strides %zu %zu", stride_y, stride_z);
 
@@ -163,22 +293,113 @@ void RsdCpuScriptIntrinsic3DLUT::kernel(const RsForEachStubParamStruct *p,
     }
 }
 
+void RsdCpuScriptIntrinsic3DLUT::kernelFloat(const RsdCpuScriptIntrinsic3DLUT *cp,
+                                             const RsForEachStubParamStruct *p,
+                                             uint32_t xstart, uint32_t xend,
+                                             uint32_t instep, uint32_t outstep) {
+    const float4 *t = cp->mTable;
+    const uint32_t dimX = cp->mTableDimX;
+    const uint32_t dimY = cp->mTableDimY;
+    const uint32_t dimZ = cp->mTableDimZ;
+    // A dimension of one entry has no neighbour to step to.
+    const size_t sx = (dimX > 1) ? 1 : 0;
+    const size_t sy = (dimY > 1) ? dimX : 0;
+    const size_t sz = (dimZ > 1) ? (size_t)dimX * dimY : 0;
+    const float mx = (float)(dimX - 1);
+    const float my = (float)(dimY - 1);
+    const float mz = (float)(dimZ - 1);
+    const bool tetrahedral = (cp->mInterpolation == RS_3DLUT_INTERPOLATION_TETRAHEDRAL);
+
+    const uint8_t *in = (const uint8_t *)p->in;
+    uint8_t *out = (uint8_t *)p->out;
+    for (uint32_t x = xstart; x < xend; x++, in += instep, out += outstep) {
+        float4 c = loadColor(in, cp->mInType);
+
+        float fx = clampUnit(c.x) * mx;
+        float fy = clampUnit(c.y) * my;
+        float fz = clampUnit(c.z) * mz;
+        uint32_t ix = rsMin((uint32_t)fx, rsMax(dimX, 2u) - 2);
+        uint32_t iy = rsMin((uint32_t)fy, rsMax(dimY, 2u) - 2);
+        uint32_t iz = rsMin((uint32_t)fz, rsMax(dimZ, 2u) - 2);
+        float rx = sx ? (fx - ix) : 0.f;
+        float ry = sy ? (fy - iy) : 0.f;
+        float rz = sz ? (fz - iz) : 0.f;
+
+        const float4 *b = t + ix + (size_t)iy * dimX + (size_t)iz * dimX * dimY;
+        float4 v;
+        if (tetrahedral) {
+            // Walk from the low to the high corner of the cell along the
+            // axes in order of decreasing fraction.
+            const float4 c000 = b[0];
+            const float4 c111 = b[sx + sy + sz];
+            if (rx > ry) {
+                if (ry > rz) {
+                    const float4 c1 = b[sx], c2 = b[sx + sy];
+                    v = c000 + rx * (c1 - c000) + ry * (c2 - c1) + rz * (c111 - c2);
+                } else if (rx > rz) {
+                    const float4 c1 = b[sx], c2 = b[sx + sz];
+                    v = c000 + rx * (c1 - c000) + rz * (c2 - c1) + ry * (c111 - c2);
+                } else {
+                    const float4 c1 = b[sz], c2 = b[sx + sz];
+                    v = c000 + rz * (c1 - c000) + rx * (c2 - c1) + ry * (c111 - c2);
+                }
+            } else {
+                if (rz > ry) {
+                    const float4 c1 = b[sz], c2 = b[sy + sz];
+                    v = c000 + rz * (c1 - c000) + ry * (c2 - c1) + rx * (c111 - c2);
+                } else if (rz > rx) {
+                    const float4 c1 = b[sy], c2 = b[sy + sz];
+                    v = c000 + ry * (c1 - c000) + rz * (c2 - c1) + rx * (c111 - c2);
+                } else {
+                    const float4 c1 = b[sy], c2 = b[sx + sy];
+                    v = c000 + ry * (c1 - c000) + rx * (c2 - c1) + rz * (c111 - c2);
+                }
+            }
+        } else {
+            float4 yz00 = b[0] + rx * (b[sx] - b[0]);
+            float4 yz10 = b[sy] + rx * (b[sy + sx] - b[sy]);
+            float4 yz01 = b[sz] + rx * (b[sz + sx] - b[sz]);
+            float4 yz11 = b[sy + sz] + rx * (b[sy + sz + sx] - b[sy + sz]);
+            float4 z0 = yz00 + ry * (yz10 - yz00);
+            float4 z1 = yz01 + ry * (yz11 - yz01);
+            v = z0 + rz * (z1 - z0);
+        }
+        v.w = c.w;
+        storeColor(out, cp->mOutType, v);
+    }
+}
+
 RsdCpuScriptIntrinsic3DLUT::RsdCpuScriptIntrinsic3DLUT(RsdCpuReferenceImpl *ctx,
                                                      const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_3DLUT) {
 
     mRootPtr = &kernel;
+    mInterpolation = RS_3DLUT_INTERPOLATION_TRILINEAR;
+    mTable = NULL;
+    mTable8 = NULL;
+    mTableDimX = 0;
+    mTableDimY = 0;
+    mTableDimZ = 0;
+    mLUTType = RS_TYPE_NONE;
+    mInType = RS_TYPE_NONE;
+    mOutType = RS_TYPE_NONE;
 }
 
 RsdCpuScriptIntrinsic3DLUT::~RsdCpuScriptIntrinsic3DLUT() {
+    free(mTable);
+    free(mTable8);
 }
 
 void RsdCpuScriptIntrinsic3DLUT::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 1;
+    s->mHal.info.exportedVariableCount = 2;
 }
 
 void RsdCpuScriptIntrinsic3DLUT::invokeFreeChildren() {
     mLUT.clear();
+    free(mTable);
+    mTable = NULL;
+    free(mTable8);
+    mTable8 = NULL;
 }
 
 
@@ -29,10 +29,23 @@ class RsdCpuScriptIntrinsicBlend : public RsdCpuScriptIntrinsic {
 public:
     virtual void populateScript(Script *);
 
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
     virtual ~RsdCpuScriptIntrinsicBlend();
     RsdCpuScriptIntrinsicBlend(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
+    int32_t mAlphaMode;
+    // Element type of the current launch.
+    RsDataType mType;
+
     static void kernel(const RsForEachStubParamStruct *p,
                           uint32_t xstart, uint32_t xend,
                           uint32_t instep, uint32_t outstep);
@@ -105,11 +118,342 @@ extern "C" void rsdIntrinsicBlendSub_K(void *dst, const void *src, uint32_t coun
 
 //#undef ARCH_ARM_HAVE_NEON
 
+void RsdCpuScriptIntrinsicBlend::setGlobalVar(uint32_t slot, const void *data,
+                                              size_t dataLength) {
+    rsAssert(slot == 0);
+    rsAssert(dataLength == 4);
+    int32_t v = ((const int32_t *)data)[0];
+    if ((v != RS_BLEND_ALPHA_PREMULTIPLIED) && (v != RS_BLEND_ALPHA_STRAIGHT)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Blend: unknown alpha mode");
+        return;
+    }
+    mAlphaMode = v;
+}
+
+void RsdCpuScriptIntrinsicBlend::invokeForEach(uint32_t slot,
+                                               const Allocation * ain,
+                                               Allocation * aout,
+                                               const void * usr,
+                                               uint32_t usrLen,
+                                               const RsScriptCall *sc) {
+    RsDataType inType = getColorType(ain ? ain->getType()->getElement() : NULL);
+    mType = getColorType(aout ? aout->getType()->getElement() : NULL);
+    if ((mType == RS_TYPE_NONE) || (inType != mType)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Blend input and output must both be uchar4, ushort4, half4 or float4.");
+        return;
+    }
+    if ((slot == BLEND_XOR) && (mType != RS_TYPE_UNSIGNED_8) && (mType != RS_TYPE_UNSIGNED_16)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Blend xor is a bitwise xor and needs uchar4 or ushort4 colors.");
+        return;
+    }
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+}
+
+// The modes below work on normalized, premultiplied float4 colors.  The
+// Porter-Duff modes other than xor, which is bitwise (see blendRowXor),
+// follow their usual definitions; the others combine
+// the unpremultiplied colors with a blend function B(dst, src) and
+// composite the result over dst:
+//   rgb = (1 - da) * src + (1 - sa) * dst + sa * da * B
+//   a = sa + da - sa * da
+
+static inline float blendDivide(float n, float d) {
+    return (d > 0.f) ? rsMin(1.f, n / d) : 1.f;
+}
+
+template <uint32_t MODE>
+static inline float blendChannel(float b, float s) {
+    switch (MODE) {
+    case BLEND_NORMAL:
+        return s;
+    case BLEND_AVERAGE:
+        return (s + b) * 0.5f;
+    case BLEND_SCREEN:
+        return s + b - s * b;
+    case BLEND_DARKEN:
+        return rsMin(s, b);
+    case BLEND_LIGHTEN:
+        return rsMax(s, b);
+    case BLEND_OVERLAY:
+        return (b <= 0.5f) ? (2.f * s * b) : (1.f - 2.f * (1.f - s) * (1.f - b));
+    case BLEND_HARDLIGHT:
+        return (s <= 0.5f) ? (2.f * s * b) : (1.f - 2.f * (1.f - s) * (1.f - b));
+    case BLEND_SOFTLIGHT: {
+        if (s <= 0.5f) {
+            return b - (1.f - 2.f * s) * b * (1.f - b);
+        }
+        float d = (b <= 0.25f) ? (((16.f * b - 12.f) * b + 4.f) * b) : sqrtf(b);
+        return b + (2.f * s - 1.f) * (d - b);
+    }
+    case BLEND_DIFFERENCE:
+        return fabsf(s - b);
+    case BLEND_NEGATION:
+        return 1.f - fabsf(1.f - s - b);
+    case BLEND_EXCLUSION:
+        return s + b - 2.f * s * b;
+    case BLEND_COLOR_DODGE:
+        return (b <= 0.f) ? 0.f : blendDivide(b, 1.f - s);
+    case BLEND_INVERSE_COLOR_DODGE:
+        return (s <= 0.f) ? 0.f : blendDivide(s, 1.f - b);
+    case BLEND_SOFT_DODGE:
+        if (s + b < 1.f) {
+            return blendDivide(0.5f * b, 1.f - s);
+        }
+        return 1.f - blendDivide(0.5f * (1.f - s), b);
+    case BLEND_COLOR_BURN:
+        return (b >= 1.f) ? 1.f : (1.f - blendDivide(1.f - b, s));
+    case BLEND_INVERSE_COLOR_BURN:
+        return (s >= 1.f) ? 1.f : (1.f - blendDivide(1.f - s, b));
+    case BLEND_SOFT_BURN:
+        if (s + b < 1.f) {
+            return blendDivide(0.5f * s, 1.f - b);
+        }
+        return 1.f - blendDivide(0.5f * (1.f - b), s);
+    case BLEND_REFLECT:
+        return blendDivide(b * b, 1.f - s);
+    case BLEND_GLOW:
+        return blendDivide(s * s, 1.f - b);
+    case BLEND_FREEZE:
+        return (s <= 0.f) ? 0.f : rsMax(0.f, 1.f - (1.f - b) * (1.f - b) / s);
+    case BLEND_HEAT:
+        return (b <= 0.f) ? 0.f : rsMax(0.f, 1.f - (1.f - s) * (1.f - s) / b);
+    case BLEND_STAMP:
+        return rsMin(1.f, rsMax(0.f, b + 2.f * s - 1.f));
+    default:
+        return s;
+    }
+}
+
+static inline float blendLum(float3 c) {
+    return 0.3f * c.x + 0.59f * c.y + 0.11f * c.z;
+}
+
+static inline float3 blendSetLum(float3 c, float l) {
+    c += l - blendLum(c);
+    l = blendLum(c);
+    float n = rsMin(c.x, rsMin(c.y, c.z));
+    float x = rsMax(c.x, rsMax(c.y, c.z));
+    if (n < 0.f) {
+        c = l + (c - l) * (l / (l - n));
+    }
+    if (x > 1.f) {
+        c = l + (c - l) * ((1.f - l) / (x - l));
+    }
+    return c;
+}
+
+static inline float blendSat(float3 c) {
+    return rsMax(c.x, rsMax(c.y, c.z)) - rsMin(c.x, rsMin(c.y, c.z));
+}
+
+static inline float3 blendSetSat(float3 c, float sat) {
+    float n = rsMin(c.x, rsMin(c.y, c.z));
+    float range = rsMax(c.x, rsMax(c.y, c.z)) - n;
+    if (range <= 0.f) {
+        return (float3)0.f;
+    }
+    return (c - n) * (sat / range);
+}
+
+static inline float3 blendUnpremultiply(float4 c) {
+    return (c.w > 0.f) ? (c.xyz / c.w) : (float3)0.f;
+}
+
+template <uint32_t MODE>
+static inline float4 blendPixel(float4 s, float4 d) {
+    switch (MODE) {
+    case BLEND_CLEAR:
+        return (float4)0.f;
+    case BLEND_SRC:
+        return s;
+    case BLEND_DST:
+        return d;
+    case BLEND_SRC_OVER:
+        return s + d * (1.f - s.w);
+    case BLEND_DST_OVER:
+        return d + s * (1.f - d.w);
+    case BLEND_SRC_IN:
+        return s * d.w;
+    case BLEND_DST_IN:
+        return d * s.w;
+    case BLEND_SRC_OUT:
+        return s * (1.f - d.w);
+    case BLEND_DST_OUT:
+        return d * (1.f - s.w);
+    case BLEND_SRC_ATOP: {
+        float4 r = s * d.w + d * (1.f - s.w);
+        r.w = d.w;
+        return r;
+    }
+    case BLEND_DST_ATOP: {
+        float4 r = d * s.w + s * (1.f - d.w);
+        r.w = s.w;
+        return r;
+    }
+    case BLEND_MULTIPLY:
+        return s * d;
+    case BLEND_ADD:
+        return s + d;
+    case BLEND_SUBTRACT:
+        return d - s;
+    default:
+        break;
+    }
+
+    float3 cs = blendUnpremultiply(s);
+    float3 cb = blendUnpremultiply(d);
+    float3 b;
+    switch (MODE) {
+    case BLEND_RED:
+        b = cb;
+        b.x = cs.x;
+        break;
+    case BLEND_GREEN:
+        b = cb;
+        b.y = cs.y;
+        break;
+    case BLEND_BLUE:
+        b = cb;
+        b.z = cs.z;
+        break;
+    case BLEND_HUE:
+        b = blendSetLum(blendSetSat(cs, blendSat(cb)), blendLum(cb));
+        break;
+    case BLEND_SATURATION:
+        b = blendSetLum(blendSetSat(cb, blendSat(cs)), blendLum(cb));
+        break;
+    case BLEND_COLOR:
+        b = blendSetLum(cs, blendLum(cb));
+        break;
+    case BLEND_LUMINOSITY:
+        b = blendSetLum(cb, blendLum(cs));
+        break;
+    default:
+        b.x = blendChannel<MODE>(cb.x, cs.x);
+        b.y = blendChannel<MODE>(cb.y, cs.y);
+        b.z = blendChannel<MODE>(cb.z, cs.z);
+        break;
+    }
+
+    float4 r;
+    r.xyz = (1.f - d.w) * s.xyz + (1.f - s.w) * d.xyz + (s.w * d.w) * b;
+    r.w = s.w + d.w - s.w * d.w;
+    return r;
+}
+
+template <uint32_t MODE>
+static void blendRow(const uint8_t *in, uint8_t *out, uint32_t count,
+                     uint32_t instep, uint32_t outstep, RsDataType dt, bool straight) {
+    for (uint32_t ct = 0; ct < count; ct++, in += instep, out += outstep) {
+        float4 s = loadColor(in, dt);
+        float4 d = loadColor(out, dt);
+        if (straight) {
+            s.xyz *= s.w;
+            d.xyz *= d.w;
+        }
+        float4 r = blendPixel<MODE>(s, d);
+        if (straight) {
+            r.xyz = blendUnpremultiply(r);
+        }
+        storeColor(out, dt, r);
+    }
+}
+
+// Xor is the bitwise xor of the two colors, as it has always been for
+// uchar4, so it ignores the alpha mode.  invokeForEach rejects half4 and
+// float4, which have no meaningful bitwise xor.
+static void blendRowXor(const uint8_t *in, uint8_t *out, uint32_t count,
+                        uint32_t instep, uint32_t outstep, RsDataType dt, bool straight) {
+    for (uint32_t ct = 0; ct < count; ct++, in += instep, out += outstep) {
+        if (dt == RS_TYPE_UNSIGNED_16) {
+            const uint16_t *s = (const uint16_t *)in;
+            uint16_t *d = (uint16_t *)out;
+            for (uint32_t c = 0; c < 4; c++) {
+                d[c] ^= s[c];
+            }
+        } else {
+            for (uint32_t c = 0; c < 4; c++) {
+                out[c] ^= in[c];
+            }
+        }
+    }
+}
+
+typedef void (*BlendRowFunc)(const uint8_t *in, uint8_t *out, uint32_t count,
+                             uint32_t instep, uint32_t outstep, RsDataType dt, bool straight);
+
+static const BlendRowFunc gBlendRows[] = {
+    blendRow<BLEND_CLEAR>,
+    blendRow<BLEND_SRC>,
+    blendRow<BLEND_DST>,
+    blendRow<BLEND_SRC_OVER>,
+    blendRow<BLEND_DST_OVER>,
+    blendRow<BLEND_SRC_IN>,
+    blendRow<BLEND_DST_IN>,
+    blendRow<BLEND_SRC_OUT>,
+    blendRow<BLEND_DST_OUT>,
+    blendRow<BLEND_SRC_ATOP>,
+    blendRow<BLEND_DST_ATOP>,
+    blendRowXor,
+    blendRow<BLEND_NORMAL>,
+    blendRow<BLEND_AVERAGE>,
+    blendRow<BLEND_MULTIPLY>,
+    blendRow<BLEND_SCREEN>,
+    blendRow<BLEND_DARKEN>,
+    blendRow<BLEND_LIGHTEN>,
+    blendRow<BLEND_OVERLAY>,
+    blendRow<BLEND_HARDLIGHT>,
+    blendRow<BLEND_SOFTLIGHT>,
+    blendRow<BLEND_DIFFERENCE>,
+    blendRow<BLEND_NEGATION>,
+    blendRow<BLEND_EXCLUSION>,
+    blendRow<BLEND_COLOR_DODGE>,
+    blendRow<BLEND_INVERSE_COLOR_DODGE>,
+    blendRow<BLEND_SOFT_DODGE>,
+    blendRow<BLEND_COLOR_BURN>,
+    blendRow<BLEND_INVERSE_COLOR_BURN>,
+    blendRow<BLEND_SOFT_BURN>,
+    blendRow<BLEND_REFLECT>,
+    blendRow<BLEND_GLOW>,
+    blendRow<BLEND_FREEZE>,
+    blendRow<BLEND_HEAT>,
+    blendRow<BLEND_ADD>,
+    blendRow<BLEND_SUBTRACT>,
+    blendRow<BLEND_STAMP>,
+    blendRow<BLEND_RED>,
+    blendRow<BLEND_GREEN>,
+    blendRow<BLEND_BLUE>,
+    blendRow<BLEND_HUE>,
+    blendRow<BLEND_SATURATION>,
+    blendRow<BLEND_COLOR>,
+    blendRow<BLEND_LUMINOSITY>
+};
+
 void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
                                         uint32_t xstart, uint32_t xend,
                                         uint32_t instep, uint32_t outstep) {
     RsdCpuScriptIntrinsicBlend *cp = (RsdCpuScriptIntrinsicBlend *)p->usr;
 
+    // The fixed point paths only cover 8 bit premultiplied colors and the
+    // modes that had them originally.
+    if ((cp->mType != RS_TYPE_UNSIGNED_8) || (cp->mAlphaMode != RS_BLEND_ALPHA_PREMULTIPLIED) ||
+        ((p->slot > BLEND_XOR) && (p->slot != BLEND_MULTIPLY) &&
+         (p->slot != BLEND_ADD) && (p->slot != BLEND_SUBTRACT))) {
+        if (p->slot > BLEND_LUMINOSITY) {
+            ALOGE("Called unimplemented value %d", p->slot);
+            rsAssert(false);
+            return;
+        }
+        if (xend > xstart) {
+            gBlendRows[p->slot]((const uint8_t *)p->in, (uint8_t *)p->out, xend - xstart,
+                                instep, outstep, cp->mType,
+                                cp->mAlphaMode == RS_BLEND_ALPHA_STRAIGHT);
+        }
+        return;
+    }
+
     // instep/outstep can be ignored--sizeof(uchar4) known at compile time
     uchar4 *out = (uchar4 *)p->out;
     uchar4 *in = (uchar4 *)p->in;
@@ -278,14 +622,6 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
             *out = *in ^ *out;
         }
         break;
-    case BLEND_NORMAL:
-        ALOGE("Called unimplemented blend intrinsic BLEND_NORMAL");
-        rsAssert(false);
-        break;
-    case BLEND_AVERAGE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_AVERAGE");
-        rsAssert(false);
-        break;
     case BLEND_MULTIPLY:
 #if defined(ARCH_ARM_HAVE_NEON)
         if((x1 + 8) < x2) {
@@ -301,82 +637,6 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
                                 >> (short4)8);
         }
         break;
-    case BLEND_SCREEN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_SCREEN");
-        rsAssert(false);
-        break;
-    case BLEND_DARKEN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_DARKEN");
-        rsAssert(false);
-        break;
-    case BLEND_LIGHTEN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_LIGHTEN");
-        rsAssert(false);
-        break;
-    case BLEND_OVERLAY:
-        ALOGE("Called unimplemented blend intrinsic BLEND_OVERLAY");
-        rsAssert(false);
-        break;
-    case BLEND_HARDLIGHT:
-        ALOGE("Called unimplemented blend intrinsic BLEND_HARDLIGHT");
-        rsAssert(false);
-        break;
-    case BLEND_SOFTLIGHT:
-        ALOGE("Called unimplemented blend intrinsic BLEND_SOFTLIGHT");
-        rsAssert(false);
-        break;
-    case BLEND_DIFFERENCE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_DIFFERENCE");
-        rsAssert(false);
-        break;
-    case BLEND_NEGATION:
-        ALOGE("Called unimplemented blend intrinsic BLEND_NEGATION");
-        rsAssert(false);
-        break;
-    case BLEND_EXCLUSION:
-        ALOGE("Called unimplemented blend intrinsic BLEND_EXCLUSION");
-        rsAssert(false);
-        break;
-    case BLEND_COLOR_DODGE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_COLOR_DODGE");
-        rsAssert(false);
-        break;
-    case BLEND_INVERSE_COLOR_DODGE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_INVERSE_COLOR_DODGE");
-        rsAssert(false);
-        break;
-    case BLEND_SOFT_DODGE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_SOFT_DODGE");
-        rsAssert(false);
-        break;
-    case BLEND_COLOR_BURN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_COLOR_BURN");
-        rsAssert(false);
-        break;
-    case BLEND_INVERSE_COLOR_BURN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_INVERSE_COLOR_BURN");
-        rsAssert(false);
-        break;
-    case BLEND_SOFT_BURN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_SOFT_BURN");
-        rsAssert(false);
-        break;
-    case BLEND_REFLECT:
-        ALOGE("Called unimplemented blend intrinsic BLEND_REFLECT");
-        rsAssert(false);
-        break;
-    case BLEND_GLOW:
-        ALOGE("Called unimplemented blend intrinsic BLEND_GLOW");
-        rsAssert(false);
-        break;
-    case BLEND_FREEZE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_FREEZE");
-        rsAssert(false);
-        break;
-    case BLEND_HEAT:
-        ALOGE("Called unimplemented blend intrinsic BLEND_HEAT");
-        rsAssert(false);
-        break;
     case BLEND_ADD:
 #if defined(ARCH_ARM_HAVE_NEON)
         if((x1 + 8) < x2) {
@@ -415,38 +675,6 @@ void RsdCpuScriptIntrinsicBlend::kernel(const RsForEachStubParamStruct *p,
             out->w = (oA - iA) < 0 ? 0 : oA - iA;
         }
         break;
-    case BLEND_STAMP:
-        ALOGE("Called unimplemented blend intrinsic BLEND_STAMP");
-        rsAssert(false);
-        break;
-    case BLEND_RED:
-        ALOGE("Called unimplemented blend intrinsic BLEND_RED");
-        rsAssert(false);
-        break;
-    case BLEND_GREEN:
-        ALOGE("Called unimplemented blend intrinsic BLEND_GREEN");
-        rsAssert(false);
-        break;
-    case BLEND_BLUE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_BLUE");
-        rsAssert(false);
-        break;
-    case BLEND_HUE:
-        ALOGE("Called unimplemented blend intrinsic BLEND_HUE");
-        rsAssert(false);
-        break;
-    case BLEND_SATURATION:
-        ALOGE("Called unimplemented blend intrinsic BLEND_SATURATION");
-        rsAssert(false);
-        break;
-    case BLEND_COLOR:
-        ALOGE("Called unimplemented blend intrinsic BLEND_COLOR");
-        rsAssert(false);
-        break;
-    case BLEND_LUMINOSITY:
-        ALOGE("Called unimplemented blend intrinsic BLEND_LUMINOSITY");
-        rsAssert(false);
-        break;
 
     default:
         ALOGE("Called unimplemented value %d", p->slot);
@@ -461,13 +689,15 @@ RsdCpuScriptIntrinsicBlend::RsdCpuScriptIntrinsicBlend(RsdCpuReferenceImpl *ctx,
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BLEND) {
 
     mRootPtr = &kernel;
+    mAlphaMode = RS_BLEND_ALPHA_PREMULTIPLIED;
+    mType = RS_TYPE_UNSIGNED_8;
 }
 
 RsdCpuScriptIntrinsicBlend::~RsdCpuScriptIntrinsicBlend() {
 }
 
 void RsdCpuScriptIntrinsicBlend::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 0;
+    s->mHal.info.exportedVariableCount = 1;
 }
 
 RsdCpuScriptImpl * rsdIntrinsic_Blend(RsdCpuReferenceImpl *ctx,
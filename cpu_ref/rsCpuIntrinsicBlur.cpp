@@ -36,26 +36,57 @@ public:
     RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
+    enum {
+        // Loads and filters rows of the input horizontally into mImage.
+        PASS_ROWS = 0,
+        // Filters strips of columns of mImage vertically into mImageTmp.
+        PASS_COLUMNS = 1
+    };
+
     float mFp[104];
     short mIp[104];
-    void **mScratch;
-    size_t *mScratchSize;
     float mRadius;
     int mIradius;
     ObjectBaseRef<Allocation> mAlloc;
 
+    // Everything but the 8 bit gaussian blurs the whole image into
+    // mImageTmp before the launch; kernelFloat then only stores it.
+    int32_t mMode;
+    RsDataType mType;
+    uint32_t mVec;
+    int mBoxRadius[3];
+    // log2 of the pyramid downscale.
+    uint32_t mLevel;
+    uint32_t mImageDimX;
+    uint32_t mImageDimY;
+    size_t mImageSize;
+    float4 *mImage;
+    float4 *mImageTmp;
+
     static void kernelU4(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
     static void kernelU1(const RsForEachStubParamStruct *p,
                          uint32_t xstart, uint32_t xend,
                          uint32_t instep, uint32_t outstep);
+    static void kernelFloat(const RsForEachStubParamStruct *p,
+                            uint32_t xstart, uint32_t xend,
+                            uint32_t instep, uint32_t outstep);
     void ComputeGaussianWeights();
+    void ComputeBoxRadii(float sigma);
+    virtual bool prepare(uint32_t slot);
+    virtual void runPassItem(uint32_t pass, uint32_t item, uint32_t lid);
+    void blurRow(uint32_t y, uint32_t lid);
+    void blurStrip(uint32_t strip, uint32_t lid);
 };
 
 }
 }
 
+// mFp holds the weights of the direct gaussian.
+static const float kMaxGaussianRadius = 25.f;
+// Columns handed to a worker at a time by the vertical pass.
+static const uint32_t kStripWidth = 64;
 
 void RsdCpuScriptIntrinsicBlur::ComputeGaussianWeights() {
     memset(mFp, 0, sizeof(mFp));
@@ -74,7 +105,7 @@ void RsdCpuScriptIntrinsicBlur::ComputeGaussianWeights() {
     // The larger the radius gets, the more our gaussian blur
     // will resemble a box blur since with large sigma
     // the gaussian curve begins to lose its shape
-    float sigma = 0.4f * mRadius + 0.6f;
+    float sigma = 0.4f * rsMin(mRadius, kMaxGaussianRadius) + 0.6f;
 
     // Now compute the coefficients. We will store some redundant values to save
     // some math during the blur calculations precompute some values
@@ -84,7 +115,7 @@ void RsdCpuScriptIntrinsicBlur::ComputeGaussianWeights() {
     float normalizeFactor = 0.0f;
     float floatR = 0.0f;
     int r;
-    mIradius = (float)ceil(mRadius) + 0.5f;
+    mIradius = (float)ceil(rsMin(mRadius, kMaxGaussianRadius)) + 0.5f;
     for (r = -mIradius; r <= mIradius; r ++) {
         floatR = (float)r;
         mFp[r + mIradius] = coeff1 * powf(e, floatR * floatR * coeff2);
@@ -101,16 +132,59 @@ void RsdCpuScriptIntrinsicBlur::ComputeGaussianWeights() {
 
 void RsdCpuScriptIntrinsicBlur::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 1);
-    mAlloc.set(static_cast<Allocation *>(data));
+    Allocation *a = static_cast<Allocation *>(data);
+    if (a && a->getIsTiled()) {
+        // Neighbouring rows are read through the row stride.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Blur input must use the linear layout.");
+        return;
+    }
+    mAlloc.set(a);
 }
 
-void RsdCpuScriptIntrinsicBlur::setGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
-    rsAssert(slot == 0);
-    mRadius = ((const float *)data)[0];
-    ComputeGaussianWeights();
+// Picks the widths of three box filters whose combined variance is
+// closest to that of a gaussian with the given sigma.
+void RsdCpuScriptIntrinsicBlur::ComputeBoxRadii(float sigma) {
+    float var = 12.f * sigma * sigma;
+    int wl = (int)sqrtf(var / 3.f + 1.f);
+    if (!(wl & 1)) {
+        wl--;
+    }
+    wl = rsMax(wl, 1);
+    int m = (int)((var - 3 * wl * wl - 12 * wl - 9) / (-4.f * wl - 4.f) + 0.5f);
+    for (int ct = 0; ct < 3; ct++) {
+        mBoxRadius[ct] = ((ct < m) ? wl : (wl + 2)) >> 1;
+    }
 }
 
-
+void RsdCpuScriptIntrinsicBlur::setGlobalVar(uint32_t slot, const void *data, size_t dataLength) {
+    rsAssert(dataLength == 4);
+
+    switch (slot) {
+    case 0: {
+        float r = ((const float *)data)[0];
+        if (!(r > 0.f)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Blur: radius must be positive");
+            return;
+        }
+        mRadius = r;
+        ComputeGaussianWeights();
+        break;
+    }
+    case 2: {
+        int32_t v = ((const int32_t *)data)[0];
+        if ((v < RS_BLUR_MODE_GAUSSIAN) || (v > RS_BLUR_MODE_PYRAMID)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Blur: unknown mode");
+            return;
+        }
+        mMode = v;
+        break;
+    }
+    default:
+        rsAssert(0);
+        return;
+    }
+}
 
 static void OneVU4(const RsForEachStubParamStruct *p, float4 *out, int32_t x, int32_t y,
                    const uchar *ptrIn, int iStride, const float* gPtr, int iradius) {
@@ -288,11 +362,7 @@ void RsdCpuScriptIntrinsicBlur::kernelU4(const RsForEachStubParamStruct *p,
     uint32_t x2 = xend;
 
     if (p->dimX > 2048) {
-        if ((p->dimX > cp->mScratchSize[p->lid]) || !cp->mScratch[p->lid]) {
-            cp->mScratch[p->lid] = realloc(cp->mScratch[p->lid], p->dimX * 16);
-            cp->mScratchSize[p->lid] = p->dimX;
-        }
-        buf = (float4 *)cp->mScratch[p->lid];
+        buf = (float4 *)cp->getScratch(p->lid, p->dimX * sizeof(float4));
     }
     float4 *fout = (float4 *)buf;
     int y = p->y;
@@ -331,7 +401,8 @@ void RsdCpuScriptIntrinsicBlur::kernelU4(const RsForEachStubParamStruct *p,
 void RsdCpuScriptIntrinsicBlur::kernelU1(const RsForEachStubParamStruct *p,
                                          uint32_t xstart, uint32_t xend,
                                          uint32_t instep, uint32_t outstep) {
-    float buf[4 * 2048];
+    float stackbuf[4 * 2048];
+    float *buf = &stackbuf[0];
     RsdCpuScriptIntrinsicBlur *cp = (RsdCpuScriptIntrinsicBlur *)p->usr;
     if (!cp->mAlloc.get()) {
         ALOGE("Blur executed without input, skipping");
@@ -344,6 +415,9 @@ void RsdCpuScriptIntrinsicBlur::kernelU1(const RsForEachStubParamStruct *p,
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
 
+    if (p->dimX > 4 * 2048) {
+        buf = (float *)cp->getScratch(p->lid, p->dimX * sizeof(float));
+    }
     float *fout = (float *)buf;
     int y = p->y;
     if ((y > cp->mIradius) && (y < ((int)p->dimY - cp->mIradius -1))) {
@@ -383,11 +457,245 @@ void RsdCpuScriptIntrinsicBlur::kernelU1(const RsForEachStubParamStruct *p,
     }
 }
 
+// Box filters count samples spaced step float4s apart, clamping reads to
+// the first and last sample.  Each of the lanes consecutive float4s is
+// filtered on its own, so one call can sweep a strip of columns.  The
+// running sum makes the cost independent of the radius.
+static void boxPass(float4 *dst, const float4 *src, float4 *acc,
+                    uint32_t count, size_t step, uint32_t lanes, int r) {
+    const int last = count - 1;
+    const float norm = 1.f / (2 * r + 1);
+
+    for (uint32_t l = 0; l < lanes; l++) {
+        float4 a = src[l] * (float)(r + 1);
+        for (int i = 1; i <= r; i++) {
+            a += src[rsMin(i, last) * step + l];
+        }
+        acc[l] = a;
+    }
+    for (int i = 0; i <= last; i++) {
+        const float4 *add = src + rsMin(i + r + 1, last) * step;
+        const float4 *sub = src + rsMax(i - r, 0) * step;
+        float4 *d = dst + i * step;
+        for (uint32_t l = 0; l < lanes; l++) {
+            d[l] = acc[l] * norm;
+            acc[l] += add[l] - sub[l];
+        }
+    }
+}
+
+// Loads row y of the working image, averaging blocks of the input when
+// it is downscaled, and filters it horizontally into mImage.
+void RsdCpuScriptIntrinsicBlur::blurRow(uint32_t y, uint32_t lid) {
+    const uint8_t *pin = (const uint8_t *)mAlloc->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = mAlloc->mHal.drvState.lod[0].stride;
+    const size_t esize = mAlloc->mHal.state.elementSizeBytes;
+    const uint32_t dimX = mAlloc->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = rsMax(mAlloc->mHal.drvState.lod[0].dimY, 1u);
+    const uint32_t w = mImageDimX;
+    const uint32_t scale = 1 << mLevel;
+
+    float4 *line = (float4 *)getScratch(lid, (w * 2 + 1) * sizeof(float4));
+    float4 *tmp = line + w;
+    float4 *acc = tmp + w;
+    float4 *row = mImage + y * w;
+
+    if (!mLevel) {
+        const uint8_t *pi = pin + y * stride;
+        for (uint32_t x = 0; x < w; x++) {
+            line[x] = loadChannels(pi, mType, mVec);
+            pi += esize;
+        }
+    } else {
+        const float norm = 1.f / (scale * scale);
+        for (uint32_t x = 0; x < w; x++) {
+            float4 sum = 0.f;
+            for (uint32_t dy = 0; dy < scale; dy++) {
+                const uint8_t *pi = pin + rsMin(y * scale + dy, dimY - 1) * stride;
+                for (uint32_t dx = 0; dx < scale; dx++) {
+                    sum += loadChannels(pi + rsMin(x * scale + dx, dimX - 1) * esize,
+                                        mType, mVec);
+                }
+            }
+            line[x] = sum * norm;
+        }
+    }
+
+    if (mMode == RS_BLUR_MODE_GAUSSIAN) {
+        for (uint32_t x = 0; x < w; x++) {
+            float4 sum = 0.f;
+            for (int r = -mIradius; r <= mIradius; r++) {
+                int validX = rsMin(rsMax((int)x + r, 0), (int)w - 1);
+                sum += line[validX] * mFp[r + mIradius];
+            }
+            row[x] = sum;
+        }
+    } else {
+        boxPass(tmp, line, acc, w, 1, 1, mBoxRadius[0]);
+        boxPass(line, tmp, acc, w, 1, 1, mBoxRadius[1]);
+        boxPass(row, line, acc, w, 1, 1, mBoxRadius[2]);
+    }
+}
+
+// Filters a strip of columns of mImage vertically into mImageTmp.
+void RsdCpuScriptIntrinsicBlur::blurStrip(uint32_t strip, uint32_t lid) {
+    const uint32_t w = mImageDimX;
+    const uint32_t h = mImageDimY;
+    const uint32_t x1 = strip * kStripWidth;
+    const uint32_t lanes = rsMin(kStripWidth, w - x1);
+
+    if (mMode == RS_BLUR_MODE_GAUSSIAN) {
+        for (uint32_t y = 0; y < h; y++) {
+            float4 *out = mImageTmp + y * w + x1;
+            for (uint32_t l = 0; l < lanes; l++) {
+                out[l] = 0.f;
+            }
+            for (int r = -mIradius; r <= mIradius; r++) {
+                int validY = rsMin(rsMax((int)y + r, 0), (int)h - 1);
+                const float4 *in = mImage + validY * w + x1;
+                const float g = mFp[r + mIradius];
+                for (uint32_t l = 0; l < lanes; l++) {
+                    out[l] += in[l] * g;
+                }
+            }
+        }
+    } else {
+        float4 *acc = (float4 *)getScratch(lid, lanes * sizeof(float4));
+        boxPass(mImageTmp + x1, mImage + x1, acc, h, w, lanes, mBoxRadius[0]);
+        boxPass(mImage + x1, mImageTmp + x1, acc, h, w, lanes, mBoxRadius[1]);
+        boxPass(mImageTmp + x1, mImage + x1, acc, h, w, lanes, mBoxRadius[2]);
+    }
+}
+
+void RsdCpuScriptIntrinsicBlur::runPassItem(uint32_t pass, uint32_t item, uint32_t lid) {
+    if (pass == PASS_ROWS) {
+        blurRow(item, lid);
+    } else {
+        blurStrip(item, lid);
+    }
+}
+
+// Selects the kernel for the current mode and, for the float path,
+// blurs the input into mImageTmp.
+bool RsdCpuScriptIntrinsicBlur::prepare(uint32_t slot) {
+    const Element *e = mElement.get();
+    mType = e->getType();
+    mVec = e->getVectorSize();
+    // Script groups launch whatever kernel is left here, even on failure.
+    mRootPtr = &kernelFloat;
+
+    if ((mMode == RS_BLUR_MODE_GAUSSIAN) && (mRadius > kMaxGaussianRadius)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Blur: the gaussian mode is limited to a radius of 25, "
+                "use the box or pyramid mode for larger radii");
+        return false;
+    }
+    if ((mMode == RS_BLUR_MODE_GAUSSIAN) && (mType == RS_TYPE_UNSIGNED_8) &&
+        ((mVec == 1) || (mVec == 4))) {
+        mRootPtr = (mVec == 1) ? &kernelU1 : &kernelU4;
+        return true;
+    }
+
+    if (!mAlloc.get()) {
+        ALOGE("Blur executed without input, skipping");
+        return false;
+    }
+    uint32_t inVec = 0;
+    if ((getChannelType(e, &mVec) == RS_TYPE_NONE) ||
+        (getChannelType(mAlloc->getType()->getElement(), &inVec) != mType) ||
+        (inVec != mVec)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Blur: input must match the element, of 1 to 4 "
+                "uchar, ushort, half or float channels");
+        return false;
+    }
+    mRootPtr = &kernelFloat;
+
+    mLevel = 0;
+    if (mMode == RS_BLUR_MODE_PYRAMID) {
+        // Keep at least 8 pixels of radius in the downscaled image.
+        while ((mLevel < 2) && (mRadius >= (float)(16 << mLevel))) {
+            mLevel++;
+        }
+    }
+    const uint32_t scale = 1 << mLevel;
+    mImageDimX = (mAlloc->mHal.drvState.lod[0].dimX + scale - 1) >> mLevel;
+    mImageDimY = (rsMax(mAlloc->mHal.drvState.lod[0].dimY, 1u) + scale - 1) >> mLevel;
+
+    size_t size = (size_t)mImageDimX * mImageDimY;
+    if (size > mImageSize) {
+        free(mImage);
+        free(mImageTmp);
+        mImage = (float4 *)malloc(size * sizeof(float4));
+        mImageTmp = (float4 *)malloc(size * sizeof(float4));
+        mImageSize = size;
+        if (!mImage || !mImageTmp) {
+            free(mImage);
+            free(mImageTmp);
+            mImage = NULL;
+            mImageTmp = NULL;
+            mImageSize = 0;
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Blur: unable to allocate the working image");
+            return false;
+        }
+    }
+    if (mMode != RS_BLUR_MODE_GAUSSIAN) {
+        ComputeBoxRadii((0.4f * mRadius + 0.6f) / scale);
+    }
+
+    runPass(PASS_ROWS, mImageDimY);
+    runPass(PASS_COLUMNS, (mImageDimX + kStripWidth - 1) / kStripWidth);
+    return true;
+}
+
+// Stores the blurred image, bilinearly upscaling a pyramid level.
+void RsdCpuScriptIntrinsicBlur::kernelFloat(const RsForEachStubParamStruct *p,
+                                            uint32_t xstart, uint32_t xend,
+                                            uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicBlur *cp = (RsdCpuScriptIntrinsicBlur *)p->usr;
+    if (!cp->mPrepared) {
+        return;
+    }
+    const uint32_t w = cp->mImageDimX;
+    const uint32_t h = cp->mImageDimY;
+    uint8_t *out = (uint8_t *)p->out;
+
+    if (!cp->mLevel) {
+        const float4 *row = cp->mImageTmp + rsMin(p->y, h - 1) * w;
+        for (uint32_t x = xstart; x < xend; x++) {
+            storeChannels(out, cp->mType, cp->mVec, row[rsMin(x, w - 1)]);
+            out += outstep;
+        }
+        return;
+    }
+
+    const float inv = 1.f / (1 << cp->mLevel);
+    float fy = rsMax((p->y + 0.5f) * inv - 0.5f, 0.f);
+    uint32_t y0 = rsMin((uint32_t)fy, h - 1);
+    uint32_t y1 = rsMin(y0 + 1, h - 1);
+    float wy = rsMin(fy - y0, 1.f);
+    const float4 *r0 = cp->mImageTmp + y0 * w;
+    const float4 *r1 = cp->mImageTmp + y1 * w;
+
+    for (uint32_t x = xstart; x < xend; x++) {
+        float fx = rsMax((x + 0.5f) * inv - 0.5f, 0.f);
+        uint32_t x0 = rsMin((uint32_t)fx, w - 1);
+        uint32_t x1 = rsMin(x0 + 1, w - 1);
+        float wx = rsMin(fx - x0, 1.f);
+        float4 top = r0[x0] + (r0[x1] - r0[x0]) * wx;
+        float4 bottom = r1[x0] + (r1[x1] - r1[x0]) * wx;
+        storeChannels(out, cp->mType, cp->mVec, top + (bottom - top) * wy);
+        out += outstep;
+    }
+}
+
 RsdCpuScriptIntrinsicBlur::RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx,
                                                      const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_BLUR) {
 
-    mRootPtr = NULL;
+    // prepare() picks the kernel for the mode at launch.
+    mRootPtr = &kernelFloat;
     if (e->getType() == RS_TYPE_UNSIGNED_8) {
         switch (e->getVectorSize()) {
         case 1:
@@ -398,32 +706,27 @@ RsdCpuScriptIntrinsicBlur::RsdCpuScriptIntrinsicBlur(RsdCpuReferenceImpl *ctx,
             break;
         }
     }
-    rsAssert(mRootPtr);
     mRadius = 5;
-
-    mScratch = new void *[mCtx->getThreadCount()];
-    mScratchSize = new size_t[mCtx->getThreadCount()];
+    mMode = RS_BLUR_MODE_GAUSSIAN;
+    mType = e->getType();
+    mVec = e->getVectorSize();
+    mLevel = 0;
+    mImageDimX = 0;
+    mImageDimY = 0;
+    mImageSize = 0;
+    mImage = NULL;
+    mImageTmp = NULL;
 
     ComputeGaussianWeights();
 }
 
 RsdCpuScriptIntrinsicBlur::~RsdCpuScriptIntrinsicBlur() {
-    uint32_t threads = mCtx->getThreadCount();
-    if (mScratch) {
-        for (size_t i = 0; i < threads; i++) {
-            if (mScratch[i]) {
-                free(mScratch[i]);
-            }
-        }
-        delete []mScratch;
-    }
-    if (mScratchSize) {
-        delete []mScratchSize;
-    }
+    free(mImage);
+    free(mImageTmp);
 }
 
 void RsdCpuScriptIntrinsicBlur::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 2;
+    s->mHal.info.exportedVariableCount = 3;
 }
 
 void RsdCpuScriptIntrinsicBlur::invokeFreeChildren() {
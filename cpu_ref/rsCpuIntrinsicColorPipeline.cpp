@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Applies a color matrix, a bias, per channel curves and a clamp in one
+// pass:  out = clamp(curve(matrix * in + bias)).  Colors are normalized
+// to 0..1 whatever the element type.
+class RsdCpuScriptIntrinsicColorPipeline : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicColorPipeline();
+    RsdCpuScriptIntrinsicColorPipeline(RsdCpuReferenceImpl *ctx, const Script *s,
+                                       const Element *e);
+
+    enum {
+        // Each channel only depends on itself.
+        SHAPE_DIAGONAL = 0,
+        // Color channels mix, alpha only scales.
+        SHAPE_3X3 = 1,
+        SHAPE_4X4 = 2,
+        SHAPE_COUNT = 3
+    };
+
+    float mMatrix[16];
+    float mBias[4];
+    bool mClamp;
+    uint32_t mShape;
+
+    // Curves copied from the bound allocation, mCurveSize entries per
+    // channel stored channel after channel.
+    ObjectBaseRef<Allocation> mCurveAlloc;
+    float *mCurves;
+    uint32_t mCurveSize;
+
+    // Precomputed result of the whole pipeline for 8 bit channels that
+    // don't mix, rebuilt whenever a setting changes.
+    uchar mTable8[4][256];
+    bool mTable8Dirty;
+
+    RsDataType mInType;
+    uint32_t mInVec;
+    RsDataType mOutType;
+    uint32_t mOutVec;
+
+protected:
+    void updateShape();
+    void buildTable8();
+    void selectKernel();
+
+    static void kernelTable8(const RsForEachStubParamStruct *p,
+                             uint32_t xstart, uint32_t xend,
+                             uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+template <uint32_t SHAPE>
+static inline float4 applyMatrix(const float *m, float4 i) {
+    float4 r;
+    switch (SHAPE) {
+    case RsdCpuScriptIntrinsicColorPipeline::SHAPE_DIAGONAL:
+        r = i * (float4){m[0], m[5], m[10], m[15]};
+        break;
+    case RsdCpuScriptIntrinsicColorPipeline::SHAPE_3X3:
+        r.x = i.x * m[0] + i.y * m[4] + i.z * m[8];
+        r.y = i.x * m[1] + i.y * m[5] + i.z * m[9];
+        r.z = i.x * m[2] + i.y * m[6] + i.z * m[10];
+        r.w = i.w * m[15];
+        break;
+    default:
+        r.x = i.x * m[0] + i.y * m[4] + i.z * m[8] + i.w * m[12];
+        r.y = i.x * m[1] + i.y * m[5] + i.z * m[9] + i.w * m[13];
+        r.z = i.x * m[2] + i.y * m[6] + i.z * m[10] + i.w * m[14];
+        r.w = i.x * m[3] + i.y * m[7] + i.z * m[11] + i.w * m[15];
+        break;
+    }
+    return r;
+}
+
+// Linear interpolation between the curve entries around v.
+static inline float applyCurve(const float *curve, uint32_t size, float v) {
+    float f = clampUnit(v) * (size - 1);
+    uint32_t i = rsMin((uint32_t)f, size - 2);
+    float frac = f - i;
+    return curve[i] + frac * (curve[i + 1] - curve[i]);
+}
+
+template <uint32_t SHAPE, bool CURVES>
+static void pipelineKernel(const RsForEachStubParamStruct *p,
+                           uint32_t xstart, uint32_t xend,
+                           uint32_t instep, uint32_t outstep) {
+    const RsdCpuScriptIntrinsicColorPipeline *cp =
+            (const RsdCpuScriptIntrinsicColorPipeline *)p->usr;
+    const uint8_t *in = (const uint8_t *)p->in;
+    uint8_t *out = (uint8_t *)p->out;
+    const float4 bias = {cp->mBias[0], cp->mBias[1], cp->mBias[2], cp->mBias[3]};
+    const float *curves = cp->mCurves;
+    const uint32_t size = cp->mCurveSize;
+
+    for (uint32_t x = xstart; x < xend; x++, in += instep, out += outstep) {
+        float4 c = applyMatrix<SHAPE>(cp->mMatrix, loadChannels(in, cp->mInType, cp->mInVec));
+        c += bias;
+        if (CURVES) {
+            c.x = applyCurve(curves, size, c.x);
+            c.y = applyCurve(curves + size, size, c.y);
+            c.z = applyCurve(curves + size * 2, size, c.z);
+            c.w = applyCurve(curves + size * 3, size, c.w);
+        }
+        if (cp->mClamp) {
+            c = clamp(c, 0.f, 1.f);
+        }
+        storeChannels(out, cp->mOutType, cp->mOutVec, c);
+    }
+}
+
+static const RsdCpuScriptImpl::outer_foreach_t
+        gPipelineKernels[RsdCpuScriptIntrinsicColorPipeline::SHAPE_COUNT][2] = {
+    {pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_DIAGONAL, false>,
+     pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_DIAGONAL, true>},
+    {pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_3X3, false>,
+     pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_3X3, true>},
+    {pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_4X4, false>,
+     pipelineKernel<RsdCpuScriptIntrinsicColorPipeline::SHAPE_4X4, true>}
+};
+
+void RsdCpuScriptIntrinsicColorPipeline::kernelTable8(const RsForEachStubParamStruct *p,
+                                                      uint32_t xstart, uint32_t xend,
+                                                      uint32_t instep, uint32_t outstep) {
+    const RsdCpuScriptIntrinsicColorPipeline *cp =
+            (const RsdCpuScriptIntrinsicColorPipeline *)p->usr;
+    const uchar *in = (const uchar *)p->in;
+    uchar *out = (uchar *)p->out;
+
+    if (cp->mInVec == 4) {
+        const uchar *tr = cp->mTable8[0];
+        const uchar *tg = cp->mTable8[1];
+        const uchar *tb = cp->mTable8[2];
+        const uchar *ta = cp->mTable8[3];
+        for (uint32_t x = xstart; x < xend; x++, in += instep, out += outstep) {
+            uchar4 i = *(const uchar4 *)in;
+            uchar4 o = {tr[i.x], tg[i.y], tb[i.z], ta[i.w]};
+            *(uchar4 *)out = o;
+        }
+        return;
+    }
+    for (uint32_t x = xstart; x < xend; x++, in += instep, out += outstep) {
+        for (uint32_t ct = 0; ct < cp->mInVec; ct++) {
+            out[ct] = cp->mTable8[ct][in[ct]];
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::updateShape() {
+    const float *m = mMatrix;
+    mShape = SHAPE_4X4;
+    if ((m[3] == 0.f) && (m[7] == 0.f) && (m[11] == 0.f) &&
+        (m[12] == 0.f) && (m[13] == 0.f) && (m[14] == 0.f)) {
+        mShape = SHAPE_3X3;
+        if ((m[1] == 0.f) && (m[2] == 0.f) && (m[4] == 0.f) &&
+            (m[6] == 0.f) && (m[8] == 0.f) && (m[9] == 0.f)) {
+            mShape = SHAPE_DIAGONAL;
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::buildTable8() {
+    const float scale[4] = {mMatrix[0], mMatrix[5], mMatrix[10], mMatrix[15]};
+    for (uint32_t ch = 0; ch < 4; ch++) {
+        for (uint32_t v = 0; v < 256; v++) {
+            float c = v * (1.f / 255.f) * scale[ch] + mBias[ch];
+            if (mCurves) {
+                c = applyCurve(mCurves + mCurveSize * ch, mCurveSize, c);
+            }
+            mTable8[ch][v] = (uchar)(clampUnit(c) * 255.f + 0.5f);
+        }
+    }
+    mTable8Dirty = false;
+}
+
+// Picks the kernel for the current settings and element types.  8 bit
+// channels that don't mix go through a table built from the pipeline.
+void RsdCpuScriptIntrinsicColorPipeline::selectKernel() {
+    if ((mShape == SHAPE_DIAGONAL) && (mInType == RS_TYPE_UNSIGNED_8) &&
+        (mOutType == RS_TYPE_UNSIGNED_8) && (mInVec == mOutVec)) {
+        if (mTable8Dirty) {
+            buildTable8();
+        }
+        mRootPtr = &kernelTable8;
+        return;
+    }
+    mRootPtr = gPipelineKernels[mShape][mCurves ? 1 : 0];
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::setGlobalVar(uint32_t slot, const void *data,
+                                                      size_t dataLength) {
+    switch (slot) {
+    case 0:
+        rsAssert(dataLength == sizeof(mMatrix));
+        memcpy(mMatrix, data, sizeof(mMatrix));
+        updateShape();
+        break;
+    case 1:
+        rsAssert(dataLength == sizeof(mBias));
+        memcpy(mBias, data, sizeof(mBias));
+        break;
+    case 3:
+        rsAssert(dataLength == 4);
+        mClamp = ((const int32_t *)data)[0] != 0;
+        break;
+    default:
+        rsAssert(0);
+        return;
+    }
+    mTable8Dirty = true;
+    selectKernel();
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 2);
+    Allocation *a = static_cast<Allocation *>(data);
+
+    free(mCurves);
+    mCurves = NULL;
+    mCurveSize = 0;
+    mCurveAlloc.clear();
+    mTable8Dirty = true;
+
+    if (a) {
+        RsDataType dt = getColorType(a->getType()->getElement());
+        uint32_t size = a->mHal.drvState.lod[0].dimX;
+        if ((dt == RS_TYPE_NONE) || a->getIsTiled() || a->getHasFieldPlanes() ||
+            (a->mHal.drvState.lod[0].dimY > 1) || (size < 2)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                    "Color pipeline curves must be a 1D allocation of at least 2 "
+                    "uchar4, ushort4, half4 or float4 entries.");
+            selectKernel();
+            return;
+        }
+
+        // Copied when bound, like the 3D LUT.
+        mCurves = (float *)malloc(size * 4 * sizeof(float));
+        if (!mCurves) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Color pipeline curve copy failed");
+            selectKernel();
+            return;
+        }
+        const uint8_t *src = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+        for (uint32_t ct = 0; ct < size; ct++) {
+            float4 c = loadColor(src + ct * a->mHal.state.elementSizeBytes, dt);
+            mCurves[ct] = c.x;
+            mCurves[size + ct] = c.y;
+            mCurves[size * 2 + ct] = c.z;
+            mCurves[size * 3 + ct] = c.w;
+        }
+        mCurveSize = size;
+        mCurveAlloc.set(a);
+    }
+    selectKernel();
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::invokeForEach(uint32_t slot,
+                                                       const Allocation * ain,
+                                                       Allocation * aout,
+                                                       const void * usr,
+                                                       uint32_t usrLen,
+                                                       const RsScriptCall *sc) {
+    uint32_t inVec = 0;
+    uint32_t outVec = 0;
+    RsDataType inType = getChannelType(ain ? ain->getType()->getElement() : NULL, &inVec);
+    RsDataType outType = getChannelType(aout ? aout->getType()->getElement() : NULL, &outVec);
+    if ((inType == RS_TYPE_NONE) || (outType == RS_TYPE_NONE)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Color pipeline input and output must have 1 to 4 "
+                "uchar, ushort, half or float channels.");
+        return;
+    }
+    mInType = inType;
+    mInVec = inVec;
+    mOutType = outType;
+    mOutVec = outVec;
+    selectKernel();
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+}
+
+RsdCpuScriptIntrinsicColorPipeline::RsdCpuScriptIntrinsicColorPipeline(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE) {
+
+    for (uint32_t ct = 0; ct < 16; ct++) {
+        mMatrix[ct] = ((ct % 5) == 0) ? 1.f : 0.f;
+    }
+    memset(mBias, 0, sizeof(mBias));
+    mClamp = true;
+    mCurves = NULL;
+    mCurveSize = 0;
+    mTable8Dirty = true;
+
+    // Script groups launch through forEachKernelSetup without the
+    // allocations, so the element the script was created with sets the
+    // types until a direct launch says otherwise.
+    mInType = getChannelType(e, &mInVec);
+    if (mInType == RS_TYPE_NONE) {
+        mInType = RS_TYPE_UNSIGNED_8;
+        mInVec = 4;
+    }
+    mOutType = mInType;
+    mOutVec = mInVec;
+
+    updateShape();
+    selectKernel();
+}
+
+RsdCpuScriptIntrinsicColorPipeline::~RsdCpuScriptIntrinsicColorPipeline() {
+    free(mCurves);
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 4;
+}
+
+void RsdCpuScriptIntrinsicColorPipeline::invokeFreeChildren() {
+    mCurveAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_ColorPipeline(RsdCpuReferenceImpl *ctx,
+                                              const Script *s, const Element *e) {
+    return new RsdCpuScriptIntrinsicColorPipeline(ctx, s, e);
+}
@@ -41,6 +41,8 @@ protected:
     short mIp[16];
     ObjectBaseRef<const Allocation> mAlloc;
     ObjectBaseRef<const Element> mElement;
+    int32_t mBorder;
+    uchar4 mBorderColor;
 
     static void kernel(const RsForEachStubParamStruct *p,
                        uint32_t xstart, uint32_t xend,
@@ -53,15 +55,43 @@ protected:
 
 void RsdCpuScriptIntrinsicConvolve3x3::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 1);
-    mAlloc.set(static_cast<Allocation *>(data));
+    Allocation *a = static_cast<Allocation *>(data);
+    if (a && a->getIsTiled()) {
+        // Neighbouring rows are read through the row stride.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Convolve3x3 input must use the linear layout.");
+        return;
+    }
+    mAlloc.set(a);
 }
 
 void RsdCpuScriptIntrinsicConvolve3x3::setGlobalVar(uint32_t slot, const void *data,
                                                     size_t dataLength) {
-    rsAssert(slot == 0);
-    memcpy (&mFp, data, dataLength);
-    for(int ct=0; ct < 9; ct++) {
-        mIp[ct] = (short)(mFp[ct] * 255.f + 0.5f);
+    switch (slot) {
+    case 0:
+        memcpy (&mFp, data, dataLength);
+        for(int ct=0; ct < 9; ct++) {
+            mIp[ct] = (short)(mFp[ct] * 255.f + 0.5f);
+        }
+        break;
+    case 2: {
+        rsAssert(dataLength == 4);
+        int32_t v = ((const int32_t *)data)[0];
+        if ((v < RS_BORDER_CLAMP) || (v > RS_BORDER_CONSTANT)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "Convolve3x3: unknown border mode");
+            return;
+        }
+        mBorder = v;
+        break;
+    }
+    case 3:
+        rsAssert(dataLength == 4);
+        memcpy(&mBorderColor, data, 4);
+        break;
+    default:
+        rsAssert(0);
+        return;
     }
 }
 
@@ -69,12 +99,13 @@ extern "C" void rsdIntrinsicConvolve3x3_K(void *dst, const void *y0, const void
                                           const void *y2, const short *coef, uint32_t count);
 
 
-static void ConvolveOne(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
+// Only called with all three columns inside the image.
+static void ConvolveOne(uint32_t x, uchar4 *out,
                         const uchar4 *py0, const uchar4 *py1, const uchar4 *py2,
                         const float* coeff) {
 
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
-    uint32_t x2 = rsMin((int32_t)x+1, (int32_t)p->dimX-1);
+    uint32_t x1 = x - 1;
+    uint32_t x2 = x + 1;
 
     float4 px = convert_float4(py0[x1]) * coeff[0] +
                 convert_float4(py0[x]) * coeff[1] +
@@ -103,24 +134,40 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernel(const RsForEachStubParamStruct *p,
     const uchar *pin = (const uchar *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
     const size_t stride = cp->mAlloc->mHal.drvState.lod[0].stride;
 
-    uint32_t y1 = rsMin((int32_t)p->y + 1, (int32_t)(p->dimY-1));
-    uint32_t y2 = rsMax((int32_t)p->y - 1, 0);
-    const uchar4 *py0 = (const uchar4 *)(pin + stride * y2);
-    const uchar4 *py1 = (const uchar4 *)(pin + stride * p->y);
-    const uchar4 *py2 = (const uchar4 *)(pin + stride * y1);
+    const int32_t dimX = p->dimX;
+    const int32_t dimY = p->dimY;
+    const int32_t y = p->y;
+    const int32_t border = cp->mBorder;
+    const int32_t y0 = borderCoord(y - 1, dimY, border);
+    const int32_t y2 = borderCoord(y + 1, dimY, border);
 
     uchar4 *out = (uchar4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
-    if(x1 == 0) {
-        ConvolveOne(p, 0, out, py0, py1, py2, cp->mFp);
-        x1 ++;
+
+    // Columns [i1, i2) have every tap inside the image.  A row next to a
+    // constant border has no interior at all.
+    uint32_t i1 = x2;
+    uint32_t i2 = x2;
+    if ((y0 >= 0) && (y2 >= 0)) {
+        i1 = rsMin(rsMax(x1, (uint32_t)1), x2);
+        i2 = rsMax(rsMin(x2, (uint32_t)(dimX - 1)), i1);
+    }
+
+    while (x1 < i1) {
+        *out = convolveBorderU4<3>(pin, stride, dimX, dimY, x1, y, cp->mFp,
+                                   border, cp->mBorderColor);
         out++;
+        x1++;
     }
 
-    if(x2 > x1) {
+    if (i2 > x1) {
+        const uchar4 *py0 = (const uchar4 *)(pin + stride * y0);
+        const uchar4 *py1 = (const uchar4 *)(pin + stride * y);
+        const uchar4 *py2 = (const uchar4 *)(pin + stride * y2);
+
 #if defined(ARCH_ARM_HAVE_NEON)
-        int32_t len = (x2 - x1 - 1) >> 1;
+        int32_t len = (i2 - x1) >> 1;
         if(len > 0) {
             rsdIntrinsicConvolve3x3_K(out, &py0[x1-1], &py1[x1-1], &py2[x1-1], cp->mIp, len);
             x1 += len << 1;
@@ -128,12 +175,19 @@ void RsdCpuScriptIntrinsicConvolve3x3::kernel(const RsForEachStubParamStruct *p,
         }
 #endif
 
-        while(x1 != x2) {
-            ConvolveOne(p, x1, out, py0, py1, py2, cp->mFp);
+        while(x1 != i2) {
+            ConvolveOne(x1, out, py0, py1, py2, cp->mFp);
             out++;
             x1++;
         }
     }
+
+    while (x1 < x2) {
+        *out = convolveBorderU4<3>(pin, stride, dimX, dimY, x1, y, cp->mFp,
+                                   border, cp->mBorderColor);
+        out++;
+        x1++;
+    }
 }
 
 RsdCpuScriptIntrinsicConvolve3x3::RsdCpuScriptIntrinsicConvolve3x3(
@@ -141,6 +195,8 @@ RsdCpuScriptIntrinsicConvolve3x3::RsdCpuScriptIntrinsicConvolve3x3(
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_3x3) {
 
     mRootPtr = &kernel;
+    mBorder = RS_BORDER_CLAMP;
+    mBorderColor = 0;
     for(int ct=0; ct < 9; ct++) {
         mFp[ct] = 1.f / 9.f;
         mIp[ct] = (short)(mFp[ct] * 255.f + 0.5f);
@@ -151,7 +207,7 @@ RsdCpuScriptIntrinsicConvolve3x3::~RsdCpuScriptIntrinsicConvolve3x3() {
 }
 
 void RsdCpuScriptIntrinsicConvolve3x3::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 2;
+    s->mHal.info.exportedVariableCount = 4;
 }
 
 void RsdCpuScriptIntrinsicConvolve3x3::invokeFreeChildren() {
@@ -40,6 +40,8 @@ protected:
     float fp[28];
     short ip[28];
     ObjectBaseRef<Allocation> alloc;
+    int32_t border;
+    uchar4 borderColor;
 
 
     static void kernel(const RsForEachStubParamStruct *p,
@@ -54,28 +56,57 @@ protected:
 
 void RsdCpuScriptIntrinsicConvolve5x5::setGlobalObj(uint32_t slot, ObjectBase *data) {
     rsAssert(slot == 1);
-    alloc.set(static_cast<Allocation *>(data));
+    Allocation *a = static_cast<Allocation *>(data);
+    if (a && a->getIsTiled()) {
+        // Neighbouring rows are read through the row stride.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Convolve5x5 input must use the linear layout.");
+        return;
+    }
+    alloc.set(a);
 }
 
 void RsdCpuScriptIntrinsicConvolve5x5::setGlobalVar(uint32_t slot,
                                                     const void *data, size_t dataLength) {
-    rsAssert(slot == 0);
-    memcpy (&fp, data, dataLength);
-    for(int ct=0; ct < 25; ct++) {
-        ip[ct] = (short)(fp[ct] * 255.f);
+    switch (slot) {
+    case 0:
+        memcpy (&fp, data, dataLength);
+        for(int ct=0; ct < 25; ct++) {
+            ip[ct] = (short)(fp[ct] * 255.f);
+        }
+        break;
+    case 2: {
+        rsAssert(dataLength == 4);
+        int32_t v = ((const int32_t *)data)[0];
+        if ((v < RS_BORDER_CLAMP) || (v > RS_BORDER_CONSTANT)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "Convolve5x5: unknown border mode");
+            return;
+        }
+        border = v;
+        break;
+    }
+    case 3:
+        rsAssert(dataLength == 4);
+        memcpy(&borderColor, data, 4);
+        break;
+    default:
+        rsAssert(0);
+        return;
     }
 }
 
 
-static void One(const RsForEachStubParamStruct *p, uint32_t x, uchar4 *out,
+// Only called with all five columns inside the image.
+static void One(uint32_t x, uchar4 *out,
                 const uchar4 *py0, const uchar4 *py1, const uchar4 *py2, const uchar4 *py3, const uchar4 *py4,
                 const float* coeff) {
 
-    uint32_t x0 = rsMax((int32_t)x-2, 0);
-    uint32_t x1 = rsMax((int32_t)x-1, 0);
+    uint32_t x0 = x - 2;
+    uint32_t x1 = x - 1;
     uint32_t x2 = x;
-    uint32_t x3 = rsMin((int32_t)x+1, (int32_t)(p->dimX-1));
-    uint32_t x4 = rsMin((int32_t)x+2, (int32_t)(p->dimX-1));
+    uint32_t x3 = x + 1;
+    uint32_t x4 = x + 2;
 
     float4 px = convert_float4(py0[x0]) * coeff[0] +
                 convert_float4(py0[x1]) * coeff[1] +
@@ -131,39 +162,61 @@ void RsdCpuScriptIntrinsicConvolve5x5::kernel(const RsForEachStubParamStruct *p,
     const uchar *pin = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
     const size_t stride = cp->alloc->mHal.drvState.lod[0].stride;
 
-    uint32_t y0 = rsMax((int32_t)p->y-2, 0);
-    uint32_t y1 = rsMax((int32_t)p->y-1, 0);
-    uint32_t y2 = p->y;
-    uint32_t y3 = rsMin((int32_t)p->y+1, (int32_t)(p->dimY-1));
-    uint32_t y4 = rsMin((int32_t)p->y+2, (int32_t)(p->dimY-1));
-
-    const uchar4 *py0 = (const uchar4 *)(pin + stride * y0);
-    const uchar4 *py1 = (const uchar4 *)(pin + stride * y1);
-    const uchar4 *py2 = (const uchar4 *)(pin + stride * y2);
-    const uchar4 *py3 = (const uchar4 *)(pin + stride * y3);
-    const uchar4 *py4 = (const uchar4 *)(pin + stride * y4);
+    const int32_t dimX = p->dimX;
+    const int32_t dimY = p->dimY;
+    const int32_t y = p->y;
+    const int32_t y0 = borderCoord(y - 2, dimY, cp->border);
+    const int32_t y1 = borderCoord(y - 1, dimY, cp->border);
+    const int32_t y3 = borderCoord(y + 1, dimY, cp->border);
+    const int32_t y4 = borderCoord(y + 2, dimY, cp->border);
 
     uchar4 *out = (uchar4 *)p->out;
     uint32_t x1 = xstart;
     uint32_t x2 = xend;
 
-    while((x1 < x2) && (x1 < 2)) {
-        One(p, x1, out, py0, py1, py2, py3, py4, cp->fp);
+    // Columns [i1, i2) have every tap inside the image.  A row near a
+    // constant border has no interior at all.
+    uint32_t i1 = x2;
+    uint32_t i2 = x2;
+    if ((y0 >= 0) && (y1 >= 0) && (y3 >= 0) && (y4 >= 0)) {
+        i1 = rsMin(rsMax(x1, (uint32_t)2), x2);
+        i2 = rsMax(rsMin(x2, (uint32_t)rsMax(dimX - 2, 0)), i1);
+    }
+
+    while (x1 < i1) {
+        *out = convolveBorderU4<5>(pin, stride, dimX, dimY, x1, y, cp->fp,
+                                   cp->border, cp->borderColor);
         out++;
         x1++;
     }
 
+    if (i2 > x1) {
+        const uchar4 *py0 = (const uchar4 *)(pin + stride * y0);
+        const uchar4 *py1 = (const uchar4 *)(pin + stride * y1);
+        const uchar4 *py2 = (const uchar4 *)(pin + stride * y);
+        const uchar4 *py3 = (const uchar4 *)(pin + stride * y3);
+        const uchar4 *py4 = (const uchar4 *)(pin + stride * y4);
+
 #if defined(ARCH_ARM_HAVE_NEON)
-    if((x1 + 3) < x2) {
-        uint32_t len = (x2 - x1 - 3) >> 1;
-        rsdIntrinsicConvolve5x5_K(out, py0, py1, py2, py3, py4, cp->ip, len);
-        out += len << 1;
-        x1 += len << 1;
-    }
+        uint32_t len = (i2 - x1) >> 1;
+        if (len > 0) {
+            rsdIntrinsicConvolve5x5_K(out, &py0[x1-2], &py1[x1-2], &py2[x1-2],
+                                      &py3[x1-2], &py4[x1-2], cp->ip, len);
+            out += len << 1;
+            x1 += len << 1;
+        }
 #endif
 
-    while(x1 < x2) {
-        One(p, x1, out, py0, py1, py2, py3, py4, cp->fp);
+        while(x1 < i2) {
+            One(x1, out, py0, py1, py2, py3, py4, cp->fp);
+            out++;
+            x1++;
+        }
+    }
+
+    while (x1 < x2) {
+        *out = convolveBorderU4<5>(pin, stride, dimX, dimY, x1, y, cp->fp,
+                                   cp->border, cp->borderColor);
         out++;
         x1++;
     }
@@ -175,6 +228,8 @@ RsdCpuScriptIntrinsicConvolve5x5::RsdCpuScriptIntrinsicConvolve5x5(
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_CONVOLVE_5x5) {
 
     mRootPtr = &kernel;
+    border = RS_BORDER_CLAMP;
+    borderColor = 0;
     for(int ct=0; ct < 25; ct++) {
         fp[ct] = 1.f / 25.f;
         ip[ct] = (short)(fp[ct] * 255.f);
@@ -185,7 +240,7 @@ RsdCpuScriptIntrinsicConvolve5x5::~RsdCpuScriptIntrinsicConvolve5x5() {
 }
 
 void RsdCpuScriptIntrinsicConvolve5x5::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 2;
+    s->mHal.info.exportedVariableCount = 4;
 }
 
 void RsdCpuScriptIntrinsicConvolve5x5::invokeFreeChildren() {
@@ -121,4 +121,194 @@ static inline float4 clamp(float4 amount, float low, float high) {
     return r;
 }
 
+// Returns the component type of a 4 component color element, or
+// RS_TYPE_NONE if the element can't hold one.
+static inline RsDataType getColorType(const android::renderscript::Element *e) {
+    if (!e || (e->getVectorSize() != 4)) {
+        return RS_TYPE_NONE;
+    }
+    switch (e->getType()) {
+    case RS_TYPE_UNSIGNED_8:
+    case RS_TYPE_UNSIGNED_16:
+    case RS_TYPE_FLOAT_16:
+    case RS_TYPE_FLOAT_32:
+        return e->getType();
+    default:
+        return RS_TYPE_NONE;
+    }
+}
+
+// Integer colors are normalized to 0..1 on load and clamped on store.
+static inline float4 loadColor(const uint8_t *p, RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_16: {
+        const uint16_t *s = (const uint16_t *)p;
+        return (float4){s[0], s[1], s[2], s[3]} * (1.f / 65535.f);
+    }
+    case RS_TYPE_FLOAT_16: {
+        const uint16_t *s = (const uint16_t *)p;
+        return (float4){rsHalfToFloat(s[0]), rsHalfToFloat(s[1]),
+                        rsHalfToFloat(s[2]), rsHalfToFloat(s[3])};
+    }
+    case RS_TYPE_FLOAT_32:
+        return *(const float4 *)p;
+    default:
+        return convert_float4(*(const uchar4 *)p) * (1.f / 255.f);
+    }
+}
+
+static inline float clampUnit(float v) {
+    return (v < 0.f) ? 0.f : ((v > 1.f) ? 1.f : v);
+}
+
+static inline void storeColor(uint8_t *p, RsDataType dt, float4 v) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_16: {
+        uint16_t *d = (uint16_t *)p;
+        d[0] = (uint16_t)(clampUnit(v.x) * 65535.f + 0.5f);
+        d[1] = (uint16_t)(clampUnit(v.y) * 65535.f + 0.5f);
+        d[2] = (uint16_t)(clampUnit(v.z) * 65535.f + 0.5f);
+        d[3] = (uint16_t)(clampUnit(v.w) * 65535.f + 0.5f);
+        break;
+    }
+    case RS_TYPE_FLOAT_16: {
+        uint16_t *d = (uint16_t *)p;
+        d[0] = rsFloatToHalf(v.x);
+        d[1] = rsFloatToHalf(v.y);
+        d[2] = rsFloatToHalf(v.z);
+        d[3] = rsFloatToHalf(v.w);
+        break;
+    }
+    case RS_TYPE_FLOAT_32:
+        *(float4 *)p = v;
+        break;
+    default:
+        *(uchar4 *)p = (uchar4){(uchar)(clampUnit(v.x) * 255.f + 0.5f),
+                                (uchar)(clampUnit(v.y) * 255.f + 0.5f),
+                                (uchar)(clampUnit(v.z) * 255.f + 0.5f),
+                                (uchar)(clampUnit(v.w) * 255.f + 0.5f)};
+        break;
+    }
+}
+
+// Returns the component type of a 1 to 4 channel element that
+// loadChannels and storeChannels handle, RS_TYPE_NONE otherwise.
+static inline RsDataType getChannelType(const android::renderscript::Element *e,
+                                        uint32_t *vecSize) {
+    if (!e || (e->getVectorSize() < 1) || (e->getVectorSize() > 4)) {
+        return RS_TYPE_NONE;
+    }
+    *vecSize = e->getVectorSize();
+    switch (e->getType()) {
+    case RS_TYPE_UNSIGNED_8:
+    case RS_TYPE_UNSIGNED_16:
+    case RS_TYPE_FLOAT_16:
+    case RS_TYPE_FLOAT_32:
+        return e->getType();
+    default:
+        return RS_TYPE_NONE;
+    }
+}
+
+// Missing channels read as 0, except alpha which reads as 1.
+static inline float4 loadChannels(const uint8_t *p, RsDataType dt, uint32_t vec) {
+    if (vec == 4) {
+        return loadColor(p, dt);
+    }
+    float4 c = {0.f, 0.f, 0.f, 1.f};
+    for (uint32_t ct = 0; ct < vec; ct++) {
+        float v;
+        switch (dt) {
+        case RS_TYPE_UNSIGNED_16:
+            v = ((const uint16_t *)p)[ct] * (1.f / 65535.f);
+            break;
+        case RS_TYPE_FLOAT_16:
+            v = rsHalfToFloat(((const uint16_t *)p)[ct]);
+            break;
+        case RS_TYPE_FLOAT_32:
+            v = ((const float *)p)[ct];
+            break;
+        default:
+            v = p[ct] * (1.f / 255.f);
+            break;
+        }
+        c[ct] = v;
+    }
+    return c;
+}
+
+static inline void storeChannels(uint8_t *p, RsDataType dt, uint32_t vec, float4 c) {
+    if (vec == 4) {
+        storeColor(p, dt, c);
+        return;
+    }
+    for (uint32_t ct = 0; ct < vec; ct++) {
+        float v = c[ct];
+        switch (dt) {
+        case RS_TYPE_UNSIGNED_16:
+            ((uint16_t *)p)[ct] = (uint16_t)(clampUnit(v) * 65535.f + 0.5f);
+            break;
+        case RS_TYPE_FLOAT_16:
+            ((uint16_t *)p)[ct] = rsFloatToHalf(v);
+            break;
+        case RS_TYPE_FLOAT_32:
+            ((float *)p)[ct] = v;
+            break;
+        default:
+            p[ct] = (uchar)(clampUnit(v) * 255.f + 0.5f);
+            break;
+        }
+    }
+}
+
+// Maps coordinate v into 0..dim-1 for the given RsBorderMode.  Returns
+// -1 when the sample takes the constant border color instead.
+static inline int32_t borderCoord(int32_t v, int32_t dim, int32_t mode) {
+    if ((uint32_t)v < (uint32_t)dim) {
+        return v;
+    }
+    switch (mode) {
+    case RS_BORDER_MIRROR: {
+        if (dim == 1) {
+            return 0;
+        }
+        int32_t period = 2 * (dim - 1);
+        v %= period;
+        if (v < 0) {
+            v += period;
+        }
+        return (v < dim) ? v : (period - v);
+    }
+    case RS_BORDER_WRAP:
+        v %= dim;
+        return (v < 0) ? (v + dim) : v;
+    case RS_BORDER_CONSTANT:
+        return -1;
+    default:
+        return (v < 0) ? 0 : (dim - 1);
+    }
+}
 
+// Convolves the N x N neighbourhood centred on (x, y) of a uchar4 image,
+// resolving each tap through borderCoord.  The convolution kernels only
+// use it for the pixels their branch free interior loops can't reach.
+template <int N>
+static inline uchar4 convolveBorderU4(const uchar *pin, size_t stride,
+                                      int32_t dimX, int32_t dimY, int32_t x, int32_t y,
+                                      const float *coeff, int32_t mode, uchar4 color) {
+    const int32_t r = N / 2;
+    const float4 c = convert_float4(color);
+    float4 px = 0.f;
+    for (int32_t dy = 0; dy < N; dy++) {
+        int32_t sy = borderCoord(y + dy - r, dimY, mode);
+        const uchar4 *row = (const uchar4 *)(pin + sy * stride);
+        for (int32_t dx = 0; dx < N; dx++) {
+            int32_t sx = borderCoord(x + dx - r, dimX, mode);
+            float4 v = ((sy < 0) || (sx < 0)) ? c : convert_float4(row[sx]);
+            px += v * coeff[dy * N + dx];
+        }
+    }
+    px = clamp(px, 0.f, 255.f);
+    uchar4 o = {(uchar)px.x, (uchar)px.y, (uchar)px.z, (uchar)px.w};
+    return o;
+}
@@ -0,0 +1,477 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Erode, dilate, open and close, selected by the forEach slot.  The
+// structuring element is either a rectangle of the given radii or a
+// mask; both are applied as min or max filters over horizontal runs so
+// the cost per pixel does not depend on their size.
+class RsdCpuScriptIntrinsicMorphology : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual ~RsdCpuScriptIntrinsicMorphology();
+    RsdCpuScriptIntrinsicMorphology(RsdCpuReferenceImpl *ctx, const Script *s,
+                                    const Element *e);
+
+protected:
+    enum {
+        OP_ERODE = 0,
+        OP_DILATE = 1,
+        OP_OPEN = 2,
+        OP_CLOSE = 3,
+        OP_COUNT = 4
+    };
+
+    enum {
+        PASS_LOAD = 0,
+        PASS_ROWS = 1,
+        PASS_COLUMNS = 2,
+        PASS_MASK = 3
+    };
+
+    // A run of set mask entries on row dy, covering columns lo..hi
+    // relative to the center.
+    struct Segment {
+        int32_t dy;
+        int32_t lo;
+        int32_t hi;
+    };
+
+    ObjectBaseRef<Allocation> mAlloc;
+    int32_t mRadiusX;
+    int32_t mRadiusY;
+
+    // Copied from the mask allocation when it is bound.
+    ObjectBaseRef<Allocation> mMaskAlloc;
+    Segment *mSegments;
+    uint32_t mSegmentCount;
+    // Largest hi - lo of the segments.
+    int32_t mSegmentSpan;
+
+    RsDataType mType;
+    uint32_t mVec;
+    uint32_t mImageDimX;
+    uint32_t mImageDimY;
+    size_t mImageSize;
+    // The kernel stores mImage; the mask pass writes mImageTmp and swaps.
+    float4 *mImage;
+    float4 *mImageTmp;
+    // Dilation rather than erosion for the stage being run.
+    bool mPassMax;
+
+    virtual bool prepare(uint32_t slot);
+    virtual void runPassItem(uint32_t pass, uint32_t item, uint32_t lid);
+    void runStage(bool max);
+    void loadRow(uint32_t y);
+    void filterRow(uint32_t y, uint32_t lid);
+    void filterStrip(uint32_t strip, uint32_t lid);
+    void filterMaskRow(uint32_t y, uint32_t lid);
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+// Columns handed to a worker at a time by the vertical pass.
+static const uint32_t kStripWidth = 64;
+
+template <bool MAX>
+static inline float4 morphOp(float4 a, float4 b) {
+    float4 r;
+    if (MAX) {
+        r.x = rsMax(a.x, b.x);
+        r.y = rsMax(a.y, b.y);
+        r.z = rsMax(a.z, b.z);
+        r.w = rsMax(a.w, b.w);
+    } else {
+        r.x = rsMin(a.x, b.x);
+        r.y = rsMin(a.y, b.y);
+        r.z = rsMin(a.z, b.z);
+        r.w = rsMin(a.w, b.w);
+    }
+    return r;
+}
+
+// van Herk / Gil-Werman: dst[i] is the min (or max) of src[i + lo] ..
+// src[i + hi], with reads clamped to the line.  The padded line is cut
+// into blocks of the window width; a forward and a backward running
+// extremum within each block give any window from two lookups, so every
+// sample costs three comparisons whatever the width.  g and h need
+// count + hi - lo entries each.
+template <bool MAX>
+static void vhgwLine(float4 *dst, const float4 *src, uint32_t count,
+                     int32_t lo, int32_t hi, float4 *g, float4 *h) {
+    const int32_t last = count - 1;
+    const int32_t w = hi - lo + 1;
+    const int32_t m = count + w - 1;
+
+    for (int32_t j = 0; j < m; j++) {
+        float4 v = src[rsMin(rsMax(j + lo, 0), last)];
+        g[j] = (j % w) ? morphOp<MAX>(g[j - 1], v) : v;
+    }
+    for (int32_t j = m - 1; j >= 0; j--) {
+        float4 v = src[rsMin(rsMax(j + lo, 0), last)];
+        h[j] = ((j == m - 1) || !((j + 1) % w)) ? v : morphOp<MAX>(h[j + 1], v);
+    }
+    for (int32_t i = 0; i <= last; i++) {
+        dst[i] = morphOp<MAX>(h[i], g[i + w - 1]);
+    }
+}
+
+static void vhgwLine(bool max, float4 *dst, const float4 *src, uint32_t count,
+                     int32_t lo, int32_t hi, float4 *g, float4 *h) {
+    if (max) {
+        vhgwLine<true>(dst, src, count, lo, hi, g, h);
+    } else {
+        vhgwLine<false>(dst, src, count, lo, hi, g, h);
+    }
+}
+
+void RsdCpuScriptIntrinsicMorphology::setGlobalVar(uint32_t slot, const void *data,
+                                                   size_t dataLength) {
+    rsAssert(slot == 1);
+    rsAssert(dataLength == 8);
+    const int32_t *r = (const int32_t *)data;
+    if ((r[0] < 0) || (r[1] < 0)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Morphology: radius must not be negative");
+        return;
+    }
+    mRadiusX = r[0];
+    mRadiusY = r[1];
+}
+
+void RsdCpuScriptIntrinsicMorphology::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    Allocation *a = static_cast<Allocation *>(data);
+
+    if (slot == 0) {
+        if (a && a->getIsTiled()) {
+            // Rows are read through the row stride.
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "Morphology input must use the linear layout.");
+            return;
+        }
+        mAlloc.set(a);
+        return;
+    }
+
+    rsAssert(slot == 2);
+    delete [] mSegments;
+    mSegments = NULL;
+    mSegmentCount = 0;
+    mSegmentSpan = 0;
+    mMaskAlloc.clear();
+    if (!a) {
+        return;
+    }
+
+    const Element *e = a->getType()->getElement();
+    const uint32_t dimX = a->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = rsMax(a->mHal.drvState.lod[0].dimY, 1u);
+    if ((e->getType() != RS_TYPE_UNSIGNED_8) || (e->getVectorSize() != 1) ||
+        a->getIsTiled() || !(dimX & 1) || !(dimY & 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Morphology mask must be a uchar allocation with odd dimensions.");
+        return;
+    }
+
+    // Split each mask row into runs.  Copied when bound, like the color
+    // pipeline curves.
+    const uint8_t *src = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    const size_t stride = a->mHal.drvState.lod[0].stride;
+    uint32_t count = 0;
+    for (uint32_t y = 0; y < dimY; y++) {
+        const uint8_t *row = src + y * stride;
+        for (uint32_t x = 0; x < dimX; x++) {
+            if (row[x] && (!x || !row[x - 1])) {
+                count++;
+            }
+        }
+    }
+    if (!count) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Morphology mask is empty.");
+        return;
+    }
+
+    mSegments = new Segment[count];
+    for (uint32_t y = 0; y < dimY; y++) {
+        const uint8_t *row = src + y * stride;
+        for (uint32_t x = 0; x < dimX; x++) {
+            if (!row[x] || (x && row[x - 1])) {
+                continue;
+            }
+            Segment *s = &mSegments[mSegmentCount++];
+            s->dy = (int32_t)y - (int32_t)(dimY >> 1);
+            s->lo = (int32_t)x - (int32_t)(dimX >> 1);
+            uint32_t end = x;
+            while (((end + 1) < dimX) && row[end + 1]) {
+                end++;
+            }
+            s->hi = (int32_t)end - (int32_t)(dimX >> 1);
+            mSegmentSpan = rsMax(mSegmentSpan, s->hi - s->lo);
+        }
+    }
+    mMaskAlloc.set(a);
+}
+
+void RsdCpuScriptIntrinsicMorphology::loadRow(uint32_t y) {
+    const uint8_t *pin = (const uint8_t *)mAlloc->mHal.drvState.lod[0].mallocPtr +
+                         y * mAlloc->mHal.drvState.lod[0].stride;
+    const size_t esize = mAlloc->mHal.state.elementSizeBytes;
+    float4 *row = mImage + y * mImageDimX;
+    for (uint32_t x = 0; x < mImageDimX; x++) {
+        row[x] = loadChannels(pin, mType, mVec);
+        pin += esize;
+    }
+}
+
+// Filters row y of mImage horizontally, in place.
+void RsdCpuScriptIntrinsicMorphology::filterRow(uint32_t y, uint32_t lid) {
+    const uint32_t w = mImageDimX;
+    float4 *line = (float4 *)getScratch(lid, (w + (w + 2 * mRadiusX) * 2) * sizeof(float4));
+    float4 *g = line + w;
+    float4 *h = g + w + 2 * mRadiusX;
+    float4 *row = mImage + y * w;
+
+    memcpy(line, row, w * sizeof(float4));
+    vhgwLine(mPassMax, row, line, w, -mRadiusX, mRadiusX, g, h);
+}
+
+// Filters a strip of columns of mImage vertically, in place.
+void RsdCpuScriptIntrinsicMorphology::filterStrip(uint32_t strip, uint32_t lid) {
+    const uint32_t w = mImageDimX;
+    const uint32_t h = mImageDimY;
+    const uint32_t x1 = strip * kStripWidth;
+    const uint32_t x2 = rsMin(x1 + kStripWidth, w);
+    float4 *in = (float4 *)getScratch(lid, (h * 2 + (h + 2 * mRadiusY) * 2) * sizeof(float4));
+    float4 *out = in + h;
+    float4 *g = out + h;
+    float4 *hb = g + h + 2 * mRadiusY;
+
+    for (uint32_t x = x1; x < x2; x++) {
+        for (uint32_t y = 0; y < h; y++) {
+            in[y] = mImage[y * w + x];
+        }
+        vhgwLine(mPassMax, out, in, h, -mRadiusY, mRadiusY, g, hb);
+        for (uint32_t y = 0; y < h; y++) {
+            mImage[y * w + x] = out[y];
+        }
+    }
+}
+
+// Combines the filtered mask runs that cover row y of mImage into row y
+// of mImageTmp.  Dilation uses the mask reflected through its center, so
+// that opening and closing are the usual duals.
+void RsdCpuScriptIntrinsicMorphology::filterMaskRow(uint32_t y, uint32_t lid) {
+    const uint32_t w = mImageDimX;
+    const int32_t span = mSegmentSpan;
+    float4 *line = (float4 *)getScratch(lid, (w + (w + span) * 2) * sizeof(float4));
+    float4 *g = line + w;
+    float4 *h = g + w + span;
+    float4 *out = mImageTmp + y * w;
+
+    for (uint32_t ct = 0; ct < mSegmentCount; ct++) {
+        const Segment *s = &mSegments[ct];
+        const int32_t dy = mPassMax ? -s->dy : s->dy;
+        const int32_t lo = mPassMax ? -s->hi : s->lo;
+        const int32_t hi = mPassMax ? -s->lo : s->hi;
+        int32_t sy = rsMin(rsMax((int32_t)y + dy, 0), (int32_t)mImageDimY - 1);
+        const float4 *src = mImage + sy * w;
+        if (!ct) {
+            vhgwLine(mPassMax, out, src, w, lo, hi, g, h);
+            continue;
+        }
+        vhgwLine(mPassMax, line, src, w, lo, hi, g, h);
+        for (uint32_t x = 0; x < w; x++) {
+            out[x] = mPassMax ? morphOp<true>(out[x], line[x]) : morphOp<false>(out[x], line[x]);
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicMorphology::runPassItem(uint32_t pass, uint32_t item, uint32_t lid) {
+    switch (pass) {
+    case PASS_LOAD:
+        loadRow(item);
+        break;
+    case PASS_ROWS:
+        filterRow(item, lid);
+        break;
+    case PASS_COLUMNS:
+        filterStrip(item, lid);
+        break;
+    default:
+        filterMaskRow(item, lid);
+        break;
+    }
+}
+
+// One erosion (min) or dilation (max) of mImage.
+void RsdCpuScriptIntrinsicMorphology::runStage(bool max) {
+    mPassMax = max;
+    if (mSegments) {
+        runPass(PASS_MASK, mImageDimY);
+        float4 *t = mImage;
+        mImage = mImageTmp;
+        mImageTmp = t;
+        return;
+    }
+    if (mRadiusX) {
+        runPass(PASS_ROWS, mImageDimY);
+    }
+    if (mRadiusY) {
+        runPass(PASS_COLUMNS, (mImageDimX + kStripWidth - 1) / kStripWidth);
+    }
+}
+
+// Loads the input and applies the operation for the slot to the whole
+// image before the launch.
+bool RsdCpuScriptIntrinsicMorphology::prepare(uint32_t slot) {
+    if (slot >= OP_COUNT) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Morphology: unknown operation");
+        return false;
+    }
+    if (!mAlloc.get()) {
+        ALOGE("Morphology executed without input, skipping");
+        return false;
+    }
+    uint32_t inVec = 0;
+    mType = getChannelType(mElement.get(), &mVec);
+    if ((mType == RS_TYPE_NONE) ||
+        (getChannelType(mAlloc->getType()->getElement(), &inVec) != mType) ||
+        (inVec != mVec)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Morphology: input must match the element, of 1 to 4 "
+                "uchar, ushort, half or float channels");
+        return false;
+    }
+
+    mImageDimX = mAlloc->mHal.drvState.lod[0].dimX;
+    mImageDimY = rsMax(mAlloc->mHal.drvState.lod[0].dimY, 1u);
+    size_t size = (size_t)mImageDimX * mImageDimY;
+    if (size > mImageSize) {
+        free(mImage);
+        free(mImageTmp);
+        mImage = (float4 *)malloc(size * sizeof(float4));
+        mImageTmp = (float4 *)malloc(size * sizeof(float4));
+        mImageSize = size;
+        if (!mImage || !mImageTmp) {
+            free(mImage);
+            free(mImageTmp);
+            mImage = NULL;
+            mImageTmp = NULL;
+            mImageSize = 0;
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Morphology: unable to allocate the working image");
+            return false;
+        }
+    }
+
+    runPass(PASS_LOAD, mImageDimY);
+    switch (slot) {
+    case OP_ERODE:
+        runStage(false);
+        break;
+    case OP_DILATE:
+        runStage(true);
+        break;
+    case OP_OPEN:
+        runStage(false);
+        runStage(true);
+        break;
+    case OP_CLOSE:
+        runStage(true);
+        runStage(false);
+        break;
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicMorphology::kernel(const RsForEachStubParamStruct *p,
+                                             uint32_t xstart, uint32_t xend,
+                                             uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicMorphology *cp = (RsdCpuScriptIntrinsicMorphology *)p->usr;
+    if (!cp->mPrepared) {
+        return;
+    }
+    const uint32_t w = cp->mImageDimX;
+    const float4 *row = cp->mImage + rsMin(p->y, cp->mImageDimY - 1) * w;
+    uint8_t *out = (uint8_t *)p->out;
+
+    for (uint32_t x = xstart; x < xend; x++) {
+        storeChannels(out, cp->mType, cp->mVec, row[rsMin(x, w - 1)]);
+        out += outstep;
+    }
+}
+
+RsdCpuScriptIntrinsicMorphology::RsdCpuScriptIntrinsicMorphology(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY) {
+
+    mRootPtr = &kernel;
+    mRadiusX = 1;
+    mRadiusY = 1;
+    mSegments = NULL;
+    mSegmentCount = 0;
+    mSegmentSpan = 0;
+    mType = e->getType();
+    mVec = e->getVectorSize();
+    mImageDimX = 0;
+    mImageDimY = 0;
+    mImageSize = 0;
+    mImage = NULL;
+    mImageTmp = NULL;
+    mPassMax = false;
+}
+
+RsdCpuScriptIntrinsicMorphology::~RsdCpuScriptIntrinsicMorphology() {
+    delete []mSegments;
+    free(mImage);
+    free(mImageTmp);
+}
+
+void RsdCpuScriptIntrinsicMorphology::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicMorphology::invokeFreeChildren() {
+    mAlloc.clear();
+    mMaskAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Morphology(RsdCpuReferenceImpl *ctx, const Script *s,
+                                           const Element *e) {
+
+    return new RsdCpuScriptIntrinsicMorphology(ctx, s, e);
+}
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Converts a uchar4 or float4 RGBA allocation into a YUV allocation.  The
+// script is launched over the YUV output; every row writes its luma and
+// every even row also writes the chroma row shared with the row below,
+// averaging each 2x2 block.
+class RsdCpuScriptIntrinsicRgbToYuv : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicRgbToYuv();
+    RsdCpuScriptIntrinsicRgbToYuv(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    ObjectBaseRef<Allocation> alloc;
+    const Allocation *mOut;
+    int32_t mColorSpace;
+    int32_t mRange;
+
+    // Rows of the matrix with 12 fractional bits, applied to samples in
+    // 8 bit units with 2 extra bits.
+    int32_t mY[3];
+    int32_t mU[3];
+    int32_t mV[3];
+    int32_t mYOffset;
+
+    void updateCoeffs();
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+
+void RsdCpuScriptIntrinsicRgbToYuv::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    alloc.set(static_cast<Allocation *>(data));
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::setGlobalVar(uint32_t slot, const void *data,
+                                                 size_t dataLength) {
+    rsAssert(dataLength == 4);
+    int32_t v = ((const int32_t *)data)[0];
+
+    switch (slot) {
+    case 1:
+        if ((v < RS_YUV_COLOR_SPACE_BT601) || (v > RS_YUV_COLOR_SPACE_BT2020)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "RgbToYuv: unknown color space");
+            return;
+        }
+        mColorSpace = v;
+        break;
+    case 2:
+        if ((v != RS_YUV_RANGE_LIMITED) && (v != RS_YUV_RANGE_FULL)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "RgbToYuv: unknown range");
+            return;
+        }
+        mRange = v;
+        break;
+    default:
+        rsAssert(0);
+        return;
+    }
+    updateCoeffs();
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::updateCoeffs() {
+    float kr, kb;
+    switch (mColorSpace) {
+    case RS_YUV_COLOR_SPACE_BT709:
+        kr = 0.2126f;
+        kb = 0.0722f;
+        break;
+    case RS_YUV_COLOR_SPACE_BT2020:
+        kr = 0.2627f;
+        kb = 0.0593f;
+        break;
+    default:
+        kr = 0.299f;
+        kb = 0.114f;
+        break;
+    }
+    float kg = 1.f - kr - kb;
+
+    float yScale = 1.f;
+    float cScale = 1.f;
+    mYOffset = 0;
+    if (mRange == RS_YUV_RANGE_LIMITED) {
+        yScale = 219.f / 255.f;
+        cScale = 224.f / 255.f;
+        mYOffset = 16;
+    }
+
+    const float one = 4096.f;
+    float us = cScale / (2.f * (1.f - kb));
+    float vs = cScale / (2.f * (1.f - kr));
+    mY[0] = (int32_t)(kr * yScale * one + 0.5f);
+    mY[1] = (int32_t)(kg * yScale * one + 0.5f);
+    mY[2] = (int32_t)(kb * yScale * one + 0.5f);
+    mU[0] = -(int32_t)(kr * us * one + 0.5f);
+    mU[1] = -(int32_t)(kg * us * one + 0.5f);
+    mU[2] = (int32_t)((1.f - kb) * us * one + 0.5f);
+    mV[0] = (int32_t)((1.f - kr) * vs * one + 0.5f);
+    mV[1] = -(int32_t)(kg * vs * one + 0.5f);
+    mV[2] = -(int32_t)(kb * vs * one + 0.5f);
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::invokeForEach(uint32_t slot,
+                                                  const Allocation * ain,
+                                                  Allocation * aout,
+                                                  const void * usr,
+                                                  uint32_t usrLen,
+                                                  const RsScriptCall *sc) {
+    const Allocation *in = alloc.get();
+    if (!in || !aout || !aout->mHal.state.yuv) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "RgbToYuv needs an input and a YUV output");
+        return;
+    }
+    uint32_t inSize = in->mHal.state.elementSizeBytes;
+    if (((inSize != 4) && (inSize != 16)) || in->getIsTiled() || in->getHasFieldPlanes()) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "RgbToYuv input must be a linear uchar4 or float4 allocation");
+        return;
+    }
+    if ((in->mHal.drvState.lod[0].dimX != aout->mHal.drvState.lod[0].dimX) ||
+        (in->mHal.drvState.lod[0].dimY != aout->mHal.drvState.lod[0].dimY)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "RgbToYuv input and output sizes differ");
+        return;
+    }
+
+    mOut = aout;
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+    mOut = NULL;
+}
+
+// Loads one pixel as 8 bit values with 2 fractional bits.
+static inline void loadRgb(const uint8_t *row, uint32_t x, bool isFloat, int32_t *rgb) {
+    if (isFloat) {
+        const float4 *f = (const float4 *)row + x;
+        const float c[3] = {f->x, f->y, f->z};
+        for (int ct = 0; ct < 3; ct++) {
+            float v = c[ct] * 1020.f + 0.5f;
+            rgb[ct] = (v < 0.f) ? 0 : ((v > 1020.f) ? 1020 : (int32_t)v);
+        }
+    } else {
+        const uint8_t *u = row + x * 4;
+        rgb[0] = u[0] << 2;
+        rgb[1] = u[1] << 2;
+        rgb[2] = u[2] << 2;
+    }
+}
+
+static inline int32_t clampSample(int32_t v, int32_t hi) {
+    return (v < 0) ? 0 : ((v > hi) ? hi : v);
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::kernel(const RsForEachStubParamStruct *p,
+                                           uint32_t xstart, uint32_t xend,
+                                           uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicRgbToYuv *cp = (RsdCpuScriptIntrinsicRgbToYuv *)p->usr;
+    const Allocation *in = cp->alloc.get();
+    const Allocation *out = cp->mOut;
+
+    const bool isFloat = (in->mHal.state.elementSizeBytes == 16);
+    const bool wide = (out->mHal.state.yuv == RS_YUV_P010);
+    // P010 keeps 10 bits in the top of each 16 bit sample.
+    const int32_t shift = wide ? 12 : 14;
+    const int32_t maxVal = wide ? 1023 : 255;
+    const int32_t yBias = (cp->mYOffset << 14) + (1 << (shift - 1));
+    const int32_t cBias = (128 << 16) + (1 << (shift + 1));
+
+    const uint32_t dimX = in->mHal.drvState.lod[0].dimX;
+    const uint32_t dimY = in->mHal.drvState.lod[0].dimY;
+    const size_t inStride = in->mHal.drvState.lod[0].stride;
+    const uint8_t *row0 = (const uint8_t *)in->mHal.drvState.lod[0].mallocPtr + p->y * inStride;
+
+    uint8_t *outY = (uint8_t *)p->out;
+    for (uint32_t x = xstart; x < xend; x++) {
+        int32_t rgb[3];
+        loadRgb(row0, x, isFloat, rgb);
+        int32_t y = (cp->mY[0] * rgb[0] + cp->mY[1] * rgb[1] + cp->mY[2] * rgb[2] +
+                     yBias) >> shift;
+        y = clampSample(y, maxVal);
+        if (wide) {
+            ((uint16_t *)outY)[0] = (uint16_t)(y << 6);
+        } else {
+            outY[0] = (uint8_t)y;
+        }
+        outY += outstep;
+    }
+
+    if (p->y & 1) {
+        return;
+    }
+
+    // Chroma for the 2x2 blocks starting on this row.  An odd final row or
+    // column repeats its last pixel.
+    const uint8_t *row1 = row0 + ((p->y + 1 < dimY) ? inStride : 0);
+    const uint32_t cy = p->y >> 1;
+    uint8_t *u;
+    uint8_t *v;
+    uint32_t cStep;
+    switch (out->mHal.state.yuv) {
+    case RS_YUV_YV12:
+    case RS_YUV_I420:
+        u = (uint8_t *)out->mHal.drvState.lod[1].mallocPtr + cy * out->mHal.drvState.lod[1].stride;
+        v = (uint8_t *)out->mHal.drvState.lod[2].mallocPtr + cy * out->mHal.drvState.lod[2].stride;
+        cStep = 1;
+        break;
+    case RS_YUV_NV12:
+        u = (uint8_t *)out->mHal.drvState.lod[1].mallocPtr + cy * out->mHal.drvState.lod[1].stride;
+        v = u + 1;
+        cStep = 2;
+        break;
+    case RS_YUV_P010:
+        u = (uint8_t *)out->mHal.drvState.lod[1].mallocPtr + cy * out->mHal.drvState.lod[1].stride;
+        v = u + 2;
+        cStep = 4;
+        break;
+    default:
+        v = (uint8_t *)out->mHal.drvState.lod[1].mallocPtr + cy * out->mHal.drvState.lod[1].stride;
+        u = v + 1;
+        cStep = 2;
+        break;
+    }
+
+    for (uint32_t cx = xstart >> 1; cx < ((xend + 1) >> 1); cx++) {
+        uint32_t x0 = cx << 1;
+        uint32_t x1 = rsMin(x0 + 1, dimX - 1);
+        int32_t sum[3] = {0, 0, 0};
+        int32_t rgb[3];
+        loadRgb(row0, x0, isFloat, rgb);
+        sum[0] += rgb[0]; sum[1] += rgb[1]; sum[2] += rgb[2];
+        loadRgb(row0, x1, isFloat, rgb);
+        sum[0] += rgb[0]; sum[1] += rgb[1]; sum[2] += rgb[2];
+        loadRgb(row1, x0, isFloat, rgb);
+        sum[0] += rgb[0]; sum[1] += rgb[1]; sum[2] += rgb[2];
+        loadRgb(row1, x1, isFloat, rgb);
+        sum[0] += rgb[0]; sum[1] += rgb[1]; sum[2] += rgb[2];
+
+        int32_t cu = (cp->mU[0] * sum[0] + cp->mU[1] * sum[1] + cp->mU[2] * sum[2] +
+                      cBias) >> (shift + 2);
+        int32_t cv = (cp->mV[0] * sum[0] + cp->mV[1] * sum[1] + cp->mV[2] * sum[2] +
+                      cBias) >> (shift + 2);
+        cu = clampSample(cu, maxVal);
+        cv = clampSample(cv, maxVal);
+        if (wide) {
+            ((uint16_t *)(u + cx * cStep))[0] = (uint16_t)(cu << 6);
+            ((uint16_t *)(v + cx * cStep))[0] = (uint16_t)(cv << 6);
+        } else {
+            u[cx * cStep] = (uint8_t)cu;
+            v[cx * cStep] = (uint8_t)cv;
+        }
+    }
+}
+
+RsdCpuScriptIntrinsicRgbToYuv::RsdCpuScriptIntrinsicRgbToYuv(
+            RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV) {
+
+    mRootPtr = &kernel;
+    mOut = NULL;
+    mColorSpace = RS_YUV_COLOR_SPACE_BT601;
+    mRange = RS_YUV_RANGE_LIMITED;
+    updateCoeffs();
+}
+
+RsdCpuScriptIntrinsicRgbToYuv::~RsdCpuScriptIntrinsicRgbToYuv() {
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicRgbToYuv::invokeFreeChildren() {
+    alloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_RgbToYuv(RsdCpuReferenceImpl *ctx,
+                                         const Script *s, const Element *e) {
+    return new RsdCpuScriptIntrinsicRgbToYuv(ctx, s, e);
+}
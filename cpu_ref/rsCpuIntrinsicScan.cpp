@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Prefix sum, min or max of the scalar allocation bound to slot 0.
+// forEach slot 0 scans each row, slot 1 builds the 2D integral image.
+// The element the script is created with is the output and accumulator
+// type: int, uint, long, ulong, float or double.
+class RsdCpuScriptIntrinsicScan : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicScan();
+    RsdCpuScriptIntrinsicScan(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    enum {
+        // Reduces one block of a row into mBlockSums.
+        PASS_REDUCE = 0,
+        // Turns the block reductions of a row into carries; run serially.
+        PASS_CARRY = 1,
+        // Scans one block of a row into mWork.
+        PASS_ROWS = 2,
+        // Scans a strip of columns of mWork in place.
+        PASS_COLUMNS = 3
+    };
+
+    typedef void (*ItemFn)(RsdCpuScriptIntrinsicScan *cp, uint32_t item, uint32_t pass);
+
+    ObjectBaseRef<Allocation> mAlloc;
+    int32_t mOp;
+    bool mExclusive;
+
+    RsDataType mInType;
+    size_t mInSize;
+    size_t mOutSize;
+    uint32_t mDimX;
+    uint32_t mDimY;
+    // Rows are cut into mBlocks blocks of mBlockSize elements.
+    uint32_t mBlocks;
+    uint32_t mBlockSize;
+    ItemFn mItemFn;
+
+    // The scanned image in the output layout, stored by the kernel.
+    uint8_t *mWork;
+    size_t mWorkSize;
+    uint8_t *mBlockSums;
+    size_t mBlockSumsSize;
+
+    virtual bool prepare(uint32_t slot);
+    virtual void runPassItem(uint32_t pass, uint32_t item, uint32_t lid);
+
+    template <typename T, uint32_t OP>
+    static void runItem(RsdCpuScriptIntrinsicScan *cp, uint32_t item, uint32_t pass);
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+// Rows shorter than this are not split across workers.
+static const uint32_t kMinBlockSize = 4096;
+// Columns handed to a worker at a time by the column pass.
+static const uint32_t kStripWidth = 64;
+
+// Signed sums wrap like the unsigned ones instead of overflowing.
+static inline int32_t scanAdd(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+static inline uint32_t scanAdd(uint32_t a, uint32_t b) {
+    return a + b;
+}
+static inline int64_t scanAdd(int64_t a, int64_t b) {
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+static inline uint64_t scanAdd(uint64_t a, uint64_t b) {
+    return a + b;
+}
+static inline float scanAdd(float a, float b) {
+    return a + b;
+}
+static inline double scanAdd(double a, double b) {
+    return a + b;
+}
+
+template <typename T> struct ScanLimits;
+template <> struct ScanLimits<int32_t> {
+    static int32_t lowest() { return (int32_t)0x80000000; }
+    static int32_t highest() { return 0x7fffffff; }
+};
+template <> struct ScanLimits<uint32_t> {
+    static uint32_t lowest() { return 0; }
+    static uint32_t highest() { return 0xffffffff; }
+};
+template <> struct ScanLimits<int64_t> {
+    static int64_t lowest() { return (int64_t)0x8000000000000000ULL; }
+    static int64_t highest() { return 0x7fffffffffffffffLL; }
+};
+template <> struct ScanLimits<uint64_t> {
+    static uint64_t lowest() { return 0; }
+    static uint64_t highest() { return 0xffffffffffffffffULL; }
+};
+template <> struct ScanLimits<float> {
+    static float lowest() { return -HUGE_VALF; }
+    static float highest() { return HUGE_VALF; }
+};
+template <> struct ScanLimits<double> {
+    static double lowest() { return -HUGE_VAL; }
+    static double highest() { return HUGE_VAL; }
+};
+
+template <typename T, uint32_t OP>
+static inline T scanIdentity() {
+    switch (OP) {
+    case RS_SCAN_OP_MIN:
+        return ScanLimits<T>::highest();
+    case RS_SCAN_OP_MAX:
+        return ScanLimits<T>::lowest();
+    default:
+        return 0;
+    }
+}
+
+template <typename T, uint32_t OP>
+static inline T scanCombine(T a, T b) {
+    switch (OP) {
+    case RS_SCAN_OP_MIN:
+        return (b < a) ? b : a;
+    case RS_SCAN_OP_MAX:
+        return (b > a) ? b : a;
+    default:
+        return scanAdd(a, b);
+    }
+}
+
+template <typename T>
+static inline T loadScalar(const uint8_t *p, RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_8:
+        return (T)*(const int8_t *)p;
+    case RS_TYPE_UNSIGNED_16:
+        return (T)*(const uint16_t *)p;
+    case RS_TYPE_SIGNED_16:
+        return (T)*(const int16_t *)p;
+    case RS_TYPE_UNSIGNED_32:
+        return (T)*(const uint32_t *)p;
+    case RS_TYPE_SIGNED_32:
+        return (T)*(const int32_t *)p;
+    case RS_TYPE_UNSIGNED_64:
+        return (T)*(const uint64_t *)p;
+    case RS_TYPE_SIGNED_64:
+        return (T)*(const int64_t *)p;
+    case RS_TYPE_FLOAT_32:
+        return (T)*(const float *)p;
+    case RS_TYPE_FLOAT_64:
+        return (T)*(const double *)p;
+    default:
+        return (T)*p;
+    }
+}
+
+// Returns the size of a scalar the scan can read, 0 otherwise.
+static size_t getInputSize(RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_8:
+    case RS_TYPE_UNSIGNED_8:
+        return 1;
+    case RS_TYPE_SIGNED_16:
+    case RS_TYPE_UNSIGNED_16:
+        return 2;
+    case RS_TYPE_SIGNED_32:
+    case RS_TYPE_UNSIGNED_32:
+    case RS_TYPE_FLOAT_32:
+        return 4;
+    case RS_TYPE_SIGNED_64:
+    case RS_TYPE_UNSIGNED_64:
+    case RS_TYPE_FLOAT_64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+template <typename T, uint32_t OP>
+void RsdCpuScriptIntrinsicScan::runItem(RsdCpuScriptIntrinsicScan *cp, uint32_t item,
+                                        uint32_t pass) {
+    const uint32_t w = cp->mDimX;
+    T *sums = (T *)cp->mBlockSums;
+    T *work = (T *)cp->mWork;
+
+    if (pass == PASS_CARRY) {
+        T *s = sums + item * cp->mBlocks;
+        T carry = scanIdentity<T, OP>();
+        for (uint32_t b = 0; b < cp->mBlocks; b++) {
+            T t = s[b];
+            s[b] = carry;
+            carry = scanCombine<T, OP>(carry, t);
+        }
+        return;
+    }
+
+    if (pass == PASS_COLUMNS) {
+        const uint32_t x1 = item * kStripWidth;
+        const uint32_t lanes = rsMin(kStripWidth, w - x1);
+        T carry[kStripWidth];
+        for (uint32_t l = 0; l < lanes; l++) {
+            carry[l] = scanIdentity<T, OP>();
+        }
+        for (uint32_t y = 0; y < cp->mDimY; y++) {
+            T *row = work + y * w + x1;
+            for (uint32_t l = 0; l < lanes; l++) {
+                if (cp->mExclusive) {
+                    T t = row[l];
+                    row[l] = carry[l];
+                    carry[l] = scanCombine<T, OP>(carry[l], t);
+                } else {
+                    carry[l] = scanCombine<T, OP>(carry[l], row[l]);
+                    row[l] = carry[l];
+                }
+            }
+        }
+        return;
+    }
+
+    const uint32_t y = item / cp->mBlocks;
+    const uint32_t x1 = (item % cp->mBlocks) * cp->mBlockSize;
+    const uint32_t x2 = rsMin(x1 + cp->mBlockSize, w);
+    const RsDataType dt = cp->mInType;
+    const size_t esize = cp->mInSize;
+    const uint8_t *in = (const uint8_t *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr +
+                        y * cp->mAlloc->mHal.drvState.lod[0].stride + x1 * esize;
+
+    if (pass == PASS_REDUCE) {
+        T acc = scanIdentity<T, OP>();
+        for (uint32_t x = x1; x < x2; x++) {
+            acc = scanCombine<T, OP>(acc, loadScalar<T>(in, dt));
+            in += esize;
+        }
+        sums[item] = acc;
+        return;
+    }
+
+    T carry = (cp->mBlocks > 1) ? sums[item] : scanIdentity<T, OP>();
+    T *out = work + y * w;
+    if (cp->mExclusive) {
+        for (uint32_t x = x1; x < x2; x++) {
+            out[x] = carry;
+            carry = scanCombine<T, OP>(carry, loadScalar<T>(in, dt));
+            in += esize;
+        }
+    } else {
+        for (uint32_t x = x1; x < x2; x++) {
+            carry = scanCombine<T, OP>(carry, loadScalar<T>(in, dt));
+            out[x] = carry;
+            in += esize;
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicScan::setGlobalVar(uint32_t slot, const void *data,
+                                             size_t dataLength) {
+    rsAssert(dataLength == 4);
+    int32_t v = ((const int32_t *)data)[0];
+
+    switch (slot) {
+    case 1:
+        if ((v < RS_SCAN_OP_SUM) || (v > RS_SCAN_OP_MAX)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Scan: unknown operation");
+            return;
+        }
+        mOp = v;
+        break;
+    case 2:
+        mExclusive = (v != 0);
+        break;
+    default:
+        rsAssert(0);
+        return;
+    }
+}
+
+void RsdCpuScriptIntrinsicScan::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    rsAssert(slot == 0);
+    Allocation *a = static_cast<Allocation *>(data);
+    if (a && a->getIsTiled()) {
+        // Rows are read through the row stride.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Scan input must use the linear layout.");
+        return;
+    }
+    mAlloc.set(a);
+}
+
+void RsdCpuScriptIntrinsicScan::runPassItem(uint32_t pass, uint32_t item, uint32_t lid) {
+    mItemFn(this, item, pass);
+}
+
+#define SCAN_ITEM_FNS(T) \
+    {&runItem<T, RS_SCAN_OP_SUM>, &runItem<T, RS_SCAN_OP_MIN>, &runItem<T, RS_SCAN_OP_MAX>}
+
+// Scans the input into mWork before the launch.  Rows that are too few
+// to keep every worker busy are cut into blocks: each block is reduced
+// in parallel, the block results are scanned serially, and each block is
+// then scanned in parallel starting from its carry.
+bool RsdCpuScriptIntrinsicScan::prepare(uint32_t slot) {
+    static const ItemFn fns[6][3] = {
+        SCAN_ITEM_FNS(int32_t),
+        SCAN_ITEM_FNS(uint32_t),
+        SCAN_ITEM_FNS(int64_t),
+        SCAN_ITEM_FNS(uint64_t),
+        SCAN_ITEM_FNS(float),
+        SCAN_ITEM_FNS(double)
+    };
+
+    if (slot > 1) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "Scan: unknown kernel");
+        return false;
+    }
+    if (!mAlloc.get()) {
+        ALOGE("Scan executed without input, skipping");
+        return false;
+    }
+
+    const Element *ie = mAlloc->getType()->getElement();
+    const Element *oe = mElement.get();
+    mInType = ie->getType();
+    mInSize = getInputSize(mInType);
+    bool floatIn = (mInType == RS_TYPE_FLOAT_32) || (mInType == RS_TYPE_FLOAT_64);
+
+    int type = -1;
+    if (oe->getVectorSize() == 1) {
+        switch (oe->getType()) {
+        case RS_TYPE_SIGNED_32:
+            type = 0;
+            break;
+        case RS_TYPE_UNSIGNED_32:
+            type = 1;
+            break;
+        case RS_TYPE_SIGNED_64:
+            type = 2;
+            break;
+        case RS_TYPE_UNSIGNED_64:
+            type = 3;
+            break;
+        case RS_TYPE_FLOAT_32:
+            type = 4;
+            break;
+        case RS_TYPE_FLOAT_64:
+            type = 5;
+            break;
+        default:
+            break;
+        }
+    }
+    if ((type < 0) || !mInSize || (ie->getVectorSize() != 1) || (floatIn && (type < 4))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Scan: the input must be a scalar and the element an int, uint, "
+                "long, ulong, float or double; float inputs need a float element");
+        return false;
+    }
+    mItemFn = fns[type][mOp];
+    mOutSize = oe->getSizeBytes();
+
+    mDimX = mAlloc->mHal.drvState.lod[0].dimX;
+    mDimY = rsMax(mAlloc->mHal.drvState.lod[0].dimY, 1u);
+    size_t size = (size_t)mDimX * mDimY * mOutSize;
+    if (size > mWorkSize) {
+        free(mWork);
+        mWork = (uint8_t *)malloc(size);
+        mWorkSize = mWork ? size : 0;
+        if (!mWork) {
+            mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                         "Scan: unable to allocate the working image");
+            return false;
+        }
+    }
+
+    const uint32_t threads = mCtx->getThreadCount();
+    mBlocks = 1;
+    mBlockSize = mDimX;
+    if (mDimY < threads) {
+        uint32_t perRow = (threads * 4 + mDimY - 1) / mDimY;
+        mBlockSize = rsMax(kMinBlockSize, (mDimX + perRow - 1) / perRow);
+        mBlocks = (mDimX + mBlockSize - 1) / mBlockSize;
+    }
+
+    if (mBlocks > 1) {
+        size_t sumsSize = (size_t)mBlocks * mDimY * mOutSize;
+        if (sumsSize > mBlockSumsSize) {
+            free(mBlockSums);
+            mBlockSums = (uint8_t *)malloc(sumsSize);
+            mBlockSumsSize = mBlockSums ? sumsSize : 0;
+            if (!mBlockSums) {
+                mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                             "Scan: unable to allocate the block sums");
+                return false;
+            }
+        }
+        runPass(PASS_REDUCE, mBlocks * mDimY);
+        for (uint32_t y = 0; y < mDimY; y++) {
+            mItemFn(this, y, PASS_CARRY);
+        }
+    }
+    runPass(PASS_ROWS, mBlocks * mDimY);
+    if (slot == 1) {
+        runPass(PASS_COLUMNS, (mDimX + kStripWidth - 1) / kStripWidth);
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicScan::kernel(const RsForEachStubParamStruct *p,
+                                       uint32_t xstart, uint32_t xend,
+                                       uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicScan *cp = (RsdCpuScriptIntrinsicScan *)p->usr;
+    // prepare() has already reported any failure.
+    if (!cp->mPrepared || (p->y >= cp->mDimY) || (xstart >= cp->mDimX)) {
+        return;
+    }
+    xend = rsMin(xend, cp->mDimX);
+    const uint8_t *row = cp->mWork + ((size_t)p->y * cp->mDimX + xstart) * cp->mOutSize;
+    memcpy(p->out, row, (xend - xstart) * cp->mOutSize);
+}
+
+void RsdCpuScriptIntrinsicScan::invokeForEach(uint32_t slot,
+                                              const Allocation * ain,
+                                              Allocation * aout,
+                                              const void * usr,
+                                              uint32_t usrLen,
+                                              const RsScriptCall *sc) {
+    const Element *oe = aout ? aout->getType()->getElement() : NULL;
+    if (!oe || (oe->getType() != mElement->getType()) || (oe->getVectorSize() != 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Scan: the output must match the script element");
+        return;
+    }
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+}
+
+RsdCpuScriptIntrinsicScan::RsdCpuScriptIntrinsicScan(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_SCAN) {
+
+    mRootPtr = &kernel;
+    mOp = RS_SCAN_OP_SUM;
+    mExclusive = false;
+    mInType = RS_TYPE_NONE;
+    mInSize = 0;
+    mOutSize = e->getSizeBytes();
+    mDimX = 0;
+    mDimY = 0;
+    mBlocks = 1;
+    mBlockSize = 0;
+    mItemFn = NULL;
+    mWork = NULL;
+    mWorkSize = 0;
+    mBlockSums = NULL;
+    mBlockSumsSize = 0;
+}
+
+RsdCpuScriptIntrinsicScan::~RsdCpuScriptIntrinsicScan() {
+    free(mWork);
+    free(mBlockSums);
+}
+
+void RsdCpuScriptIntrinsicScan::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 3;
+}
+
+void RsdCpuScriptIntrinsicScan::invokeFreeChildren() {
+    mAlloc.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Scan(RsdCpuReferenceImpl *ctx, const Script *s,
+                                     const Element *e) {
+
+    return new RsdCpuScriptIntrinsicScan(ctx, s, e);
+}
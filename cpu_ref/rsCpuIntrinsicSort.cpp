@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "rsCpuIntrinsic.h"
+#include "rsCpuIntrinsicInlines.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+namespace android {
+namespace renderscript {
+
+
+// Stable ascending sort of the 1D key allocation bound to slot 0 into
+// the output, which may be the same allocation.  A payload bound to
+// slot 1 is reordered in place along with the keys.  Keys are uint,
+// int, float, ulong, long or double, matching the script element.
+class RsdCpuScriptIntrinsicSort : public RsdCpuScriptIntrinsic {
+public:
+    virtual void populateScript(Script *);
+    virtual void invokeFreeChildren();
+
+    virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
+
+    virtual ~RsdCpuScriptIntrinsicSort();
+    RsdCpuScriptIntrinsicSort(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
+
+protected:
+    enum {
+        // Encodes the keys into mKeys[0] and numbers them.
+        PASS_LOAD = 0,
+        // Counts the digits of a range into its histogram.
+        PASS_HISTOGRAM = 1,
+        // Moves a range to the offsets in its histogram.
+        PASS_SCATTER = 2,
+        // Gathers the payload through the sorted indices.
+        PASS_PAYLOAD = 3
+    };
+
+    typedef void (*ChunkFn)(RsdCpuScriptIntrinsicSort *cp, uint32_t idx, uint32_t pass);
+
+    ObjectBaseRef<Allocation> mAlloc;
+    ObjectBaseRef<Allocation> mPayload;
+
+    RsDataType mKeyType;
+    size_t mKeySize;
+    uint32_t mCount;
+    // The keys are cut into one range per worker.
+    uint32_t mThreads;
+    ChunkFn mChunkFn;
+
+    // Keys encoded so their unsigned order is the sort order, and the
+    // original position of each, double buffered.  mCur is the buffer
+    // holding the latest pass.
+    uint8_t *mKeys[2];
+    uint32_t *mIndex[2];
+    size_t mBufferCount;
+    uint32_t mCur;
+    uint32_t mShift;
+    // 256 counts, then offsets, per range.
+    uint32_t *mHist;
+    // Copy of the payload read by PASS_PAYLOAD.
+    uint8_t *mPayloadCopy;
+    size_t mPayloadCopySize;
+
+    virtual bool prepare(uint32_t slot);
+    virtual void runPassItem(uint32_t pass, uint32_t item, uint32_t lid);
+    bool reserve(size_t count, bool index);
+
+    template <typename K>
+    static void runChunk(RsdCpuScriptIntrinsicSort *cp, uint32_t idx, uint32_t pass);
+
+    static void kernel(const RsForEachStubParamStruct *p,
+                       uint32_t xstart, uint32_t xend,
+                       uint32_t instep, uint32_t outstep);
+};
+
+}
+}
+
+// Maps keys to unsigned values with the same order: the sign bit of
+// integers is flipped, and negative floats have every bit flipped.
+static inline uint32_t encodeKey32(uint32_t v, RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_32:
+        return v ^ 0x80000000;
+    case RS_TYPE_FLOAT_32:
+        return (v & 0x80000000) ? ~v : (v ^ 0x80000000);
+    default:
+        return v;
+    }
+}
+
+static inline uint32_t decodeKey32(uint32_t k, RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_SIGNED_32:
+        return k ^ 0x80000000;
+    case RS_TYPE_FLOAT_32:
+        return (k & 0x80000000) ? (k ^ 0x80000000) : ~k;
+    default:
+        return k;
+    }
+}
+
+static inline uint64_t encodeKey64(uint64_t v, RsDataType dt) {
+    const uint64_t sign = 0x8000000000000000ULL;
+    switch (dt) {
+    case RS_TYPE_SIGNED_64:
+        return v ^ sign;
+    case RS_TYPE_FLOAT_64:
+        return (v & sign) ? ~v : (v ^ sign);
+    default:
+        return v;
+    }
+}
+
+static inline uint64_t decodeKey64(uint64_t k, RsDataType dt) {
+    const uint64_t sign = 0x8000000000000000ULL;
+    switch (dt) {
+    case RS_TYPE_SIGNED_64:
+        return k ^ sign;
+    case RS_TYPE_FLOAT_64:
+        return (k & sign) ? (k ^ sign) : ~k;
+    default:
+        return k;
+    }
+}
+
+// Returns the size of a key type the sort handles, 0 otherwise.
+static size_t getKeySize(RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_32:
+    case RS_TYPE_SIGNED_32:
+    case RS_TYPE_FLOAT_32:
+        return 4;
+    case RS_TYPE_UNSIGNED_64:
+    case RS_TYPE_SIGNED_64:
+    case RS_TYPE_FLOAT_64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static inline uint32_t encodeKey(uint32_t v, RsDataType dt) {
+    return encodeKey32(v, dt);
+}
+
+static inline uint64_t encodeKey(uint64_t v, RsDataType dt) {
+    return encodeKey64(v, dt);
+}
+
+template <typename K>
+void RsdCpuScriptIntrinsicSort::runChunk(RsdCpuScriptIntrinsicSort *cp, uint32_t idx,
+                                         uint32_t pass) {
+    // Each range is contiguous and scattered in order, so the sort is stable.
+    const uint32_t x1 = (uint32_t)(((uint64_t)cp->mCount * idx) / cp->mThreads);
+    const uint32_t x2 = (uint32_t)(((uint64_t)cp->mCount * (idx + 1)) / cp->mThreads);
+    uint32_t *hist = cp->mHist + idx * 256;
+    const K *keys = (const K *)cp->mKeys[cp->mCur];
+    const uint32_t *index = cp->mIndex[cp->mCur];
+
+    switch (pass) {
+    case PASS_LOAD: {
+        const K *src = (const K *)cp->mAlloc->mHal.drvState.lod[0].mallocPtr;
+        K *dst = (K *)cp->mKeys[0];
+        for (uint32_t x = x1; x < x2; x++) {
+            dst[x] = encodeKey(src[x], cp->mKeyType);
+        }
+        if (cp->mIndex[0]) {
+            for (uint32_t x = x1; x < x2; x++) {
+                cp->mIndex[0][x] = x;
+            }
+        }
+        break;
+    }
+    case PASS_HISTOGRAM:
+        memset(hist, 0, 256 * sizeof(uint32_t));
+        for (uint32_t x = x1; x < x2; x++) {
+            hist[(keys[x] >> cp->mShift) & 0xff]++;
+        }
+        break;
+    case PASS_SCATTER: {
+        K *dstKeys = (K *)cp->mKeys[cp->mCur ^ 1];
+        uint32_t *dstIndex = cp->mIndex[cp->mCur ^ 1];
+        if (dstIndex) {
+            for (uint32_t x = x1; x < x2; x++) {
+                uint32_t o = hist[(keys[x] >> cp->mShift) & 0xff]++;
+                dstKeys[o] = keys[x];
+                dstIndex[o] = index[x];
+            }
+        } else {
+            for (uint32_t x = x1; x < x2; x++) {
+                dstKeys[hist[(keys[x] >> cp->mShift) & 0xff]++] = keys[x];
+            }
+        }
+        break;
+    }
+    case PASS_PAYLOAD: {
+        const size_t esize = cp->mPayload->mHal.state.elementSizeBytes;
+        uint8_t *dst = (uint8_t *)cp->mPayload->mHal.drvState.lod[0].mallocPtr;
+        for (uint32_t x = x1; x < x2; x++) {
+            memcpy(dst + x * esize, cp->mPayloadCopy + index[x] * esize, esize);
+        }
+        break;
+    }
+    }
+}
+
+void RsdCpuScriptIntrinsicSort::setGlobalObj(uint32_t slot, ObjectBase *data) {
+    Allocation *a = static_cast<Allocation *>(data);
+    if (a && (a->getIsTiled() || a->getHasFieldPlanes() ||
+              (a->mHal.drvState.lod[0].dimY > 1))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Sort keys and payload must be linear 1D allocations.");
+        return;
+    }
+
+    switch (slot) {
+    case 0:
+        mAlloc.set(a);
+        break;
+    case 1:
+        mPayload.set(a);
+        break;
+    default:
+        rsAssert(0);
+        return;
+    }
+}
+
+void RsdCpuScriptIntrinsicSort::runPassItem(uint32_t pass, uint32_t item, uint32_t lid) {
+    mChunkFn(this, item, pass);
+}
+
+bool RsdCpuScriptIntrinsicSort::reserve(size_t count, bool index) {
+    if (count > mBufferCount) {
+        for (int ct = 0; ct < 2; ct++) {
+            free(mKeys[ct]);
+            free(mIndex[ct]);
+            mKeys[ct] = NULL;
+            mIndex[ct] = NULL;
+        }
+        mBufferCount = 0;
+        for (int ct = 0; ct < 2; ct++) {
+            mKeys[ct] = (uint8_t *)malloc(count * sizeof(uint64_t));
+            if (!mKeys[ct]) {
+                return false;
+            }
+        }
+        mBufferCount = count;
+    }
+    for (int ct = 0; ct < 2; ct++) {
+        if (index && !mIndex[ct]) {
+            mIndex[ct] = (uint32_t *)malloc(mBufferCount * sizeof(uint32_t));
+            if (!mIndex[ct]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// LSD radix sort, 8 bits per pass.  The digits of each range are counted
+// in parallel; the counts are turned into per range offsets serially, in
+// digit then range order, and the ranges are then scattered in parallel.
+// Passes where every key has the same digit are skipped.  Sorts into
+// mKeys[mCur] before the launch.
+bool RsdCpuScriptIntrinsicSort::prepare(uint32_t slot) {
+    if (!mAlloc.get()) {
+        ALOGE("Sort executed without keys, skipping");
+        return false;
+    }
+
+    const Element *e = mAlloc->getType()->getElement();
+    if (!mKeySize || (mElement->getVectorSize() != 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "Sort: the element must be a uint, int, float, ulong, long or double");
+        return false;
+    }
+    if ((e->getType() != mKeyType) || (e->getVectorSize() != 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Sort: the keys must match the script element");
+        return false;
+    }
+    const uint32_t count = mAlloc->mHal.drvState.lod[0].dimX;
+    if (mPayload.get() && (mPayload->mHal.drvState.lod[0].dimX != count)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Sort: the payload must have one entry per key");
+        return false;
+    }
+
+    const bool index = (mPayload.get() != NULL);
+    if (!reserve(count, index)) {
+        mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                     "Sort: unable to allocate the sort buffers");
+        return false;
+    }
+    if (index) {
+        size_t size = (size_t)count * mPayload->mHal.state.elementSizeBytes;
+        if (size > mPayloadCopySize) {
+            free(mPayloadCopy);
+            mPayloadCopy = (uint8_t *)malloc(size);
+            mPayloadCopySize = mPayloadCopy ? size : 0;
+            if (!mPayloadCopy) {
+                mCtx->getContext()->setError(RS_ERROR_OUT_OF_MEMORY,
+                                             "Sort: unable to copy the payload");
+                return false;
+            }
+        }
+    }
+
+    mCount = count;
+    mCur = 0;
+    runPass(PASS_LOAD, mThreads);
+    for (mShift = 0; mShift < mKeySize * 8; mShift += 8) {
+        runPass(PASS_HISTOGRAM, mThreads);
+
+        uint32_t offset = 0;
+        bool skip = false;
+        for (uint32_t d = 0; d < 256; d++) {
+            uint32_t total = 0;
+            for (uint32_t t = 0; t < mThreads; t++) {
+                uint32_t c = mHist[t * 256 + d];
+                mHist[t * 256 + d] = offset + total;
+                total += c;
+            }
+            if (total == mCount) {
+                skip = true;
+                break;
+            }
+            offset += total;
+        }
+        if (skip) {
+            continue;
+        }
+        runPass(PASS_SCATTER, mThreads);
+        mCur ^= 1;
+    }
+
+    if (index) {
+        memcpy(mPayloadCopy, mPayload->mHal.drvState.lod[0].mallocPtr,
+               (size_t)mCount * mPayload->mHal.state.elementSizeBytes);
+        runPass(PASS_PAYLOAD, mThreads);
+    }
+    return true;
+}
+
+void RsdCpuScriptIntrinsicSort::kernel(const RsForEachStubParamStruct *p,
+                                       uint32_t xstart, uint32_t xend,
+                                       uint32_t instep, uint32_t outstep) {
+    RsdCpuScriptIntrinsicSort *cp = (RsdCpuScriptIntrinsicSort *)p->usr;
+    if (!cp->mPrepared) {
+        return;
+    }
+    xend = rsMin(xend, cp->mCount);
+    if (cp->mKeySize == 4) {
+        const uint32_t *keys = (const uint32_t *)cp->mKeys[cp->mCur];
+        uint32_t *out = (uint32_t *)p->out;
+        for (uint32_t x = xstart; x < xend; x++) {
+            *out++ = decodeKey32(keys[x], cp->mKeyType);
+        }
+    } else {
+        const uint64_t *keys = (const uint64_t *)cp->mKeys[cp->mCur];
+        uint64_t *out = (uint64_t *)p->out;
+        for (uint32_t x = xstart; x < xend; x++) {
+            *out++ = decodeKey64(keys[x], cp->mKeyType);
+        }
+    }
+}
+
+void RsdCpuScriptIntrinsicSort::invokeForEach(uint32_t slot,
+                                              const Allocation * ain,
+                                              Allocation * aout,
+                                              const void * usr,
+                                              uint32_t usrLen,
+                                              const RsScriptCall *sc) {
+    const Element *oe = aout ? aout->getType()->getElement() : NULL;
+    if (!oe || (oe->getType() != mKeyType) || (oe->getVectorSize() != 1)) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "Sort: the output must match the script element");
+        return;
+    }
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+}
+
+RsdCpuScriptIntrinsicSort::RsdCpuScriptIntrinsicSort(RsdCpuReferenceImpl *ctx,
+                                                     const Script *s, const Element *e)
+            : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_SORT) {
+
+    mRootPtr = &kernel;
+    mKeyType = e->getType();
+    mKeySize = getKeySize(mKeyType);
+    mChunkFn = (mKeySize == 8) ? &runChunk<uint64_t> : &runChunk<uint32_t>;
+
+    mCount = 0;
+    mThreads = mCtx->getThreadCount();
+    for (int ct = 0; ct < 2; ct++) {
+        mKeys[ct] = NULL;
+        mIndex[ct] = NULL;
+    }
+    mBufferCount = 0;
+    mCur = 0;
+    mShift = 0;
+    mHist = new uint32_t[mThreads * 256];
+    mPayloadCopy = NULL;
+    mPayloadCopySize = 0;
+}
+
+RsdCpuScriptIntrinsicSort::~RsdCpuScriptIntrinsicSort() {
+    for (int ct = 0; ct < 2; ct++) {
+        free(mKeys[ct]);
+        free(mIndex[ct]);
+    }
+    delete []mHist;
+    free(mPayloadCopy);
+}
+
+void RsdCpuScriptIntrinsicSort::populateScript(Script *s) {
+    s->mHal.info.exportedVariableCount = 2;
+}
+
+void RsdCpuScriptIntrinsicSort::invokeFreeChildren() {
+    mAlloc.clear();
+    mPayload.clear();
+}
+
+
+RsdCpuScriptImpl * rsdIntrinsic_Sort(RsdCpuReferenceImpl *ctx, const Script *s,
+                                     const Element *e) {
+
+    return new RsdCpuScriptIntrinsicSort(ctx, s, e);
+}
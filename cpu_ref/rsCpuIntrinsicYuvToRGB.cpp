@@ -18,10 +18,6 @@
 #include "rsCpuIntrinsic.h"
 #include "rsCpuIntrinsicInlines.h"
 
-#ifndef RS_COMPATIBILITY_LIB
-#include "hardware/gralloc.h"
-#endif
-
 using namespace android;
 using namespace android::renderscript;
 
@@ -34,17 +30,43 @@ public:
     virtual void populateScript(Script *);
     virtual void invokeFreeChildren();
 
+    virtual void setGlobalVar(uint32_t slot, const void *data, size_t dataLength);
     virtual void setGlobalObj(uint32_t slot, ObjectBase *data);
+    virtual void invokeForEach(uint32_t slot,
+                       const Allocation * ain,
+                       Allocation * aout,
+                       const void * usr,
+                       uint32_t usrLen,
+                       const RsScriptCall *sc);
 
     virtual ~RsdCpuScriptIntrinsicYuvToRGB();
     RsdCpuScriptIntrinsicYuvToRGB(RsdCpuReferenceImpl *ctx, const Script *s, const Element *e);
 
 protected:
     ObjectBaseRef<Allocation> alloc;
+    int32_t mColorSpace;
+    int32_t mRange;
+    uint32_t mScale;
+    // Channel type of the output of the current launch.
+    RsDataType mOutType;
+
+    // Floating point form of the conversion matrix, applied to samples
+    // in 8 bit units.
+    float mYOffset;
+    float mYScale;
+    float mVR;
+    float mUG;
+    float mVG;
+    float mUB;
+
+    void updateCoeffs();
 
     static void kernel(const RsForEachStubParamStruct *p,
                        uint32_t xstart, uint32_t xend,
                        uint32_t instep, uint32_t outstep);
+    static void kernelGeneric(const RsdCpuScriptIntrinsicYuvToRGB *cp,
+                              const RsForEachStubParamStruct *p,
+                              uint32_t xstart, uint32_t xend, uint32_t outstep);
 };
 
 }
@@ -56,6 +78,93 @@ void RsdCpuScriptIntrinsicYuvToRGB::setGlobalObj(uint32_t slot, ObjectBase *data
     alloc.set(static_cast<Allocation *>(data));
 }
 
+void RsdCpuScriptIntrinsicYuvToRGB::invokeForEach(uint32_t slot,
+                                                  const Allocation * ain,
+                                                  Allocation * aout,
+                                                  const void * usr,
+                                                  uint32_t usrLen,
+                                                  const RsScriptCall *sc) {
+    mOutType = getColorType(aout ? aout->getType()->getElement() : NULL);
+    if (mOutType == RS_TYPE_NONE) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                "YuvToRGB output must be uchar4, ushort4, half4 or float4.");
+        return;
+    }
+    RsdCpuScriptIntrinsic::invokeForEach(slot, ain, aout, usr, usrLen, sc);
+}
+
+void RsdCpuScriptIntrinsicYuvToRGB::setGlobalVar(uint32_t slot, const void *data,
+                                                 size_t dataLength) {
+    rsAssert(dataLength == 4);
+    int32_t v = ((const int32_t *)data)[0];
+
+    switch (slot) {
+    case 1:
+        if ((v < RS_YUV_COLOR_SPACE_BT601) || (v > RS_YUV_COLOR_SPACE_BT2020)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "YuvToRGB: unknown color space");
+            return;
+        }
+        mColorSpace = v;
+        break;
+    case 2:
+        if ((v != RS_YUV_RANGE_LIMITED) && (v != RS_YUV_RANGE_FULL)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE, "YuvToRGB: unknown range");
+            return;
+        }
+        mRange = v;
+        break;
+    case 3:
+        if ((v != 1) && (v != 2) && (v != 4)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "YuvToRGB: downscale must be 1, 2 or 4");
+            return;
+        }
+        mScale = v;
+        break;
+    default:
+        rsAssert(0);
+        return;
+    }
+    updateCoeffs();
+}
+
+// Builds the matrix from the luma weights of the color space.  Limited
+// range maps luma 16..235 and chroma 16..240 to the full 0..255 scale.
+void RsdCpuScriptIntrinsicYuvToRGB::updateCoeffs() {
+    float kr, kb;
+    switch (mColorSpace) {
+    case RS_YUV_COLOR_SPACE_BT709:
+        kr = 0.2126f;
+        kb = 0.0722f;
+        break;
+    case RS_YUV_COLOR_SPACE_BT2020:
+        kr = 0.2627f;
+        kb = 0.0593f;
+        break;
+    default:
+        kr = 0.299f;
+        kb = 0.114f;
+        break;
+    }
+    float kg = 1.f - kr - kb;
+
+    float cScale;
+    if (mRange == RS_YUV_RANGE_FULL) {
+        mYOffset = 0.f;
+        mYScale = 1.f;
+        cScale = 1.f;
+    } else {
+        mYOffset = 16.f;
+        mYScale = 255.f / 219.f;
+        cScale = 255.f / 224.f;
+    }
+    mVR = cScale * 2.f * (1.f - kr);
+    mUB = cScale * 2.f * (1.f - kb);
+    mUG = cScale * 2.f * kb * (1.f - kb) / kg;
+    mVG = cScale * 2.f * kr * (1.f - kr) / kg;
+}
+
 
 
 
@@ -113,6 +222,16 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
         ALOGE("YuvToRGB executed without input, skipping");
         return;
     }
+
+    // The fixed point paths below only cover the original 8 bit BT.601
+    // limited range conversion to uchar4.
+    uint32_t yuv = cp->alloc->mHal.state.yuv;
+    if ((cp->mColorSpace != RS_YUV_COLOR_SPACE_BT601) ||
+        (cp->mRange != RS_YUV_RANGE_LIMITED) || (cp->mScale != 1) || (cp->mOutType != RS_TYPE_UNSIGNED_8) ||
+        ((yuv != 0) && (yuv != RS_YUV_NV21) && (yuv != RS_YUV_YV12))) {
+        kernelGeneric(cp, p, xstart, xend, outstep);
+        return;
+    }
     const uchar *pinY = (const uchar *)cp->alloc->mHal.drvState.lod[0].mallocPtr;
 
     size_t strideY = cp->alloc->mHal.drvState.lod[0].stride;
@@ -134,9 +253,7 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
     switch (cp->alloc->mHal.state.yuv) {
     // In API 17 there was no yuv format and the intrinsic treated everything as NV21
     case 0:
-#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
-    case HAL_PIXEL_FORMAT_YCrCb_420_SP:  // NV21
-#endif
+    case RS_YUV_NV21:
         {
             const uchar *pinUV = (const uchar *)cp->alloc->mHal.drvState.lod[1].mallocPtr;
             size_t strideUV = cp->alloc->mHal.drvState.lod[1].stride;
@@ -176,8 +293,7 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
         }
         break;
 
-#if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
-    case HAL_PIXEL_FORMAT_YV12:
+    case RS_YUV_YV12:
         {
             const uchar *pinU = (const uchar *)cp->alloc->mHal.drvState.lod[1].mallocPtr;
             const size_t strideU = cp->alloc->mHal.drvState.lod[1].stride;
@@ -211,23 +327,153 @@ void RsdCpuScriptIntrinsicYuvToRGB::kernel(const RsForEachStubParamStruct *p,
             }
         }
         break;
-#endif
     }
 
 }
 
+// Pointers to one luma row and the chroma row that goes with it.  cStep
+// is the distance in bytes between horizontally adjacent chroma samples.
+typedef struct {
+    const uint8_t *y;
+    const uint8_t *u;
+    const uint8_t *v;
+    uint32_t cStep;
+} YuvRow;
+
+static void getYuvRow(const Allocation *a, const RsForEachStubParamStruct *p,
+                      uint32_t y, YuvRow *r) {
+    const uint8_t *pinY = (const uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
+    const uint8_t *pinC = (const uint8_t *)a->mHal.drvState.lod[1].mallocPtr;
+    size_t strideY = a->mHal.drvState.lod[0].stride;
+    size_t strideC = a->mHal.drvState.lod[1].stride;
+
+    // calculate correct stride in legacy case
+    if (a->mHal.drvState.lod[0].dimY == 0) {
+        strideY = p->dimX;
+    }
+    r->y = pinY + (y * strideY);
+
+    switch (a->mHal.state.yuv) {
+    case RS_YUV_YV12:
+    case RS_YUV_I420:
+        r->u = pinC + ((y >> 1) * strideC);
+        r->v = (const uint8_t *)a->mHal.drvState.lod[2].mallocPtr +
+               ((y >> 1) * a->mHal.drvState.lod[2].stride);
+        r->cStep = 1;
+        break;
+    case RS_YUV_NV12:
+        r->u = pinC + ((y >> 1) * strideC);
+        r->v = r->u + 1;
+        r->cStep = 2;
+        break;
+    case RS_YUV_P010:
+        r->u = pinC + ((y >> 1) * strideC);
+        r->v = r->u + 2;
+        r->cStep = 4;
+        break;
+    default:
+        if (pinC == NULL) {
+            // Legacy yuv support didn't fill in uv
+            pinC = pinY + (strideY * p->dimY);
+            strideC = strideY;
+        }
+        r->v = pinC + ((y >> 1) * strideC);
+        r->u = r->v + 1;
+        r->cStep = 2;
+        break;
+    }
+}
+
+// Returns a sample in 8 bit units.  P010 keeps 10 bits in the top of a
+// 16 bit word, so dividing by 256 keeps the fraction.
+static inline float yuvSample(const uint8_t *p, bool wide) {
+    if (wide) {
+        return ((const uint16_t *)p)[0] * (1.f / 256.f);
+    }
+    return p[0];
+}
+
+static inline float clampChannel(float v, float hi) {
+    return (v < 0.f) ? 0.f : ((v > hi) ? hi : v);
+}
+
+// Handles every format, matrix and range.  Each output pixel averages a
+// scale x scale block of luma and the chroma samples covering it, so a
+// downscaled launch runs over the output dimensions.
+void RsdCpuScriptIntrinsicYuvToRGB::kernelGeneric(const RsdCpuScriptIntrinsicYuvToRGB *cp,
+                                                  const RsForEachStubParamStruct *p,
+                                                  uint32_t xstart, uint32_t xend,
+                                                  uint32_t outstep) {
+    const Allocation *a = cp->alloc.get();
+    const bool wide = (a->mHal.state.yuv == RS_YUV_P010);
+    const uint32_t yStep = wide ? 2 : 1;
+    const uint32_t scale = cp->mScale;
+
+    uint32_t inW = a->mHal.drvState.lod[0].dimX;
+    uint32_t inH = a->mHal.drvState.lod[0].dimY;
+    if (inH == 0) {
+        inW = p->dimX;
+        inH = p->dimY;
+    }
+    if (!inW || !inH) {
+        return;
+    }
+
+    YuvRow rows[4];
+    for (uint32_t dy = 0; dy < scale; dy++) {
+        getYuvRow(a, p, rsMin(p->y * scale + dy, inH - 1), &rows[dy]);
+    }
+    const float yNorm = 1.f / (scale * scale);
+    const float cNorm = (scale == 4) ? 0.25f : 1.f;
+
+    uint8_t *out = (uint8_t *)p->out;
+    for (uint32_t x = xstart; x < xend; x++, out += outstep) {
+        float ySum = 0.f;
+        float uSum = 0.f;
+        float vSum = 0.f;
+        for (uint32_t dy = 0; dy < scale; dy++) {
+            const YuvRow *r = &rows[dy];
+            for (uint32_t dx = 0; dx < scale; dx++) {
+                uint32_t sx = rsMin(x * scale + dx, inW - 1);
+                ySum += yuvSample(r->y + sx * yStep, wide);
+                if (!(dy & 1) && !(dx & 1)) {
+                    uint32_t cx = sx >> 1;
+                    uSum += yuvSample(r->u + cx * r->cStep, wide);
+                    vSum += yuvSample(r->v + cx * r->cStep, wide);
+                }
+            }
+        }
+
+        float Y = (ySum * yNorm - cp->mYOffset) * cp->mYScale;
+        float U = uSum * cNorm - 128.f;
+        float V = vSum * cNorm - 128.f;
+        float R = Y + V * cp->mVR;
+        float G = Y - U * cp->mUG - V * cp->mVG;
+        float B = Y + U * cp->mUB;
+
+        const float n = 1.f / 255.f;
+        storeColor(out, cp->mOutType, (float4){clampChannel(R * n, 1.f), clampChannel(G * n, 1.f),
+                                               clampChannel(B * n, 1.f), 1.f});
+    }
+}
+
 RsdCpuScriptIntrinsicYuvToRGB::RsdCpuScriptIntrinsicYuvToRGB(
             RsdCpuReferenceImpl *ctx, const Script *s, const Element *e)
             : RsdCpuScriptIntrinsic(ctx, s, e, RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB) {
 
     mRootPtr = &kernel;
+    mColorSpace = RS_YUV_COLOR_SPACE_BT601;
+    mRange = RS_YUV_RANGE_LIMITED;
+    mScale = 1;
+    mOutType = RS_TYPE_UNSIGNED_8;
+    updateCoeffs();
 }
 
 RsdCpuScriptIntrinsicYuvToRGB::~RsdCpuScriptIntrinsicYuvToRGB() {
 }
 
 void RsdCpuScriptIntrinsicYuvToRGB::populateScript(Script *s) {
-    s->mHal.info.exportedVariableCount = 1;
+    s->mHal.info.exportedVariableCount = 4;
 }
 
 void RsdCpuScriptIntrinsicYuvToRGB::invokeFreeChildren() {
@@ -20,6 +20,8 @@
 
 #include "rsCpuScript.h"
 
+#include <stddef.h>
+
 #ifdef RS_COMPATIBILITY_LIB
     #include <dlfcn.h>
     #include <stdio.h>
@@ -471,21 +473,31 @@ void RsdCpuScriptImpl::populateScript(Script *script) {
 
 typedef void (*rs_t)(const void *, void *, const void *, uint32_t, uint32_t, uint32_t, uint32_t);
 
-void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aout,
+bool RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aout,
                                         const void * usr, uint32_t usrLen,
                                         const RsScriptCall *sc,
                                         MTLaunchStruct *mtls) {
 
-    memset(mtls, 0, sizeof(MTLaunchStruct));
+    memset(mtls, 0, offsetof(MTLaunchStruct, levels));
 
     // possible for this to occur if IO_OUTPUT/IO_INPUT with no bound surface
     if (ain && (const uint8_t *)ain->mHal.drvState.lod[0].mallocPtr == NULL) {
         mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "rsForEach called with null allocations");
-        return;
+        return false;
     }
     if (aout && (const uint8_t *)aout->mHal.drvState.lod[0].mallocPtr == NULL) {
         mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "rsForEach called with null allocations");
-        return;
+        return false;
+    }
+
+    if ((ain && ain->getHasFieldPlanes()) || (aout && aout->getHasFieldPlanes())) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                     "rsForEach over a planar allocation, use field views");
+        return false;
+    }
+    if (aout && aout->getIsReadOnly()) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "rsForEach output allocation is read-only");
+        return false;
     }
 
     if (ain) {
@@ -500,7 +512,7 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         //mtls->dimArray = aout->getType()->getDimArray();
     } else {
         mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT, "rsForEach called with null allocations");
-        return;
+        return false;
     }
 
     if (!sc || (sc->xEnd == 0)) {
@@ -511,7 +523,7 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         rsAssert(sc->xStart < sc->xEnd);
         mtls->xStart = rsMin(mtls->fep.dimX, sc->xStart);
         mtls->xEnd = rsMin(mtls->fep.dimX, sc->xEnd);
-        if (mtls->xStart >= mtls->xEnd) return;
+        if (mtls->xStart >= mtls->xEnd) return false;
     }
 
     if (!sc || (sc->yEnd == 0)) {
@@ -522,7 +534,7 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         rsAssert(sc->yStart < sc->yEnd);
         mtls->yStart = rsMin(mtls->fep.dimY, sc->yStart);
         mtls->yEnd = rsMin(mtls->fep.dimY, sc->yEnd);
-        if (mtls->yStart >= mtls->yEnd) return;
+        if (mtls->yStart >= mtls->yEnd) return false;
     }
 
     if (!sc || (sc->zEnd == 0)) {
@@ -533,7 +545,7 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         rsAssert(sc->zStart < sc->zEnd);
         mtls->zStart = rsMin(mtls->fep.dimZ, sc->zStart);
         mtls->zEnd = rsMin(mtls->fep.dimZ, sc->zEnd);
-        if (mtls->zStart >= mtls->zEnd) return;
+        if (mtls->zStart >= mtls->zEnd) return false;
     }
 
     mtls->xEnd = rsMax((uint32_t)1, mtls->xEnd);
@@ -568,6 +580,108 @@ void RsdCpuScriptImpl::forEachMtlsSetup(const Allocation * ain, Allocation * aou
         mtls->fep.eStrideOut = aout->getType()->getElementSizeBytes();
         mtls->fep.yStrideOut = aout->mHal.drvState.lod[0].stride;
     }
+
+    mtls->prefetchIn = ain && ain->getIsFileBacked() &&
+            !(ain->getFileFlags() & RS_ALLOCATION_FILE_ACCESS_RANDOM);
+    mtls->prefetchOut = aout && aout->getIsFileBacked() &&
+            !(aout->getFileFlags() & RS_ALLOCATION_FILE_ACCESS_RANDOM);
+
+    mtls->tileDimIn = ain ? ain->getTileDim() : 0;
+    mtls->tileDimOut = aout ? aout->getTileDim() : 0;
+    if (mtls->tileDimIn || mtls->tileDimOut) {
+        if (sc && (sc->lodEnd || sc->faceEnd)) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_SCRIPT,
+                                         "Tiled allocations have a single LOD and face");
+            return false;
+        }
+        // Tile sizes are powers of two, so blocks of the smaller size never
+        // straddle a block of the larger one.
+        mtls->isTileLaunch = true;
+        mtls->tile = mtls->tileDimIn ? mtls->tileDimIn : mtls->tileDimOut;
+        if (mtls->tileDimOut) {
+            mtls->tile = rsMin(mtls->tile, mtls->tileDimOut);
+        }
+    } else if (sc && (sc->lodEnd || sc->faceEnd)) {
+        return forEachLevelSetup(ain, aout, sc, mtls);
+    } else if (sc && (sc->flags & RS_FOR_EACH_SKIP_UNALLOCATED) && ain && ain->getIsSparse()) {
+        mtls->isBrickLaunch = true;
+        mtls->brickX = ain->getBrickX();
+        mtls->brickY = ain->getBrickY();
+        mtls->brickZ = ain->getBrickZ();
+    }
+    return true;
+}
+
+bool RsdCpuScriptImpl::forEachLevelSetup(const Allocation * ain, Allocation * aout,
+                                         const RsScriptCall *sc,
+                                         MTLaunchStruct *mtls) {
+    mtls->isLevelLaunch = true;
+
+    const Allocation *a = ain ? ain : aout;
+    uint32_t lodEnd = rsMax((uint32_t)1, sc->lodEnd);
+    uint32_t faceEnd = rsMax((uint32_t)1, sc->faceEnd);
+    bool faces = faceEnd > 1;
+
+    if ((sc->lodStart >= lodEnd) || (sc->faceStart >= faceEnd) ||
+        (faceEnd > (RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_Z + 1))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "rsForEach called with an invalid LOD or face range");
+        return false;
+    }
+    if (sc->xEnd || sc->yEnd || sc->zEnd || sc->arrayEnd || mtls->fep.dimZ) {
+        // Every level has its own size, so a sub-rectangle has no meaning.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "rsForEach LOD or face ranges require a full 1D or 2D launch");
+        return false;
+    }
+    if (a->mHal.state.yuv || (aout && aout->mHal.state.yuv)) {
+        // The extra LODs of a YUV allocation hold its chroma planes.
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "rsForEach LOD ranges are not supported for YUV allocations");
+        return false;
+    }
+    if ((lodEnd > a->mHal.drvState.lodCount) ||
+        (aout && (lodEnd > aout->mHal.drvState.lodCount)) ||
+        (faces && (!a->getType()->getDimFaces() ||
+                   (aout && !aout->getType()->getDimFaces())))) {
+        mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                     "rsForEach LOD or face range exceeds the allocation");
+        return false;
+    }
+
+    for (uint32_t lod = sc->lodStart; lod < lodEnd; lod++) {
+        if (ain && aout &&
+            ((ain->mHal.drvState.lod[lod].dimX != aout->mHal.drvState.lod[lod].dimX) ||
+             (ain->mHal.drvState.lod[lod].dimY != aout->mHal.drvState.lod[lod].dimY))) {
+            mCtx->getContext()->setError(RS_ERROR_BAD_VALUE,
+                                         "rsForEach input and output LOD sizes differ");
+            mtls->levelCount = 0;
+            return false;
+        }
+        for (uint32_t face = sc->faceStart; face < faceEnd; face++) {
+            MTLaunchLevel *l = &mtls->levels[mtls->levelCount++];
+            l->lod = lod;
+            l->face = (RsAllocationCubemapFace)face;
+            l->dimX = a->mHal.drvState.lod[lod].dimX;
+            l->dimY = a->mHal.drvState.lod[lod].dimY;
+            l->firstSlice = 0;
+            l->ptrIn = NULL;
+            l->yStrideIn = 0;
+            if (ain) {
+                l->ptrIn = (const uint8_t *)ain->mHal.drvState.lod[lod].mallocPtr +
+                           ain->mHal.drvState.faceOffset * face;
+                l->yStrideIn = ain->mHal.drvState.lod[lod].stride;
+            }
+            l->ptrOut = NULL;
+            l->yStrideOut = 0;
+            if (aout) {
+                l->ptrOut = (uint8_t *)aout->mHal.drvState.lod[lod].mallocPtr +
+                            aout->mHal.drvState.faceOffset * face;
+                l->yStrideOut = aout->mHal.drvState.lod[lod].stride;
+            }
+        }
+    }
+    return true;
 }
 
 
@@ -579,7 +693,9 @@ void RsdCpuScriptImpl::invokeForEach(uint32_t slot,
                                      const RsScriptCall *sc) {
 
     MTLaunchStruct mtls;
-    forEachMtlsSetup(ain, aout, usr, usrLen, sc, &mtls);
+    if (!forEachMtlsSetup(ain, aout, usr, usrLen, sc, &mtls)) {
+        return;
+    }
     forEachKernelSetup(slot, &mtls);
 
     RsdCpuScriptImpl * oldTLS = mCtx->setTLS(this);
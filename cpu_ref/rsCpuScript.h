@@ -74,9 +74,12 @@ public:
 
     const Script * getScript() {return mScript;}
 
-    void forEachMtlsSetup(const Allocation * ain, Allocation * aout,
+    // Returns false, with any error already set, if there is nothing to launch.
+    bool forEachMtlsSetup(const Allocation * ain, Allocation * aout,
                           const void * usr, uint32_t usrLen,
                           const RsScriptCall *sc, MTLaunchStruct *mtls);
+    bool forEachLevelSetup(const Allocation * ain, Allocation * aout,
+                           const RsScriptCall *sc, MTLaunchStruct *mtls);
     virtual void forEachKernelSetup(uint32_t slot, MTLaunchStruct *mtls);
 
 
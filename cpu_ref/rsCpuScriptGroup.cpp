@@ -182,7 +182,9 @@ void CpuScriptGroupImpl::execute() {
             RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
             uint32_t slot = kernels[ct]->mSlot;
 
-            si->forEachMtlsSetup(ins[ct], outs[ct], NULL, 0, NULL, &mtls);
+            if (!si->forEachMtlsSetup(ins[ct], outs[ct], NULL, 0, NULL, &mtls)) {
+                continue;
+            }
             si->forEachKernelSetup(slot, &mtls);
             mCtx->launchThreads(ins[ct], outs[ct], NULL, &mtls);
         }
@@ -213,10 +215,18 @@ void CpuScriptGroupImpl::execute() {
 
         Script *s = kernels[0]->mScript;
         RsdCpuScriptImpl *si = (RsdCpuScriptImpl *)mCtx->lookupScript(s);
-        si->forEachMtlsSetup(ins[0], outs[0], NULL, 0, NULL, &mtls);
+        if (!si->forEachMtlsSetup(ins[0], outs[0], NULL, 0, NULL, &mtls)) {
+            return;
+        }
         mtls.script = NULL;
         mtls.kernel = (void (*)())&scriptGroupRoot;
         mtls.fep.usr = &sl;
+        // Only outs[0] is passed on; the chained kernels write the rest.
+        for (size_t ct = 1; ct < outs.size(); ct++) {
+            if (outs[ct]) {
+                outs[ct]->markAllWritten();
+            }
+        }
         mCtx->launchThreads(ins[0], outs[0], NULL, &mtls);
     }
 }
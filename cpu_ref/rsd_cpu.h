@@ -123,6 +123,15 @@ public:
     virtual CpuScriptGroup * createScriptGroup(const ScriptGroup *sg) = 0;
     virtual bool getInForEach() = 0;
 
+    // Calls cbk once on each thread of the worker pool and returns when all
+    // calls have finished.  The calling thread runs idx 0.
+    virtual uint32_t getThreadCount() const = 0;
+    virtual void launchWorkers(void (*cbk)(void *usr, uint32_t idx), void *usr) = 0;
+    // As launchWorkers, but may also be called from inside a kernel, where
+    // the pool is busy; the call for each idx then runs in turn on the
+    // calling thread.
+    virtual void runWorkers(void (*cbk)(void *usr, uint32_t idx), void *usr) = 0;
+
 #ifndef RS_COMPATIBILITY_LIB
     virtual void setSetupCompilerCallback(
             RSSetupCompilerCallback pSetupCompilerCallback) = 0;
@@ -39,11 +39,19 @@
 #include <GLES/glext.h>
 #endif
 
+#include <math.h>
+
 #ifdef RS_SERVER
 // server requires malloc.h for memalign
 #include <malloc.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 using namespace android;
 using namespace android::renderscript;
 
@@ -93,14 +101,226 @@ uint8_t *GetOffsetPtr(const android::renderscript::Allocation *alloc,
                       uint32_t xoff, uint32_t yoff, uint32_t zoff,
                       uint32_t lod, RsAllocationCubemapFace face) {
     uint8_t *ptr = (uint8_t *)alloc->mHal.drvState.lod[lod].mallocPtr;
+    const size_t tile = alloc->getTileDim();
+    if (tile) {
+        // Tiled allocations have one LOD and face.  Blocks are stored in
+        // row-major order, as are the elements within a block.
+        size_t tilesX = (alloc->mHal.drvState.lod[0].dimX + tile - 1) / tile;
+        size_t index = ((yoff / tile) * tilesX + (xoff / tile)) * tile * tile +
+                       (yoff % tile) * tile + (xoff % tile);
+        return ptr + index * alloc->mHal.state.elementSizeBytes;
+    }
     ptr += face * alloc->mHal.drvState.faceOffset;
-    ptr += zoff * alloc->mHal.drvState.lod[lod].dimY * alloc->mHal.drvState.lod[lod].stride;
-    ptr += yoff * alloc->mHal.drvState.lod[lod].stride;
-    ptr += xoff * alloc->mHal.state.elementSizeBytes;
+    ptr += (size_t)zoff * alloc->mHal.drvState.lod[lod].dimY * alloc->mHal.drvState.lod[lod].stride;
+    ptr += (size_t)yoff * alloc->mHal.drvState.lod[lod].stride;
+    ptr += (size_t)xoff * alloc->mHal.state.elementSizeBytes;
     return ptr;
 }
 
 
+// Copies count elements between linear memory and a tiled allocation,
+// starting at (x, y) and continuing in row-major order.
+static void TiledCopy(const Allocation *alloc, uint32_t x, uint32_t y, size_t count,
+                      uint8_t *mem, bool toAlloc) {
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    const uint32_t tile = alloc->getTileDim();
+    const uint32_t dimX = alloc->mHal.drvState.lod[0].dimX;
+    while (count) {
+        // Runs stop at the edge of a block and at the end of a row.
+        size_t n = rsMin(count, (size_t)rsMin(tile - (x % tile), dimX - x));
+        uint8_t *ptr = GetOffsetPtr(alloc, x, y, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        if (toAlloc) {
+            memcpy(ptr, mem, n * eSize);
+        } else {
+            memcpy(mem, ptr, n * eSize);
+        }
+        mem += n * eSize;
+        count -= n;
+        x += n;
+        if (x == dimX) {
+            x = 0;
+            y++;
+        }
+    }
+}
+
+// Copies count packed cells between linear memory and an allocation that
+// keeps each field in its own plane, starting at cell index cell.
+static void PlanarCopy(const Allocation *alloc, size_t cell, size_t count,
+                       uint8_t *mem, bool toAlloc) {
+    const Element *e = alloc->mHal.state.type->getElement();
+    const size_t eSize = alloc->mHal.state.elementSizeBytes;
+    uint8_t *base = (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr;
+    for (uint32_t f = 0; f < e->getFieldCount(); f++) {
+        const size_t fSize = e->getField(f)->getSizeBytes() * e->getFieldArraySize(f);
+        uint8_t *plane = base + alloc->getFieldPlaneOffset(f) + cell * fSize;
+        uint8_t *packed = mem + e->getFieldOffsetBytes(f);
+        for (size_t ct = 0; ct < count; ct++) {
+            if (toAlloc) {
+                memcpy(plane, packed, fSize);
+            } else {
+                memcpy(packed, plane, fSize);
+            }
+            plane += fSize;
+            packed += eSize;
+        }
+    }
+}
+
+// Address of one field of a cell of a planar allocation.
+static uint8_t * PlanarFieldPtr(const Allocation *alloc, uint32_t field, size_t cell) {
+    const Element *e = alloc->mHal.state.type->getElement();
+    const size_t fSize = e->getField(field)->getSizeBytes() * e->getFieldArraySize(field);
+    return (uint8_t *)alloc->mHal.drvState.lod[0].mallocPtr +
+            alloc->getFieldPlaneOffset(field) + cell * fSize;
+}
+
+// Copies rows of w cells at (xoff, yoff, zoff) of a planar allocation.
+static void PlanarCopyRows(const Allocation *alloc, uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                           uint32_t w, uint32_t h, uint32_t d, uint8_t *mem, size_t stride,
+                           bool toAlloc) {
+    const size_t dimX = alloc->mHal.drvState.lod[0].dimX;
+    const size_t dimY = rsMax(alloc->mHal.drvState.lod[0].dimY, 1u);
+    for (uint32_t z = 0; z < d; z++) {
+        for (uint32_t line = 0; line < h; line++) {
+            size_t cell = ((zoff + z) * dimY + yoff + line) * dimX + xoff;
+            PlanarCopy(alloc, cell, w, mem + ((size_t)z * h + line) * stride, toAlloc);
+        }
+    }
+}
+
+// Copies of at least this many bytes are split across the worker pool.
+static const size_t kParallelCopyBytes = 256 * 1024;
+// Copies of at least this many bytes bypass the cache where the CPU allows
+// it.  The destination would be evicted before it is read again anyway.
+static const size_t kStreamingCopyBytes = 2 * 1024 * 1024;
+// Work is handed out in chunks of about this size.
+static const size_t kCopyChunkBytes = 64 * 1024;
+
+typedef struct CopyJobRec {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t dstStride;
+    size_t srcStride;
+    size_t rowBytes;
+    size_t rows;
+    size_t rowsPerChunk;
+    uint32_t chunkCount;
+    bool streaming;
+    volatile int nextChunk;
+} CopyJob;
+
+static void CopyBytes(uint8_t *dst, const uint8_t *src, size_t bytes, bool streaming) {
+#if defined(__SSE2__)
+    if (streaming && (bytes >= 128)) {
+        size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+        memcpy(dst, src, head);
+        dst += head;
+        src += head;
+        bytes -= head;
+
+        size_t body = bytes & ~(size_t)63;
+        for (size_t ct = 0; ct < body; ct += 64) {
+            __m128i v0 = _mm_loadu_si128((const __m128i *)(src + ct));
+            __m128i v1 = _mm_loadu_si128((const __m128i *)(src + ct + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i *)(src + ct + 32));
+            __m128i v3 = _mm_loadu_si128((const __m128i *)(src + ct + 48));
+            _mm_stream_si128((__m128i *)(dst + ct), v0);
+            _mm_stream_si128((__m128i *)(dst + ct + 16), v1);
+            _mm_stream_si128((__m128i *)(dst + ct + 32), v2);
+            _mm_stream_si128((__m128i *)(dst + ct + 48), v3);
+        }
+        _mm_sfence();
+        memcpy(dst + body, src + body, bytes - body);
+        return;
+    }
+#endif
+    memcpy(dst, src, bytes);
+}
+
+static void CopyChunk(const CopyJob *job, uint32_t chunk) {
+    if (job->rows == 1) {
+        size_t start = chunk * kCopyChunkBytes;
+        size_t len = rsMin(kCopyChunkBytes, job->rowBytes - start);
+        CopyBytes(job->dst + start, job->src + start, len, job->streaming);
+        return;
+    }
+
+    size_t end = rsMin((chunk + 1) * job->rowsPerChunk, job->rows);
+    for (size_t row = chunk * job->rowsPerChunk; row < end; row++) {
+        CopyBytes(job->dst + row * job->dstStride, job->src + row * job->srcStride,
+                  job->rowBytes, job->streaming);
+    }
+}
+
+static void CopyWorker(void *usr, uint32_t idx) {
+    CopyJob *job = (CopyJob *)usr;
+    while (1) {
+        uint32_t chunk = (uint32_t)__sync_fetch_and_add(&job->nextChunk, 1);
+        if (chunk >= job->chunkCount) {
+            return;
+        }
+        CopyChunk(job, chunk);
+    }
+}
+
+// Copies rows of rowBytes between two strided images that do not overlap.
+// Rows that are contiguous in both images are copied as one run, and large
+// copies are spread over the CPU worker pool.
+static void CopyRows(const Context *rsc, uint8_t *dst, size_t dstStride,
+                     const uint8_t *src, size_t srcStride, size_t rowBytes, size_t rows) {
+    if (!rowBytes || !rows) {
+        return;
+    }
+    if ((rows > 1) && (dstStride == rowBytes) && (srcStride == rowBytes)) {
+        rowBytes *= rows;
+        rows = 1;
+    }
+
+    CopyJob job;
+    job.dst = dst;
+    job.src = src;
+    job.dstStride = dstStride;
+    job.srcStride = srcStride;
+    job.rowBytes = rowBytes;
+    job.rows = rows;
+    job.nextChunk = 0;
+    if (rows == 1) {
+        job.rowsPerChunk = 1;
+        job.chunkCount = (rowBytes + kCopyChunkBytes - 1) / kCopyChunkBytes;
+    } else {
+        job.rowsPerChunk = rsMax(kCopyChunkBytes / rowBytes, (size_t)1);
+        job.chunkCount = (rows + job.rowsPerChunk - 1) / job.rowsPerChunk;
+    }
+
+    const size_t total = rowBytes * rows;
+    job.streaming = total >= kStreamingCopyBytes;
+
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    if ((total < kParallelCopyBytes) || (job.chunkCount < 2) ||
+        (dc->mCpuRef->getThreadCount() < 2)) {
+        CopyWorker(&job, 0);
+        return;
+    }
+    rsdLaunchThreads(rsc, CopyWorker, &job);
+}
+
+// Row copy within a single allocation, where source and destination may
+// overlap.
+static void MoveRows(uint8_t *dst, size_t dstStride,
+                     const uint8_t *src, size_t srcStride, size_t rowBytes, size_t rows) {
+    if (dst > src) {
+        for (size_t row = rows; row > 0; row--) {
+            memmove(dst + (row - 1) * dstStride, src + (row - 1) * srcStride, rowBytes);
+        }
+    } else {
+        for (size_t row = 0; row < rows; row++) {
+            memmove(dst + row * dstStride, src + row * srcStride, rowBytes);
+        }
+    }
+}
+
+
 static void Update2DTexture(const Context *rsc, const Allocation *alloc, const void *ptr,
                             uint32_t xoff, uint32_t yoff, uint32_t lod,
                             RsAllocationCubemapFace face, uint32_t w, uint32_t h) {
@@ -254,12 +474,13 @@ static void UploadToBufferObject(const Context *rsc, const Allocation *alloc) {
 static size_t DeriveYUVLayout(int yuv, Allocation::Hal::DrvState *state) {
     // YUV only supports basic 2d
     // so we can stash the plane pointers in the mipmap levels.
+    // Chroma planes round up, so an odd final row or column of luma still
+    // has a chroma sample.
     size_t uvSize = 0;
-#ifndef RS_SERVER
     switch(yuv) {
-    case HAL_PIXEL_FORMAT_YV12:
-        state->lod[2].dimX = state->lod[0].dimX / 2;
-        state->lod[2].dimY = state->lod[0].dimY / 2;
+    case RS_YUV_YV12:
+        state->lod[2].dimX = (state->lod[0].dimX + 1) / 2;
+        state->lod[2].dimY = (state->lod[0].dimY + 1) / 2;
         state->lod[2].stride = rsRound(state->lod[0].stride >> 1, 16);
         state->lod[2].mallocPtr = ((uint8_t *)state->lod[0].mallocPtr) +
                 (state->lod[0].stride * state->lod[0].dimY);
@@ -274,9 +495,31 @@ static size_t DeriveYUVLayout(int yuv, Allocation::Hal::DrvState *state) {
 
         state->lodCount = 3;
         break;
-    case HAL_PIXEL_FORMAT_YCrCb_420_SP:  // NV21
-        state->lod[1].dimX = state->lod[0].dimX;
-        state->lod[1].dimY = state->lod[0].dimY / 2;
+    case RS_YUV_I420:
+        // U follows luma and V follows U, each at half the luma stride.
+        state->lod[1].dimX = (state->lod[0].dimX + 1) / 2;
+        state->lod[1].dimY = (state->lod[0].dimY + 1) / 2;
+        state->lod[1].stride = (state->lod[0].stride + 1) >> 1;
+        state->lod[1].mallocPtr = ((uint8_t *)state->lod[0].mallocPtr) +
+                (state->lod[0].stride * state->lod[0].dimY);
+        uvSize += state->lod[1].stride * state->lod[1].dimY;
+
+        state->lod[2].dimX = state->lod[1].dimX;
+        state->lod[2].dimY = state->lod[1].dimY;
+        state->lod[2].stride = state->lod[1].stride;
+        state->lod[2].mallocPtr = ((uint8_t *)state->lod[1].mallocPtr) +
+                (state->lod[1].stride * state->lod[1].dimY);
+        uvSize += state->lod[2].stride * state->lod[2].dimY;
+
+        state->lodCount = 3;
+        break;
+    case RS_YUV_NV21:
+    case RS_YUV_NV12:
+    case RS_YUV_P010:
+        // One interleaved chroma plane; NV21 stores V first.  Its rows hold
+        // a pair of samples for every two columns.
+        state->lod[1].dimX = (state->lod[0].dimX + 1) & ~1;
+        state->lod[1].dimY = (state->lod[0].dimY + 1) / 2;
         state->lod[1].stride = state->lod[0].stride;
         state->lod[1].mallocPtr = ((uint8_t *)state->lod[0].mallocPtr) +
                 (state->lod[0].stride * state->lod[0].dimY);
@@ -286,38 +529,71 @@ static size_t DeriveYUVLayout(int yuv, Allocation::Hal::DrvState *state) {
     default:
         rsAssert(0);
     }
-#endif
     return uvSize;
 }
 
 
+// Row stride of LOD or plane n.  Driver allocated rows are 16-byte
+// aligned; wrapped user memory keeps the layout it was described with.
+static size_t GetLODStride(const Allocation::Hal::UserLayout *user, uint32_t n, size_t rowSize) {
+    if (!user) {
+        return rsRound(rowSize, 16);
+    }
+    if ((n < user->count) && user->stride[n]) {
+        return user->stride[n];
+    }
+    return rowSize;
+}
+
 static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *alloc,
         const Type *type, uint8_t *ptr) {
+    const Allocation::Hal::UserLayout *user = NULL;
+    if (alloc->mHal.state.userProvidedPtr) {
+        user = &alloc->mHal.userLayout;
+    }
+
     alloc->mHal.drvState.lod[0].dimX = type->getDimX();
     alloc->mHal.drvState.lod[0].dimY = type->getDimY();
     alloc->mHal.drvState.lod[0].dimZ = type->getDimZ();
     alloc->mHal.drvState.lod[0].mallocPtr = 0;
-    // Stride needs to be 16-byte aligned too!
     size_t stride = alloc->mHal.drvState.lod[0].dimX * type->getElementSizeBytes();
-    alloc->mHal.drvState.lod[0].stride = rsRound(stride, 16);
+    alloc->mHal.drvState.lod[0].stride = GetLODStride(user, 0, stride);
     alloc->mHal.drvState.lodCount = type->getLODCount();
     alloc->mHal.drvState.faceCount = type->getDimFaces();
 
     size_t offsets[Allocation::MAX_LOD];
     memset(offsets, 0, sizeof(offsets));
+    if (user && user->count) {
+        offsets[0] = user->offset[0];
+    }
 
     size_t o = alloc->mHal.drvState.lod[0].stride * rsMax(alloc->mHal.drvState.lod[0].dimY, 1u) *
             rsMax(alloc->mHal.drvState.lod[0].dimZ, 1u);
-    if(alloc->mHal.drvState.lodCount > 1) {
+    if (alloc->getHasFieldPlanes()) {
+        // Planes hold whole fields; the row stride describes packed cells.
+        o = alloc->getFieldPlaneOffset(type->getElement()->getFieldCount());
+    } else if (alloc->getTileDim()) {
+        // The stride of a tiled allocation is that of a block row; the
+        // storage is padded out to whole blocks.
+        size_t tile = alloc->getTileDim();
+        size_t tilesX = (alloc->mHal.drvState.lod[0].dimX + tile - 1) / tile;
+        size_t tilesY = (alloc->mHal.drvState.lod[0].dimY + tile - 1) / tile;
+        alloc->mHal.drvState.lod[0].stride = tile * type->getElementSizeBytes();
+        o = tilesX * tilesY * tile * alloc->mHal.drvState.lod[0].stride;
+    } else if(alloc->mHal.drvState.lodCount > 1) {
         uint32_t tx = alloc->mHal.drvState.lod[0].dimX;
         uint32_t ty = alloc->mHal.drvState.lod[0].dimY;
         uint32_t tz = alloc->mHal.drvState.lod[0].dimZ;
+        o += offsets[0];
         for (uint32_t lod=1; lod < alloc->mHal.drvState.lodCount; lod++) {
             alloc->mHal.drvState.lod[lod].dimX = tx;
             alloc->mHal.drvState.lod[lod].dimY = ty;
             alloc->mHal.drvState.lod[lod].dimZ = tz;
             alloc->mHal.drvState.lod[lod].stride =
-                    rsRound(tx * type->getElementSizeBytes(), 16);
+                    GetLODStride(user, lod, tx * type->getElementSizeBytes());
+            if (user && (lod < user->count)) {
+                o = user->offset[lod];
+            }
             offsets[lod] = o;
             o += alloc->mHal.drvState.lod[lod].stride * rsMax(ty, 1u) * rsMax(tz, 1u);
             if (tx > 1) tx >>= 1;
@@ -328,13 +604,21 @@ static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *
         o += DeriveYUVLayout(alloc->mHal.state.yuv, &alloc->mHal.drvState);
 
         for (uint32_t ct = 1; ct < alloc->mHal.drvState.lodCount; ct++) {
-            offsets[ct] = (size_t)alloc->mHal.drvState.lod[ct].mallocPtr;
+            offsets[ct] = (size_t)alloc->mHal.drvState.lod[ct].mallocPtr + offsets[0];
+            if (user && (ct < user->count)) {
+                // Planes of camera and codec buffers are placed and padded
+                // by the producer.
+                offsets[ct] = user->offset[ct];
+                if (user->stride[ct]) {
+                    alloc->mHal.drvState.lod[ct].stride = user->stride[ct];
+                }
+            }
         }
     }
 
     alloc->mHal.drvState.faceOffset = o;
 
-    alloc->mHal.drvState.lod[0].mallocPtr = ptr;
+    alloc->mHal.drvState.lod[0].mallocPtr = ptr + offsets[0];
     for (uint32_t lod=1; lod < alloc->mHal.drvState.lodCount; lod++) {
         alloc->mHal.drvState.lod[lod].mallocPtr = ptr + offsets[lod];
     }
@@ -347,6 +631,41 @@ static size_t AllocationBuildPointerTable(const Context *rsc, const Allocation *
     return allocSize;
 }
 
+// Checks the layout a user-backed allocation will get against its type.
+static bool ValidateUserLayout(const Allocation *alloc) {
+    const Allocation::Hal::UserLayout *user = &alloc->mHal.userLayout;
+    const Type *type = alloc->getType();
+    uint32_t entries = type->getLODCount();
+    if (alloc->mHal.state.yuv) {
+        entries = ((alloc->mHal.state.yuv == RS_YUV_YV12) ||
+                   (alloc->mHal.state.yuv == RS_YUV_I420)) ? 3 : 2;
+    }
+    if (user->count > entries) {
+        ALOGE("User allocation layout has %u entries, type has %u LODs or planes",
+              user->count, entries);
+        return false;
+    }
+
+    // Planes other than luma have their own row sizes, validated by the
+    // producer that laid them out.
+    entries = alloc->mHal.state.yuv ? 1 : type->getLODCount();
+    for (uint32_t ct = 0; ct < rsMin(user->count, entries); ct++) {
+        size_t rowSize = type->getLODDimX(ct) * type->getElementSizeBytes();
+        if (user->stride[ct] && (user->stride[ct] < rowSize)) {
+            ALOGE("User allocation stride %zu for LOD %u is smaller than a row, %zu bytes",
+                  user->stride[ct], ct, rowSize);
+            return false;
+        }
+        if ((alloc->mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE) &&
+            user->stride[ct] && (user->stride[ct] != rowSize)) {
+            // Texture uploads read packed rows.
+            ALOGE("User allocations shared with textures must have packed rows");
+            return false;
+        }
+    }
+    return true;
+}
+
 static uint8_t* allocAlignedMemory(size_t allocSize, bool forceZero) {
     // We align all allocations to a 16-byte boundary.
     uint8_t* ptr = (uint8_t *)memalign(16, allocSize);
@@ -377,34 +696,30 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
         // in getSurface
     } else if (alloc->mHal.state.userProvidedPtr != NULL) {
         // user-provided allocation
-        // limitations: no faces, no LOD, USAGE_SCRIPT or SCRIPT+TEXTURE only
+        // limitations: no faces, USAGE_SCRIPT or SCRIPT+TEXTURE only
         if (!(alloc->mHal.state.usageFlags == (RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED) ||
               alloc->mHal.state.usageFlags == (RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED | RS_ALLOCATION_USAGE_GRAPHICS_TEXTURE))) {
             ALOGE("Can't use user-allocated buffers if usage is not USAGE_SCRIPT | USAGE_SHARED or USAGE_SCRIPT | USAGE_SHARED | USAGE_GRAPHICS_TEXTURE");
+            alloc->mHal.drv = NULL;
+            free(drv);
             return false;
         }
-        if (alloc->getType()->getDimLOD() || alloc->getType()->getDimFaces()) {
-            ALOGE("User-allocated buffers must not have multiple faces or LODs");
+        if (alloc->getType()->getDimFaces()) {
+            ALOGE("User-allocated buffers must not have multiple faces");
+            alloc->mHal.drv = NULL;
+            free(drv);
             return false;
         }
-
-        // rows must be 16-byte aligned
-        // validate that here, otherwise fall back to not use the user-backed allocation
-        if (((alloc->getType()->getDimX() * alloc->getType()->getElement()->getSizeBytes()) % 16) != 0) {
-            ALOGV("User-backed allocation failed stride requirement, falling back to separate allocation");
-            drv->useUserProvidedPtr = false;
-
-            ptr = allocAlignedMemory(allocSize, forceZero);
-            if (!ptr) {
-                alloc->mHal.drv = NULL;
-                free(drv);
-                return false;
-            }
-
-        } else {
-            drv->useUserProvidedPtr = true;
-            ptr = (uint8_t*)alloc->mHal.state.userProvidedPtr;
+        if (!ValidateUserLayout(alloc)) {
+            alloc->mHal.drv = NULL;
+            free(drv);
+            return false;
         }
+
+        // The memory is used in place whatever its row alignment; the
+        // pointer table below describes it with the strides it came with.
+        drv->useUserProvidedPtr = true;
+        ptr = (uint8_t*)alloc->mHal.state.userProvidedPtr;
     } else {
         ptr = allocAlignedMemory(allocSize, forceZero);
         if (!ptr) {
@@ -449,11 +764,6 @@ bool rsdAllocationInit(const Context *rsc, Allocation *alloc, bool forceZero) {
 
     drv->readBackFBO = NULL;
 
-    // fill out the initial state of the buffer if we couldn't use the user-provided ptr and USAGE_SHARED was accepted
-    if ((alloc->mHal.state.userProvidedPtr != 0) && (drv->useUserProvidedPtr == false)) {
-        rsdAllocationData2D(rsc, alloc, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X, alloc->getType()->getDimX(), alloc->getType()->getDimY(), alloc->mHal.state.userProvidedPtr, allocSize, 0);
-    }
-
     return true;
 }
 
@@ -830,6 +1140,18 @@ void rsdAllocationData1D(const Context *rsc, const Allocation *alloc,
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
     const size_t eSize = alloc->mHal.state.type->getElementSizeBytes();
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopy(alloc, xoff, count, (uint8_t *)data, true);
+        drv->uploadDeferred = true;
+        return;
+    }
+    if (alloc->getTileDim()) {
+        // 1D offsets into a 2D allocation count elements in row-major order.
+        uint32_t dimX = alloc->mHal.drvState.lod[0].dimX;
+        TiledCopy(alloc, xoff % dimX, xoff / dimX, count, (uint8_t *)data, true);
+        drv->uploadDeferred = true;
+        return;
+    }
     uint8_t * ptr = GetOffsetPtr(alloc, xoff, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
     size_t size = count * eSize;
 
@@ -840,7 +1162,7 @@ void rsdAllocationData1D(const Context *rsc, const Allocation *alloc,
             alloc->incRefs(data, count);
             alloc->decRefs(ptr, count);
         }
-        memcpy(ptr, data, size);
+        CopyRows(rsc, ptr, size, (const uint8_t *)data, size, size, 1);
     }
     drv->uploadDeferred = true;
 }
@@ -856,7 +1178,16 @@ void rsdAllocationData2D(const Context *rsc, const Allocation *alloc,
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopyRows(alloc, xoff, yoff, 0, w, h, 1, (uint8_t *)data, stride, true);
+        drv->uploadDeferred = true;
+    } else if (alloc->getTileDim()) {
+        const uint8_t *src = static_cast<const uint8_t *>(data);
+        for (uint32_t line = 0; line < h; line++) {
+            TiledCopy(alloc, xoff, yoff + line, w, (uint8_t *)src + line * stride, true);
+        }
+        drv->uploadDeferred = true;
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         const uint8_t *src = static_cast<const uint8_t *>(data);
         uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, 0, lod, face);
         if (dst == src) {
@@ -866,26 +1197,27 @@ void rsdAllocationData2D(const Context *rsc, const Allocation *alloc,
             return;
         }
 
-        for (uint32_t line=yoff; line < (yoff+h); line++) {
-            if (alloc->mHal.state.hasReferences) {
-                alloc->incRefs(src, w);
-                alloc->decRefs(dst, w);
+        const size_t dstStride = alloc->mHal.drvState.lod[lod].stride;
+        if (alloc->mHal.state.hasReferences) {
+            for (uint32_t line = 0; line < h; line++) {
+                alloc->incRefs(src + line * stride, w);
+                alloc->decRefs(dst + line * dstStride, w);
             }
-            memcpy(dst, src, lineSize);
-            src += stride;
-            dst += alloc->mHal.drvState.lod[lod].stride;
         }
+        CopyRows(rsc, dst, dstStride, src, stride, lineSize, h);
+        src += stride * h;
+
         if (alloc->mHal.state.yuv) {
             int lod = 1;
             while (alloc->mHal.drvState.lod[lod].mallocPtr) {
                 size_t lineSize = alloc->mHal.drvState.lod[lod].dimX;
                 uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, 0, lod, face);
+                // An odd final luma row still carries a row of chroma.
+                size_t lines = ((yoff + h + 1) >> 1) - (yoff >> 1);
 
-                for (uint32_t line=(yoff >> 1); line < ((yoff+h)>>1); line++) {
-                    memcpy(dst, src, lineSize);
-                    src += lineSize;
-                    dst += alloc->mHal.drvState.lod[lod].stride;
-                }
+                CopyRows(rsc, dst, alloc->mHal.drvState.lod[lod].stride,
+                         src, lineSize, lineSize, lines);
+                src += lineSize * lines;
                 lod++;
             }
 
@@ -903,32 +1235,46 @@ void rsdAllocationData3D(const Context *rsc, const Allocation *alloc,
                          size_t sizeBytes, size_t stride) {
     DrvAllocation *drv = (DrvAllocation *)alloc->mHal.drv;
 
-    uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    uint32_t lineSize = eSize * w;
+    size_t eSize = alloc->mHal.state.elementSizeBytes;
+    size_t lineSize = eSize * w;
     if (!stride) {
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopyRows(alloc, xoff, yoff, zoff, w, h, d, (uint8_t *)data, stride, true);
+        drv->uploadDeferred = true;
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         const uint8_t *src = static_cast<const uint8_t *>(data);
-        for (uint32_t z = zoff; z < d; z++) {
-            uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, z, lod,
-                                        RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            if (dst == src) {
-                // Skip the copy if we are the same allocation. This can arise from
-                // our Bitmap optimization, where we share the same storage.
-                drv->uploadDeferred = true;
-                return;
-            }
+        const size_t dstStride = alloc->mHal.drvState.lod[lod].stride;
+        uint8_t *dst = GetOffsetPtr(alloc, xoff, yoff, zoff, lod,
+                                    RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        if (dst == src) {
+            // Skip the copy if we are the same allocation. This can arise from
+            // our Bitmap optimization, where we share the same storage.
+            drv->uploadDeferred = true;
+            return;
+        }
 
-            for (uint32_t line=yoff; line < (yoff+h); line++) {
-                if (alloc->mHal.state.hasReferences) {
-                    alloc->incRefs(src, w);
-                    alloc->decRefs(dst, w);
+        if (alloc->mHal.state.hasReferences) {
+            for (uint32_t z = 0; z < d; z++) {
+                uint8_t *slice = GetOffsetPtr(alloc, xoff, yoff, zoff + z, lod,
+                                              RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+                for (uint32_t line = 0; line < h; line++) {
+                    alloc->incRefs(src + ((size_t)z * h + line) * stride, w);
+                    alloc->decRefs(slice + line * dstStride, w);
                 }
-                memcpy(dst, src, lineSize);
-                src += stride;
-                dst += alloc->mHal.drvState.lod[lod].stride;
+            }
+        }
+
+        if (h == alloc->mHal.drvState.lod[lod].dimY) {
+            // Whole slices: rows are evenly spaced across slice boundaries.
+            CopyRows(rsc, dst, dstStride, src, stride, lineSize, (size_t)h * d);
+        } else {
+            for (uint32_t z = 0; z < d; z++) {
+                dst = GetOffsetPtr(alloc, xoff, yoff, zoff + z, lod,
+                                   RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+                CopyRows(rsc, dst, dstStride, src + (size_t)z * h * stride, stride, lineSize, h);
             }
         }
         drv->uploadDeferred = true;
@@ -939,11 +1285,20 @@ void rsdAllocationRead1D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t lod, size_t count,
                          void *data, size_t sizeBytes) {
     const size_t eSize = alloc->mHal.state.type->getElementSizeBytes();
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopy(alloc, xoff, count, (uint8_t *)data, false);
+        return;
+    }
+    if (alloc->getTileDim()) {
+        uint32_t dimX = alloc->mHal.drvState.lod[0].dimX;
+        TiledCopy(alloc, xoff % dimX, xoff / dimX, count, (uint8_t *)data, false);
+        return;
+    }
     const uint8_t * ptr = GetOffsetPtr(alloc, xoff, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
     if (data != ptr) {
         // Skip the copy if we are the same allocation. This can arise from
         // our Bitmap optimization, where we share the same storage.
-        memcpy(data, ptr, count * eSize);
+        CopyRows(rsc, (uint8_t *)data, count * eSize, ptr, count * eSize, count * eSize, 1);
     }
 }
 
@@ -956,7 +1311,14 @@ void rsdAllocationRead2D(const Context *rsc, const Allocation *alloc,
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopyRows(alloc, xoff, yoff, 0, w, h, 1, (uint8_t *)data, stride, false);
+    } else if (alloc->getTileDim()) {
+        uint8_t *dst = static_cast<uint8_t *>(data);
+        for (uint32_t line = 0; line < h; line++) {
+            TiledCopy(alloc, xoff, yoff + line, w, dst + line * stride, false);
+        }
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         uint8_t *dst = static_cast<uint8_t *>(data);
         const uint8_t *src = GetOffsetPtr(alloc, xoff, yoff, 0, lod, face);
         if (dst == src) {
@@ -965,11 +1327,7 @@ void rsdAllocationRead2D(const Context *rsc, const Allocation *alloc,
             return;
         }
 
-        for (uint32_t line=yoff; line < (yoff+h); line++) {
-            memcpy(dst, src, lineSize);
-            dst += stride;
-            src += alloc->mHal.drvState.lod[lod].stride;
-        }
+        CopyRows(rsc, dst, stride, src, alloc->mHal.drvState.lod[lod].stride, lineSize, h);
     } else {
         ALOGE("Add code to readback from non-script memory");
     }
@@ -980,27 +1338,32 @@ void rsdAllocationRead3D(const Context *rsc, const Allocation *alloc,
                          uint32_t xoff, uint32_t yoff, uint32_t zoff,
                          uint32_t lod,
                          uint32_t w, uint32_t h, uint32_t d, void *data, size_t sizeBytes, size_t stride) {
-    uint32_t eSize = alloc->mHal.state.elementSizeBytes;
-    uint32_t lineSize = eSize * w;
+    size_t eSize = alloc->mHal.state.elementSizeBytes;
+    size_t lineSize = eSize * w;
     if (!stride) {
         stride = lineSize;
     }
 
-    if (alloc->mHal.drvState.lod[0].mallocPtr) {
+    if (alloc->getHasFieldPlanes()) {
+        PlanarCopyRows(alloc, xoff, yoff, zoff, w, h, d, (uint8_t *)data, stride, false);
+    } else if (alloc->mHal.drvState.lod[0].mallocPtr) {
         uint8_t *dst = static_cast<uint8_t *>(data);
-        for (uint32_t z = zoff; z < d; z++) {
-            const uint8_t *src = GetOffsetPtr(alloc, xoff, yoff, z, lod,
-                                              RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            if (dst == src) {
-                // Skip the copy if we are the same allocation. This can arise from
-                // our Bitmap optimization, where we share the same storage.
-                return;
-            }
+        const size_t srcStride = alloc->mHal.drvState.lod[lod].stride;
+        const uint8_t *src = GetOffsetPtr(alloc, xoff, yoff, zoff, lod,
+                                          RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        if (dst == src) {
+            // Skip the copy if we are the same allocation. This can arise from
+            // our Bitmap optimization, where we share the same storage.
+            return;
+        }
 
-            for (uint32_t line=yoff; line < (yoff+h); line++) {
-                memcpy(dst, src, lineSize);
-                dst += stride;
-                src += alloc->mHal.drvState.lod[lod].stride;
+        if (h == alloc->mHal.drvState.lod[lod].dimY) {
+            CopyRows(rsc, dst, stride, src, srcStride, lineSize, (size_t)h * d);
+        } else {
+            for (uint32_t z = 0; z < d; z++) {
+                src = GetOffsetPtr(alloc, xoff, yoff, zoff + z, lod,
+                                   RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+                CopyRows(rsc, dst + (size_t)z * h * stride, stride, src, srcStride, lineSize, h);
             }
         }
     }
@@ -1021,6 +1384,38 @@ void rsdAllocationData1D_alloc(const android::renderscript::Context *rsc,
                                uint32_t dstXoff, uint32_t dstLod, size_t count,
                                const android::renderscript::Allocation *srcAlloc,
                                uint32_t srcXoff, uint32_t srcLod) {
+    const size_t eSize = dstAlloc->mHal.state.elementSizeBytes;
+    if (dstAlloc->getTileDim() || srcAlloc->getTileDim() ||
+        dstAlloc->getHasFieldPlanes() || srcAlloc->getHasFieldPlanes()) {
+        // Go through linear memory; the runs of the two layouts differ.
+        uint8_t *tmp = (uint8_t *)malloc(count * eSize);
+        if (!tmp) {
+            rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory copying allocation.");
+            return;
+        }
+        rsdAllocationRead1D(rsc, srcAlloc, srcXoff, srcLod, count, tmp, count * eSize);
+        rsdAllocationData1D(rsc, dstAlloc, dstXoff, dstLod, count, tmp, count * eSize);
+        free(tmp);
+        return;
+    }
+    uint8_t *dst = GetOffsetPtr(dstAlloc, dstXoff, 0, 0, dstLod,
+                                RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    const uint8_t *src = GetOffsetPtr(srcAlloc, srcXoff, 0, 0, srcLod,
+                                      RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    if (dst == src) {
+        return;
+    }
+
+    if (dstAlloc->mHal.state.hasReferences) {
+        dstAlloc->incRefs(src, count);
+        dstAlloc->decRefs(dst, count);
+    }
+    if (dstAlloc == srcAlloc) {
+        MoveRows(dst, 0, src, 0, count * eSize, 1);
+    } else {
+        CopyRows(rsc, dst, count * eSize, src, count * eSize, count * eSize, 1);
+    }
+    ((DrvAllocation *)dstAlloc->mHal.drv)->uploadDeferred = true;
 }
 
 
@@ -1032,13 +1427,36 @@ void rsdAllocationData2D_alloc_script(const android::renderscript::Context *rsc,
                                       uint32_t srcXoff, uint32_t srcYoff, uint32_t srcLod,
                                       RsAllocationCubemapFace srcFace) {
     size_t elementSize = dstAlloc->getType()->getElementSizeBytes();
-    for (uint32_t i = 0; i < h; i ++) {
-        uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff + i, 0, dstLod, dstFace);
-        uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff + i, 0, srcLod, srcFace);
-        memcpy(dstPtr, srcPtr, w * elementSize);
+    if (dstAlloc->getTileDim() || srcAlloc->getTileDim() ||
+        dstAlloc->getHasFieldPlanes() || srcAlloc->getHasFieldPlanes()) {
+        // Go through linear memory a row at a time.  Rows are moved from
+        // the bottom up when they overlap in one allocation.
+        size_t rowBytes = w * elementSize;
+        uint8_t *tmp = (uint8_t *)malloc(rowBytes);
+        if (!tmp) {
+            rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory copying allocation.");
+            return;
+        }
+        bool reverse = (dstAlloc == srcAlloc) && (dstYoff > srcYoff);
+        for (uint32_t ct = 0; ct < h; ct++) {
+            uint32_t line = reverse ? (h - 1 - ct) : ct;
+            rsdAllocationRead2D(rsc, srcAlloc, srcXoff, srcYoff + line, srcLod, srcFace,
+                                w, 1, tmp, rowBytes, rowBytes);
+            rsdAllocationData2D(rsc, dstAlloc, dstXoff, dstYoff + line, dstLod, dstFace,
+                                w, 1, tmp, rowBytes, rowBytes);
+        }
+        free(tmp);
+        return;
+    }
+    uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff, 0, dstLod, dstFace);
+    uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff, 0, srcLod, srcFace);
+    size_t dstStride = dstAlloc->mHal.drvState.lod[dstLod].stride;
+    size_t srcStride = srcAlloc->mHal.drvState.lod[srcLod].stride;
 
-        //ALOGE("COPIED dstXoff(%u), dstYoff(%u), dstLod(%u), dstFace(%u), w(%u), h(%u), srcXoff(%u), srcYoff(%u), srcLod(%u), srcFace(%u)",
-        //     dstXoff, dstYoff, dstLod, dstFace, w, h, srcXoff, srcYoff, srcLod, srcFace);
+    if (dstAlloc == srcAlloc) {
+        MoveRows(dstPtr, dstStride, srcPtr, srcStride, w * elementSize, h);
+    } else {
+        CopyRows(rsc, dstPtr, dstStride, srcPtr, srcStride, w * elementSize, h);
     }
 }
 
@@ -1049,16 +1467,43 @@ void rsdAllocationData3D_alloc_script(const android::renderscript::Context *rsc,
                                       const android::renderscript::Allocation *srcAlloc,
                                       uint32_t srcXoff, uint32_t srcYoff, uint32_t srcZoff, uint32_t srcLod) {
     uint32_t elementSize = dstAlloc->getType()->getElementSizeBytes();
-    for (uint32_t j = 0; j < d; j++) {
-        for (uint32_t i = 0; i < h; i ++) {
-            uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff + i, dstZoff + j,
-                                           dstLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff + i, srcZoff + j,
-                                           srcLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
-            memcpy(dstPtr, srcPtr, w * elementSize);
-
-            //ALOGE("COPIED dstXoff(%u), dstYoff(%u), dstLod(%u), dstFace(%u), w(%u), h(%u), srcXoff(%u), srcYoff(%u), srcLod(%u), srcFace(%u)",
-            //     dstXoff, dstYoff, dstLod, dstFace, w, h, srcXoff, srcYoff, srcLod, srcFace);
+    size_t dstStride = dstAlloc->mHal.drvState.lod[dstLod].stride;
+    size_t srcStride = srcAlloc->mHal.drvState.lod[srcLod].stride;
+    // Overlapping slices of one allocation are moved back to front when
+    // the destination follows the source.
+    bool reverse = (dstAlloc == srcAlloc) && (dstZoff > srcZoff);
+    if (dstAlloc->getHasFieldPlanes() || srcAlloc->getHasFieldPlanes()) {
+        // Go through packed cells a row at a time.
+        size_t rowBytes = (size_t)w * elementSize;
+        uint8_t *tmp = (uint8_t *)malloc(rowBytes);
+        if (!tmp) {
+            rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Out of memory copying allocation.");
+            return;
+        }
+        bool reverseRows = (dstAlloc == srcAlloc) && (dstZoff == srcZoff) && (dstYoff > srcYoff);
+        for (uint32_t ct = 0; ct < d; ct++) {
+            uint32_t j = reverse ? (d - 1 - ct) : ct;
+            for (uint32_t cl = 0; cl < h; cl++) {
+                uint32_t line = reverseRows ? (h - 1 - cl) : cl;
+                rsdAllocationRead3D(rsc, srcAlloc, srcXoff, srcYoff + line, srcZoff + j, srcLod,
+                                    w, 1, 1, tmp, rowBytes, rowBytes);
+                rsdAllocationData3D(rsc, dstAlloc, dstXoff, dstYoff + line, dstZoff + j, dstLod,
+                                    w, 1, 1, tmp, rowBytes, rowBytes);
+            }
+        }
+        free(tmp);
+        return;
+    }
+    for (uint32_t ct = 0; ct < d; ct++) {
+        uint32_t j = reverse ? (d - 1 - ct) : ct;
+        uint8_t *dstPtr = GetOffsetPtr(dstAlloc, dstXoff, dstYoff, dstZoff + j,
+                                       dstLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        uint8_t *srcPtr = GetOffsetPtr(srcAlloc, srcXoff, srcYoff, srcZoff + j,
+                                       srcLod, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+        if (dstAlloc == srcAlloc) {
+            MoveRows(dstPtr, dstStride, srcPtr, srcStride, w * elementSize, h);
+        } else {
+            CopyRows(rsc, dstPtr, dstStride, srcPtr, srcStride, w * elementSize, h);
         }
     }
 }
@@ -1108,6 +1553,9 @@ void rsdAllocationElementData1D(const Context *rsc, const Allocation *alloc,
 
     const Element * e = alloc->mHal.state.type->getElement()->getField(cIdx);
     ptr += alloc->mHal.state.type->getElement()->getFieldOffsetBytes(cIdx);
+    if (alloc->getHasFieldPlanes()) {
+        ptr = PlanarFieldPtr(alloc, cIdx, x);
+    }
 
     if (alloc->mHal.state.hasReferences) {
         e->incRefs(data);
@@ -1128,6 +1576,9 @@ void rsdAllocationElementData2D(const Context *rsc, const Allocation *alloc,
 
     const Element * e = alloc->mHal.state.type->getElement()->getField(cIdx);
     ptr += alloc->mHal.state.type->getElement()->getFieldOffsetBytes(cIdx);
+    if (alloc->getHasFieldPlanes()) {
+        ptr = PlanarFieldPtr(alloc, cIdx, (size_t)y * alloc->mHal.drvState.lod[0].dimX + x);
+    }
 
     if (alloc->mHal.state.hasReferences) {
         e->incRefs(data);
@@ -1138,78 +1589,458 @@ void rsdAllocationElementData2D(const Context *rsc, const Allocation *alloc,
     drv->uploadDeferred = true;
 }
 
-static void mip565(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
+// Mipmap generation.  Every level is filtered from the one above it, so the
+// levels run in order, but all faces of a level are built by one launch
+// that hands out chunks of destination rows to the worker pool.
+
+// Launches producing less than this many bytes stay on the calling thread.
+static const size_t kParallelMipBytes = 64 * 1024;
+// Rows are handed out in chunks reading about this many source bytes.
+static const size_t kMipChunkBytes = 32 * 1024;
+// Taps of the windowed sinc filters: a radius of 3 texels of the smaller
+// level covers 6 source texels on each side of the output centre.
+static const uint32_t kMipFilterTaps = 12;
+
+typedef struct MipJobRec {
+    const Allocation *alloc;
+    uint32_t lod;
+    RsDataType dataType;
+    // Components per element, including the padding of 3 component vectors.
+    uint32_t components;
+    bool filtered;
+    float weights[kMipFilterTaps];
+    float *scratch;
+    size_t scratchFloats;
+    uint32_t rowsPerChunk;
+    uint32_t chunksPerFace;
+    uint32_t chunkCount;
+    volatile int nextChunk;
+} MipJob;
+
+static float MipSinc(float x) {
+    if (fabsf(x) < 1e-5f) {
+        return 1.f;
+    }
+    x *= (float)M_PI;
+    return sinf(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind.
+static float MipBesselI0(float x) {
+    float sum = 1.f;
+    float term = 1.f;
+    for (int k = 1; k < 16; k++) {
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void MipFilterWeights(RsMipmapFilter filter, float *w) {
+    const float radius = 3.f;
+    const float beta = 4.f;
+    float sum = 0.f;
+    for (uint32_t k = 0; k < kMipFilterTaps; k++) {
+        // Distance in texels of the smaller level from the output centre.
+        float x = ((float)k - 5.5f) * 0.5f;
+        float window;
+        if (filter == RS_MIPMAP_FILTER_LANCZOS3) {
+            window = MipSinc(x / radius);
+        } else {
+            float r = x / radius;
+            window = MipBesselI0(beta * sqrtf(rsMax(0.f, 1.f - r * r))) / MipBesselI0(beta);
+        }
+        w[k] = MipSinc(x) * window;
+        sum += w[k];
+    }
+    for (uint32_t k = 0; k < kMipFilterTaps; k++) {
+        w[k] /= sum;
+    }
+}
+
+// Averages each bit field of four packed 16 bit texels.
+static uint16_t MipBoxPacked(uint16_t i1, uint16_t i2, uint16_t i3, uint16_t i4,
+                             const uint32_t *shifts, const uint32_t *widths, uint32_t fields) {
+    uint32_t r = 0;
+    for (uint32_t ct = 0; ct < fields; ct++) {
+        uint32_t mask = (1 << widths[ct]) - 1;
+        uint32_t s = shifts[ct];
+        uint32_t v = ((i1 >> s) & mask) + ((i2 >> s) & mask) +
+                     ((i3 >> s) & mask) + ((i4 >> s) & mask);
+        r |= (v >> 2) << s;
+    }
+    return r;
+}
 
-    for (uint32_t y=0; y < h; y++) {
-        uint16_t *oPtr = (uint16_t *)GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint16_t *i1 = (uint16_t *)GetOffsetPtr(alloc, 0, 0, y*2, lod, face);
-        const uint16_t *i2 = (uint16_t *)GetOffsetPtr(alloc, 0, 0, y*2+1, lod, face);
+// 2x2 box filter of integer texels.  sw is the width of the source level;
+// for odd widths the last column is dropped, a width of 1 repeats it.
+template <typename T>
+static void MipBoxRow(T *out, const T *i1, const T *i2, uint32_t dw, uint32_t sw, uint32_t c) {
+    for (uint32_t x = 0; x < dw; x++) {
+        const uint32_t x0 = 2 * x * c;
+        const uint32_t x1 = rsMin(2 * x + 1, sw - 1) * c;
+        for (uint32_t ct = 0; ct < c; ct++) {
+            uint32_t v = (uint32_t)i1[x0 + ct] + i1[x1 + ct] + i2[x0 + ct] + i2[x1 + ct];
+            out[x * c + ct] = (T)(v >> 2);
+        }
+    }
+}
+
+static void MipBoxRowF32(float *out, const float *i1, const float *i2,
+                         uint32_t dw, uint32_t sw, uint32_t c) {
+    uint32_t x = 0;
+#if defined(__SSE2__)
+    if ((c == 4) && (sw == dw * 2)) {
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (; x < dw; x++) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(i1 + x * 8), _mm_loadu_ps(i1 + x * 8 + 4)),
+                                  _mm_add_ps(_mm_loadu_ps(i2 + x * 8), _mm_loadu_ps(i2 + x * 8 + 4)));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(v, quarter));
+        }
+    }
+#elif defined(__ARM_NEON__)
+    if ((c == 4) && (sw == dw * 2)) {
+        for (; x < dw; x++) {
+            float32x4_t v = vaddq_f32(vaddq_f32(vld1q_f32(i1 + x * 8), vld1q_f32(i1 + x * 8 + 4)),
+                                      vaddq_f32(vld1q_f32(i2 + x * 8), vld1q_f32(i2 + x * 8 + 4)));
+            vst1q_f32(out + x * 4, vmulq_n_f32(v, 0.25f));
+        }
+    }
+#endif
+    for (; x < dw; x++) {
+        const uint32_t x0 = 2 * x * c;
+        const uint32_t x1 = rsMin(2 * x + 1, sw - 1) * c;
+        for (uint32_t ct = 0; ct < c; ct++) {
+            out[x * c + ct] = (i1[x0 + ct] + i1[x1 + ct] + i2[x0 + ct] + i2[x1 + ct]) * 0.25f;
+        }
+    }
+}
+
+static void MipBoxRowF16(uint16_t *out, const uint16_t *i1, const uint16_t *i2,
+                         uint32_t dw, uint32_t sw, uint32_t c) {
+    for (uint32_t x = 0; x < dw; x++) {
+        const uint32_t x0 = 2 * x * c;
+        const uint32_t x1 = rsMin(2 * x + 1, sw - 1) * c;
+        for (uint32_t ct = 0; ct < c; ct++) {
+            float v = rsHalfToFloat(i1[x0 + ct]) + rsHalfToFloat(i1[x1 + ct]) +
+                      rsHalfToFloat(i2[x0 + ct]) + rsHalfToFloat(i2[x1 + ct]);
+            out[x * c + ct] = rsFloatToHalf(v * 0.25f);
+        }
+    }
+}
+
+static void MipBoxRowU8(uint8_t *out, const uint8_t *i1, const uint8_t *i2,
+                        uint32_t dw, uint32_t sw, uint32_t c) {
+    uint32_t x = 0;
+    if (sw == dw * 2) {
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        if (c == 4) {
+            // Four output texels from 32 bytes of each row.
+            for (; x + 4 <= dw; x += 4) {
+                __m128i s[2];
+                for (int h = 0; h < 2; h++) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(i1 + x * 8 + h * 16));
+                    __m128i b = _mm_loadu_si128((const __m128i *)(i2 + x * 8 + h * 16));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                               _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                               _mm_unpackhi_epi8(b, zero));
+                    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                    s[h] = _mm_srli_epi16(_mm_unpacklo_epi64(lo, hi), 2);
+                }
+                _mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(s[0], s[1]));
+            }
+        } else if (c == 1) {
+            const __m128i even = _mm_set1_epi16(0xff);
+            for (; x + 8 <= dw; x += 8) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(i1 + x * 2));
+                __m128i b = _mm_loadu_si128((const __m128i *)(i2 + x * 2));
+                __m128i v = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, even), _mm_srli_epi16(a, 8)),
+                                          _mm_add_epi16(_mm_and_si128(b, even), _mm_srli_epi16(b, 8)));
+                v = _mm_srli_epi16(v, 2);
+                _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(v, v));
+            }
+        }
+#elif defined(__ARM_NEON__)
+        if (c == 4) {
+            for (; x + 8 <= dw; x += 8) {
+                uint8x16x4_t a = vld4q_u8(i1 + x * 8);
+                uint8x16x4_t b = vld4q_u8(i2 + x * 8);
+                uint8x8x4_t r;
+                for (int ch = 0; ch < 4; ch++) {
+                    uint16x8_t v = vaddq_u16(vpaddlq_u8(a.val[ch]), vpaddlq_u8(b.val[ch]));
+                    r.val[ch] = vshrn_n_u16(v, 2);
+                }
+                vst4_u8(out + x * 4, r);
+            }
+        } else if (c == 1) {
+            for (; x + 8 <= dw; x += 8) {
+                uint16x8_t v = vaddq_u16(vpaddlq_u8(vld1q_u8(i1 + x * 2)),
+                                         vpaddlq_u8(vld1q_u8(i2 + x * 2)));
+                vst1_u8(out + x, vshrn_n_u16(v, 2));
+            }
+        }
+#endif
+    }
+    if (x < dw) {
+        MipBoxRow<uint8_t>(out + x * c, i1 + x * 2 * c, i2 + x * 2 * c, dw - x, sw - x * 2, c);
+    }
+}
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = rsBoxFilter565(i1[0], i1[1], i2[0], i2[1]);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+static void MipLoadRow(float *dst, const uint8_t *src, RsDataType dt, size_t count) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_8:
+        for (size_t ct = 0; ct < count; ct++) {
+            dst[ct] = src[ct];
         }
+        break;
+    case RS_TYPE_UNSIGNED_16:
+        for (size_t ct = 0; ct < count; ct++) {
+            dst[ct] = ((const uint16_t *)src)[ct];
+        }
+        break;
+    case RS_TYPE_FLOAT_16:
+        for (size_t ct = 0; ct < count; ct++) {
+            dst[ct] = rsHalfToFloat(((const uint16_t *)src)[ct]);
+        }
+        break;
+    default:
+        memcpy(dst, src, count * sizeof(float));
+        break;
     }
 }
 
-static void mip8888(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
+static void MipStoreRow(uint8_t *dst, const float *src, RsDataType dt, size_t count) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_8:
+        for (size_t ct = 0; ct < count; ct++) {
+            dst[ct] = (uint8_t)rsMin(255.f, rsMax(0.f, src[ct] + 0.5f));
+        }
+        break;
+    case RS_TYPE_UNSIGNED_16:
+        for (size_t ct = 0; ct < count; ct++) {
+            ((uint16_t *)dst)[ct] = (uint16_t)rsMin(65535.f, rsMax(0.f, src[ct] + 0.5f));
+        }
+        break;
+    case RS_TYPE_FLOAT_16:
+        for (size_t ct = 0; ct < count; ct++) {
+            ((uint16_t *)dst)[ct] = rsFloatToHalf(src[ct]);
+        }
+        break;
+    default:
+        memcpy(dst, src, count * sizeof(float));
+        break;
+    }
+}
 
-    for (uint32_t y=0; y < h; y++) {
-        uint32_t *oPtr = (uint32_t *)GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint32_t *i1 = (uint32_t *)GetOffsetPtr(alloc, 0, y*2, 0, lod, face);
-        const uint32_t *i2 = (uint32_t *)GetOffsetPtr(alloc, 0, y*2+1, 0, lod, face);
+static void MipAccumulate(float *acc, const float *row, float w, size_t count) {
+    size_t ct = 0;
+#if defined(__SSE2__)
+    const __m128 wv = _mm_set1_ps(w);
+    for (; ct + 4 <= count; ct += 4) {
+        _mm_storeu_ps(acc + ct, _mm_add_ps(_mm_loadu_ps(acc + ct),
+                                           _mm_mul_ps(_mm_loadu_ps(row + ct), wv)));
+    }
+#elif defined(__ARM_NEON__)
+    for (; ct + 4 <= count; ct += 4) {
+        vst1q_f32(acc + ct, vmlaq_n_f32(vld1q_f32(acc + ct), vld1q_f32(row + ct), w));
+    }
+#endif
+    for (; ct < count; ct++) {
+        acc[ct] += row[ct] * w;
+    }
+}
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = rsBoxFilter8888(i1[0], i1[1], i2[0], i2[1]);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+// Separable windowed sinc: the source rows around the output row are
+// combined first, then each output texel is filtered across that row.
+static void MipFilterRow(const MipJob *job, float *scratch, uint32_t y, uint32_t face) {
+    const Allocation *alloc = job->alloc;
+    const uint32_t c = job->components;
+    const uint32_t sw = alloc->mHal.drvState.lod[job->lod].dimX;
+    const uint32_t sh = rsMax(alloc->mHal.drvState.lod[job->lod].dimY, (uint32_t)1);
+    const uint32_t dw = alloc->mHal.drvState.lod[job->lod + 1].dimX;
+
+    float *acc = scratch;
+    float *tmp = acc + sw * c;
+    float *out = tmp + sw * c;
+
+    memset(acc, 0, sw * c * sizeof(float));
+    for (uint32_t k = 0; k < kMipFilterTaps; k++) {
+        int32_t sy = rsMin(rsMax((int32_t)(2 * y + k) - 5, 0), (int32_t)sh - 1);
+        MipLoadRow(tmp, GetOffsetPtr(alloc, 0, sy, 0, job->lod, (RsAllocationCubemapFace)face),
+                   job->dataType, sw * c);
+        MipAccumulate(acc, tmp, job->weights[k], sw * c);
+    }
+
+    for (uint32_t x = 0; x < dw; x++) {
+        for (uint32_t ct = 0; ct < c; ct++) {
+            out[x * c + ct] = 0.f;
+        }
+        for (uint32_t k = 0; k < kMipFilterTaps; k++) {
+            int32_t sx = rsMin(rsMax((int32_t)(2 * x + k) - 5, 0), (int32_t)sw - 1);
+            const float *p = acc + sx * c;
+            for (uint32_t ct = 0; ct < c; ct++) {
+                out[x * c + ct] += p[ct] * job->weights[k];
+            }
         }
     }
+    MipStoreRow(GetOffsetPtr(alloc, 0, y, 0, job->lod + 1, (RsAllocationCubemapFace)face),
+                out, job->dataType, dw * c);
 }
 
-static void mip8(const Allocation *alloc, int lod, RsAllocationCubemapFace face) {
-    uint32_t w = alloc->mHal.drvState.lod[lod + 1].dimX;
-    uint32_t h = alloc->mHal.drvState.lod[lod + 1].dimY;
+static void MipBoxRowAny(const MipJob *job, uint32_t y, uint32_t face) {
+    const Allocation *alloc = job->alloc;
+    const uint32_t lod = job->lod;
+    const uint32_t c = job->components;
+    const uint32_t sw = alloc->mHal.drvState.lod[lod].dimX;
+    const uint32_t sh = rsMax(alloc->mHal.drvState.lod[lod].dimY, (uint32_t)1);
+    const uint32_t dw = alloc->mHal.drvState.lod[lod + 1].dimX;
+    const RsAllocationCubemapFace f = (RsAllocationCubemapFace)face;
+
+    uint8_t *o = GetOffsetPtr(alloc, 0, y, 0, lod + 1, f);
+    const uint8_t *i1 = GetOffsetPtr(alloc, 0, rsMin(2 * y, sh - 1), 0, lod, f);
+    const uint8_t *i2 = GetOffsetPtr(alloc, 0, rsMin(2 * y + 1, sh - 1), 0, lod, f);
+
+    switch (job->dataType) {
+    case RS_TYPE_UNSIGNED_8:
+        MipBoxRowU8(o, i1, i2, dw, sw, c);
+        break;
+    case RS_TYPE_UNSIGNED_16:
+        MipBoxRow<uint16_t>((uint16_t *)o, (const uint16_t *)i1, (const uint16_t *)i2, dw, sw, c);
+        break;
+    case RS_TYPE_FLOAT_16:
+        MipBoxRowF16((uint16_t *)o, (const uint16_t *)i1, (const uint16_t *)i2, dw, sw, c);
+        break;
+    case RS_TYPE_FLOAT_32:
+        MipBoxRowF32((float *)o, (const float *)i1, (const float *)i2, dw, sw, c);
+        break;
+    default: {
+        static const uint32_t s565[] = {0, 5, 11};
+        static const uint32_t w565[] = {5, 6, 5};
+        static const uint32_t s5551[] = {0, 1, 6, 11};
+        static const uint32_t w5551[] = {1, 5, 5, 5};
+        static const uint32_t s4444[] = {0, 4, 8, 12};
+        static const uint32_t w4444[] = {4, 4, 4, 4};
+        const uint32_t *shifts = s4444;
+        const uint32_t *widths = w4444;
+        uint32_t fields = 4;
+        if (job->dataType == RS_TYPE_UNSIGNED_5_6_5) {
+            shifts = s565;
+            widths = w565;
+            fields = 3;
+        } else if (job->dataType == RS_TYPE_UNSIGNED_5_5_5_1) {
+            shifts = s5551;
+            widths = w5551;
+        }
+        const uint16_t *p1 = (const uint16_t *)i1;
+        const uint16_t *p2 = (const uint16_t *)i2;
+        for (uint32_t x = 0; x < dw; x++) {
+            const uint32_t x1 = rsMin(2 * x + 1, sw - 1);
+            ((uint16_t *)o)[x] = MipBoxPacked(p1[2 * x], p1[x1], p2[2 * x], p2[x1],
+                                              shifts, widths, fields);
+        }
+        break;
+    }
+    }
+}
 
-    for (uint32_t y=0; y < h; y++) {
-        uint8_t *oPtr = GetOffsetPtr(alloc, 0, y, 0, lod + 1, face);
-        const uint8_t *i1 = GetOffsetPtr(alloc, 0, y*2, 0, lod, face);
-        const uint8_t *i2 = GetOffsetPtr(alloc, 0, y*2+1, 0, lod, face);
+static void MipWorker(void *usr, uint32_t idx) {
+    MipJob *job = (MipJob *)usr;
+    float *scratch = job->scratch ? job->scratch + idx * job->scratchFloats : NULL;
+    const uint32_t dh = rsMax(job->alloc->mHal.drvState.lod[job->lod + 1].dimY, (uint32_t)1);
 
-        for (uint32_t x=0; x < w; x++) {
-            *oPtr = (uint8_t)(((uint32_t)i1[0] + i1[1] + i2[0] + i2[1]) * 0.25f);
-            oPtr ++;
-            i1 += 2;
-            i2 += 2;
+    while (1) {
+        uint32_t chunk = (uint32_t)__sync_fetch_and_add(&job->nextChunk, 1);
+        if (chunk >= job->chunkCount) {
+            return;
+        }
+        uint32_t face = chunk / job->chunksPerFace;
+        uint32_t y = (chunk % job->chunksPerFace) * job->rowsPerChunk;
+        uint32_t yEnd = rsMin(y + job->rowsPerChunk, dh);
+        for (; y < yEnd; y++) {
+            if (job->filtered) {
+                MipFilterRow(job, scratch, y, face);
+            } else {
+                MipBoxRowAny(job, y, face);
+            }
         }
     }
 }
 
-void rsdAllocationGenerateMipmaps(const Context *rsc, const Allocation *alloc) {
+void rsdAllocationGenerateMipmapsFiltered(const Context *rsc, const Allocation *alloc,
+                                          RsMipmapFilter filter) {
     if(!alloc->mHal.drvState.lod[0].mallocPtr) {
         return;
     }
-    uint32_t numFaces = alloc->getType()->getDimFaces() ? 6 : 1;
-    for (uint32_t face = 0; face < numFaces; face ++) {
-        for (uint32_t lod=0; lod < (alloc->getType()->getLODCount() -1); lod++) {
-            switch (alloc->getType()->getElement()->getSizeBits()) {
-            case 32:
-                mip8888(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
-            case 16:
-                mip565(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
-            case 8:
-                mip8(alloc, lod, (RsAllocationCubemapFace)face);
-                break;
-            }
+
+    const Element *e = alloc->getType()->getElement();
+    MipJob job;
+    memset(&job, 0, sizeof(job));
+    job.alloc = alloc;
+    job.dataType = e->getType();
+    switch (job.dataType) {
+    case RS_TYPE_UNSIGNED_8:
+    case RS_TYPE_UNSIGNED_16:
+    case RS_TYPE_FLOAT_16:
+    case RS_TYPE_FLOAT_32:
+        if (e->getFieldCount() || (e->getVectorSize() > 4)) {
+            return;
         }
+        job.components = e->getSizeBytes() / ((job.dataType == RS_TYPE_UNSIGNED_8) ? 1 :
+                                              (job.dataType == RS_TYPE_FLOAT_32) ? 4 : 2);
+        job.filtered = filter != RS_MIPMAP_FILTER_BOX;
+        break;
+    case RS_TYPE_UNSIGNED_5_6_5:
+    case RS_TYPE_UNSIGNED_5_5_5_1:
+    case RS_TYPE_UNSIGNED_4_4_4_4:
+        job.components = 1;
+        break;
+    default:
+        // Mipmaps of other element types are left untouched.
+        return;
+    }
+    if (job.filtered) {
+        MipFilterWeights(filter, job.weights);
     }
+
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    const uint32_t threads = dc->mCpuRef->getThreadCount();
+    const uint32_t faceCount = alloc->getType()->getDimFaces() ? 6 : 1;
+    const uint32_t lodCount = alloc->getType()->getLODCount();
+
+    if (job.filtered) {
+        // Two rows of the source level and one of the destination.
+        job.scratchFloats = (size_t)alloc->mHal.drvState.lod[0].dimX * job.components * 3;
+        job.scratch = (float *)malloc(job.scratchFloats * threads * sizeof(float));
+        if (!job.scratch) {
+            ALOGE("Out of memory generating mipmaps");
+            return;
+        }
+    }
+
+    for (uint32_t lod = 0; lod + 1 < lodCount; lod++) {
+        const size_t srcStride = alloc->mHal.drvState.lod[lod].stride;
+        const uint32_t dh = rsMax(alloc->mHal.drvState.lod[lod + 1].dimY, (uint32_t)1);
+        job.lod = lod;
+        job.rowsPerChunk = rsMin(rsMax((uint32_t)(kMipChunkBytes / (srcStride * 2)), (uint32_t)1),
+                                 dh);
+        job.chunksPerFace = (dh + job.rowsPerChunk - 1) / job.rowsPerChunk;
+        job.chunkCount = job.chunksPerFace * faceCount;
+        job.nextChunk = 0;
+
+        const size_t bytes = (size_t)alloc->mHal.drvState.lod[lod + 1].stride * dh * faceCount;
+        if ((job.chunkCount < 2) || (threads < 2) ||
+            (!job.filtered && (bytes < kParallelMipBytes))) {
+            MipWorker(&job, 0);
+        } else {
+            rsdLaunchThreads(rsc, MipWorker, &job);
+        }
+    }
+    free(job.scratch);
+}
+
+void rsdAllocationGenerateMipmaps(const Context *rsc, const Allocation *alloc) {
+    rsdAllocationGenerateMipmapsFiltered(rsc, alloc, RS_MIPMAP_FILTER_BOX);
 }
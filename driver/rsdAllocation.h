@@ -91,6 +91,10 @@ GLenum rsdTypeToGLType(RsDataType t);
 GLenum rsdKindToGLFormat(RsDataKind k);
 #endif
 
+// Address of a cell of a script allocation in either storage layout.
+uint8_t *GetOffsetPtr(const android::renderscript::Allocation *alloc,
+                      uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                      uint32_t lod, RsAllocationCubemapFace face);
 
 bool rsdAllocationInit(const android::renderscript::Context *rsc,
                        android::renderscript::Allocation *alloc,
@@ -183,6 +187,9 @@ void rsdAllocationElementData2D(const android::renderscript::Context *rsc,
 
 void rsdAllocationGenerateMipmaps(const android::renderscript::Context *rsc,
                                   const android::renderscript::Allocation *alloc);
+void rsdAllocationGenerateMipmapsFiltered(const android::renderscript::Context *rsc,
+                                          const android::renderscript::Allocation *alloc,
+                                          RsMipmapFilter filter);
 
 
 
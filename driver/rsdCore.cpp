@@ -109,7 +109,8 @@ static RsdHalFunctions FunctionTable = {
         rsdAllocationData3D_alloc,
         rsdAllocationElementData1D,
         rsdAllocationElementData2D,
-        rsdAllocationGenerateMipmaps
+        rsdAllocationGenerateMipmaps,
+        rsdAllocationGenerateMipmapsFiltered
     },
 
 
@@ -237,6 +238,11 @@ void Shutdown(Context *rsc) {
     rsc->mHal.drv = NULL;
 }
 
+void rsdLaunchThreads(const Context *rsc, WorkerCallback_t cbk, void *data) {
+    RsdHal *dc = (RsdHal *)rsc->mHal.drv;
+    dc->mCpuRef->runWorkers(cbk, data);
+}
+
 void* rsdAllocRuntimeMem(size_t size, uint32_t flags) {
     void* buffer = calloc(size, sizeof(char));
     return buffer;
@@ -51,7 +51,7 @@ typedef struct RsdHalRec {
 #endif
 } RsdHal;
 
-void rsdLaunchThreads(android::renderscript::Context *rsc, WorkerCallback_t cbk, void *data);
+void rsdLaunchThreads(const android::renderscript::Context *rsc, WorkerCallback_t cbk, void *data);
 void* rsdAllocRuntimeMem(size_t size, uint32_t flags);
 void rsdFreeRuntimeMem(void* ptr);
 
@@ -562,6 +562,12 @@ static void * ElementAt1D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     const Type *t = a->getType();
     const Element *e = t->getElement();
 
+    if (a->getHasFieldPlanes()) {
+        // Cells of a planar allocation are not stored together.
+        rsc->setError(RS_ERROR_FATAL_DEBUG, "ElementAt of a planar allocation, use a field view");
+        return NULL;
+    }
+
     char buf[256];
     if (x >= t->getLODDimX(0)) {
         sprintf(buf, "Out range ElementAt X %i of %i", x, t->getLODDimX(0));
@@ -583,8 +589,11 @@ static void * ElementAt1D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
         }
     }
 
+    if (a->getIsTiled()) {
+        return GetOffsetPtr(a, x, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    }
     uint8_t *p = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
-    const uint32_t eSize = e->getSizeBytes();
+    const size_t eSize = e->getSizeBytes();
     return &p[(eSize * x)];
 }
 
@@ -593,6 +602,12 @@ static void * ElementAt2D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     const Type *t = a->getType();
     const Element *e = t->getElement();
 
+    if (a->getHasFieldPlanes()) {
+        // Cells of a planar allocation are not stored together.
+        rsc->setError(RS_ERROR_FATAL_DEBUG, "ElementAt of a planar allocation, use a field view");
+        return NULL;
+    }
+
     char buf[256];
     if (x >= t->getLODDimX(0)) {
         sprintf(buf, "Out range ElementAt X %i of %i", x, t->getLODDimX(0));
@@ -620,9 +635,12 @@ static void * ElementAt2D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
         }
     }
 
+    if (a->getIsTiled()) {
+        return GetOffsetPtr(a, x, y, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X);
+    }
     uint8_t *p = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
-    const uint32_t eSize = e->getSizeBytes();
-    const uint32_t stride = a->mHal.drvState.lod[0].stride;
+    const size_t eSize = e->getSizeBytes();
+    const size_t stride = a->mHal.drvState.lod[0].stride;
     return &p[(eSize * x) + (y * stride)];
 }
 
@@ -631,6 +649,12 @@ static void * ElementAt3D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     const Type *t = a->getType();
     const Element *e = t->getElement();
 
+    if (a->getHasFieldPlanes()) {
+        // Cells of a planar allocation are not stored together.
+        rsc->setError(RS_ERROR_FATAL_DEBUG, "ElementAt of a planar allocation, use a field view");
+        return NULL;
+    }
+
     char buf[256];
     if (x >= t->getLODDimX(0)) {
         sprintf(buf, "Out range ElementAt X %i of %i", x, t->getLODDimX(0));
@@ -665,9 +689,10 @@ static void * ElementAt3D(Allocation *a, RsDataType dt, uint32_t vecSize, uint32
     }
 
     uint8_t *p = (uint8_t *)a->mHal.drvState.lod[0].mallocPtr;
-    const uint32_t eSize = e->getSizeBytes();
-    const uint32_t stride = a->mHal.drvState.lod[0].stride;
-    return &p[(eSize * x) + (y * stride)];
+    const size_t eSize = e->getSizeBytes();
+    const size_t stride = a->mHal.drvState.lod[0].stride;
+    const size_t dimY = a->mHal.drvState.lod[0].dimY;
+    return &p[(eSize * x) + (y * stride) + (z * dimY * stride)];
 }
 
 static const void * SC_GetElementAt1D(Allocation *a, uint32_t x) {
@@ -680,46 +705,73 @@ static const void * SC_GetElementAt3D(Allocation *a, uint32_t x, uint32_t y, uin
     return ElementAt3D(a, RS_TYPE_UNSIGNED_8, 0, x, y, z);
 }
 
+// Read-only file backed allocations are mapped without write access, so
+// a store is reported as an error rather than left to fault.
+static bool IsWritable(Allocation *a) {
+    return a->checkWritable(RsdCpuReference::getTlsContext());
+}
+
 static void SC_SetElementAt1D(Allocation *a, const void *ptr, uint32_t x) {
     const Type *t = a->getType();
     const Element *e = t->getElement();
+    if (!IsWritable(a)) {
+        return;
+    }
     void *tmp = ElementAt1D(a, RS_TYPE_UNSIGNED_8, 0, x);
     if (tmp != NULL) {
         memcpy(tmp, ptr, e->getSizeBytes());
+        a->markWritten(x, 0, 0, x + 1, 1, 1);
     }
 }
 static void SC_SetElementAt2D(Allocation *a, const void *ptr, uint32_t x, uint32_t y) {
     const Type *t = a->getType();
     const Element *e = t->getElement();
+    if (!IsWritable(a)) {
+        return;
+    }
     void *tmp = ElementAt2D(a, RS_TYPE_UNSIGNED_8, 0, x, y);
     if (tmp != NULL) {
         memcpy(tmp, ptr, e->getSizeBytes());
+        a->markWritten(x, y, 0, x + 1, y + 1, 1);
     }
 }
 static void SC_SetElementAt3D(Allocation *a, const void *ptr, uint32_t x, uint32_t y, uint32_t z) {
     const Type *t = a->getType();
     const Element *e = t->getElement();
+    if (!IsWritable(a)) {
+        return;
+    }
     void *tmp = ElementAt3D(a, RS_TYPE_UNSIGNED_8, 0, x, y, z);
     if (tmp != NULL) {
         memcpy(tmp, ptr, e->getSizeBytes());
+        a->markWritten(x, y, z, x + 1, y + 1, z + 1);
     }
 }
 
 #define ELEMENT_AT(T, DT, VS)                                               \
     static void SC_SetElementAt1_##T(Allocation *a, const T *val, uint32_t x) {           \
+        if (!IsWritable(a)) return;                                     \
         void *r = ElementAt1D(a, DT, VS, x);                            \
-        if (r != NULL) ((T *)r)[0] = *val;                               \
-        else ALOGE("Error from %s", __PRETTY_FUNCTION__);               \
+        if (r != NULL) {                                                \
+            ((T *)r)[0] = *val;                                         \
+            a->markWritten(x, 0, 0, x + 1, 1, 1);                       \
+        } else ALOGE("Error from %s", __PRETTY_FUNCTION__);             \
     }                                                                   \
     static void SC_SetElementAt2_##T(Allocation * a, const T * val, uint32_t x, uint32_t y) { \
+        if (!IsWritable(a)) return;                                     \
         void *r = ElementAt2D(a, DT, VS, x, y);            \
-        if (r != NULL) ((T *)r)[0] = *val;                               \
-        else ALOGE("Error from %s", __PRETTY_FUNCTION__);               \
+        if (r != NULL) {                                                \
+            ((T *)r)[0] = *val;                                         \
+            a->markWritten(x, y, 0, x + 1, y + 1, 1);                   \
+        } else ALOGE("Error from %s", __PRETTY_FUNCTION__);             \
     }                                                                   \
     static void SC_SetElementAt3_##T(Allocation * a, const T * val, uint32_t x, uint32_t y, uint32_t z) { \
+        if (!IsWritable(a)) return;                                     \
         void *r = ElementAt3D(a, DT, VS, x, y, z);         \
-        if (r != NULL) ((T *)r)[0] = *val;                               \
-        else ALOGE("Error from %s", __PRETTY_FUNCTION__);               \
+        if (r != NULL) {                                                \
+            ((T *)r)[0] = *val;                                         \
+            a->markWritten(x, y, z, x + 1, y + 1, z + 1);               \
+        } else ALOGE("Error from %s", __PRETTY_FUNCTION__);             \
     }                                                                   \
     static void SC_GetElementAt1_##T(Allocation * a, T *val, uint32_t x) {                  \
         void *r = ElementAt1D(a, DT, VS, x);               \
@@ -1,10 +1,12 @@
 
 ContextDestroy {
     direct
+    nocapture
 }
 
 ContextGetMessage {
     direct
+    nocapture
     param void *data
     param size_t *receiveLen
     param uint32_t *usrID
@@ -13,6 +15,7 @@ ContextGetMessage {
 
 ContextPeekMessage {
     direct
+    nocapture
     param size_t *receiveLen
     param uint32_t *usrID
     ret RsMessageToClientType
@@ -25,10 +28,12 @@ ContextSendMessage {
 
 ContextInitToClient {
     direct
+    nocapture
 }
 
 ContextDeinitToClient {
     direct
+    nocapture
 }
 
 TypeCreate {
@@ -52,6 +57,73 @@ AllocationCreateTyped {
     ret RsAllocation
 }
 
+AllocationCreateStrided {
+    direct
+    param RsType vtype
+    param RsAllocationMipmapControl mips
+    param uint32_t usages
+    param uintptr_t ptr
+    param const size_t *strides
+    param const size_t *offsets
+    ret RsAllocation
+}
+
+AllocationCreateFromFile {
+    direct
+    param RsType vtype
+    param uint32_t usages
+    param const char *path
+    param size_t offset
+    param uint32_t flags
+    ret RsAllocation
+}
+
+AllocationCreateSparse {
+    direct
+    param RsType vtype
+    param uint32_t usages
+    param uint32_t brickX
+    param uint32_t brickY
+    param uint32_t brickZ
+    ret RsAllocation
+}
+
+AllocationCreateTiled {
+    direct
+    param RsType vtype
+    param uint32_t usages
+    param uint32_t tileDim
+    ret RsAllocation
+}
+
+AllocationCreateFieldPlanes {
+    direct
+    param RsType vtype
+    param uint32_t usages
+    ret RsAllocation
+}
+
+AllocationCreateFieldView {
+    direct
+    param RsAllocation parent
+    param uint32_t field
+    ret RsAllocation
+}
+
+AllocationCreateView {
+    direct
+    param RsAllocation parent
+    param uint32_t xoff
+    param uint32_t yoff
+    param uint32_t zoff
+    param uint32_t lod
+    param RsAllocationCubemapFace face
+    param uint32_t w
+    param uint32_t h
+    param uint32_t d
+    ret RsAllocation
+}
+
 AllocationCreateFromBitmap {
     direct
     param RsType vtype
@@ -96,6 +168,7 @@ ContextSetPriority {
 
 ContextDestroyWorker {
         sync
+    nocapture
 }
 
 AssignName {
@@ -185,6 +258,11 @@ AllocationGenerateMipmaps {
     param RsAllocation va
 }
 
+AllocationGenerateMipmapsFiltered {
+    param RsAllocation va
+    param RsMipmapFilter filter
+}
+
 AllocationRead {
     param RsAllocation va
     param void * data
@@ -210,6 +288,15 @@ Allocation2DRead {
     param size_t stride
 }
 
+AllocationGetPointer {
+    param RsAllocation va
+    param uint32_t lod
+    param RsAllocationCubemapFace face
+    param size_t *stride
+    sync
+    ret void *
+    }
+
 AllocationSyncAll {
     param RsAllocation va
     param RsAllocationUsageType src
@@ -403,3 +490,34 @@ ScriptGroupExecute {
 
 
 
+CommandBufferCreate {
+    direct
+    ret RsCommandBuffer
+}
+
+CommandBufferBeginRecording {
+    direct
+    param RsCommandBuffer cb
+}
+
+CommandBufferEndRecording {
+    direct
+    param RsCommandBuffer cb
+}
+
+CommandBufferGetCommandCount {
+    direct
+    param RsCommandBuffer cb
+    ret uint32_t
+}
+
+CommandBufferPatch {
+    param RsCommandBuffer cb
+    param uint32_t cmdIndex
+    param const void *data
+}
+
+CommandBufferSubmit {
+    param RsCommandBuffer cb
+}
+
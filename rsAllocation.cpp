@@ -19,6 +19,12 @@
 #include "rsAdapter.h"
 #include "rs_hal.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #if !defined(RS_SERVER) && !defined(RS_COMPATIBILITY_LIB)
 #include "system/window.h"
 #include "gui/GLConsumer.h"
@@ -27,8 +33,12 @@
 using namespace android;
 using namespace android::renderscript;
 
+// Serialized data sizes equal to or above this are written as 64 bits.
+static const uint32_t kSerializedSize64 = 0xffffffff;
+
 Allocation::Allocation(Context *rsc, const Type *type, uint32_t usages,
-                       RsAllocationMipmapControl mc, void * ptr)
+                       RsAllocationMipmapControl mc, void * ptr,
+                       const Hal::UserLayout *layout)
     : ObjectBase(rsc) {
 
     memset(&mHal, 0, sizeof(mHal));
@@ -36,6 +46,20 @@ Allocation::Allocation(Context *rsc, const Type *type, uint32_t usages,
     mHal.state.usageFlags = usages;
     mHal.state.mipmapControl = mc;
     mHal.state.userProvidedPtr = ptr;
+    if (layout) {
+        mHal.userLayout = *layout;
+    }
+    mViewCount = 0;
+    mFileBacked = false;
+    mFileFlags = 0;
+    mBrickX = 0;
+    mBrickY = 0;
+    mBrickZ = 0;
+    mBrickWritten = NULL;
+    mTileDim = 0;
+    mFieldPlanes = false;
+    mMapping = NULL;
+    mMappingSize = 0;
 
     setType(type);
     updateCache();
@@ -49,7 +73,9 @@ void Allocation::operator delete(void* ptr) {
 }
 
 Allocation * Allocation::createAllocation(Context *rsc, const Type *type, uint32_t usages,
-                              RsAllocationMipmapControl mc, void * ptr) {
+                              RsAllocationMipmapControl mc, void * ptr,
+                              const Hal::UserLayout *layout, uint32_t tileDim,
+                              bool fieldPlanes) {
     // Allocation objects must use allocator specified by the driver
     void* allocMem = rsc->mHal.funcs.allocRuntimeMem(sizeof(Allocation), 0);
 
@@ -58,7 +84,10 @@ Allocation * Allocation::createAllocation(Context *rsc, const Type *type, uint32
         return NULL;
     }
 
-    Allocation *a = new (allocMem) Allocation(rsc, type, usages, mc, ptr);
+    Allocation *a = new (allocMem) Allocation(rsc, type, usages, mc, ptr, layout);
+    // The driver lays out the storage from this.
+    a->mTileDim = tileDim;
+    a->mFieldPlanes = fieldPlanes;
 
     if (!rsc->mHal.funcs.allocation.init(rsc, a, type->getElement()->getHasReferences())) {
         rsc->setError(RS_ERROR_FATAL_DRIVER, "Allocation::Allocation, alloc failure");
@@ -78,9 +107,339 @@ void Allocation::updateCache() {
     mHal.state.hasReferences = mHal.state.type->getElement()->getHasReferences();
 }
 
+Allocation * Allocation::createView(Context *rsc, Allocation *parent,
+                                    uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                                    uint32_t lod, RsAllocationCubemapFace face,
+                                    uint32_t w, uint32_t h, uint32_t d) {
+    if (parent->mHal.state.yuv || parent->mHal.state.hasReferences || parent->mTileDim ||
+        parent->mFieldPlanes || parent->mBrickX) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Views of YUV, tiled, planar, sparse or object allocations are not supported.");
+        return NULL;
+    }
+    if ((lod >= parent->mHal.drvState.lodCount) ||
+        ((face != RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X) &&
+         (!parent->mHal.state.hasFaces || (face > RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_Z)))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "View LOD or face out of range.");
+        return NULL;
+    }
+
+    const Hal::DrvState::LodState &level = parent->mHal.drvState.lod[lod];
+    if (!level.mallocPtr) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation has no script storage to view.");
+        return NULL;
+    }
+    if (!w || ((xoff + w) > level.dimX) ||
+        ((yoff + rsMax(h, 1u)) > rsMax(level.dimY, 1u)) ||
+        ((zoff + rsMax(d, 1u)) > rsMax(level.dimZ, 1u))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "View out of range.");
+        return NULL;
+    }
+    if ((d > 1) && (h != level.dimY)) {
+        // Slices of a view are addressed with the view's own height.
+        rsc->setError(RS_ERROR_BAD_VALUE, "3D views must cover whole slices.");
+        return NULL;
+    }
+
+    uint8_t *ptr = (uint8_t *)level.mallocPtr;
+    ptr += face * parent->mHal.drvState.faceOffset;
+    ptr += (zoff * level.dimY + yoff) * level.stride;
+    ptr += xoff * parent->mHal.state.elementSizeBytes;
+
+    Hal::UserLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.stride[0] = level.stride;
+    layout.count = 1;
+
+    ObjectBaseRef<Type> t = Type::getTypeRef(rsc, parent->getType()->getElement(),
+                                             w, h, d, false, false, 0);
+    Allocation *a = createAllocation(rsc, t.get(),
+                                     RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                     RS_ALLOCATION_MIPMAP_NONE, ptr, &layout);
+    if (!a) {
+        return NULL;
+    }
+    a->mViewParent.set(parent);
+    a->mFileBacked = parent->mFileBacked;
+    a->mFileFlags = parent->mFileFlags;
+    __sync_fetch_and_add(&parent->mViewCount, 1);
+    return a;
+}
+
+Allocation * Allocation::createFromFile(Context *rsc, const Type *type, uint32_t usages,
+                                        const char *path, size_t offset, uint32_t flags) {
+    if (usages & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "File backed allocations are limited to script usage.");
+        return NULL;
+    }
+    if (type->getDimYuv() || type->getDimFaces() || type->getElement()->getHasReferences()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "File backed allocations cannot be YUV, cubemaps or hold objects.");
+        return NULL;
+    }
+    if ((flags & RS_ALLOCATION_FILE_ACCESS_SEQUENTIAL) && (flags & RS_ALLOCATION_FILE_ACCESS_RANDOM)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Conflicting file access hints.");
+        return NULL;
+    }
+
+    bool writable = (flags & RS_ALLOCATION_FILE_READ_WRITE) != 0;
+    int fd = open(path, writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (fd < 0) {
+        ALOGE("Unable to open %s for allocation, errno %i", path, errno);
+        rsc->setError(RS_ERROR_BAD_VALUE, "Unable to open allocation file.");
+        return NULL;
+    }
+
+    size_t size = type->getSizeBytes();
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        rsc->setError(RS_ERROR_BAD_VALUE, "Unable to stat allocation file.");
+        return NULL;
+    }
+    if ((size_t)st.st_size < offset + size) {
+        // A writable file is grown to fit; a read-only one must already
+        // hold all of the data.
+        if (!writable || (ftruncate(fd, offset + size) < 0)) {
+            ALOGE("Allocation file %s holds %lli bytes, %zu needed",
+                  path, (long long)st.st_size, offset + size);
+            close(fd);
+            rsc->setError(RS_ERROR_BAD_VALUE, "Allocation file too small.");
+            return NULL;
+        }
+    }
+
+    // mmap offsets must be page aligned; the allocation starts delta bytes
+    // into the mapping.
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t delta = offset % page;
+    size_t mapSize = size + delta;
+    void *base = mmap(NULL, mapSize, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                      MAP_SHARED, fd, offset - delta);
+    close(fd);
+    if (base == MAP_FAILED) {
+        ALOGE("Unable to map %zu bytes of %s, errno %i", mapSize, path, errno);
+        rsc->setError(RS_ERROR_FATAL_DRIVER, "Unable to map allocation file.");
+        return NULL;
+    }
+
+    if (flags & RS_ALLOCATION_FILE_ACCESS_SEQUENTIAL) {
+        madvise(base, mapSize, MADV_SEQUENTIAL);
+    } else if (flags & RS_ALLOCATION_FILE_ACCESS_RANDOM) {
+        madvise(base, mapSize, MADV_RANDOM);
+    }
+    if (flags & RS_ALLOCATION_FILE_WILL_NEED) {
+        madvise(base, mapSize, MADV_WILLNEED);
+    }
+
+    Allocation *a = createAllocation(rsc, type,
+                                     RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                     RS_ALLOCATION_MIPMAP_NONE, (uint8_t *)base + delta);
+    if (!a) {
+        munmap(base, mapSize);
+        return NULL;
+    }
+    a->mFileBacked = true;
+    a->mFileFlags = flags;
+    a->mMapping = base;
+    a->mMappingSize = mapSize;
+    return a;
+}
+
+Allocation * Allocation::createSparse(Context *rsc, const Type *type, uint32_t usages,
+                                      uint32_t brickX, uint32_t brickY, uint32_t brickZ) {
+    if (usages & ~(RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Sparse allocations are limited to script usage.");
+        return NULL;
+    }
+    if (type->getDimYuv() || type->getDimFaces() || type->getElement()->getHasReferences()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Sparse allocations cannot be YUV, cubemaps or hold objects.");
+        return NULL;
+    }
+    if (!brickX) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Sparse allocation brick size must not be 0.");
+        return NULL;
+    }
+
+    // Anonymous memory reads as zero and is only backed once written, so
+    // nothing is committed or cleared up front.
+    size_t size = type->getSizeBytes();
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Unable to reserve %zu bytes for sparse allocation, errno %i", size, errno);
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Unable to reserve sparse allocation.");
+        return NULL;
+    }
+
+    Allocation *a = createAllocation(rsc, type,
+                                     RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                     RS_ALLOCATION_MIPMAP_NONE, base);
+    if (!a) {
+        munmap(base, size);
+        return NULL;
+    }
+    a->mBrickX = brickX;
+    a->mBrickY = rsMax(brickY, 1u);
+    a->mBrickZ = rsMax(brickZ, 1u);
+    a->mMapping = base;
+    a->mMappingSize = size;
+
+    uint32_t bricksX = (type->getDimX() + a->mBrickX - 1) / a->mBrickX;
+    uint32_t bricksY = (rsMax(type->getDimY(), 1u) + a->mBrickY - 1) / a->mBrickY;
+    uint32_t bricksZ = (rsMax(type->getDimZ(), 1u) + a->mBrickZ - 1) / a->mBrickZ;
+    a->mBrickWritten = (uint32_t *)calloc((bricksX * bricksY * bricksZ + 31) / 32,
+                                          sizeof(uint32_t));
+    if (!a->mBrickWritten) {
+        rsc->setError(RS_ERROR_OUT_OF_MEMORY, "Unable to allocate sparse brick mask.");
+        delete a;
+        return NULL;
+    }
+    return a;
+}
+
+Allocation * Allocation::createTiled(Context *rsc, const Type *type, uint32_t usages,
+                                     uint32_t tileDim) {
+    if (usages != RS_ALLOCATION_USAGE_SCRIPT) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Tiled allocations are limited to script usage.");
+        return NULL;
+    }
+    if (!type->getDimY() || type->getDimZ() || type->getDimLOD() || type->getDimFaces() ||
+        type->getDimYuv() || type->getElement()->getHasReferences()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Tiled allocations must be plain 2D allocations without objects.");
+        return NULL;
+    }
+    if ((tileDim < 2) || (tileDim > 256) || (tileDim & (tileDim - 1))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Tile size must be a power of two from 2 to 256.");
+        return NULL;
+    }
+    return createAllocation(rsc, type, usages, RS_ALLOCATION_MIPMAP_NONE, NULL, NULL, tileDim);
+}
+
+Allocation * Allocation::createFieldPlanes(Context *rsc, const Type *type, uint32_t usages) {
+    if (usages != RS_ALLOCATION_USAGE_SCRIPT) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Planar allocations are limited to script usage.");
+        return NULL;
+    }
+    const Element *e = type->getElement();
+    if (!e->getFieldCount() || e->getHasReferences()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Planar allocations need a struct element without objects.");
+        return NULL;
+    }
+    if (type->getDimLOD() || type->getDimFaces() || type->getDimYuv()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Planar allocations cannot have LODs or faces.");
+        return NULL;
+    }
+    return createAllocation(rsc, type, usages, RS_ALLOCATION_MIPMAP_NONE, NULL, NULL, 0, true);
+}
+
+size_t Allocation::getFieldPlaneOffset(uint32_t field) const {
+    const Type *t = mHal.state.type;
+    const Element *e = t->getElement();
+    size_t cells = (size_t)t->getDimX() * rsMax(t->getDimY(), 1u) * rsMax(t->getDimZ(), 1u);
+    size_t offset = 0;
+    for (uint32_t ct = 0; ct < field; ct++) {
+        size_t bytes = cells * e->getField(ct)->getSizeBytes() * e->getFieldArraySize(ct);
+        // Keep every plane aligned for vector loads.
+        offset += (bytes + 15) & ~(size_t)15;
+    }
+    return offset;
+}
+
+Allocation * Allocation::createFieldView(Context *rsc, Allocation *parent, uint32_t field) {
+    if (!parent->mFieldPlanes) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Field views need a planar allocation.");
+        return NULL;
+    }
+    const Type *pt = parent->getType();
+    const Element *e = pt->getElement();
+    if (field >= e->getFieldCount()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Field view index out of range.");
+        return NULL;
+    }
+    if (e->getFieldArraySize(field) != 1) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Field views of array fields are not supported.");
+        return NULL;
+    }
+
+    const Element *fe = e->getField(field);
+    uint8_t *ptr = (uint8_t *)parent->mHal.drvState.lod[0].mallocPtr +
+            parent->getFieldPlaneOffset(field);
+    Hal::UserLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.stride[0] = (size_t)pt->getDimX() * fe->getSizeBytes();
+    layout.count = 1;
+
+    ObjectBaseRef<Type> t = Type::getTypeRef(rsc, fe, pt->getDimX(), pt->getDimY(),
+                                             pt->getDimZ(), false, false, 0);
+    Allocation *a = createAllocation(rsc, t.get(),
+                                     RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                     RS_ALLOCATION_MIPMAP_NONE, ptr, &layout);
+    if (!a) {
+        return NULL;
+    }
+    a->mViewParent.set(parent);
+    __sync_fetch_and_add(&parent->mViewCount, 1);
+    return a;
+}
+
 Allocation::~Allocation() {
     freeChildrenUnlocked();
     mRSC->mHal.funcs.allocation.destroy(mRSC, this);
+    if (mMapping) {
+        munmap(mMapping, mMappingSize);
+    }
+    free(mBrickWritten);
+    if (mViewParent.get()) {
+        __sync_fetch_and_sub(&mViewParent->mViewCount, 1);
+    }
+}
+
+bool Allocation::checkWritable(Context *rsc) const {
+    if (getIsReadOnly()) {
+        ALOGE("Write to read-only file backed allocation %p", this);
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation is mapped read-only.");
+        return false;
+    }
+    return true;
+}
+
+void Allocation::markWritten(uint32_t x1, uint32_t y1, uint32_t z1,
+                             uint32_t x2, uint32_t y2, uint32_t z2) {
+    if (!mBrickWritten) {
+        return;
+    }
+    const Type *type = mHal.state.type;
+    x2 = rsMin(x2, type->getDimX());
+    y2 = rsMin(y2, rsMax(type->getDimY(), 1u));
+    z2 = rsMin(z2, rsMax(type->getDimZ(), 1u));
+    if ((x1 >= x2) || (y1 >= y2) || (z1 >= z2)) {
+        return;
+    }
+
+    const uint32_t bricksX = (type->getDimX() + mBrickX - 1) / mBrickX;
+    const uint32_t bricksY = (rsMax(type->getDimY(), 1u) + mBrickY - 1) / mBrickY;
+    for (uint32_t bz = z1 / mBrickZ; bz <= (z2 - 1) / mBrickZ; bz++) {
+        for (uint32_t by = y1 / mBrickY; by <= (y2 - 1) / mBrickY; by++) {
+            for (uint32_t bx = x1 / mBrickX; bx <= (x2 - 1) / mBrickX; bx++) {
+                uint32_t brick = (bz * bricksY + by) * bricksX + bx;
+                uint32_t bit = 1u << (brick & 31);
+                // Kernel workers mark their bricks concurrently.
+                if (!(mBrickWritten[brick >> 5] & bit)) {
+                    __sync_fetch_and_or(&mBrickWritten[brick >> 5], bit);
+                }
+            }
+        }
+    }
+}
+
+void Allocation::markAllWritten() {
+    const Type *type = mHal.state.type;
+    markWritten(0, 0, 0, type->getDimX(), rsMax(type->getDimY(), 1u),
+                rsMax(type->getDimZ(), 1u));
 }
 
 void Allocation::syncAll(Context *rsc, RsAllocationUsageType src) {
@@ -91,6 +450,10 @@ void Allocation::data(Context *rsc, uint32_t xoff, uint32_t lod,
                          uint32_t count, const void *data, size_t sizeBytes) {
     const size_t eSize = mHal.state.type->getElementSizeBytes();
 
+    if (!checkWritable(rsc)) {
+        return;
+    }
+
     if ((count * eSize) != sizeBytes) {
         ALOGE("Allocation::subData called with mismatched size expected %zu, got %zu",
              (count * eSize), sizeBytes);
@@ -99,19 +462,34 @@ void Allocation::data(Context *rsc, uint32_t xoff, uint32_t lod,
     }
 
     rsc->mHal.funcs.allocation.data1D(rsc, this, xoff, lod, count, data, sizeBytes);
+    if (!lod) {
+        markWritten(xoff, 0, 0, xoff + count, 1, 1);
+    }
     sendDirty(rsc);
 }
 
 void Allocation::data(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t lod, RsAllocationCubemapFace face,
                       uint32_t w, uint32_t h, const void *data, size_t sizeBytes, size_t stride) {
+    if (!checkWritable(rsc)) {
+        return;
+    }
     rsc->mHal.funcs.allocation.data2D(rsc, this, xoff, yoff, lod, face, w, h, data, sizeBytes, stride);
+    if (!lod) {
+        markWritten(xoff, yoff, 0, xoff + w, yoff + h, 1);
+    }
     sendDirty(rsc);
 }
 
 void Allocation::data(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff,
                       uint32_t lod,
                       uint32_t w, uint32_t h, uint32_t d, const void *data, size_t sizeBytes, size_t stride) {
+    if (!checkWritable(rsc)) {
+        return;
+    }
     rsc->mHal.funcs.allocation.data3D(rsc, this, xoff, yoff, zoff, lod, w, h, d, data, sizeBytes, stride);
+    if (!lod) {
+        markWritten(xoff, yoff, zoff, xoff + w, yoff + h, zoff + d);
+    }
     sendDirty(rsc);
 }
 
@@ -158,10 +536,50 @@ void Allocation::read(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff,
 
 }
 
+void * Allocation::getPointer(Context *rsc, uint32_t lod, RsAllocationCubemapFace face,
+                              size_t *stride) {
+    if (lod >= mHal.drvState.lodCount) {
+        ALOGE("Error Allocation::getPointer LOD %i out of range.", lod);
+        rsc->setError(RS_ERROR_BAD_VALUE, "getPointer LOD out of range.");
+        return NULL;
+    }
+    if ((face != RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X) &&
+        (!mHal.state.hasFaces || (face > RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_Z))) {
+        ALOGE("Error Allocation::getPointer face %i out of range.", face);
+        rsc->setError(RS_ERROR_BAD_VALUE, "getPointer face out of range.");
+        return NULL;
+    }
+
+    if (mTileDim || mFieldPlanes) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "Tiled and planar allocations cannot be accessed directly.");
+        return NULL;
+    }
+    if (!checkWritable(rsc)) {
+        return NULL;
+    }
+
+    uint8_t *ptr = (uint8_t *)mHal.drvState.lod[lod].mallocPtr;
+    if (!ptr) {
+        // IO_INPUT allocations have no storage until a buffer is received.
+        return NULL;
+    }
+    // Writes through the pointer cannot be tracked.
+    markAllWritten();
+    if (stride) {
+        *stride = mHal.drvState.lod[lod].stride;
+    }
+    return ptr + face * mHal.drvState.faceOffset;
+}
+
 void Allocation::elementData(Context *rsc, uint32_t x, const void *data,
                                 uint32_t cIdx, size_t sizeBytes) {
     size_t eSize = mHal.state.elementSizeBytes;
 
+    if (!checkWritable(rsc)) {
+        return;
+    }
+
     if (cIdx >= mHal.state.type->getElement()->getFieldCount()) {
         ALOGE("Error Allocation::subElementData component %i out of range.", cIdx);
         rsc->setError(RS_ERROR_BAD_VALUE, "subElementData component out of range.");
@@ -183,6 +601,7 @@ void Allocation::elementData(Context *rsc, uint32_t x, const void *data,
     }
 
     rsc->mHal.funcs.allocation.elementData1D(rsc, this, x, data, cIdx, sizeBytes);
+    markWritten(x, 0, 0, x + 1, 1, 1);
     sendDirty(rsc);
 }
 
@@ -190,6 +609,10 @@ void Allocation::elementData(Context *rsc, uint32_t x, uint32_t y,
                                 const void *data, uint32_t cIdx, size_t sizeBytes) {
     size_t eSize = mHal.state.elementSizeBytes;
 
+    if (!checkWritable(rsc)) {
+        return;
+    }
+
     if (x >= mHal.drvState.lod[0].dimX) {
         ALOGE("Error Allocation::subElementData X offset %i out of range.", x);
         rsc->setError(RS_ERROR_BAD_VALUE, "subElementData X offset out of range.");
@@ -217,6 +640,7 @@ void Allocation::elementData(Context *rsc, uint32_t x, uint32_t y,
     }
 
     rsc->mHal.funcs.allocation.elementData2D(rsc, this, x, y, data, cIdx, sizeBytes);
+    markWritten(x, y, 0, x + 1, y + 1, 1);
     sendDirty(rsc);
 }
 
@@ -247,8 +671,8 @@ void Allocation::dumpLOGV(const char *prefix) const {
          prefix, mHal.drvState.lod[0].mallocPtr, mHal.state.usageFlags, mHal.state.mipmapControl);
 }
 
-uint32_t Allocation::getPackedSize() const {
-    uint32_t numItems = mHal.state.type->getSizeBytes() / mHal.state.type->getElementSizeBytes();
+size_t Allocation::getPackedSize() const {
+    size_t numItems = mHal.state.type->getSizeBytes() / mHal.state.type->getElementSizeBytes();
     return numItems * mHal.state.type->getElement()->getSizeBytesUnpadded();
 }
 
@@ -257,7 +681,7 @@ void Allocation::writePackedData(Context *rsc, const Type *type,
     const Element *elem = type->getElement();
     uint32_t unpaddedBytes = elem->getSizeBytesUnpadded();
     uint32_t paddedBytes = elem->getSizeBytes();
-    uint32_t numItems = type->getSizeBytes() / paddedBytes;
+    size_t numItems = type->getSizeBytes() / paddedBytes;
 
     uint32_t srcInc = !dstPadded ? paddedBytes : unpaddedBytes;
     uint32_t dstInc =  dstPadded ? paddedBytes : unpaddedBytes;
@@ -265,7 +689,7 @@ void Allocation::writePackedData(Context *rsc, const Type *type,
     // no sub-elements
     uint32_t fieldCount = elem->getFieldCount();
     if (fieldCount == 0) {
-        for (uint32_t i = 0; i < numItems; i ++) {
+        for (size_t i = 0; i < numItems; i ++) {
             memcpy(dst, src, unpaddedBytes);
             src += srcInc;
             dst += dstInc;
@@ -288,7 +712,7 @@ void Allocation::writePackedData(Context *rsc, const Type *type,
     uint32_t *dstOffsets =  dstPadded ? offsetsPadded : offsetsUnpadded;
 
     // complex elements, need to copy subelem after subelem
-    for (uint32_t i = 0; i < numItems; i ++) {
+    for (size_t i = 0; i < numItems; i ++) {
         for (uint32_t fI = 0; fI < fieldCount; fI++) {
             memcpy(dst + dstOffsets[fI], src + srcOffsets[fI], sizeUnpadded[fI]);
         }
@@ -302,26 +726,28 @@ void Allocation::writePackedData(Context *rsc, const Type *type,
 }
 
 void Allocation::unpackVec3Allocation(Context *rsc, const void *data, size_t dataSize) {
+    if (!checkWritable(rsc)) {
+        return;
+    }
     const uint8_t *src = (const uint8_t*)data;
     uint8_t *dst = (uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, this);
 
     writePackedData(rsc, getType(), dst, src, true);
     rsc->mHal.funcs.allocation.unlock1D(rsc, this);
+    markAllWritten();
 }
 
-void Allocation::packVec3Allocation(Context *rsc, OStream *stream) const {
+void Allocation::packVec3Allocation(Context *rsc, OStream *stream, const uint8_t *src) const {
     uint32_t paddedBytes = getType()->getElement()->getSizeBytes();
     uint32_t unpaddedBytes = getType()->getElement()->getSizeBytesUnpadded();
-    uint32_t numItems = mHal.state.type->getSizeBytes() / paddedBytes;
+    size_t numItems = mHal.state.type->getSizeBytes() / paddedBytes;
 
-    const uint8_t *src = (const uint8_t*)rsc->mHal.funcs.allocation.lock1D(rsc, this);
     uint8_t *dst = new uint8_t[numItems * unpaddedBytes];
 
     writePackedData(rsc, getType(), dst, src, false);
     stream->addByteArray(dst, getPackedSize());
 
     delete[] dst;
-    rsc->mHal.funcs.allocation.unlock1D(rsc, this);
 }
 
 void Allocation::serialize(Context *rsc, OStream *stream) const {
@@ -335,19 +761,37 @@ void Allocation::serialize(Context *rsc, OStream *stream) const {
     // to initialize the class
     mHal.state.type->serialize(rsc, stream);
 
-    uint32_t dataSize = mHal.state.type->getSizeBytes();
+    size_t dataSize = mHal.state.type->getSizeBytes();
     // 3 element vectors are padded to 4 in memory, but padding isn't serialized
-    uint32_t packedSize = getPackedSize();
-    // Write how much data we are storing
-    stream->addU32(packedSize);
+    size_t packedSize = getPackedSize();
+    // Write how much data we are storing.  Sizes that do not fit in 32 bits
+    // follow an all ones marker, older readers reject the allocation.
+    if ((uint64_t)packedSize >= kSerializedSize64) {
+        stream->addU32(kSerializedSize64);
+        stream->addU64(packedSize);
+    } else {
+        stream->addU32(packedSize);
+    }
+
+    const uint8_t *src = (const uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, this);
+    uint8_t *linear = NULL;
+    if (mTileDim || mFieldPlanes) {
+        // Tiled and planar storage is written as the packed cells in the
+        // order readers expect.
+        linear = new uint8_t[dataSize];
+        rsc->mHal.funcs.allocation.read1D(rsc, this, 0, 0, dataSize / mHal.state.elementSizeBytes,
+                                          linear, dataSize);
+        src = linear;
+    }
     if (dataSize == packedSize) {
         // Now write the data
-        stream->addByteArray(rsc->mHal.funcs.allocation.lock1D(rsc, this), dataSize);
-        rsc->mHal.funcs.allocation.unlock1D(rsc, this);
+        stream->addByteArray(src, dataSize);
     } else {
         // Now write the data
-        packVec3Allocation(rsc, stream);
+        packVec3Allocation(rsc, stream, src);
     }
+    delete[] linear;
+    rsc->mHal.funcs.allocation.unlock1D(rsc, this);
 }
 
 Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
@@ -371,9 +815,12 @@ Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
     type->decUserRef();
 
     // Number of bytes we wrote out for this allocation
-    uint32_t dataSize = stream->loadU32();
+    uint64_t dataSize = stream->loadU32();
+    if (dataSize == kSerializedSize64) {
+        dataSize = stream->loadU64();
+    }
     // 3 element vectors are padded to 4 in memory, but padding isn't serialized
-    uint32_t packedSize = alloc->getPackedSize();
+    size_t packedSize = alloc->getPackedSize();
     if (dataSize != type->getSizeBytes() &&
         dataSize != packedSize) {
         ALOGE("failed to read allocation because numbytes written is not the same loaded type wants\n");
@@ -385,9 +832,12 @@ Allocation *Allocation::createFromStream(Context *rsc, IStream *stream) {
     alloc->setName(name.string(), name.size());
 
     if (dataSize == type->getSizeBytes()) {
-        uint32_t count = dataSize / type->getElementSizeBytes();
-        // Read in all of our allocation data
-        alloc->data(rsc, 0, 0, count, stream->getPtr() + stream->getPos(), dataSize);
+        // Read in all of our allocation data.  The element count can exceed
+        // what data() takes, so copy the bytes directly.
+        uint8_t *dst = (uint8_t *)rsc->mHal.funcs.allocation.lock1D(rsc, alloc);
+        memcpy(dst, stream->getPtr() + stream->getPos(), dataSize);
+        rsc->mHal.funcs.allocation.unlock1D(rsc, alloc);
+        alloc->sendDirty(rsc);
     } else {
         alloc->unpackVec3Allocation(rsc, stream->getPtr() + stream->getPos(), dataSize);
     }
@@ -432,6 +882,21 @@ bool Allocation::freeChildren() {
 }
 
 void Allocation::copyRange1D(Context *rsc, const Allocation *src, int32_t srcOff, int32_t destOff, int32_t len) {
+    if ((srcOff < 0) || (destOff < 0) || (len < 0) ||
+        ((uint32_t)(srcOff + len) > src->mHal.drvState.lod[0].dimX) ||
+        ((uint32_t)(destOff + len) > mHal.drvState.lod[0].dimX)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "copyRange1D out of range.");
+        return;
+    }
+    if (src->mHal.state.elementSizeBytes != mHal.state.elementSizeBytes) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "copyRange1D element size mismatch.");
+        return;
+    }
+    if (!checkWritable(rsc)) {
+        return;
+    }
+    rsc->mHal.funcs.allocation.allocData1D(rsc, this, destOff, 0, len, src, srcOff, 0);
+    markWritten(destOff, 0, 0, destOff + len, 1, 1);
 }
 
 void Allocation::resize1D(Context *rsc, uint32_t dimX) {
@@ -439,6 +904,14 @@ void Allocation::resize1D(Context *rsc, uint32_t dimX) {
     if (dimX == oldDimX) {
         return;
     }
+    if (mViewCount) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Cannot resize an allocation that has views.");
+        return;
+    }
+    if (mFileBacked || mMapping || mTileDim || mFieldPlanes) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Cannot resize a mapped, tiled or planar allocation.");
+        return;
+    }
 
     ObjectBaseRef<Type> t = mHal.state.type->cloneAndResize1D(rsc, dimX);
     if (dimX < oldDimX) {
@@ -486,9 +959,24 @@ void rsi_AllocationSyncAll(Context *rsc, RsAllocation va, RsAllocationUsageType
 
 void rsi_AllocationGenerateMipmaps(Context *rsc, RsAllocation va) {
     Allocation *alloc = static_cast<Allocation *>(va);
+    if (!alloc->checkWritable(rsc)) {
+        return;
+    }
     rsc->mHal.funcs.allocation.generateMipmaps(rsc, alloc);
 }
 
+void rsi_AllocationGenerateMipmapsFiltered(Context *rsc, RsAllocation va, RsMipmapFilter filter) {
+    Allocation *alloc = static_cast<Allocation *>(va);
+    if (filter > RS_MIPMAP_FILTER_KAISER) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Unknown mipmap filter");
+        return;
+    }
+    if (!alloc->checkWritable(rsc)) {
+        return;
+    }
+    rsc->mHal.funcs.allocation.generateMipmapsFiltered(rsc, alloc, filter);
+}
+
 void rsi_AllocationCopyToBitmap(Context *rsc, RsAllocation va, void *data, size_t sizeBytes) {
     Allocation *a = static_cast<Allocation *>(va);
     const Type * t = a->getType();
@@ -530,7 +1018,9 @@ void rsi_Allocation3DData(Context *rsc, RsAllocation va, uint32_t xoff, uint32_t
 void rsi_AllocationRead(Context *rsc, RsAllocation va, void *data, size_t sizeBytes) {
     Allocation *a = static_cast<Allocation *>(va);
     const Type * t = a->getType();
-    if(t->getDimY()) {
+    if (t->getDimZ()) {
+        a->read(rsc, 0, 0, 0, 0, t->getDimX(), t->getDimY(), t->getDimZ(), data, sizeBytes, 0);
+    } else if(t->getDimY()) {
         a->read(rsc, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X,
                 t->getDimX(), t->getDimY(), data, sizeBytes, 0);
     } else {
@@ -539,6 +1029,78 @@ void rsi_AllocationRead(Context *rsc, RsAllocation va, void *data, size_t sizeBy
 
 }
 
+void * rsi_AllocationGetPointer(Context *rsc, RsAllocation va, uint32_t lod,
+                               RsAllocationCubemapFace face, size_t *stride, size_t strideLen) {
+    Allocation *a = static_cast<Allocation *>(va);
+    rsAssert(!stride || (strideLen == sizeof(size_t)));
+    return a->getPointer(rsc, lod, face, stride);
+}
+
+RsAllocation rsi_AllocationCreateView(Context *rsc, RsAllocation parent,
+                                      uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                                      uint32_t lod, RsAllocationCubemapFace face,
+                                      uint32_t w, uint32_t h, uint32_t d) {
+    Allocation *alloc = Allocation::createView(rsc, static_cast<Allocation *>(parent),
+                                               xoff, yoff, zoff, lod, face, w, h, d);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationCreateFromFile(Context *rsc, RsType vtype, uint32_t usages,
+                                          const char *path, size_t pathLength,
+                                          size_t offset, uint32_t flags) {
+    String8 name(path, pathLength);
+    Allocation *alloc = Allocation::createFromFile(rsc, static_cast<Type *>(vtype), usages,
+                                                   name.string(), offset, flags);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationCreateSparse(Context *rsc, RsType vtype, uint32_t usages,
+                                        uint32_t brickX, uint32_t brickY, uint32_t brickZ) {
+    Allocation *alloc = Allocation::createSparse(rsc, static_cast<Type *>(vtype), usages,
+                                                 brickX, brickY, brickZ);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationCreateTiled(Context *rsc, RsType vtype, uint32_t usages,
+                                       uint32_t tileDim) {
+    Allocation *alloc = Allocation::createTiled(rsc, static_cast<Type *>(vtype), usages, tileDim);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationCreateFieldPlanes(Context *rsc, RsType vtype, uint32_t usages) {
+    Allocation *alloc = Allocation::createFieldPlanes(rsc, static_cast<Type *>(vtype), usages);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
+RsAllocation rsi_AllocationCreateFieldView(Context *rsc, RsAllocation parent, uint32_t field) {
+    Allocation *alloc = Allocation::createFieldView(rsc, static_cast<Allocation *>(parent), field);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
 void rsi_AllocationResize1D(Context *rsc, RsAllocation va, uint32_t dimX) {
     Allocation *a = static_cast<Allocation *>(va);
     a->resize1D(rsc, dimX);
@@ -560,6 +1122,34 @@ RsAllocation rsi_AllocationCreateTyped(Context *rsc, RsType vtype,
     return alloc;
 }
 
+RsAllocation rsi_AllocationCreateStrided(Context *rsc, RsType vtype,
+                                         RsAllocationMipmapControl mips,
+                                         uint32_t usages, uintptr_t ptr,
+                                         const size_t *strides, size_t stridesLength,
+                                         const size_t *offsets, size_t offsetsLength) {
+    Allocation::Hal::UserLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.count = stridesLength / sizeof(size_t);
+
+    if ((layout.count > Allocation::MAX_LOD) ||
+        (offsetsLength && (offsetsLength != stridesLength))) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "Allocation layout mismatch.");
+        return NULL;
+    }
+    memcpy(layout.stride, strides, stridesLength);
+    if (offsetsLength) {
+        memcpy(layout.offset, offsets, offsetsLength);
+    }
+
+    Allocation * alloc = Allocation::createAllocation(rsc, static_cast<Type *>(vtype), usages, mips,
+                                                      (void*)ptr, &layout);
+    if (!alloc) {
+        return NULL;
+    }
+    alloc->incUserRef();
+    return alloc;
+}
+
 RsAllocation rsi_AllocationCreateFromBitmap(Context *rsc, RsType vtype,
                                             RsAllocationMipmapControl mips,
                                             const void *data, size_t sizeBytes, uint32_t usages) {
@@ -630,11 +1220,17 @@ void rsi_AllocationCopy2DRange(Context *rsc,
                                uint32_t srcMip, uint32_t srcFace) {
     Allocation *dst = static_cast<Allocation *>(dstAlloc);
     Allocation *src= static_cast<Allocation *>(srcAlloc);
+    if (!dst->checkWritable(rsc)) {
+        return;
+    }
     rsc->mHal.funcs.allocation.allocData2D(rsc, dst, dstXoff, dstYoff, dstMip,
                                            (RsAllocationCubemapFace)dstFace,
                                            width, height,
                                            src, srcXoff, srcYoff,srcMip,
                                            (RsAllocationCubemapFace)srcFace);
+    if (!dstMip) {
+        dst->markWritten(dstXoff, dstYoff, 0, dstXoff + width, dstYoff + height, 1);
+    }
 }
 
 void rsi_AllocationCopy3DRange(Context *rsc,
@@ -647,9 +1243,16 @@ void rsi_AllocationCopy3DRange(Context *rsc,
                                uint32_t srcMip) {
     Allocation *dst = static_cast<Allocation *>(dstAlloc);
     Allocation *src= static_cast<Allocation *>(srcAlloc);
+    if (!dst->checkWritable(rsc)) {
+        return;
+    }
     rsc->mHal.funcs.allocation.allocData3D(rsc, dst, dstXoff, dstYoff, dstZoff, dstMip,
                                            width, height, depth,
                                            src, srcXoff, srcYoff, srcZoff, srcMip);
+    if (!dstMip) {
+        dst->markWritten(dstXoff, dstYoff, dstZoff,
+                         dstXoff + width, dstYoff + height, dstZoff + depth);
+    }
 }
 
 
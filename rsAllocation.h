@@ -77,6 +77,17 @@ public:
         };
         mutable DrvState drvState;
 
+        // Layout of memory wrapped through userProvidedPtr.  Entry n gives
+        // the row stride and the offset from userProvidedPtr of LOD n, or
+        // of plane n of a YUV allocation.  Entries past count, and zero
+        // strides, use packed rows.  Kept after drvState so the layout seen
+        // by the script runtime does not change.
+        struct UserLayout {
+            size_t stride[android::renderscript::Allocation::MAX_LOD];
+            size_t offset[android::renderscript::Allocation::MAX_LOD];
+            uint32_t count;
+        };
+        UserLayout userLayout;
     };
     Hal mHal;
 
@@ -84,7 +95,38 @@ public:
 
     static Allocation * createAllocation(Context *rsc, const Type *, uint32_t usages,
                                          RsAllocationMipmapControl mc = RS_ALLOCATION_MIPMAP_NONE,
-                                         void *ptr = 0);
+                                         void *ptr = 0, const Hal::UserLayout *layout = NULL,
+                                         uint32_t tileDim = 0, bool fieldPlanes = false);
+    // Creates an allocation aliasing a box within one LOD and face of
+    // parent.  The view shares the parent's storage and row stride, so it
+    // can be launched over or copied in place of the parent's region.
+    static Allocation * createView(Context *rsc, Allocation *parent,
+                                   uint32_t xoff, uint32_t yoff, uint32_t zoff,
+                                   uint32_t lod, RsAllocationCubemapFace face,
+                                   uint32_t w, uint32_t h, uint32_t d);
+    // Creates an allocation over size bytes of a file starting at offset,
+    // mapped shared so writes reach the file.  The OS pages the contents
+    // in and out as kernels touch them.
+    static Allocation * createFromFile(Context *rsc, const Type *type, uint32_t usages,
+                                       const char *path, size_t offset, uint32_t flags);
+    // Creates an allocation that only reserves address space.  Pages are
+    // committed, zeroed, the first time they are touched.  Kernels can skip
+    // the bricks of brickX * brickY * brickZ cells that were never written.
+    static Allocation * createSparse(Context *rsc, const Type *type, uint32_t usages,
+                                     uint32_t brickX, uint32_t brickY, uint32_t brickZ);
+    // Creates a 2D allocation stored as tileDim x tileDim blocks of
+    // elements, so neighbouring rows are close in memory.  Only runs of up
+    // to tileDim elements within one block row are contiguous; copies in
+    // and out convert to and from the linear layout.
+    static Allocation * createTiled(Context *rsc, const Type *type, uint32_t usages,
+                                    uint32_t tileDim);
+    // Creates an allocation of a struct element that keeps each field in
+    // its own contiguous plane.  Copies in and out use the usual packed
+    // structs; kernels run over the planes through field views.
+    static Allocation * createFieldPlanes(Context *rsc, const Type *type, uint32_t usages);
+    // Creates an allocation of the field's element aliasing one plane of
+    // parent, which must have been created with createFieldPlanes.
+    static Allocation * createFieldView(Context *rsc, Allocation *parent, uint32_t field);
     virtual ~Allocation();
     void updateCache();
 
@@ -109,6 +151,11 @@ public:
     void read(Context *rsc, uint32_t xoff, uint32_t yoff, uint32_t zoff, uint32_t lod,
               uint32_t w, uint32_t h, uint32_t d, void *data, size_t sizeBytes, size_t stride);
 
+    // Returns the storage of one LOD and face, NULL if there is none or it
+    // is mapped read-only.
+    void * getPointer(Context *rsc, uint32_t lod, RsAllocationCubemapFace face,
+                      size_t *stride);
+
     void elementData(Context *rsc, uint32_t x,
                      const void *data, uint32_t elementOff, size_t sizeBytes);
     void elementData(Context *rsc, uint32_t x, uint32_t y,
@@ -134,6 +181,33 @@ public:
     bool getIsBufferObject() const {
         return (mHal.state.usageFlags & RS_ALLOCATION_USAGE_GRAPHICS_VERTEX) != 0;
     }
+    bool getIsFileBacked() const {return mFileBacked;}
+    bool getIsSparse() const {return mBrickX != 0;}
+    uint32_t getBrickX() const {return mBrickX;}
+    uint32_t getBrickY() const {return mBrickY;}
+    uint32_t getBrickZ() const {return mBrickZ;}
+    // Records that cells in [x1, x2) x [y1, y2) x [z1, z2) of LOD 0 may have
+    // been written.  Only sparse allocations keep track; the bricks stay
+    // marked for the life of the allocation.
+    void markWritten(uint32_t x1, uint32_t y1, uint32_t z1,
+                     uint32_t x2, uint32_t y2, uint32_t z2);
+    void markAllWritten();
+    // Bricks are numbered x fastest, then y, then z.
+    bool getBrickWritten(uint32_t brick) const {
+        return (mBrickWritten[brick >> 5] >> (brick & 31)) & 1;
+    }
+    bool getIsTiled() const {return mTileDim != 0;}
+    uint32_t getTileDim() const {return mTileDim;}
+    bool getHasFieldPlanes() const {return mFieldPlanes;}
+    // Offset of the plane of a field from the start of the storage.  The
+    // offset of the plane after the last field is the storage size.
+    size_t getFieldPlaneOffset(uint32_t field) const;
+    uint32_t getFileFlags() const {return mFileFlags;}
+    bool getIsReadOnly() const {
+        return mFileBacked && !(mFileFlags & RS_ALLOCATION_FILE_READ_WRITE);
+    }
+    // Sets an error and returns false if the allocation cannot be written.
+    bool checkWritable(Context *rsc) const;
 
     void incRefs(const void *ptr, size_t ct, size_t startOff = 0) const;
     void decRefs(const void *ptr, size_t ct, size_t startOff = 0) const;
@@ -152,6 +226,27 @@ public:
 protected:
     Vector<const Program *> mToDirtyList;
     ObjectBaseRef<const Type> mType;
+    // Set on views; keeps the storage they alias alive.
+    ObjectBaseRef<Allocation> mViewParent;
+    // Number of views of this allocation, which pin its storage in place.
+    volatile int32_t mViewCount;
+    // Set on allocations over a mapped file and on views of them.
+    bool mFileBacked;
+    uint32_t mFileFlags;
+    // Brick size of a sparse allocation, 0 otherwise.
+    uint32_t mBrickX;
+    uint32_t mBrickY;
+    uint32_t mBrickZ;
+    // One bit per brick of a sparse allocation, set by markWritten.
+    uint32_t *mBrickWritten;
+    // Block size of a tiled allocation, 0 for the linear layout.
+    uint32_t mTileDim;
+    // Set when each field of the element is stored in its own plane.
+    bool mFieldPlanes;
+    // Memory mapped for a file backed or sparse allocation, unmapped with
+    // it.  Views share the parent's mapping and leave this NULL.
+    void *mMapping;
+    size_t mMappingSize;
     void setType(const Type *t) {
         mType.set(t);
         mHal.state.type = t;
@@ -159,13 +254,14 @@ protected:
 
 private:
     void freeChildrenUnlocked();
-    Allocation(Context *rsc, const Type *, uint32_t usages, RsAllocationMipmapControl mc, void *ptr);
+    Allocation(Context *rsc, const Type *, uint32_t usages, RsAllocationMipmapControl mc, void *ptr,
+               const Hal::UserLayout *layout);
 
-    uint32_t getPackedSize() const;
+    size_t getPackedSize() const;
     static void writePackedData(Context *rsc, const Type *type, uint8_t *dst,
                                 const uint8_t *src, bool dstPadded);
     void unpackVec3Allocation(Context *rsc, const void *data, size_t dataSize);
-    void packVec3Allocation(Context *rsc, OStream *stream) const;
+    void packVec3Allocation(Context *rsc, OStream *stream, const uint8_t *src) const;
 };
 
 }
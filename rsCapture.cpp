@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsContext.h"
+#include "rsCapture.h"
+#include "rsgApiStructs.h"
+#include "rsgApiFuncDecl.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+static const uint32_t gReplayTableSize = sizeof(gCaptureReplayFuncs) / sizeof(gCaptureReplayFuncs[0]);
+
+static uint64_t hashBytes(const uint8_t *data, size_t len) {
+    // 64 bit FNV-1a.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t ct = 0; ct < len; ct++) {
+        h ^= data[ct];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static size_t getSnapshotSize(const Allocation *a) {
+    const Type *t = a->getType();
+    return t->getElementSizeBytes() * t->getDimX() * rsMax(t->getDimY(), 1u) *
+           rsMax(t->getDimZ(), 1u);
+}
+
+CommandCapture::CommandCapture() {
+    mFile = NULL;
+    mCmdID = 0;
+    mRecord = NULL;
+    mRecordSize = 0;
+    mRecordCapacity = 0;
+}
+
+CommandCapture::~CommandCapture() {
+    if (mFile) {
+        fclose(mFile);
+    }
+    free(mRecord);
+}
+
+CommandCapture * CommandCapture::create(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ALOGE("Unable to open capture file %s", path);
+        return NULL;
+    }
+
+    CaptureFileHeader hdr;
+    hdr.magic = RS_CAPTURE_MAGIC;
+    hdr.version = RS_CAPTURE_VERSION;
+    hdr.apiCount = gReplayTableSize;
+    hdr.pointerSize = sizeof(void *);
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        ALOGE("Unable to write capture file %s", path);
+        fclose(f);
+        return NULL;
+    }
+
+    CommandCapture *cc = new CommandCapture();
+    cc->mFile = f;
+    cc->mMutex.init();
+    return cc;
+}
+
+void CommandCapture::append(const void *data, size_t bytes) {
+    if ((mRecordSize + bytes) > mRecordCapacity) {
+        size_t newCapacity = rsMax(mRecordCapacity * 2, mRecordSize + bytes);
+        newCapacity = rsMax(newCapacity, (size_t)4096);
+        uint8_t *newRecord = (uint8_t *)realloc(mRecord, newCapacity);
+        if (!newRecord) {
+            ALOGE("CommandCapture out of memory for command %i", mCmdID);
+            return;
+        }
+        mRecord = newRecord;
+        mRecordCapacity = newCapacity;
+    }
+    memcpy(&mRecord[mRecordSize], data, bytes);
+    mRecordSize += bytes;
+}
+
+void CommandCapture::writeRecord(uint32_t type, uint32_t cmdID) {
+    CaptureRecordHeader hdr;
+    hdr.type = type;
+    hdr.cmdID = cmdID;
+    hdr.bytes = mRecordSize;
+    fwrite(&hdr, sizeof(hdr), 1, mFile);
+    if (mRecordSize) {
+        fwrite(mRecord, mRecordSize, 1, mFile);
+    }
+    // Captures are usually taken from apps that are never shut down
+    // cleanly, so keep the file complete up to the last command.
+    fflush(mFile);
+    mRecordSize = 0;
+}
+
+// Reads back the contents of an allocation.  Returns NULL while a
+// CommandBuffer is recording, since nothing reaches the core thread then.
+static uint8_t * readAllocation(RsContext vrsc, RsAllocation va, RsCaptureReadFunc read,
+                                size_t *bytes) {
+    Context *rsc = static_cast<Context *>(vrsc);
+    if (!va || rsc->mIO.isRecording()) {
+        return NULL;
+    }
+
+    const Allocation *a = static_cast<const Allocation *>(va);
+    *bytes = getSnapshotSize(a);
+    uint8_t *data = (uint8_t *)malloc(*bytes);
+    if (!data) {
+        ALOGE("CommandCapture out of memory snapshotting allocation %p", va);
+        return NULL;
+    }
+    read(vrsc, va, data, *bytes);
+    return data;
+}
+
+// Stores the hash of the contents of va.  Returns false if it matches the
+// hash already stored.
+bool CommandCapture::setSnapshotHash(RsAllocation va, uint64_t hash) {
+    for (size_t ct = 0; ct < mSnapshots.size(); ct++) {
+        if (mSnapshots[ct].alloc == va) {
+            if (mSnapshots[ct].hash == hash) {
+                return false;
+            }
+            mSnapshots.editArray()[ct].hash = hash;
+            return true;
+        }
+    }
+    Snapshot n;
+    n.alloc = va;
+    n.hash = hash;
+    mSnapshots.add(n);
+    return true;
+}
+
+void CommandCapture::snapshotAllocation(RsContext vrsc, RsAllocation va, RsCaptureReadFunc read) {
+    size_t bytes;
+    uint8_t *data = readAllocation(vrsc, va, read, &bytes);
+    if (!data) {
+        return;
+    }
+
+    if (setSnapshotHash(va, hashBytes(data, bytes))) {
+        mRecordSize = 0;
+        writeValue(&va, sizeof(va));
+        append(data, bytes);
+        writeRecord(RS_CAPTURE_RECORD_ALLOCATION_DATA, 0);
+    }
+    free(data);
+}
+
+void CommandCapture::updateSnapshot(RsContext vrsc, RsAllocation va, RsCaptureReadFunc read) {
+    size_t bytes;
+    uint8_t *data = readAllocation(vrsc, va, read, &bytes);
+    if (!data) {
+        return;
+    }
+    setSnapshotHash(va, hashBytes(data, bytes));
+    free(data);
+}
+
+void CommandCapture::forgetAllocation(RsAllocation va) {
+    // Handles are reused once an object is destroyed, so a new allocation
+    // must not inherit the snapshot of an old one at the same address.
+    for (size_t ct = 0; ct < mSnapshots.size(); ct++) {
+        if (mSnapshots[ct].alloc == va) {
+            mSnapshots.removeAt(ct);
+            return;
+        }
+    }
+}
+
+void CommandCapture::beginCommand(uint32_t cmdID) {
+    mCmdID = cmdID;
+    mRecordSize = 0;
+}
+
+void CommandCapture::writeValue(const void *v, size_t bytes) {
+    uint64_t slot = 0;
+    memcpy(&slot, v, rsMin(bytes, sizeof(slot)));
+    append(&slot, sizeof(slot));
+}
+
+void CommandCapture::writeData(const void *data, size_t bytes) {
+    uint64_t len = data ? bytes : 0;
+    append(&len, sizeof(len));
+    if (len) {
+        append(data, len);
+    }
+}
+
+void CommandCapture::writeArray64(const void *data, size_t bytes, size_t elementSize) {
+    uint64_t count = data ? (bytes / elementSize) : 0;
+    append(&count, sizeof(count));
+    const uint8_t *p = (const uint8_t *)data;
+    for (uint64_t ct = 0; ct < count; ct++) {
+        writeValue(&p[ct * elementSize], elementSize);
+    }
+}
+
+void CommandCapture::endCommand() {
+    writeRecord(RS_CAPTURE_RECORD_COMMAND, mCmdID);
+}
+
+
+CaptureReader::CaptureReader() {
+    mFile = NULL;
+    memset(&mFileHeader, 0, sizeof(mFileHeader));
+    memset(&mHeader, 0, sizeof(mHeader));
+    mRecord = NULL;
+    mRecordCapacity = 0;
+    mReadPos = 0;
+}
+
+CaptureReader::~CaptureReader() {
+    if (mFile) {
+        fclose(mFile);
+    }
+    for (size_t ct = 0; ct < mScratch.size(); ct++) {
+        free(mScratch[ct]);
+    }
+    free(mRecord);
+}
+
+bool CaptureReader::open(const char *path) {
+    mFile = fopen(path, "rb");
+    if (!mFile) {
+        ALOGE("Unable to open capture file %s", path);
+        return false;
+    }
+    if (fread(&mFileHeader, sizeof(mFileHeader), 1, mFile) != 1 ||
+        mFileHeader.magic != RS_CAPTURE_MAGIC) {
+        ALOGE("%s is not a RenderScript capture", path);
+        return false;
+    }
+    if (mFileHeader.version != RS_CAPTURE_VERSION ||
+        mFileHeader.apiCount != gReplayTableSize) {
+        ALOGE("Capture %s was taken with a different API version", path);
+        return false;
+    }
+    return true;
+}
+
+bool CaptureReader::next() {
+    for (size_t ct = 0; ct < mScratch.size(); ct++) {
+        free(mScratch[ct]);
+    }
+    mScratch.clear();
+
+    if (fread(&mHeader, sizeof(mHeader), 1, mFile) != 1) {
+        return false;
+    }
+    if (mHeader.bytes > mRecordCapacity) {
+        uint8_t *newRecord = (uint8_t *)realloc(mRecord, mHeader.bytes);
+        if (!newRecord) {
+            ALOGE("CaptureReader out of memory reading %llu byte record",
+                  (unsigned long long)mHeader.bytes);
+            return false;
+        }
+        mRecord = newRecord;
+        mRecordCapacity = mHeader.bytes;
+    }
+    if (mHeader.bytes && (fread(mRecord, mHeader.bytes, 1, mFile) != 1)) {
+        ALOGE("Capture truncated in command %i", mHeader.cmdID);
+        return false;
+    }
+    mReadPos = 0;
+    return true;
+}
+
+const char * CaptureReader::getCommandName() const {
+    if (mHeader.type == RS_CAPTURE_RECORD_ALLOCATION_DATA) {
+        return "AllocationSnapshot";
+    }
+    if (mHeader.cmdID < gReplayTableSize) {
+        return gApiNames[mHeader.cmdID];
+    }
+    return "Unknown";
+}
+
+void CaptureReader::replay(RsContext rsc) {
+    if (mHeader.type == RS_CAPTURE_RECORD_ALLOCATION_DATA) {
+        replayAllocationData(rsc);
+        return;
+    }
+
+    if ((mHeader.cmdID >= gReplayTableSize) || !gCaptureReplayFuncs[mHeader.cmdID]) {
+        ALOGE("CaptureReader cannot replay command %i", mHeader.cmdID);
+        return;
+    }
+    gCaptureReplayFuncs[mHeader.cmdID](this, rsc);
+}
+
+void CaptureReader::replayAllocationData(RsContext rsc) {
+    RsAllocation va = readHandle();
+    if (!va) {
+        return;
+    }
+
+    const Allocation *a = static_cast<const Allocation *>(va);
+    const Type *t = a->getType();
+    size_t bytes = mHeader.bytes - mReadPos;
+    if (bytes != getSnapshotSize(a)) {
+        ALOGE("Allocation snapshot size mismatch, expected %zu, got %zu",
+              getSnapshotSize(a), bytes);
+        return;
+    }
+
+    const void *data = &mRecord[mReadPos];
+    if (t->getDimZ()) {
+        rsAllocation3DData(rsc, va, 0, 0, 0, 0, t->getDimX(), t->getDimY(), t->getDimZ(),
+                           data, bytes, t->getDimX() * t->getElementSizeBytes());
+    } else if (t->getDimY()) {
+        rsAllocation2DData(rsc, va, 0, 0, 0, RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X,
+                           t->getDimX(), t->getDimY(), data, bytes,
+                           t->getDimX() * t->getElementSizeBytes());
+    } else {
+        rsAllocation1DData(rsc, va, 0, 0, t->getDimX(), data, bytes);
+    }
+    mReadPos += bytes;
+}
+
+void CaptureReader::readValue(void *v, size_t bytes) {
+    uint64_t slot = 0;
+    if ((mReadPos + sizeof(slot)) <= mHeader.bytes) {
+        memcpy(&slot, &mRecord[mReadPos], sizeof(slot));
+        mReadPos += sizeof(slot);
+    } else {
+        ALOGE("Capture record for command %i is too short", mHeader.cmdID);
+    }
+    memcpy(v, &slot, rsMin(bytes, sizeof(slot)));
+}
+
+void * CaptureReader::readHandle() {
+    uint64_t h;
+    readValue(&h, sizeof(h));
+    return lookupHandle(h);
+}
+
+const void * CaptureReader::readData(size_t *bytes) {
+    uint64_t len;
+    readValue(&len, sizeof(len));
+    if ((mReadPos + len) > mHeader.bytes) {
+        ALOGE("Capture record for command %i is too short", mHeader.cmdID);
+        len = 0;
+    }
+    bytes[0] = len;
+    if (!len) {
+        return NULL;
+    }
+    const void *data = &mRecord[mReadPos];
+    mReadPos += len;
+    return data;
+}
+
+void * CaptureReader::readArray64(size_t elementSize, bool isHandle, size_t *bytes) {
+    uint64_t count;
+    readValue(&count, sizeof(count));
+    bytes[0] = count * elementSize;
+    if (!count) {
+        return NULL;
+    }
+
+    uint8_t *array = (uint8_t *)allocScratch(count * elementSize);
+    for (uint64_t ct = 0; ct < count; ct++) {
+        if (isHandle) {
+            void *h = readHandle();
+            memcpy(&array[ct * elementSize], &h, elementSize);
+        } else {
+            readValue(&array[ct * elementSize], elementSize);
+        }
+    }
+    return array;
+}
+
+void * CaptureReader::allocScratch(size_t bytes) {
+    void *p = calloc(1, rsMax(bytes, (size_t)1));
+    mScratch.add(p);
+    return p;
+}
+
+void CaptureReader::mapHandle(uint64_t captured, void *replayed) {
+    if (!captured) {
+        return;
+    }
+    HandleMap m;
+    m.captured = captured;
+    m.replayed = replayed;
+    mHandles.add(m);
+}
+
+void * CaptureReader::lookupHandle(uint64_t captured) const {
+    if (!captured) {
+        return NULL;
+    }
+    // Search newest first; the capturing process may have reused the
+    // address of a destroyed object.
+    for (size_t ct = mHandles.size(); ct > 0; ct--) {
+        if (mHandles[ct - 1].captured == captured) {
+            return mHandles[ct - 1].replayed;
+        }
+    }
+    ALOGE("Capture references unknown object 0x%llx", (unsigned long long)captured);
+    return NULL;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_CAPTURE_H
+#define ANDROID_RS_CAPTURE_H
+
+#include "rsUtils.h"
+#include "rsMutex.h"
+
+#include <stdio.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+namespace renderscript {
+
+// Trace file layout.  A CaptureFileHeader is followed by records, each a
+// CaptureRecordHeader and a payload.  Command payloads hold the API
+// parameters in spec order: every scalar widened to 64 bits, then the
+// contents of each input pointer, then the return value.  Arrays of handles
+// and size_t are stored as 64-bit values so a trace taken on a 32-bit
+// device replays on a 64-bit host.
+enum {
+    RS_CAPTURE_MAGIC = 0x54435352,  // 'RSCT'
+    RS_CAPTURE_VERSION = 1
+};
+
+enum RsCaptureRecordType {
+    RS_CAPTURE_RECORD_COMMAND = 1,
+    // The packed contents of LOD 0, face 0 of an allocation as returned by
+    // rsAllocationRead.  Written before a command that references the
+    // allocation whenever the contents changed outside the command stream.
+    RS_CAPTURE_RECORD_ALLOCATION_DATA = 2
+};
+
+typedef struct CaptureFileHeaderRec {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t apiCount;
+    uint32_t pointerSize;
+} CaptureFileHeader;
+
+typedef struct CaptureRecordHeaderRec {
+    uint32_t type;
+    uint32_t cmdID;
+    uint64_t bytes;
+} CaptureRecordHeader;
+
+typedef void (*RsCaptureReadFunc)(RsContext, RsAllocation, void *, size_t);
+
+// Writes the command stream of a context to a file.  The generated rs*
+// entry points call into this while ThreadIO has a capture attached.
+class CommandCapture {
+public:
+    static CommandCapture * create(const char *path);
+    ~CommandCapture();
+
+    void lock() {mMutex.lock();}
+    void unlock() {mMutex.unlock();}
+
+    // Writes the contents of an allocation if they differ from the last
+    // snapshot taken of it.  read is used so the snapshot is ordered after
+    // every command already queued to the core thread.
+    void snapshotAllocation(RsContext rsc, RsAllocation va, RsCaptureReadFunc read);
+    // Takes the contents of an allocation after a captured command as the
+    // last snapshot without writing them.  Replay reproduces them by
+    // running the command, so only later changes made by the app need a
+    // snapshot.
+    void updateSnapshot(RsContext rsc, RsAllocation va, RsCaptureReadFunc read);
+    void forgetAllocation(RsAllocation va);
+
+    void beginCommand(uint32_t cmdID);
+    void writeValue(const void *v, size_t bytes);
+    void writeData(const void *data, size_t bytes);
+    void writeArray64(const void *data, size_t bytes, size_t elementSize);
+    void endCommand();
+
+protected:
+    CommandCapture();
+
+    void append(const void *data, size_t bytes);
+    void writeRecord(uint32_t type, uint32_t cmdID);
+    bool setSnapshotHash(RsAllocation va, uint64_t hash);
+
+    typedef struct SnapshotRec {
+        const void *alloc;
+        uint64_t hash;
+    } Snapshot;
+
+    Mutex mMutex;
+    FILE *mFile;
+    uint32_t mCmdID;
+    uint8_t *mRecord;
+    size_t mRecordSize;
+    size_t mRecordCapacity;
+    Vector<Snapshot> mSnapshots;
+};
+
+class CaptureReader;
+typedef void (*RsCaptureReplayFunc)(CaptureReader *, RsContext);
+
+// Reads a trace written by CommandCapture and replays it one record at a
+// time against a context.  Handles recorded in the trace are mapped to the
+// objects created during replay.
+class CaptureReader {
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    bool open(const char *path);
+    bool next();
+
+    uint32_t getRecordType() const {return mHeader.type;}
+    uint32_t getCommandID() const {return mHeader.cmdID;}
+    const char * getCommandName() const;
+
+    void replay(RsContext rsc);
+
+    // Used by the generated replay functions to decode the current record.
+    void readValue(void *v, size_t bytes);
+    void * readHandle();
+    const void * readData(size_t *bytes);
+    void * readArray64(size_t elementSize, bool isHandle, size_t *bytes);
+    void * allocScratch(size_t bytes);
+    void mapHandle(uint64_t captured, void *replayed);
+    void * lookupHandle(uint64_t captured) const;
+
+protected:
+    typedef struct HandleMapRec {
+        uint64_t captured;
+        void *replayed;
+    } HandleMap;
+
+    void replayAllocationData(RsContext rsc);
+
+    FILE *mFile;
+    CaptureFileHeader mFileHeader;
+    CaptureRecordHeader mHeader;
+    uint8_t *mRecord;
+    size_t mRecordCapacity;
+    size_t mReadPos;
+    Vector<HandleMap> mHandles;
+    Vector<void *> mScratch;
+};
+
+}
+}
+#endif //ANDROID_RS_CAPTURE_H
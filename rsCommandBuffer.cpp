@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rsContext.h"
+#include "rsCommandBuffer.h"
+#include "rsgApiStructs.h"
+
+using namespace android;
+using namespace android::renderscript;
+
+CommandBuffer::CommandBuffer(Context *rsc) : ObjectBase(rsc) {
+    mData = NULL;
+    mSize = 0;
+    mCapacity = 0;
+    mLastOffset = 0;
+    mCommandCount = 0;
+    mRecording = false;
+    mExecuting = false;
+    mLock.init();
+}
+
+CommandBuffer::~CommandBuffer() {
+    releaseRefs(&mRefs);
+    releaseRefs(&mStaleRefs);
+    free(mData);
+}
+
+void CommandBuffer::releaseRefs(Vector<ObjectBase *> *refs) {
+    for (size_t ct = 0; ct < refs->size(); ct++) {
+        (*refs)[ct]->decSysRef();
+    }
+    refs->clear();
+}
+
+bool CommandBuffer::freeChildren() {
+    incSysRef();
+    releaseRefs(&mRefs);
+    releaseRefs(&mStaleRefs);
+    return decSysRef();
+}
+
+void CommandBuffer::clear() {
+    mLock.lock();
+    for (size_t ct = 0; ct < mRefs.size(); ct++) {
+        mStaleRefs.add(mRefs[ct]);
+    }
+    mRefs.clear();
+    mSize = 0;
+    mCommandCount = 0;
+    mLock.unlock();
+}
+
+void * CommandBuffer::appendCommand(uint32_t cmdID, size_t dataLen) {
+    // Keep every command body aligned the same way as the fifo send buffer.
+    size_t cmdSize = rsRound(sizeof(CmdHeader) + dataLen, sizeof(double));
+    mLock.lock();
+    if ((mSize + cmdSize) > mCapacity) {
+        size_t newCapacity = rsMax(mCapacity * 2, mSize + cmdSize);
+        newCapacity = rsMax(newCapacity, (size_t)4096);
+        uint8_t *newData = (uint8_t *)realloc(mData, newCapacity);
+        if (!newData) {
+            ALOGE("CommandBuffer %p out of memory recording command %i", this, cmdID);
+            mLock.unlock();
+            return NULL;
+        }
+        mData = newData;
+        mCapacity = newCapacity;
+    }
+
+    CmdHeader *hdr = (CmdHeader *)&mData[mSize];
+    hdr->cmdID = cmdID;
+    hdr->bytes = dataLen;
+    mLastOffset = mSize;
+    mSize += cmdSize;
+    mCommandCount++;
+    mLock.unlock();
+    return &hdr[1];
+}
+
+void CommandBuffer::commitCommand() {
+    // Only the recording client thread grows mData, so the command cannot
+    // move under us.
+    const CmdHeader *hdr = (const CmdHeader *)&mData[mLastOffset];
+    const RsCmdHandles *handles = &gCmdHandles[hdr->cmdID];
+    const uint8_t *cmd = (const uint8_t *)&hdr[1];
+    for (uint32_t ct = 0; ct < handles->count; ct++) {
+        void *h = *(void * const *)&cmd[handles->offsets[ct]];
+        if (h) {
+            ObjectBase *ob = static_cast<ObjectBase *>(h);
+            ob->incSysRef();
+            mRefs.add(ob);
+        }
+    }
+}
+
+bool CommandBuffer::patch(Context *rsc, uint32_t cmdIndex, const void *data, size_t dataLen) {
+    mLock.lock();
+    if (cmdIndex >= mCommandCount) {
+        mLock.unlock();
+        rsc->setError(RS_ERROR_BAD_VALUE, "CommandBuffer patch index out of range");
+        return false;
+    }
+
+    size_t offset = 0;
+    CmdHeader *hdr = (CmdHeader *)mData;
+    for (uint32_t ct = 0; ct < cmdIndex; ct++) {
+        offset += rsRound(sizeof(CmdHeader) + hdr->bytes, sizeof(double));
+        hdr = (CmdHeader *)&mData[offset];
+    }
+
+    if (dataLen > hdr->bytes) {
+        mLock.unlock();
+        rsc->setError(RS_ERROR_BAD_VALUE, "CommandBuffer patch larger than command");
+        return false;
+    }
+    uint8_t *cmd = (uint8_t *)&hdr[1];
+    memcpy(&cmd[hdr->bytes - dataLen], data, dataLen);
+    mLock.unlock();
+    return true;
+}
+
+void CommandBuffer::execute(Context *rsc) {
+    if (mRecording || mExecuting) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "CommandBuffer submitted while recording or from within itself");
+        return;
+    }
+
+    mLock.lock();
+    releaseRefs(&mStaleRefs);
+    mExecuting = true;
+    rsc->mIO.setReplaying(true);
+    size_t offset = 0;
+    while (offset < mSize) {
+        const CmdHeader *hdr = (const CmdHeader *)&mData[offset];
+        if ((hdr->cmdID >= (sizeof(gPlaybackFuncs) / sizeof(void *))) ||
+            !gPlaybackFuncs[hdr->cmdID]) {
+            ALOGE("CommandBuffer %p bad command %i", this, hdr->cmdID);
+            break;
+        }
+        gPlaybackFuncs[hdr->cmdID](rsc, &hdr[1], hdr->bytes);
+        offset += rsRound(sizeof(CmdHeader) + hdr->bytes, sizeof(double));
+    }
+    rsc->mIO.setReplaying(false);
+    mExecuting = false;
+    mLock.unlock();
+}
+
+void CommandBuffer::serialize(Context *rsc, OStream *stream) const {
+}
+
+RsA3DClassID CommandBuffer::getClassId() const {
+    return RS_A3D_CLASS_ID_UNKNOWN;
+}
+
+
+namespace android {
+namespace renderscript {
+
+RsCommandBuffer rsi_CommandBufferCreate(Context *rsc) {
+    CommandBuffer *cb = new CommandBuffer(rsc);
+    cb->incUserRef();
+    return cb;
+}
+
+void rsi_CommandBufferBeginRecording(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    if (rsc->isSynchronous()) {
+        rsc->setError(RS_ERROR_BAD_VALUE,
+                      "CommandBuffer recording requires an asynchronous context");
+        return;
+    }
+    if (!rsc->mIO.beginRecording(cb)) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "A CommandBuffer is already recording");
+        return;
+    }
+    cb->clear();
+    cb->setRecording(true);
+}
+
+void rsi_CommandBufferEndRecording(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    if (!cb->isRecording()) {
+        rsc->setError(RS_ERROR_BAD_VALUE, "CommandBuffer is not recording");
+        return;
+    }
+    rsc->mIO.endRecording();
+    cb->setRecording(false);
+}
+
+uint32_t rsi_CommandBufferGetCommandCount(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    return cb->getCommandCount();
+}
+
+void rsi_CommandBufferPatch(Context *rsc, RsCommandBuffer vcb, uint32_t cmdIndex,
+                            const void *data, size_t dataLen) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->patch(rsc, cmdIndex, data, dataLen);
+}
+
+void rsi_CommandBufferSubmit(Context *rsc, RsCommandBuffer vcb) {
+    CommandBuffer *cb = static_cast<CommandBuffer *>(vcb);
+    cb->execute(rsc);
+}
+
+}
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RS_COMMAND_BUFFER_H
+#define ANDROID_RS_COMMAND_BUFFER_H
+
+#include "rsObjectBase.h"
+#include "rsMutex.h"
+
+// ---------------------------------------------------------------------------
+namespace android {
+namespace renderscript {
+
+// A CommandBuffer holds a sequence of already marshalled fifo commands.
+// While recording, ThreadIO redirects coreHeader() into the buffer instead
+// of the socket.  Submitting the buffer replays every command on the core
+// thread from a single fifo command.  The buffer holds a reference to every
+// object a recorded command names until it is cleared or destroyed.
+class CommandBuffer : public ObjectBase {
+public:
+    CommandBuffer(Context *);
+
+    // Returns storage for the body of a new command of dataLen bytes.
+    void * appendCommand(uint32_t cmdID, size_t dataLen);
+    // Takes references to the objects named by the command last appended,
+    // once its body has been written.
+    void commitCommand();
+    uint32_t getCommandCount() const {return mCommandCount;}
+
+    // Overwrites the trailing dataLen bytes of the inline payload of a
+    // recorded command.  For ScriptSetVarV, ScriptInvokeV and a ScriptForEach
+    // without a launch range this is the variable, argument or usr data.
+    bool patch(Context *rsc, uint32_t cmdIndex, const void *data, size_t dataLen);
+
+    void execute(Context *rsc);
+    void clear();
+
+    bool isRecording() const {return mRecording;}
+    void setRecording(bool r) {mRecording = r;}
+
+    virtual void serialize(Context *rsc, OStream *stream) const;
+    virtual RsA3DClassID getClassId() const;
+    virtual bool freeChildren();
+
+protected:
+    virtual ~CommandBuffer();
+
+    static void releaseRefs(Vector<ObjectBase *> *refs);
+
+    typedef struct CmdHeaderRec {
+        uint32_t cmdID;
+        uint32_t bytes;
+    } CmdHeader;
+
+    uint8_t *mData;
+    size_t mSize;
+    size_t mCapacity;
+    size_t mLastOffset;
+    uint32_t mCommandCount;
+    bool mRecording;
+    bool mExecuting;
+
+    // Objects named by the recorded commands.  Clearing the buffer happens
+    // on the client thread, so the references it drops are only released
+    // by the next execute() on the core thread.
+    Vector<ObjectBase *> mRefs;
+    Vector<ObjectBase *> mStaleRefs;
+    // Serializes recording and patching on the client thread with a replay
+    // of an earlier submission on the core thread.
+    Mutex mLock;
+};
+
+}
+}
+#endif //ANDROID_RS_COMMAND_BUFFER_H
@@ -18,6 +18,7 @@
 #include "rsDevice.h"
 #include "rsContext.h"
 #include "rsThreadIO.h"
+#include "rsCapture.h"
 
 #ifndef RS_COMPATIBILITY_LIB
 #include "rsMesh.h"
@@ -532,11 +533,33 @@ Context * Context::createContextLite() {
     return rsc;
 }
 
+void Context::initCapture() {
+#ifndef RS_SERVER
+    // debug.rs.capture names a path prefix; each context writes its own
+    // trace which can be replayed offline with rstest-replay.
+    char prefix[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.capture", prefix, "");
+    if (!prefix[0]) {
+        return;
+    }
+
+    static uint32_t captureCount = 0;
+    char path[PROPERTY_VALUE_MAX + 32];
+    snprintf(path, sizeof(path), "%s-%i-%u.rstrace", prefix, getpid(), captureCount++);
+    CommandCapture *cc = CommandCapture::create(path);
+    if (cc) {
+        ALOGV("%p capturing commands to %s", this, path);
+        mIO.setCapture(cc);
+    }
+#endif
+}
+
 bool Context::initContext(Device *dev, const RsSurfaceConfig *sc) {
     pthread_mutex_lock(&gInitMutex);
 
     mIO.init();
     mIO.setTimeoutCallback(printWatchdogInfo, this, 2e9);
+    initCapture();
 
     dev->addContext(this);
     mDev = dev;
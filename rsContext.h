@@ -270,6 +270,7 @@ protected:
 private:
     Context();
     bool initContext(Device *, const RsSurfaceConfig *sc);
+    void initCapture();
 
     bool mSynchronous;
     bool initGLThread();
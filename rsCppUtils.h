@@ -27,6 +27,7 @@
 #include <stdint.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <time.h>
 
@@ -278,6 +279,62 @@ static inline uint32_t rsBoxFilter8888(uint32_t i1, uint32_t i2, uint32_t i3, ui
     return (r >> 2) | ((g >> 2) << 8) | ((b >> 2) << 16) | ((a >> 2) << 24);
 }
 
+// IEEE half precision conversions; float to half rounds to nearest even.
+static inline float rsHalfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else if (exp) {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    } else {
+        // Zero or denormal, mant * 2^-24.
+        float f = mant * (1.f / 16777216.f);
+        return sign ? -f : f;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint16_t rsFloatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t fexp = (bits >> 23) & 0xff;
+    uint32_t mant = bits & 0x7fffff;
+    int32_t exp = (int32_t)fexp - 127 + 15;
+
+    if (fexp == 0xff) {
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    }
+    if (exp >= 0x1f) {
+        return sign | 0x7c00;
+    }
+
+    uint32_t shift = 13;
+    uint32_t h = exp << 10;
+    if (exp <= 0) {
+        if (exp < -10) {
+            return sign;
+        }
+        mant |= 0x800000;
+        shift = 14 - exp;
+        h = 0;
+    }
+    // Round to nearest even.  A carry out of the mantissa correctly bumps
+    // the exponent, up to infinity.
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    h += mant >> shift;
+    if ((rem > halfway) || ((rem == halfway) && (h & 1))) {
+        h++;
+    }
+    return sign | h;
+}
+
 }
 }
 
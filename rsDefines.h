@@ -33,6 +33,7 @@ typedef void * RsAdapter1D;
 typedef void * RsAdapter2D;
 typedef void * RsAllocation;
 typedef void * RsAnimation;
+typedef void * RsCommandBuffer;
 typedef void * RsContext;
 typedef void * RsDevice;
 typedef void * RsElement;
@@ -124,6 +125,27 @@ enum RsAllocationMipmapControl {
     RS_ALLOCATION_MIPMAP_ON_SYNC_TO_TEXTURE = 2
 };
 
+// Flags for allocations backed by a mapped file.
+enum RsAllocationFileFlags {
+    RS_ALLOCATION_FILE_READ_ONLY = 0x0000,
+    RS_ALLOCATION_FILE_READ_WRITE = 0x0001,
+    // Access pattern hints passed on to the kernel with madvise.  Unless
+    // the access is random, kernels launched over the allocation also ask
+    // for the rows ahead of the slices being processed.
+    RS_ALLOCATION_FILE_ACCESS_SEQUENTIAL = 0x0002,
+    RS_ALLOCATION_FILE_ACCESS_RANDOM = 0x0004,
+    RS_ALLOCATION_FILE_WILL_NEED = 0x0008
+};
+
+// Downsampling filter used when generating mipmap levels.  The windowed
+// sinc filters are separable with a support of 3 texels of the smaller
+// level; packed 16 bit formats always use the box filter.
+enum RsMipmapFilter {
+    RS_MIPMAP_FILTER_BOX = 0,
+    RS_MIPMAP_FILTER_LANCZOS3 = 1,
+    RS_MIPMAP_FILTER_KAISER = 2
+};
+
 enum RsAllocationCubemapFace {
     RS_ALLOCATION_CUBEMAP_FACE_POSITIVE_X = 0,
     RS_ALLOCATION_CUBEMAP_FACE_NEGATIVE_X = 1,
@@ -186,6 +208,29 @@ enum RsDataKind {
     RS_KIND_INVALID = 100,
 };
 
+// Plane layouts of a YUV type.  NV21 and YV12 keep their gralloc values;
+// the others are the FourCC codes of the format.  P010 stores 10 bit
+// samples in the top bits of 16 bit words and needs a 16 bit element.
+enum RsYuvFormat {
+    RS_YUV_NONE = 0,
+    RS_YUV_NV21 = 0x11,
+    RS_YUV_YV12 = 0x32315659,
+    RS_YUV_NV12 = 0x3231564e,
+    RS_YUV_I420 = 0x30323449,
+    RS_YUV_P010 = 0x30313050
+};
+
+enum RsYuvColorSpace {
+    RS_YUV_COLOR_SPACE_BT601 = 0,
+    RS_YUV_COLOR_SPACE_BT709 = 1,
+    RS_YUV_COLOR_SPACE_BT2020 = 2
+};
+
+enum RsYuvRange {
+    RS_YUV_RANGE_LIMITED = 0,
+    RS_YUV_RANGE_FULL = 1
+};
+
 enum RsSamplerParam {
     RS_SAMPLER_MIN_FILTER,
     RS_SAMPLER_MAG_FILTER,
@@ -363,7 +408,51 @@ enum RsScriptIntrinsicID {
     RS_SCRIPT_INTRINSIC_ID_BLUR = 5,
     RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB = 6,
     RS_SCRIPT_INTRINSIC_ID_BLEND = 7,
-    RS_SCRIPT_INTRINSIC_ID_3DLUT = 8
+    RS_SCRIPT_INTRINSIC_ID_3DLUT = 8,
+    RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV = 9,
+    RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE = 10,
+    RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY = 11,
+    RS_SCRIPT_INTRINSIC_ID_SCAN = 12,
+    RS_SCRIPT_INTRINSIC_ID_SORT = 13
+};
+
+// Interpolation used by the 3D LUT intrinsic.  Tetrahedral reads four
+// corners of each cell instead of eight.
+enum Rs3DLUTInterpolation {
+    RS_3DLUT_INTERPOLATION_TRILINEAR = 0,
+    RS_3DLUT_INTERPOLATION_TETRAHEDRAL = 1
+};
+
+// How the blend intrinsic interprets the colors of its inputs.
+enum RsBlendAlphaMode {
+    RS_BLEND_ALPHA_PREMULTIPLIED = 0,
+    RS_BLEND_ALPHA_STRAIGHT = 1
+};
+
+// Filter used by the blur intrinsic.  The box and pyramid modes stack
+// three box filters, so their cost does not grow with the radius; the
+// pyramid mode also filters a half or quarter size copy of large blurs.
+enum RsBlurMode {
+    RS_BLUR_MODE_GAUSSIAN = 0,
+    RS_BLUR_MODE_BOX = 1,
+    RS_BLUR_MODE_PYRAMID = 2
+};
+
+// How the convolution intrinsics sample outside the image.  Mirror
+// reflects about the edge pixel without repeating it; constant reads a
+// color set on the script.
+enum RsBorderMode {
+    RS_BORDER_CLAMP = 0,
+    RS_BORDER_MIRROR = 1,
+    RS_BORDER_WRAP = 2,
+    RS_BORDER_CONSTANT = 3
+};
+
+// Operation accumulated by the scan intrinsic.
+enum RsScanOp {
+    RS_SCAN_OP_SUM = 0,
+    RS_SCAN_OP_MIN = 1,
+    RS_SCAN_OP_MAX = 2
 };
 
 typedef struct {
@@ -380,6 +469,12 @@ enum RsForEachStrategy {
     RS_FOR_EACH_STRATEGY_TILE_LARGE = 5
 };
 
+enum RsForEachFlags {
+    // Bricks of a sparse input allocation that were never written are
+    // skipped instead of being read as zeroes.
+    RS_FOR_EACH_SKIP_UNALLOCATED = 0x0001
+};
+
 // Script to Script
 typedef struct {
     enum RsForEachStrategy strategy;
@@ -392,8 +487,21 @@ typedef struct {
     uint32_t arrayStart;
     uint32_t arrayEnd;
 
+    // Runs the kernel over LODs [lodStart, lodEnd) and cubemap faces
+    // [faceStart, faceEnd) in a single launch.  An end of 0 keeps the
+    // default of LOD 0, face 0.  These follow the fields scripts were
+    // compiled against, so a shorter struct leaves them zeroed.
+    uint32_t lodStart;
+    uint32_t lodEnd;
+    uint32_t faceStart;
+    uint32_t faceEnd;
+    // Mask of RsForEachFlags.
+    uint32_t flags;
 } RsScriptCall;
 
+// Size of RsScriptCall as laid out by scripts calling rsForEach.
+#define RS_SCRIPT_CALL_LEGACY_SIZE (sizeof(uint32_t) * 9)
+
 #ifdef __cplusplus
 };
 #endif
@@ -18,11 +18,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 using namespace android;
 using namespace android::renderscript;
@@ -62,6 +64,30 @@ bool FifoSocket::writeAsync(const void *data, size_t bytes, bool waitForSpace) {
     return true;
 }
 
+bool FifoSocket::writeAsync(const void *hdr, size_t hdrBytes, const void *data, size_t bytes) {
+    if (bytes == 0) {
+        return writeAsync(hdr, hdrBytes);
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<void *>(hdr);
+    iov[0].iov_len = hdrBytes;
+    iov[1].iov_base = const_cast<void *>(data);
+    iov[1].iov_len = bytes;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    size_t ret = ::sendmsg(sv[0], &msg, 0);
+    rsAssert(ret == (hdrBytes + bytes));
+    if (ret != (hdrBytes + bytes)) {
+        ALOGE("writeAsync %p %zu %p %zu  ret %zu", hdr, hdrBytes, data, bytes, ret);
+    }
+    return true;
+}
+
 void FifoSocket::writeWaitReturn(void *retData, size_t retBytes) {
     if (mShutdown) {
         return;
@@ -88,6 +114,18 @@ size_t FifoSocket::read(void *data, size_t bytes) {
     return ret;
 }
 
+size_t FifoSocket::readAvailable(void *data, size_t maxBytes) {
+    if (mShutdown) {
+        return 0;
+    }
+
+    ssize_t ret = ::recv(sv[1], data, maxBytes, 0);
+    if (mShutdown || (ret < 0)) {
+        ret = 0;
+    }
+    return ret;
+}
+
 bool FifoSocket::isEmpty() {
     struct pollfd p;
     p.fd = sv[1];
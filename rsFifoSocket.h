@@ -35,8 +35,12 @@ public:
     void shutdown();
 
     bool writeAsync(const void *data, size_t bytes, bool waitForSpace = true);
+    // Writes a header and its payload with a single gathered send.
+    bool writeAsync(const void *hdr, size_t hdrBytes, const void *data, size_t bytes);
     void writeWaitReturn(void *ret, size_t retSize);
     size_t read(void *data, size_t bytes);
+    // Blocks until data is available then returns as much as fits in maxBytes.
+    size_t readAvailable(void *data, size_t maxBytes);
     void readReturn(const void *data, size_t bytes);
     bool isEmpty();
 
@@ -39,6 +39,7 @@ FileA3D::FileA3D(Context *rsc) : ObjectBase(rsc) {
     mMajorVersion = 0;
     mMinorVersion = 1;
     mDataSize = 0;
+    mUse64BitOffsets = false;
 }
 
 FileA3D::~FileA3D() {
@@ -77,8 +78,8 @@ void FileA3D::parseHeader(IStream *headerStream) {
         //ALOGV("Header data, entry name = %s", entry->mObjectName.string());
         entry->mType = (RsA3DClassID)headerStream->loadU32();
         if (mUse64BitOffsets){
-            entry->mOffset = headerStream->loadOffset();
-            entry->mLength = headerStream->loadOffset();
+            entry->mOffset = headerStream->loadU64();
+            entry->mLength = headerStream->loadU64();
         } else {
             entry->mOffset = headerStream->loadU32();
             entry->mLength = headerStream->loadU32();
@@ -314,7 +315,10 @@ bool FileA3D::writeFile(const char *filename) {
     OStream headerStream(5*1024, false);
     headerStream.addU32(mMajorVersion);
     headerStream.addU32(mMinorVersion);
-    uint32_t is64Bit = 0;
+    // Files only switch to 64 bit index entries once the data outgrows 32
+    // bits, so smaller files stay readable by older runtimes.
+    mUse64BitOffsets = mWriteStream->getPos() > 0xffffffffULL;
+    uint32_t is64Bit = mUse64BitOffsets ? 1 : 0;
     headerStream.addU32(is64Bit);
 
     uint32_t writeIndexSize = mWriteIndex.size();
@@ -323,8 +327,8 @@ bool FileA3D::writeFile(const char *filename) {
         headerStream.addString(&mWriteIndex[i]->mObjectName);
         headerStream.addU32((uint32_t)mWriteIndex[i]->mType);
         if (mUse64BitOffsets){
-            headerStream.addOffset(mWriteIndex[i]->mOffset);
-            headerStream.addOffset(mWriteIndex[i]->mLength);
+            headerStream.addU64(mWriteIndex[i]->mOffset);
+            headerStream.addU64(mWriteIndex[i]->mLength);
         } else {
             uint32_t offset = (uint32_t)mWriteIndex[i]->mOffset;
             headerStream.addU32(offset);
@@ -150,6 +150,10 @@ void Program::bindAllocation(Context *rsc, Allocation *alloc, uint32_t slot) {
             rsc->setError(RS_ERROR_BAD_SHADER, "Cannot bind allocation");
             return;
         }
+        // The constants are written through lock1D when the program is set up.
+        if (!alloc->checkWritable(rsc)) {
+            return;
+        }
     }
     if (mConstants[slot].get() == alloc) {
         return;
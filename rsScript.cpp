@@ -47,7 +47,16 @@ void Script::setSlot(uint32_t slot, Allocation *a) {
         return;
     }
 
+    if (a && !a->checkWritable(mRSC)) {
+        // Bound pointers are writable from the script.
+        return;
+    }
+
     mSlots[slot].set(a);
+    if (a) {
+        // Kernels may write anywhere through the binding.
+        a->markAllWritten();
+    }
     mRSC->mHal.funcs.script.setGlobalBind(mRSC, this, slot, a);
 }
 
@@ -86,6 +95,9 @@ void Script::setVarObj(uint32_t slot, ObjectBase *val) {
         return;
     }
     //ALOGE("setvarobj  %i %p", slot, val);
+    if (val && (val->getClassId() == RS_A3D_CLASS_ID_ALLOCATION)) {
+        static_cast<Allocation *>(val)->markAllWritten();
+    }
     mRSC->mHal.funcs.script.setGlobalObj(mRSC, this, slot, val);
 }
 
@@ -183,8 +195,14 @@ void rsi_ScriptForEach(Context *rsc, RsScript vs, uint32_t slot,
     // input for sc. Instead, it retains an existing pointer value (the prior
     // field in the packed data object). This can cause confusion because
     // drivers might now inspect bogus sc data.
+    RsScriptCall call;
     if (scLen == 0) {
         sc = NULL;
+    } else if (scLen < sizeof(call)) {
+        // Callers built before the trailing fields were added.
+        memset(&call, 0, sizeof(call));
+        memcpy(&call, sc, scLen);
+        sc = &call;
     }
     s->runForEach(rsc, slot,
                   static_cast<const Allocation *>(vain), static_cast<Allocation *>(vaout),
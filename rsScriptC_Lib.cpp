@@ -177,6 +177,13 @@ void rsrForEach(Context *rsc,
                 Allocation *in, Allocation *out,
                 const void *usr, uint32_t usrBytes,
                 const RsScriptCall *call) {
+    // Scripts pass the struct without the fields that follow arrayEnd.
+    RsScriptCall sc;
+    if (call) {
+        memset(&sc, 0, sizeof(sc));
+        memcpy(&sc, call, RS_SCRIPT_CALL_LEGACY_SIZE);
+        call = &sc;
+    }
     target->runForEach(rsc, /* root slot */ 0, in, out, usr, usrBytes, call);
 }
 
@@ -33,12 +33,8 @@ void IStream::loadByteArray(void *dest, size_t numBytes) {
 }
 
 uint64_t IStream::loadOffset() {
-    uint64_t tmp;
     if (mUse64) {
-        mPos = (mPos + 7) & (~7);
-        tmp = reinterpret_cast<const uint64_t *>(&mData[mPos])[0];
-        mPos += sizeof(uint64_t);
-        return tmp;
+        return loadU64();
     }
     return loadU32();
 }
@@ -72,18 +68,7 @@ void OStream::addByteArray(const void *src, size_t numBytes) {
 
 void OStream::addOffset(uint64_t v) {
     if (mUse64) {
-        mPos = (mPos + 7) & (~7);
-        if (mPos + sizeof(v) >= mLength) {
-            growSize();
-        }
-        mData[mPos++] = (uint8_t)(v & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 8) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 16) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 24) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 32) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 40) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 48) & 0xff);
-        mData[mPos++] = (uint8_t)((v >> 56) & 0xff);
+        addU64(v);
     } else {
         addU32(v);
     }
@@ -46,6 +46,12 @@ public:
         mPos += sizeof(uint32_t);
         return tmp;
     }
+    uint64_t loadU64() {
+        mPos = (mPos + 7) & (~7);
+        uint64_t tmp = reinterpret_cast<const uint64_t *>(&mData[mPos])[0];
+        mPos += sizeof(uint64_t);
+        return tmp;
+    }
     uint16_t loadU16() {
         mPos = (mPos + 1) & (~1);
         uint16_t tmp = reinterpret_cast<const uint16_t *>(&mData[mPos])[0];
@@ -115,6 +121,15 @@ public:
         mData[mPos++] = (uint8_t)((v >> 16) & 0xff);
         mData[mPos++] = (uint8_t)((v >> 24) & 0xff);
     }
+    void addU64(uint64_t v) {
+        mPos = (mPos + 7) & (~7);
+        if (mPos + sizeof(v) >= mLength) {
+            growSize();
+        }
+        for (uint32_t ct = 0; ct < sizeof(v); ct++) {
+            mData[mPos++] = (uint8_t)((v >> (ct * 8)) & 0xff);
+        }
+    }
     void addU16(uint16_t v) {
         mPos = (mPos + 1) & (~1);
         if (mPos + sizeof(v) >= mLength) {
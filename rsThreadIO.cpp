@@ -16,6 +16,8 @@
 
 #include "rsContext.h"
 #include "rsThreadIO.h"
+#include "rsCommandBuffer.h"
+#include "rsCapture.h"
 #include "rsgApiStructs.h"
 
 #include <unistd.h>
@@ -32,10 +34,17 @@ using namespace android::renderscript;
 ThreadIO::ThreadIO() {
     mRunning = true;
     mPureFifo = false;
+    mReplaying = false;
+    mRecording = NULL;
+    mRecordingCmd = false;
+    mCapture = NULL;
     mMaxInlineSize = 1024;
+    mClientReadPos = 0;
+    mClientEndPos = 0;
 }
 
 ThreadIO::~ThreadIO() {
+    delete mCapture;
 }
 
 void ThreadIO::init() {
@@ -50,6 +59,10 @@ void ThreadIO::shutdown() {
 
 void * ThreadIO::coreHeader(uint32_t cmdID, size_t dataLen) {
     //ALOGE("coreHeader %i %i", cmdID, dataLen);
+    mRecordingCmd = isRecorded(cmdID);
+    if (mRecordingCmd) {
+        return mRecording->appendCommand(cmdID, dataLen);
+    }
     CoreCmdHeader *hdr = (CoreCmdHeader *)&mSendBuffer[0];
     hdr->bytes = dataLen;
     hdr->cmdID = cmdID;
@@ -60,6 +73,10 @@ void * ThreadIO::coreHeader(uint32_t cmdID, size_t dataLen) {
 }
 
 void ThreadIO::coreCommit() {
+    if (mRecordingCmd) {
+        mRecording->commitCommand();
+        return;
+    }
     mToCore.writeAsync(&mSendBuffer, mSendLen);
 }
 
@@ -78,6 +95,11 @@ void ThreadIO::coreRead(void *data, size_t len) {
 }
 
 void ThreadIO::coreSetReturn(const void *data, size_t dataLen) {
+    if (mReplaying) {
+        // Nobody is waiting on commands replayed from a CommandBuffer.
+        return;
+    }
+
     uint32_t buf;
     if (data == NULL) {
         data = &buf;
@@ -97,6 +119,31 @@ void ThreadIO::coreGetReturn(void *data, size_t dataLen) {
     mToCore.writeWaitReturn(data, dataLen);
 }
 
+bool ThreadIO::beginRecording(CommandBuffer *cb) {
+    if (mRecording) {
+        return false;
+    }
+    mRecording = cb;
+    return true;
+}
+
+void ThreadIO::endRecording() {
+    mRecording = NULL;
+}
+
+bool ThreadIO::isRecorded(uint32_t cmdID) const {
+    // A patch edits a buffer and ObjDestroy drops the client's reference;
+    // both take effect now rather than on every submission.  Commands that
+    // wait for the core thread are rejected before they get here.
+    return mRecording && (cmdID != RS_CMD_ID_CommandBufferPatch) &&
+           (cmdID != RS_CMD_ID_ObjDestroy);
+}
+
+void ThreadIO::setCapture(CommandCapture *cc) {
+    delete mCapture;
+    mCapture = cc;
+}
+
 void ThreadIO::setTimeoutCallback(void (*cb)(void *), void *dat, uint64_t timeout) {
     //mToCore.setTimeoutCallback(cb, dat, timeout);
 }
@@ -183,9 +230,38 @@ bool ThreadIO::playCoreCommands(Context *con, int waitFd) {
     return ret;
 }
 
+bool ThreadIO::fillClientBuffer(size_t bytes) {
+    size_t avail = mClientEndPos - mClientReadPos;
+    if (avail >= bytes) {
+        return true;
+    }
+
+    if (mClientReadPos) {
+        memmove(mClientBuffer, &mClientBuffer[mClientReadPos], avail);
+        mClientReadPos = 0;
+        mClientEndPos = avail;
+    }
+
+    while (mClientEndPos < bytes) {
+        size_t r = mToClient.readAvailable(&mClientBuffer[mClientEndPos],
+                                           sizeof(mClientBuffer) - mClientEndPos);
+        if (!r) {
+            // The fifo has been shut down.
+            return false;
+        }
+        mClientEndPos += r;
+    }
+    return true;
+}
+
 RsMessageToClientType ThreadIO::getClientHeader(size_t *receiveLen, uint32_t *usrID) {
     //ALOGE("getClientHeader");
-    mToClient.read(&mLastClientHeader, sizeof(mLastClientHeader));
+    if (!fillClientBuffer(sizeof(mLastClientHeader))) {
+        memset(&mLastClientHeader, 0, sizeof(mLastClientHeader));
+    } else {
+        memcpy(&mLastClientHeader, &mClientBuffer[mClientReadPos], sizeof(mLastClientHeader));
+        mClientReadPos += sizeof(mLastClientHeader);
+    }
 
     receiveLen[0] = mLastClientHeader.bytes;
     usrID[0] = mLastClientHeader.userID;
@@ -202,7 +278,14 @@ RsMessageToClientType ThreadIO::getClientPayload(void *data, size_t *receiveLen,
         return RS_MESSAGE_TO_CLIENT_RESIZE;
     }
     if (receiveLen[0]) {
-        mToClient.read(data, receiveLen[0]);
+        // Drain whatever part of the payload arrived with the header, then
+        // read the remainder straight into the caller's buffer.
+        size_t buffered = rsMin(mClientEndPos - mClientReadPos, receiveLen[0]);
+        memcpy(data, &mClientBuffer[mClientReadPos], buffered);
+        mClientReadPos += buffered;
+        if (buffered < receiveLen[0]) {
+            mToClient.read(((uint8_t *)data) + buffered, receiveLen[0] - buffered);
+        }
     }
     //ALOGE("getClientPayload x");
     return (RsMessageToClientType)mLastClientHeader.cmdID;
@@ -217,10 +300,7 @@ bool ThreadIO::sendToClient(RsMessageToClientType cmdID, uint32_t usrID, const v
     hdr.cmdID = cmdID;
     hdr.userID = usrID;
 
-    mToClient.writeAsync(&hdr, sizeof(hdr));
-    if (dataLen) {
-        mToClient.writeAsync(data, dataLen);
-    }
+    mToClient.writeAsync(&hdr, sizeof(hdr), data, dataLen);
 
     //ALOGE("sendToClient x");
     return true;
@@ -25,6 +25,8 @@ namespace android {
 namespace renderscript {
 
 class Context;
+class CommandBuffer;
+class CommandCapture;
 
 class ThreadIO {
 public:
@@ -34,7 +36,11 @@ public:
     void init();
     void shutdown();
 
-    size_t getMaxInlineSize() {
+    size_t getMaxInlineSize(uint32_t cmdID) {
+        if (isRecorded(cmdID)) {
+            // Recorded commands must carry all of their data with them.
+            return (size_t)-1;
+        }
         return mMaxInlineSize;
     }
     bool isPureFifo() {
@@ -47,6 +53,27 @@ public:
 
     void setTimeoutCallback(void (*)(void *), void *, uint64_t timeout);
 
+    // While recording, commands issued by the client are appended to the
+    // CommandBuffer instead of being sent to the core thread.
+    bool beginRecording(CommandBuffer *cb);
+    void endRecording();
+    bool isRecording() const {
+        return mRecording != NULL;
+    }
+    // True if the command is appended to the recording CommandBuffer.
+    bool isRecorded(uint32_t cmdID) const;
+    // Suppresses return values while the core thread replays a CommandBuffer.
+    void setReplaying(bool r) {
+        mReplaying = r;
+    }
+
+    // While a capture is attached every API call made on this context is
+    // also written to the capture file.  ThreadIO owns the capture.
+    void setCapture(CommandCapture *cc);
+    CommandCapture * getCapture() const {
+        return mCapture;
+    }
+
     void * coreHeader(uint32_t, size_t dataLen);
     void coreCommit();
 
@@ -79,8 +106,20 @@ protected:
     } ClientCmdHeader;
     ClientCmdHeader mLastClientHeader;
 
+    // Messages to the client are pulled from the socket in bulk so a burst
+    // of small messages costs a single wakeup rather than two reads each.
+    bool fillClientBuffer(size_t bytes);
+    size_t mClientReadPos;
+    size_t mClientEndPos;
+    uint8_t mClientBuffer[16 * 1024] __attribute__((aligned(sizeof(double))));
+
     bool mRunning;
     bool mPureFifo;
+    bool mReplaying;
+    CommandBuffer *mRecording;
+    // Set by coreHeader() when the command being built is recorded.
+    bool mRecordingCmd;
+    CommandCapture *mCapture;
     size_t mMaxInlineSize;
 
     FifoSocket mToClient;
@@ -86,7 +86,7 @@ void Type::compute() {
         mHal.state.lodDimX = new uint32_t[mHal.state.lodCount];
         mHal.state.lodDimY = new uint32_t[mHal.state.lodCount];
         mHal.state.lodDimZ = new uint32_t[mHal.state.lodCount];
-        mHal.state.lodOffset = new uint32_t[mHal.state.lodCount];
+        mHal.state.lodOffset = new size_t[mHal.state.lodCount];
     }
 
     uint32_t tx = mHal.state.dimX;
@@ -98,7 +98,7 @@ void Type::compute() {
         mHal.state.lodDimY[lod] = ty;
         mHal.state.lodDimZ[lod]  = tz;
         mHal.state.lodOffset[lod] = offset;
-        offset += tx * rsMax(ty, 1u) * rsMax(tz, 1u) * mElement->getSizeBytes();
+        offset += (size_t)tx * rsMax(ty, 1u) * rsMax(tz, 1u) * mElement->getSizeBytes();
         if (tx > 1) tx >>= 1;
         if (ty > 1) ty >>= 1;
         if (tz > 1) tz >>= 1;
@@ -110,63 +110,70 @@ void Type::compute() {
     if (mHal.state.faces) {
         offset *= 6;
     }
-#ifndef RS_SERVER
     // YUV only supports basic 2d
     // so we can stash the plane pointers in the mipmap levels.
     if (mHal.state.dimYuv) {
         switch(mHal.state.dimYuv) {
-        case HAL_PIXEL_FORMAT_YV12:
+        // Chroma planes round up to cover an odd final row or column.
+        case RS_YUV_YV12:
+        case RS_YUV_I420: {
             mHal.state.lodOffset[1] = offset;
-            mHal.state.lodDimX[1] = mHal.state.lodDimX[0] / 2;
-            mHal.state.lodDimY[1] = mHal.state.lodDimY[0] / 2;
-            offset += offset / 4;
+            mHal.state.lodDimX[1] = (mHal.state.lodDimX[0] + 1) / 2;
+            mHal.state.lodDimY[1] = (mHal.state.lodDimY[0] + 1) / 2;
+            size_t planeSize = (size_t)mHal.state.lodDimX[1] * mHal.state.lodDimY[1] *
+                               mElement->getSizeBytes();
+            offset += planeSize;
             mHal.state.lodOffset[2] = offset;
-            mHal.state.lodDimX[2] = mHal.state.lodDimX[0] / 2;
-            mHal.state.lodDimY[2] = mHal.state.lodDimY[0] / 2;
-            offset += offset / 4;
+            mHal.state.lodDimX[2] = mHal.state.lodDimX[1];
+            mHal.state.lodDimY[2] = mHal.state.lodDimY[1];
+            offset += planeSize;
             break;
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:  // NV21
+        }
+        case RS_YUV_NV21:
+        case RS_YUV_NV12:
+        case RS_YUV_P010:
             mHal.state.lodOffset[1] = offset;
-            mHal.state.lodDimX[1] = mHal.state.lodDimX[0];
-            mHal.state.lodDimY[1] = mHal.state.lodDimY[0] / 2;
-            offset += offset / 2;
+            mHal.state.lodDimX[1] = (mHal.state.lodDimX[0] + 1) & ~1;
+            mHal.state.lodDimY[1] = (mHal.state.lodDimY[0] + 1) / 2;
+            offset += (size_t)mHal.state.lodDimX[1] * mHal.state.lodDimY[1] *
+                      mElement->getSizeBytes();
             break;
         default:
             rsAssert(0);
         }
     }
-#endif
     mTotalSizeBytes = offset;
     mHal.state.element = mElement.get();
 }
 
-uint32_t Type::getLODOffset(uint32_t lod, uint32_t x) const {
-    uint32_t offset = mHal.state.lodOffset[lod];
+size_t Type::getLODOffset(uint32_t lod, uint32_t x) const {
+    size_t offset = mHal.state.lodOffset[lod];
     offset += x * mElement->getSizeBytes();
     return offset;
 }
 
-uint32_t Type::getLODOffset(uint32_t lod, uint32_t x, uint32_t y) const {
-    uint32_t offset = mHal.state.lodOffset[lod];
-    offset += (x + y * mHal.state.lodDimX[lod]) * mElement->getSizeBytes();
+size_t Type::getLODOffset(uint32_t lod, uint32_t x, uint32_t y) const {
+    size_t offset = mHal.state.lodOffset[lod];
+    offset += (x + (size_t)y * mHal.state.lodDimX[lod]) * mElement->getSizeBytes();
     return offset;
 }
 
-uint32_t Type::getLODOffset(uint32_t lod, uint32_t x, uint32_t y, uint32_t z) const {
-    uint32_t offset = mHal.state.lodOffset[lod];
+size_t Type::getLODOffset(uint32_t lod, uint32_t x, uint32_t y, uint32_t z) const {
+    size_t offset = mHal.state.lodOffset[lod];
     offset += (x +
-               y * mHal.state.lodDimX[lod] +
-               z * mHal.state.lodDimX[lod] * mHal.state.lodDimY[lod]) * mElement->getSizeBytes();
+               (size_t)y * mHal.state.lodDimX[lod] +
+               (size_t)z * mHal.state.lodDimX[lod] * mHal.state.lodDimY[lod]) *
+              mElement->getSizeBytes();
     return offset;
 }
 
-uint32_t Type::getLODFaceOffset(uint32_t lod, RsAllocationCubemapFace face,
-                                uint32_t x, uint32_t y) const {
-    uint32_t offset = mHal.state.lodOffset[lod];
-    offset += (x + y * mHal.state.lodDimX[lod]) * mElement->getSizeBytes();
+size_t Type::getLODFaceOffset(uint32_t lod, RsAllocationCubemapFace face,
+                              uint32_t x, uint32_t y) const {
+    size_t offset = mHal.state.lodOffset[lod];
+    offset += (x + (size_t)y * mHal.state.lodDimX[lod]) * mElement->getSizeBytes();
 
     if (face != 0) {
-        uint32_t faceOffset = getSizeBytes() / 6;
+        size_t faceOffset = getSizeBytes() / 6;
         offset += faceOffset * face;
     }
     return offset;
@@ -303,7 +310,7 @@ ObjectBaseRef<Type> Type::cloneAndResize2D(Context *rsc,
 void Type::incRefs(const void *ptr, size_t ct, size_t startOff) const {
     const uint8_t *p = static_cast<const uint8_t *>(ptr);
     const Element *e = mHal.state.element;
-    uint32_t stride = e->getSizeBytes();
+    size_t stride = e->getSizeBytes();
 
     p += stride * startOff;
     while (ct > 0) {
@@ -320,7 +327,7 @@ void Type::decRefs(const void *ptr, size_t ct, size_t startOff) const {
     }
     const uint8_t *p = static_cast<const uint8_t *>(ptr);
     const Element *e = mHal.state.element;
-    uint32_t stride = e->getSizeBytes();
+    size_t stride = e->getSizeBytes();
 
     p += stride * startOff;
     while (ct > 0) {
@@ -340,6 +347,18 @@ RsType rsi_TypeCreate(Context *rsc, RsElement _e, uint32_t dimX,
                      uint32_t dimY, uint32_t dimZ, bool mips, bool faces, uint32_t yuv) {
     Element *e = static_cast<Element *>(_e);
 
+    if (yuv) {
+        size_t sampleSize = (yuv == RS_YUV_P010) ? 2 : 1;
+        if ((yuv != RS_YUV_NV21) && (yuv != RS_YUV_YV12) && (yuv != RS_YUV_NV12) &&
+            (yuv != RS_YUV_I420) && (yuv != RS_YUV_P010)) {
+            rsc->setError(RS_ERROR_BAD_VALUE, "Unknown YUV format");
+            return NULL;
+        }
+        if (e->getSizeBytes() != sampleSize) {
+            rsc->setError(RS_ERROR_BAD_VALUE, "YUV element does not match the sample size");
+            return NULL;
+        }
+    }
     return Type::getType(rsc, e, dimX, dimY, dimZ, mips, faces, yuv);
 }
 
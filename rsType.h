@@ -47,7 +47,7 @@ public:
             uint32_t *lodDimX;
             uint32_t *lodDimY;
             uint32_t *lodDimZ;
-            uint32_t *lodOffset;
+            size_t *lodOffset;
             uint32_t lodCount;
             uint32_t dimYuv;
             bool faces;
@@ -83,15 +83,15 @@ public:
         rsAssert(lod < mHal.state.lodCount);
         return mHal.state.lodDimZ[lod];
     }
-    uint32_t getLODOffset(uint32_t lod) const {
+    size_t getLODOffset(uint32_t lod) const {
         rsAssert(lod < mHal.state.lodCount);
         return mHal.state.lodOffset[lod];
     }
-    uint32_t getLODOffset(uint32_t lod, uint32_t x) const;
-    uint32_t getLODOffset(uint32_t lod, uint32_t x, uint32_t y) const;
-    uint32_t getLODOffset(uint32_t lod, uint32_t x, uint32_t y, uint32_t z) const;
+    size_t getLODOffset(uint32_t lod, uint32_t x) const;
+    size_t getLODOffset(uint32_t lod, uint32_t x, uint32_t y) const;
+    size_t getLODOffset(uint32_t lod, uint32_t x, uint32_t y, uint32_t z) const;
 
-    uint32_t getLODFaceOffset(uint32_t lod, RsAllocationCubemapFace face,
+    size_t getLODFaceOffset(uint32_t lod, RsAllocationCubemapFace face,
                               uint32_t x, uint32_t y) const;
 
     uint32_t getLODCount() const {return mHal.state.lodCount;}
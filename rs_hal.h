@@ -213,6 +213,8 @@ typedef struct {
                               const void *data, uint32_t elementOff, size_t sizeBytes);
 
         void (*generateMipmaps)(const Context *rsc, const Allocation *alloc);
+        void (*generateMipmapsFiltered)(const Context *rsc, const Allocation *alloc,
+                                        RsMipmapFilter filter);
     } allocation;
 
     struct {
@@ -155,6 +155,42 @@ void printPlaybackFuncs(FILE *f, const char *prefix) {
     }
 }
 
+static const char *gHandleTypes[] = {
+    "RsAsyncVoidPtr", "RsAdapter1D", "RsAdapter2D", "RsAllocation", "RsAnimation",
+    "RsCommandBuffer", "RsElement", "RsFile", "RsFont", "RsSampler", "RsScript",
+    "RsScriptKernelID", "RsScriptFieldID", "RsScriptMethodID", "RsScriptGroup",
+    "RsMesh", "RsPath", "RsType", "RsObjectBase", "RsProgram", "RsProgramVertex",
+    "RsProgramFragment", "RsProgramStore", "RsProgramRaster", NULL
+};
+
+// Object handles are remapped when a capture is replayed.
+static int isHandle(const VarType *vt) {
+    int ct;
+    if (vt->type != 4) {
+        return 0;
+    }
+    for (ct=0; gHandleTypes[ct]; ct++) {
+        if (!strcmp(vt->typeName, gHandleTypes[ct])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Arrays of pointer sized values are widened to 64 bits in a capture.
+static int isArray64(const VarType *vt) {
+    return isHandle(vt) || !strcmp(vt->typeName, "size_t");
+}
+
+// Values only meaningful in the capturing process.
+static int isClientLocal(const VarType *vt) {
+    return !strcmp(vt->typeName, "uintptr_t") || !strcmp(vt->typeName, "RsNativeWindow");
+}
+
+static int isCaptured(const ApiEntry *api) {
+    return !api->nocapture && !api->nocontext;
+}
+
 static int hasInlineDataPointers(const ApiEntry * api) {
     int ret = 0;
     int ct;
@@ -181,6 +217,136 @@ static int hasInlineDataPointers(const ApiEntry * api) {
     return ret;
 }
 
+// Commands whose sender waits for the core thread, for a return value or
+// for client memory, cannot be recorded in a CommandBuffer.
+static int waitsForCore(const ApiEntry *api) {
+    int ct;
+    if (api->direct || hasInlineDataPointers(api)) {
+        return 0;
+    }
+    if (api->sync || api->ret.typeName[0]) {
+        return 1;
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        if (api->params[ct].ptrLevel) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int countHandles(const ApiEntry *api) {
+    int ct;
+    int count = 0;
+    for (ct=0; ct < api->paramCount; ct++) {
+        if (!api->params[ct].ptrLevel && isHandle(&api->params[ct])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int maxHandles() {
+    int ct;
+    int count = 1;
+    for (ct=0; ct < apiCount; ct++) {
+        if (countHandles(&apis[ct]) > count) {
+            count = countHandles(&apis[ct]);
+        }
+    }
+    return count;
+}
+
+void printCaptureCall(FILE *f, const ApiEntry *api) {
+    int ct;
+    fprintf(f, "s_CurrentTable->%s(", api->name);
+    if (!api->nocontext) {
+        fprintf(f, "(Context *)rsc");
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        if (ct > 0 || !api->nocontext) {
+            fprintf(f, ", ");
+        }
+        fprintf(f, "%s", api->params[ct].name);
+    }
+    fprintf(f, ");\n");
+}
+
+void printCaptureFunc(FILE *f, const ApiEntry *api) {
+    int ct;
+
+    fprintf(f, "static ");
+    printFuncDecl(f, api, "CAP_", 0, 0);
+    fprintf(f, "\n{\n");
+    fprintf(f, "    CommandCapture *capture = ((Context *)rsc)->mIO.getCapture();\n");
+    fprintf(f, "    capture->lock();\n");
+
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (!vt->ptrLevel && !strcmp(vt->typeName, "RsAllocation")) {
+            fprintf(f, "    capture->snapshotAllocation(rsc, %s, s_CurrentTable->AllocationRead);\n",
+                    vt->name);
+        }
+    }
+
+    fprintf(f, "    ");
+    if (api->ret.typeName[0]) {
+        printVarType(f, &api->ret);
+        fprintf(f, " ret = ");
+    }
+    printCaptureCall(f, api);
+
+    fprintf(f, "    capture->beginCommand(RS_CMD_ID_%s);\n", api->name);
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (!vt->ptrLevel) {
+            fprintf(f, "    capture->writeValue(&%s, sizeof(%s));\n", vt->name, vt->name);
+        }
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (vt->ptrLevel != 1 || (!vt->isConst && !isHandle(vt))) {
+            // Non-const pointers are outputs unless they hold handles.
+            continue;
+        }
+        if (isArray64(vt)) {
+            fprintf(f, "    capture->writeArray64(%s, %s_length, sizeof(%s));\n",
+                    vt->name, vt->name, vt->typeName);
+        } else {
+            fprintf(f, "    capture->writeData(%s, %s_length);\n", vt->name, vt->name);
+        }
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (vt->ptrLevel == 2 && vt->isConst) {
+            fprintf(f, "    for (size_t ct = 0; ct < (%s_length_length / sizeof(size_t)); ct++) {\n", vt->name);
+            fprintf(f, "        capture->writeData(%s[ct], %s_length[ct]);\n", vt->name, vt->name);
+            fprintf(f, "    }\n");
+        }
+    }
+    if (api->ret.typeName[0]) {
+        fprintf(f, "    capture->writeValue(&ret, sizeof(ret));\n");
+        if (!strcmp(api->ret.typeName, "RsAllocation")) {
+            fprintf(f, "    capture->forgetAllocation(ret);\n");
+        }
+    }
+    fprintf(f, "    capture->endCommand();\n");
+
+    // Kernels, copies and uploads change the allocations they are given.
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (!vt->ptrLevel && !strcmp(vt->typeName, "RsAllocation")) {
+            fprintf(f, "    capture->updateSnapshot(rsc, %s, s_CurrentTable->AllocationRead);\n",
+                    vt->name);
+        }
+    }
+    fprintf(f, "    capture->unlock();\n");
+    if (api->ret.typeName[0]) {
+        fprintf(f, "    return ret;\n");
+    }
+    fprintf(f, "}\n\n");
+}
+
 void printApiCpp(FILE *f) {
     int ct;
     int ct2;
@@ -191,6 +357,7 @@ void printApiCpp(FILE *f) {
     fprintf(f, "#include \"rsgApiStructs.h\"\n");
     fprintf(f, "#include \"rsgApiFuncDecl.h\"\n");
     fprintf(f, "#include \"rsFifo.h\"\n");
+    fprintf(f, "#include \"rsCapture.h\"\n");
     fprintf(f, "\n");
     fprintf(f, "using namespace android;\n");
     fprintf(f, "using namespace android::renderscript;\n");
@@ -248,6 +415,19 @@ void printApiCpp(FILE *f) {
             fprintf(f, "    }\n\n");
 
             fprintf(f, "    ThreadIO *io = &((Context *)rsc)->mIO;\n");
+            if (waitsForCore(api)) {
+                fprintf(f, "    if (io->isRecording()) {\n");
+                fprintf(f, "        ((Context *)rsc)->setError(RS_ERROR_BAD_VALUE, "
+                        "\"%s cannot be recorded in a CommandBuffer\");\n", api->name);
+                if (api->ret.typeName[0]) {
+                    fprintf(f, "        return (");
+                    printVarType(f, &api->ret);
+                    fprintf(f, ")0;\n");
+                } else {
+                    fprintf(f, "        return;\n");
+                }
+                fprintf(f, "    }\n");
+            }
             fprintf(f, "    const size_t size = sizeof(RS_CMD_%s);\n", api->name);
             if (hasInlineDataPointers(api)) {
                 fprintf(f, "    size_t dataSize = 0;\n");
@@ -262,7 +442,7 @@ void printApiCpp(FILE *f) {
             //fprintf(f, "    ALOGE(\"add command %s\\n\");\n", api->name);
             if (hasInlineDataPointers(api)) {
                 fprintf(f, "    RS_CMD_%s *cmd = NULL;\n", api->name);
-                fprintf(f, "    if (dataSize < io->getMaxInlineSize()) {;\n");
+                fprintf(f, "    if (dataSize < io->getMaxInlineSize(RS_CMD_ID_%s)) {;\n", api->name);
                 fprintf(f, "        cmd = static_cast<RS_CMD_%s *>(io->coreHeader(RS_CMD_ID_%s, dataSize + size));\n", api->name, api->name);
                 fprintf(f, "    } else {\n");
                 fprintf(f, "        cmd = static_cast<RS_CMD_%s *>(io->coreHeader(RS_CMD_ID_%s, size));\n", api->name, api->name);
@@ -276,7 +456,7 @@ void printApiCpp(FILE *f) {
                 const VarType *vt = &api->params[ct2];
                 needFlush += vt->ptrLevel;
                 if (vt->ptrLevel && hasInlineDataPointers(api)) {
-                    fprintf(f, "    if (dataSize < io->getMaxInlineSize()) {\n");
+                    fprintf(f, "    if (dataSize < io->getMaxInlineSize(RS_CMD_ID_%s)) {\n", api->name);
                     fprintf(f, "        memcpy(payload, %s, %s_length);\n", vt->name, vt->name);
                     fprintf(f, "        cmd->%s = (", vt->name);
                     printVarType(f, vt);
@@ -296,7 +476,7 @@ void printApiCpp(FILE *f) {
 
             fprintf(f, "    io->coreCommit();\n");
             if (hasInlineDataPointers(api)) {
-                fprintf(f, "    if (dataSize >= io->getMaxInlineSize()) {\n");
+                fprintf(f, "    if (dataSize >= io->getMaxInlineSize(RS_CMD_ID_%s)) {\n", api->name);
                 fprintf(f, "        io->coreGetReturn(NULL, 0);\n");
                 fprintf(f, "    }\n");
             } else if (api->ret.typeName[0]) {
@@ -396,12 +576,34 @@ void printApiCpp(FILE *f) {
     fprintf(f, "};\n");
 
     fprintf(f, "static RsApiEntrypoints_t *s_CurrentTable = &s_LocalTable;\n\n");
+    for (ct=0; ct < apiCount; ct++) {
+        if (isCaptured(&apis[ct])) {
+            printCaptureFunc(f, &apis[ct]);
+        }
+    }
+
     for (ct=0; ct < apiCount; ct++) {
         int needFlush = 0;
         const ApiEntry * api = &apis[ct];
 
         printFuncDecl(f, api, "rs", 0, 0);
         fprintf(f, "\n{\n");
+        if (isCaptured(api)) {
+            fprintf(f, "    if (((Context *)rsc)->mIO.getCapture()) {\n");
+            fprintf(f, "        ");
+            if (api->ret.typeName[0]) {
+                fprintf(f, "return ");
+            }
+            fprintf(f, "CAP_%s(rsc", api->name);
+            for (ct2=0; ct2 < api->paramCount; ct2++) {
+                fprintf(f, ", %s", api->params[ct2].name);
+            }
+            fprintf(f, ");\n");
+            if (!api->ret.typeName[0]) {
+                fprintf(f, "        return;\n");
+            }
+            fprintf(f, "    }\n");
+        }
         fprintf(f, "    ");
         if (api->ret.typeName[0]) {
             fprintf(f, "return ");
@@ -425,6 +627,83 @@ void printApiCpp(FILE *f) {
 
 }
 
+void printCaptureReplayFunc(FILE *f, const ApiEntry *api) {
+    int ct;
+
+    fprintf(f, "void rspc_%s(CaptureReader *r, RsContext rsc) {\n", api->name);
+    for (ct=0; ct < api->paramCount; ct++) {
+        fprintf(f, "    ");
+        printVarTypeAndName(f, &api->params[ct]);
+        fprintf(f, ";\n");
+    }
+
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (vt->ptrLevel) {
+            continue;
+        }
+        if (isHandle(vt)) {
+            fprintf(f, "    %s = (%s)r->readHandle();\n", vt->name, vt->typeName);
+        } else {
+            fprintf(f, "    r->readValue(&%s, sizeof(%s));\n", vt->name, vt->name);
+            if (isClientLocal(vt)) {
+                fprintf(f, "    %s = 0;\n", vt->name);
+            }
+        }
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (vt->ptrLevel != 1) {
+            continue;
+        }
+        fprintf(f, "    %s = (", vt->name);
+        printVarType(f, vt);
+        if (!vt->isConst && !isHandle(vt)) {
+            fprintf(f, ")r->allocScratch(%s_length);\n", vt->name);
+        } else if (isArray64(vt)) {
+            fprintf(f, ")r->readArray64(sizeof(%s), %i, &%s_length);\n",
+                    vt->typeName, isHandle(vt), vt->name);
+        } else {
+            fprintf(f, ")r->readData(&%s_length);\n", vt->name);
+        }
+    }
+    for (ct=0; ct < api->paramCount; ct++) {
+        const VarType *vt = &api->params[ct];
+        if (vt->ptrLevel != 2) {
+            continue;
+        }
+        fprintf(f, "    %s = (", vt->name);
+        printVarType(f, vt);
+        fprintf(f, ")r->allocScratch(%s_length_length);\n", vt->name);
+        if (vt->isConst) {
+            fprintf(f, "    for (size_t ct = 0; ct < (%s_length_length / sizeof(size_t)); ct++) {\n", vt->name);
+            fprintf(f, "        size_t len;\n");
+            fprintf(f, "        %s[ct] = (const %s *)r->readData(&len);\n", vt->name, vt->typeName);
+            fprintf(f, "    }\n");
+        }
+    }
+
+    fprintf(f, "    ");
+    if (api->ret.typeName[0]) {
+        printVarType(f, &api->ret);
+        fprintf(f, " ret = ");
+    }
+    fprintf(f, "rs%s(rsc", api->name);
+    for (ct=0; ct < api->paramCount; ct++) {
+        fprintf(f, ", %s", api->params[ct].name);
+    }
+    fprintf(f, ");\n");
+
+    if (api->ret.typeName[0]) {
+        fprintf(f, "    uint64_t capturedRet;\n");
+        fprintf(f, "    r->readValue(&capturedRet, sizeof(capturedRet));\n");
+        if (isHandle(&api->ret)) {
+            fprintf(f, "    r->mapHandle(capturedRet, ret);\n");
+        }
+    }
+    fprintf(f, "};\n\n");
+}
+
 void printPlaybackCpp(FILE *f) {
     int ct;
     int ct2;
@@ -434,6 +713,9 @@ void printPlaybackCpp(FILE *f) {
     fprintf(f, "#include \"rsThreadIO.h\"\n");
     fprintf(f, "#include \"rsgApiStructs.h\"\n");
     fprintf(f, "#include \"rsgApiFuncDecl.h\"\n");
+    fprintf(f, "#include \"rsCapture.h\"\n");
+    fprintf(f, "\n");
+    fprintf(f, "#include <stddef.h>\n");
     fprintf(f, "\n");
     fprintf(f, "namespace android {\n");
     fprintf(f, "namespace renderscript {\n");
@@ -616,6 +898,52 @@ void printPlaybackCpp(FILE *f) {
     }
     fprintf(f, "};\n");
 
+    for (ct=0; ct < apiCount; ct++) {
+        if (isCaptured(&apis[ct])) {
+            printCaptureReplayFunc(f, &apis[ct]);
+        }
+    }
+
+    fprintf(f, "RsCaptureReplayFunc gCaptureReplayFuncs[%i] = {\n", apiCount + 1);
+    fprintf(f, "    NULL,\n");
+    for (ct=0; ct < apiCount; ct++) {
+        if (isCaptured(&apis[ct])) {
+            fprintf(f, "    %s%s,\n", "rspc_", apis[ct].name);
+        } else {
+            fprintf(f, "    NULL,\n");
+        }
+    }
+    fprintf(f, "};\n");
+
+    fprintf(f, "const RsCmdHandles gCmdHandles[%i] = {\n", apiCount + 1);
+    fprintf(f, "    {0, {0}},\n");
+    for (ct=0; ct < apiCount; ct++) {
+        const ApiEntry * api = &apis[ct];
+        int first = 1;
+        if (api->direct || !countHandles(api)) {
+            fprintf(f, "    {0, {0}},\n");
+            continue;
+        }
+        fprintf(f, "    {%i, {", countHandles(api));
+        for (ct2=0; ct2 < api->paramCount; ct2++) {
+            const VarType *vt = &api->params[ct2];
+            if (vt->ptrLevel || !isHandle(vt)) {
+                continue;
+            }
+            fprintf(f, "%soffsetof(RS_CMD_%s, %s)", first ? "" : ", ", api->name, vt->name);
+            first = 0;
+        }
+        fprintf(f, "}},\n");
+    }
+    fprintf(f, "};\n");
+
+    fprintf(f, "const char * gApiNames[%i] = {\n", apiCount + 1);
+    fprintf(f, "    NULL,\n");
+    for (ct=0; ct < apiCount; ct++) {
+        fprintf(f, "    \"%s\",\n", apis[ct].name);
+    }
+    fprintf(f, "};\n");
+
     fprintf(f, "};\n");
     fprintf(f, "};\n");
 }
@@ -651,6 +979,7 @@ int main(int argc, char **argv) {
             fprintf(f, "\n");
             fprintf(f, "#include \"rsContext.h\"\n");
             fprintf(f, "#include \"rsFifo.h\"\n");
+            fprintf(f, "#include \"rsCapture.h\"\n");
             fprintf(f, "\n");
             fprintf(f, "namespace android {\n");
             fprintf(f, "namespace renderscript {\n");
@@ -665,6 +994,15 @@ int main(int argc, char **argv) {
             fprintf(f, "typedef void (*RsPlaybackRemoteFunc)(Context *, ThreadIO *);\n");
             fprintf(f, "extern RsPlaybackLocalFunc gPlaybackFuncs[%i];\n", apiCount + 1);
             fprintf(f, "extern RsPlaybackRemoteFunc gPlaybackRemoteFuncs[%i];\n", apiCount + 1);
+            fprintf(f, "\n// Offsets of the object handles carried by each command.\n");
+            fprintf(f, "#define RS_CMD_MAX_HANDLES %i\n", maxHandles());
+            fprintf(f, "typedef struct RsCmdHandlesRec {\n");
+            fprintf(f, "    uint32_t count;\n");
+            fprintf(f, "    size_t offsets[RS_CMD_MAX_HANDLES];\n");
+            fprintf(f, "} RsCmdHandles;\n");
+            fprintf(f, "extern const RsCmdHandles gCmdHandles[%i];\n", apiCount + 1);
+            fprintf(f, "extern RsCaptureReplayFunc gCaptureReplayFuncs[%i];\n", apiCount + 1);
+            fprintf(f, "extern const char * gApiNames[%i];\n", apiCount + 1);
 
             fprintf(f, "}\n");
             fprintf(f, "}\n");
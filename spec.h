@@ -27,6 +27,7 @@ typedef struct {
   int handcodeApi;
   int direct;
   int nocontext;
+  int nocapture;
   int paramCount;
   VarType ret;
   VarType params[16];
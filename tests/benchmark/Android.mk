@@ -0,0 +1,29 @@
+# Like the replay tool, the benchmark is built for the target: it measures
+# the CPU driver, which only builds for the device.  It needs nothing from
+# the graphics stack, only the runtime, the C++ API and libcutils for the
+# thread count properties.
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libRS \
+	libRScpp \
+	libcutils \
+	libutils
+
+LOCAL_MODULE:= rstest-benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+intermediates := $(call intermediates-dir-for,STATIC_LIBRARIES,libRS,TARGET,)
+
+LOCAL_C_INCLUDES += frameworks/rs/cpp
+LOCAL_C_INCLUDES += frameworks/rs
+LOCAL_C_INCLUDES += $(intermediates)
+
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,746 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Native benchmarks for the CPU reference driver.  Results are written to
+// stdout as CSV, one line per measurement, for regression tracking.
+//
+// usage: rstest-benchmark [-i iterations] [-s WxH] [-f filter]
+//   -i  launches per timed batch (default 20)
+//   -s  only run at the given image size
+//   -f  only run benchmarks whose "group/name" contains filter; groups are
+//       intrinsic, dispatch, scriptgroup and copy
+
+#include "RenderScript.h"
+
+#include <cutils/properties.h>
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace android;
+using namespace RSC;
+
+static const int kBatches = 5;
+static int gIterations = 20;
+static const char *gFilter = NULL;
+
+struct ImageSize {
+    uint32_t w;
+    uint32_t h;
+};
+
+static ImageSize gSizes[] = {
+    {640, 480},
+    {1920, 1080},
+    {3840, 2160},
+};
+static uint32_t gSizeCount = sizeof(gSizes) / sizeof(gSizes[0]);
+
+static uint64_t getTimeNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static bool isSelected(const char *group, const char *name) {
+    if (!gFilter) {
+        return true;
+    }
+    char full[128];
+    snprintf(full, sizeof(full), "%s/%s", group, name);
+    return strstr(full, gFilter) != NULL;
+}
+
+static void printResult(const char *group, const char *name, const char *element,
+                        uint32_t w, uint32_t h, uint32_t threads,
+                        double avgUs, double bestUs, double throughput, const char *unit) {
+    printf("%s,%s,%s,%u,%u,%u,%i,%.3f,%.3f,%.3f,%s\n", group, name, element, w, h,
+           threads, gIterations, avgUs, bestUs, throughput, unit);
+    fflush(stdout);
+}
+
+typedef void (*BenchFunc)(void *);
+
+// Times gIterations calls of fn followed by a finish, kBatches times.
+// Returns the average time per call and the time per call of the best batch.
+static void timeBench(sp<RS> rs, BenchFunc fn, void *arg, double *avgUs, double *bestUs) {
+    fn(arg);
+    rs->finish();
+
+    double total = 0;
+    double best = 0;
+    for (int b = 0; b < kBatches; b++) {
+        uint64_t t0 = getTimeNs();
+        for (int ct = 0; ct < gIterations; ct++) {
+            fn(arg);
+        }
+        rs->finish();
+        double us = (getTimeNs() - t0) / 1000.0 / gIterations;
+        total += us;
+        if (!b || us < best) {
+            best = us;
+        }
+    }
+    *avgUs = total / kBatches;
+    *bestUs = best;
+}
+
+static uint32_t getThreadCount() {
+    char buf[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.max-threads", buf, "0");
+    int threads = atoi(buf);
+    if (!threads) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return threads;
+}
+
+// Thin owner for a script intrinsic; the C++ API only wraps some of them.
+class Intrinsic {
+public:
+    Intrinsic(sp<RS> rs, RsScriptIntrinsicID id, sp<const Element> e) : mRS(rs) {
+        mID = rsScriptIntrinsicCreate(mRS->getContext(), id, e->getID());
+    }
+    ~Intrinsic() {
+        rsObjDestroy(mRS->getContext(), mID);
+    }
+
+    RsScript getID() const {return mID;}
+
+    void setVar(uint32_t slot, const void *data, size_t len) {
+        rsScriptSetVarV(mRS->getContext(), mID, slot, data, len);
+    }
+    void setVar(uint32_t slot, RsObjectBase obj) {
+        rsScriptSetVarObj(mRS->getContext(), mID, slot, obj);
+    }
+    void forEach(uint32_t slot, RsAllocation in, RsAllocation out) {
+        rsScriptForEach(mRS->getContext(), mID, slot, in, out, NULL, 0, NULL, 0);
+    }
+
+private:
+    sp<RS> mRS;
+    RsScript mID;
+};
+
+// How the image input reaches the kernel.
+enum InputMode {
+    INPUT_FOREACH,      // passed as the forEach input
+    INPUT_VAR,          // bound to global slot 1, forEach has no input
+    INPUT_VAR0,         // bound to global slot 0, forEach has no input
+    INPUT_YUV,          // YUV allocation bound to global slot 0
+    OUTPUT_YUV,         // bound to global slot 0, the output is YUV
+    INPUT_KEYS,         // 1D allocation of w * h cells bound to global slot 0
+};
+
+struct IntrinsicRun {
+    sp<RS> rs;
+    Intrinsic *script;
+    uint32_t slot;
+    RsAllocation in;
+    RsAllocation out;
+};
+
+static void runIntrinsic(void *arg) {
+    IntrinsicRun *r = (IntrinsicRun *)arg;
+    r->script->forEach(r->slot, r->in, r->out);
+}
+
+static void setupNone(sp<RS> rs, Intrinsic *s, const void *param) {
+}
+
+static void setupBlur(sp<RS> rs, Intrinsic *s, const void *param) {
+    s->setVar(0, param, sizeof(float));
+}
+
+static void setupConvolve3x3(sp<RS> rs, Intrinsic *s, const void *param) {
+    const float k[9] = {
+        -1.f, -1.f, -1.f,
+        -1.f,  9.f, -1.f,
+        -1.f, -1.f, -1.f
+    };
+    s->setVar(0, k, sizeof(k));
+}
+
+static void setupConvolve5x5(sp<RS> rs, Intrinsic *s, const void *param) {
+    float k[25];
+    for (int ct = 0; ct < 25; ct++) {
+        k[ct] = 1.f / 25.f;
+    }
+    s->setVar(0, k, sizeof(k));
+}
+
+static void setupColorMatrix(sp<RS> rs, Intrinsic *s, const void *param) {
+    // Sepia; every coefficient non-zero so no shortcut path is taken.
+    const float m[16] = {
+        0.393f, 0.349f, 0.272f, 0.1f,
+        0.769f, 0.686f, 0.534f, 0.1f,
+        0.189f, 0.168f, 0.131f, 0.1f,
+        0.1f,   0.1f,   0.1f,   0.7f
+    };
+    s->setVar(0, m, sizeof(m));
+}
+
+static void setupLUT(sp<RS> rs, Intrinsic *s, const void *param) {
+    uint8_t table[256 * 4];
+    for (int ct = 0; ct < 256 * 4; ct++) {
+        table[ct] = 255 - (ct & 0xff);
+    }
+    sp<Allocation> lut = Allocation::createSized(rs, Element::U8(rs), sizeof(table));
+    lut->copy1DFrom(table);
+    // The script keeps its own reference to the table.
+    s->setVar(0, lut->getID());
+}
+
+static void setup3DLUT(sp<RS> rs, Intrinsic *s, const void *param) {
+    const uint32_t dim = 32;
+    RsContext rsc = rs->getContext();
+    RsType t = rsTypeCreate(rsc, Element::U8_4(rs)->getID(), dim, dim, dim, false, false, 0);
+    RsAllocation lut = rsAllocationCreateTyped(rsc, t, RS_ALLOCATION_MIPMAP_NONE,
+                                               RS_ALLOCATION_USAGE_SCRIPT, 0);
+    uint8_t *cube = new uint8_t[dim * dim * dim * 4];
+    for (uint32_t ct = 0; ct < dim * dim * dim; ct++) {
+        cube[ct * 4 + 0] = (ct % dim) * 255 / (dim - 1);
+        cube[ct * 4 + 1] = ((ct / dim) % dim) * 255 / (dim - 1);
+        cube[ct * 4 + 2] = (ct / (dim * dim)) * 255 / (dim - 1);
+        cube[ct * 4 + 3] = 255;
+    }
+    rsAllocation3DData(rsc, lut, 0, 0, 0, 0, dim, dim, dim, cube, dim * dim * dim * 4, 0);
+    delete [] cube;
+    s->setVar(0, lut);
+    rsObjDestroy(rsc, lut);
+    rsObjDestroy(rsc, t);
+}
+
+static void setupColorPipeline(sp<RS> rs, Intrinsic *s, const void *param) {
+    // The sepia matrix again, so the general 4x4 path is measured.
+    setupColorMatrix(rs, s, param);
+    const float bias[4] = {0.02f, 0.02f, 0.02f, 0.f};
+    s->setVar(1, bias, sizeof(bias));
+}
+
+static void setupColorPipelineCurves(sp<RS> rs, Intrinsic *s, const void *param) {
+    setupColorPipeline(rs, s, param);
+    uint8_t curves[256 * 4];
+    for (int ct = 0; ct < 256 * 4; ct++) {
+        int v = ct >> 2;
+        curves[ct] = (uint8_t)((v * v) / 255);
+    }
+    sp<Allocation> a = Allocation::createSized(rs, Element::U8_4(rs), 256);
+    a->copy1DFrom(curves);
+    // Copied by the script when set.
+    s->setVar(2, a->getID());
+}
+
+static void setupMorphology(sp<RS> rs, Intrinsic *s, const void *param) {
+    int32_t r = (int32_t)*(const float *)param;
+    const int32_t radius[2] = {r, r};
+    s->setVar(1, radius, sizeof(radius));
+}
+
+struct IntrinsicConfig {
+    const char *name;
+    RsScriptIntrinsicID id;
+    uint32_t slot;
+    RsDataType dataType;
+    uint32_t vecSize;
+    const char *element;
+    InputMode input;
+    void (*setup)(sp<RS> rs, Intrinsic *s, const void *param);
+    float param;
+    // Format of the YUV side for INPUT_YUV and OUTPUT_YUV.
+    uint32_t yuv;
+};
+
+// Each CPU intrinsic over the element types and modes that take separate
+// paths through it.
+static const IntrinsicConfig gIntrinsics[] = {
+    {"blur_r3", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 1, "U8", INPUT_VAR, setupBlur, 3.f},
+    {"blur_r3", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR, setupBlur, 3.f},
+    {"blur_r10", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 1, "U8", INPUT_VAR, setupBlur, 10.f},
+    {"blur_r10", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR, setupBlur, 10.f},
+    {"blur_r25", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 1, "U8", INPUT_VAR, setupBlur, 25.f},
+    {"blur_r25", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR, setupBlur, 25.f},
+    {"blur_r10", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_VAR, setupBlur, 10.f},
+    {"blur_r10", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_FLOAT_32, 1, "F32", INPUT_VAR, setupBlur, 10.f},
+    {"blur_r10", RS_SCRIPT_INTRINSIC_ID_BLUR, 0, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_VAR, setupBlur, 10.f},
+    {"convolve3x3", RS_SCRIPT_INTRINSIC_ID_CONVOLVE_3x3, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR, setupConvolve3x3, 0.f},
+    {"convolve5x5", RS_SCRIPT_INTRINSIC_ID_CONVOLVE_5x5, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR, setupConvolve5x5, 0.f},
+    {"colormatrix", RS_SCRIPT_INTRINSIC_ID_COLOR_MATRIX, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupColorMatrix, 0.f},
+    {"lut", RS_SCRIPT_INTRINSIC_ID_LUT, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupLUT, 0.f},
+    {"3dlut", RS_SCRIPT_INTRINSIC_ID_3DLUT, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setup3DLUT, 0.f},
+    {"3dlut", RS_SCRIPT_INTRINSIC_ID_3DLUT, 0, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_FOREACH, setup3DLUT, 0.f},
+    {"3dlut", RS_SCRIPT_INTRINSIC_ID_3DLUT, 0, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_FOREACH, setup3DLUT, 0.f},
+    {"yuvtorgb_nv21", RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_YUV, setupNone, 0.f, RS_YUV_NV21},
+    {"yuvtorgb_p010", RS_SCRIPT_INTRINSIC_ID_YUV_TO_RGB, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_YUV, setupNone, 0.f, RS_YUV_P010},
+    {"blend_src", RS_SCRIPT_INTRINSIC_ID_BLEND, 1, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_srcover", RS_SCRIPT_INTRINSIC_ID_BLEND, 3, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_dstover", RS_SCRIPT_INTRINSIC_ID_BLEND, 4, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_srcin", RS_SCRIPT_INTRINSIC_ID_BLEND, 5, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_srcatop", RS_SCRIPT_INTRINSIC_ID_BLEND, 9, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_xor", RS_SCRIPT_INTRINSIC_ID_BLEND, 11, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_multiply", RS_SCRIPT_INTRINSIC_ID_BLEND, 14, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_add", RS_SCRIPT_INTRINSIC_ID_BLEND, 34, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_subtract", RS_SCRIPT_INTRINSIC_ID_BLEND, 35, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_srcover", RS_SCRIPT_INTRINSIC_ID_BLEND, 3, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_srcover", RS_SCRIPT_INTRINSIC_ID_BLEND, 3, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_xor", RS_SCRIPT_INTRINSIC_ID_BLEND, 11, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_FOREACH, setupNone, 0.f},
+    {"blend_multiply", RS_SCRIPT_INTRINSIC_ID_BLEND, 14, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_FOREACH, setupNone, 0.f},
+    {"rgbtoyuv_nv21", RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", OUTPUT_YUV, setupNone, 0.f, RS_YUV_NV21},
+    {"rgbtoyuv_nv21", RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV, 0, RS_TYPE_FLOAT_32, 4, "F32_4", OUTPUT_YUV, setupNone, 0.f, RS_YUV_NV21},
+    {"rgbtoyuv_p010", RS_SCRIPT_INTRINSIC_ID_RGB_TO_YUV, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", OUTPUT_YUV, setupNone, 0.f, RS_YUV_P010},
+    {"colorpipeline", RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupColorPipeline, 0.f},
+    {"colorpipeline", RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, 0, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_FOREACH, setupColorPipeline, 0.f},
+    {"colorpipeline", RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, 0, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_FOREACH, setupColorPipeline, 0.f},
+    {"colorpipeline_curves", RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_FOREACH, setupColorPipelineCurves, 0.f},
+    {"colorpipeline_curves", RS_SCRIPT_INTRINSIC_ID_COLOR_PIPELINE, 0, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_FOREACH, setupColorPipelineCurves, 0.f},
+    {"erode_r2", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 0, RS_TYPE_UNSIGNED_8, 1, "U8", INPUT_VAR0, setupMorphology, 2.f},
+    {"erode_r2", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 0, RS_TYPE_UNSIGNED_8, 4, "U8_4", INPUT_VAR0, setupMorphology, 2.f},
+    {"erode_r2", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 0, RS_TYPE_UNSIGNED_16, 4, "U16_4", INPUT_VAR0, setupMorphology, 2.f},
+    {"erode_r2", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 0, RS_TYPE_FLOAT_32, 4, "F32_4", INPUT_VAR0, setupMorphology, 2.f},
+    {"open_r7", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 2, RS_TYPE_UNSIGNED_8, 1, "U8", INPUT_VAR0, setupMorphology, 7.f},
+    {"open_r7", RS_SCRIPT_INTRINSIC_ID_MORPHOLOGY, 2, RS_TYPE_FLOAT_32, 1, "F32", INPUT_VAR0, setupMorphology, 7.f},
+    {"scan_rows", RS_SCRIPT_INTRINSIC_ID_SCAN, 0, RS_TYPE_UNSIGNED_32, 1, "U32", INPUT_VAR0, setupNone, 0.f},
+    {"scan_rows", RS_SCRIPT_INTRINSIC_ID_SCAN, 0, RS_TYPE_FLOAT_32, 1, "F32", INPUT_VAR0, setupNone, 0.f},
+    {"scan_integral", RS_SCRIPT_INTRINSIC_ID_SCAN, 1, RS_TYPE_UNSIGNED_32, 1, "U32", INPUT_VAR0, setupNone, 0.f},
+    {"scan_integral", RS_SCRIPT_INTRINSIC_ID_SCAN, 1, RS_TYPE_FLOAT_32, 1, "F32", INPUT_VAR0, setupNone, 0.f},
+    {"sort", RS_SCRIPT_INTRINSIC_ID_SORT, 0, RS_TYPE_UNSIGNED_32, 1, "U32", INPUT_KEYS, setupNone, 0.f},
+    {"sort", RS_SCRIPT_INTRINSIC_ID_SORT, 0, RS_TYPE_FLOAT_32, 1, "F32", INPUT_KEYS, setupNone, 0.f},
+};
+
+static sp<const Element> createElement(sp<RS> rs, RsDataType dt, uint32_t vecSize) {
+    if (vecSize == 1) {
+        return Element::createUser(rs, dt);
+    }
+    return Element::createVector(rs, dt, vecSize);
+}
+
+static size_t getSampleSize(RsDataType dt) {
+    switch (dt) {
+    case RS_TYPE_UNSIGNED_8:
+        return 1;
+    case RS_TYPE_UNSIGNED_16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+static sp<const Type> create2DType(sp<RS> rs, sp<const Element> e, uint32_t w, uint32_t h) {
+    Type::Builder tb(rs, e);
+    tb.setX(w);
+    tb.setY(h);
+    return tb.create();
+}
+
+static sp<const Type> create1DType(sp<RS> rs, sp<const Element> e, uint32_t count) {
+    Type::Builder tb(rs, e);
+    tb.setX(count);
+    return tb.create();
+}
+
+// Fills the w * h cells of a 2D allocation, or the first w * h cells of a
+// 1D one.  Floats stay within 0..1 so no kernel meets NaNs or denormals.
+static void fillAllocation(sp<Allocation> a, uint32_t w, uint32_t h, RsDataType dt,
+                           uint32_t vecSize) {
+    size_t count = (size_t)w * h * vecSize;
+    size_t bytes = count * getSampleSize(dt);
+    uint8_t *buf = new uint8_t[bytes];
+    if (dt == RS_TYPE_FLOAT_32) {
+        float *f = (float *)buf;
+        for (size_t ct = 0; ct < count; ct++) {
+            f[ct] = (uint8_t)(ct * 7 + (ct >> 8)) * (1.f / 255.f);
+        }
+    } else {
+        for (size_t ct = 0; ct < bytes; ct++) {
+            buf[ct] = (uint8_t)(ct * 7 + (ct >> 8));
+        }
+    }
+    if (a->getType()->getY()) {
+        a->copy2DRangeFrom(0, 0, w, h, buf);
+    } else {
+        a->copy1DRangeFrom(0, (size_t)w * h, buf);
+    }
+    delete [] buf;
+}
+
+static void benchIntrinsics(sp<RS> rs) {
+    uint32_t threads = getThreadCount();
+    RsContext rsc = rs->getContext();
+
+    for (uint32_t i = 0; i < sizeof(gIntrinsics) / sizeof(gIntrinsics[0]); i++) {
+        const IntrinsicConfig *cfg = &gIntrinsics[i];
+        if (!isSelected("intrinsic", cfg->name)) {
+            continue;
+        }
+
+        sp<const Element> e = createElement(rs, cfg->dataType, cfg->vecSize);
+
+        for (uint32_t s = 0; s < gSizeCount; s++) {
+            uint32_t w = gSizes[s].w;
+            uint32_t h = gSizes[s].h;
+            sp<const Type> t;
+            if (cfg->input == INPUT_KEYS) {
+                t = create1DType(rs, e, w * h);
+            } else {
+                t = create2DType(rs, e, w, h);
+            }
+            sp<Allocation> ain = Allocation::createTyped(rs, t);
+            sp<Allocation> aout = Allocation::createTyped(rs, t);
+            fillAllocation(ain, w, h, cfg->dataType, cfg->vecSize);
+
+            Intrinsic script(rs, cfg->id, e);
+            cfg->setup(rs, &script, &cfg->param);
+
+            IntrinsicRun r;
+            r.rs = rs;
+            r.script = &script;
+            r.slot = cfg->slot;
+            r.in = ain->getID();
+            r.out = aout->getID();
+
+            RsType yuvType = NULL;
+            RsAllocation yuv = NULL;
+            switch (cfg->input) {
+            case INPUT_FOREACH:
+                break;
+            case INPUT_VAR:
+                script.setVar(1, ain->getID());
+                r.in = NULL;
+                break;
+            case INPUT_VAR0:
+            case INPUT_KEYS:
+                script.setVar(0, ain->getID());
+                r.in = NULL;
+                break;
+            case INPUT_YUV:
+            case OUTPUT_YUV: {
+                // P010 keeps each sample in 16 bits.
+                sp<const Element> ye = (cfg->yuv == RS_YUV_P010) ? Element::U16(rs) :
+                                                                   Element::U8(rs);
+                yuvType = rsTypeCreate(rsc, ye->getID(), w, h, 0, false, false, cfg->yuv);
+                yuv = rsAllocationCreateTyped(rsc, yuvType, RS_ALLOCATION_MIPMAP_NONE,
+                                              RS_ALLOCATION_USAGE_SCRIPT, 0);
+                if (cfg->input == INPUT_YUV) {
+                    script.setVar(0, yuv);
+                } else {
+                    script.setVar(0, ain->getID());
+                    r.out = yuv;
+                }
+                r.in = NULL;
+                break;
+            }
+            }
+
+            double avgUs, bestUs;
+            timeBench(rs, runIntrinsic, &r, &avgUs, &bestUs);
+            printResult("intrinsic", cfg->name, cfg->element, w, h, threads, avgUs, bestUs,
+                        (w * h) / bestUs, "Mpix/s");
+
+            if (yuv) {
+                rsObjDestroy(rsc, yuv);
+                rsObjDestroy(rsc, yuvType);
+            }
+        }
+    }
+}
+
+// Launch overhead as a function of worker thread count.  The thread count
+// is read from debug.rs.max-threads when a context is created.
+static void benchDispatch() {
+    if (!isSelected("dispatch", "colormatrix")) {
+        return;
+    }
+
+    char saved[PROPERTY_VALUE_MAX];
+    property_get("debug.rs.max-threads", saved, "0");
+
+    static const ImageSize dispatchSizes[] = {
+        {1, 1},
+        {64, 64},
+        {256, 256},
+    };
+
+    uint32_t cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = 1;
+    while (true) {
+        char value[16];
+        snprintf(value, sizeof(value), "%u", threads);
+        property_set("debug.rs.max-threads", value);
+
+        sp<RS> rs = new RS();
+        if (!rs->init(true, false)) {
+            printf("# context creation failed with %u threads\n", threads);
+            break;
+        }
+
+        sp<const Element> e = Element::U8_4(rs);
+        for (uint32_t s = 0; s < sizeof(dispatchSizes) / sizeof(dispatchSizes[0]); s++) {
+            uint32_t w = dispatchSizes[s].w;
+            uint32_t h = dispatchSizes[s].h;
+            sp<const Type> t = create2DType(rs, e, w, h);
+            sp<Allocation> ain = Allocation::createTyped(rs, t);
+            sp<Allocation> aout = Allocation::createTyped(rs, t);
+
+            Intrinsic script(rs, RS_SCRIPT_INTRINSIC_ID_COLOR_MATRIX, e);
+            setupColorMatrix(rs, &script, NULL);
+
+            IntrinsicRun r;
+            r.rs = rs;
+            r.script = &script;
+            r.slot = 0;
+            r.in = ain->getID();
+            r.out = aout->getID();
+
+            // Pipelined launches: the cost of queueing and running back to
+            // back kernels.
+            double avgUs, bestUs;
+            timeBench(rs, runIntrinsic, &r, &avgUs, &bestUs);
+            printResult("dispatch", "colormatrix_pipelined", "U8_4", w, h, threads,
+                        avgUs, bestUs, 1000000.0 / bestUs, "launch/s");
+
+            // Round trip: a single launch waited on by the client.
+            double total = 0;
+            double best = 0;
+            for (int ct = 0; ct < gIterations * kBatches; ct++) {
+                uint64_t t0 = getTimeNs();
+                runIntrinsic(&r);
+                rs->finish();
+                double us = (getTimeNs() - t0) / 1000.0;
+                total += us;
+                if (!ct || us < best) {
+                    best = us;
+                }
+            }
+            avgUs = total / (gIterations * kBatches);
+            printResult("dispatch", "colormatrix_roundtrip", "U8_4", w, h, threads,
+                        avgUs, best, 1000000.0 / best, "launch/s");
+        }
+        if (threads == cpus) {
+            break;
+        }
+        threads = (threads * 2 < cpus) ? threads * 2 : cpus;
+    }
+
+    property_set("debug.rs.max-threads", saved);
+}
+
+struct ChainRun {
+    Intrinsic **scripts;
+    uint32_t length;
+    RsAllocation *allocs;
+    RsContext rsc;
+    RsScriptGroup group;
+};
+
+static void runChain(void *arg) {
+    ChainRun *r = (ChainRun *)arg;
+    for (uint32_t ct = 0; ct < r->length; ct++) {
+        r->scripts[ct]->forEach(0, r->allocs[ct], r->allocs[ct + 1]);
+    }
+}
+
+static void runGroup(void *arg) {
+    ChainRun *r = (ChainRun *)arg;
+    rsScriptGroupExecute(r->rsc, r->group);
+}
+
+// Chains of color matrix kernels, launched one by one through explicit
+// intermediate allocations and as a single ScriptGroup.
+static void benchScriptGroup(sp<RS> rs) {
+    if (!isSelected("scriptgroup", "colormatrix_chain")) {
+        return;
+    }
+
+    uint32_t threads = getThreadCount();
+    RsContext rsc = rs->getContext();
+    sp<const Element> e = Element::U8_4(rs);
+    static const uint32_t chainLengths[] = {2, 4, 8};
+
+    for (uint32_t c = 0; c < sizeof(chainLengths) / sizeof(chainLengths[0]); c++) {
+        uint32_t len = chainLengths[c];
+        for (uint32_t s = 0; s < gSizeCount; s++) {
+            uint32_t w = gSizes[s].w;
+            uint32_t h = gSizes[s].h;
+            sp<const Type> t = create2DType(rs, e, w, h);
+
+            Intrinsic **scripts = new Intrinsic *[len];
+            sp<Allocation> *allocs = new sp<Allocation>[len + 1];
+            RsAllocation *allocIDs = new RsAllocation[len + 1];
+            RsScriptKernelID *kernels = new RsScriptKernelID[len];
+            for (uint32_t ct = 0; ct <= len; ct++) {
+                allocs[ct] = Allocation::createTyped(rs, t);
+                allocIDs[ct] = allocs[ct]->getID();
+            }
+            fillAllocation(allocs[0], w, h, RS_TYPE_UNSIGNED_8, 4);
+            for (uint32_t ct = 0; ct < len; ct++) {
+                scripts[ct] = new Intrinsic(rs, RS_SCRIPT_INTRINSIC_ID_COLOR_MATRIX, e);
+                setupColorMatrix(rs, scripts[ct], NULL);
+                kernels[ct] = rsScriptKernelIDCreate(rsc, scripts[ct]->getID(), 0, 3);
+            }
+
+            RsScriptKernelID *srcK = new RsScriptKernelID[len - 1];
+            RsScriptKernelID *dstK = new RsScriptKernelID[len - 1];
+            RsScriptFieldID *dstF = new RsScriptFieldID[len - 1];
+            RsType *types = new RsType[len - 1];
+            for (uint32_t ct = 0; ct < len - 1; ct++) {
+                srcK[ct] = kernels[ct];
+                dstK[ct] = kernels[ct + 1];
+                dstF[ct] = NULL;
+                types[ct] = t->getID();
+            }
+
+            ChainRun r;
+            r.scripts = scripts;
+            r.length = len;
+            r.allocs = allocIDs;
+            r.rsc = rsc;
+            r.group = rsScriptGroupCreate(rsc, kernels, len * sizeof(RsScriptKernelID),
+                                          srcK, (len - 1) * sizeof(RsScriptKernelID),
+                                          dstK, (len - 1) * sizeof(RsScriptKernelID),
+                                          dstF, (len - 1) * sizeof(RsScriptFieldID),
+                                          types, (len - 1) * sizeof(RsType));
+            rsScriptGroupSetInput(rsc, r.group, kernels[0], allocIDs[0]);
+            rsScriptGroupSetOutput(rsc, r.group, kernels[len - 1], allocIDs[len]);
+
+            char name[64];
+            double avgUs, bestUs;
+            snprintf(name, sizeof(name), "colormatrix_chain%u_separate", len);
+            timeBench(rs, runChain, &r, &avgUs, &bestUs);
+            printResult("scriptgroup", name, "U8_4", w, h, threads, avgUs, bestUs,
+                        (w * h) / bestUs, "Mpix/s");
+
+            snprintf(name, sizeof(name), "colormatrix_chain%u_group", len);
+            timeBench(rs, runGroup, &r, &avgUs, &bestUs);
+            printResult("scriptgroup", name, "U8_4", w, h, threads, avgUs, bestUs,
+                        (w * h) / bestUs, "Mpix/s");
+
+            rsObjDestroy(rsc, r.group);
+            for (uint32_t ct = 0; ct < len; ct++) {
+                rsObjDestroy(rsc, kernels[ct]);
+                delete scripts[ct];
+            }
+            delete [] srcK;
+            delete [] dstK;
+            delete [] dstF;
+            delete [] types;
+            delete [] kernels;
+            delete [] allocIDs;
+            delete [] allocs;
+            delete [] scripts;
+        }
+    }
+}
+
+struct CopyRun {
+    sp<Allocation> a;
+    sp<Allocation> b;
+    void *host;
+    uint32_t w;
+    uint32_t h;
+};
+
+static void runCopyFrom(void *arg) {
+    CopyRun *r = (CopyRun *)arg;
+    r->a->copy2DRangeFrom(0, 0, r->w, r->h, r->host);
+}
+
+static void runCopyTo(void *arg) {
+    CopyRun *r = (CopyRun *)arg;
+    r->a->copy2DRangeTo(0, 0, r->w, r->h, r->host);
+}
+
+static void runCopyAlloc(void *arg) {
+    CopyRun *r = (CopyRun *)arg;
+    r->b->copy2DRangeFrom(0, 0, r->w, r->h, r->a, 0, 0);
+}
+
+static void benchCopy(sp<RS> rs) {
+    static const struct {
+        const char *name;
+        BenchFunc fn;
+    } copies[] = {
+        {"host_to_alloc", runCopyFrom},
+        {"alloc_to_host", runCopyTo},
+        {"alloc_to_alloc", runCopyAlloc},
+    };
+
+    uint32_t threads = getThreadCount();
+    sp<const Element> e = Element::U8_4(rs);
+    for (uint32_t s = 0; s < gSizeCount; s++) {
+        CopyRun r;
+        r.w = gSizes[s].w;
+        r.h = gSizes[s].h;
+        sp<const Type> t = create2DType(rs, e, r.w, r.h);
+        r.a = Allocation::createTyped(rs, t);
+        r.b = Allocation::createTyped(rs, t);
+        size_t bytes = r.w * r.h * 4;
+        r.host = malloc(bytes);
+        memset(r.host, 0x55, bytes);
+
+        for (uint32_t ct = 0; ct < sizeof(copies) / sizeof(copies[0]); ct++) {
+            if (!isSelected("copy", copies[ct].name)) {
+                continue;
+            }
+            double avgUs, bestUs;
+            timeBench(rs, copies[ct].fn, &r, &avgUs, &bestUs);
+            printResult("copy", copies[ct].name, "U8_4", r.w, r.h, threads, avgUs, bestUs,
+                        bytes / bestUs, "MB/s");
+        }
+        free(r.host);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ImageSize single;
+
+    for (int ct = 1; ct < argc; ct++) {
+        if (!strcmp(argv[ct], "-i") && (ct + 1 < argc)) {
+            gIterations = atoi(argv[++ct]);
+            if (gIterations <= 0) {
+                printf("iterations must be positive\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[ct], "-s") && (ct + 1 < argc)) {
+            if (sscanf(argv[++ct], "%ux%u", &single.w, &single.h) != 2 || !single.w || !single.h) {
+                printf("size must be WxH\n");
+                return 1;
+            }
+            gSizes[0] = single;
+            gSizeCount = 1;
+        } else if (!strcmp(argv[ct], "-f") && (ct + 1 < argc)) {
+            gFilter = argv[++ct];
+        } else {
+            printf("usage: %s [-i iterations] [-s WxH] [-f filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("group,name,element,width,height,threads,iterations,avg_us,best_us,throughput,unit\n");
+
+    benchDispatch();
+
+    sp<RS> rs = new RS();
+    if (!rs->init(true, false)) {
+        printf("context creation failed\n");
+        return 1;
+    }
+    benchIntrinsics(rs);
+    benchScriptGroup(rs);
+    benchCopy(rs);
+    return 0;
+}
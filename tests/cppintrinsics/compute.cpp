@@ -0,0 +1,643 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the results of the CPU intrinsics against scalar expectations,
+// and that read-only and sparse allocations refuse writes.
+// Each test prints what went wrong and returns true on failure.
+
+#include "RenderScript.h"
+#include "rs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace android;
+using namespace RSC;
+
+// Wraps a YUV buffer of the given format laid out with packed rows.
+static sp<Allocation> createYuv(sp<RS> rs, sp<const Element> e, uint32_t w, uint32_t h,
+                                int yuv, void *ptr, const size_t *strides,
+                                const size_t *offsets, uint32_t planes) {
+    RsType id = rsTypeCreate(rs->getContext(), e->getID(), w, h, 0, false, false, yuv);
+    sp<const Type> t = new Type(id, rs);
+    return Allocation::createStrided(rs, t, RS_ALLOCATION_MIPMAP_NONE,
+                                     RS_ALLOCATION_USAGE_SCRIPT | RS_ALLOCATION_USAGE_SHARED,
+                                     ptr, strides, offsets, planes);
+}
+
+// An odd sized NV21 output has a final chroma row and pair that cover a
+// single luma row and column.  They must be written, and nothing past them.
+static bool testRgbToYuvOddNV21(sp<RS> rs) {
+    const uint32_t w = 17;
+    const uint32_t h = 9;
+    const size_t lumaSize = w * h;
+    const size_t chromaStride = w + 1;
+    const size_t chromaSize = chromaStride * ((h + 1) / 2);
+    const size_t guard = 64;
+    const uint8_t fill = 0xaa;
+
+    uint8_t *buf = new uint8_t[lumaSize + chromaSize + guard];
+    memset(buf, fill, lumaSize + chromaSize + guard);
+    const size_t strides[2] = {w, chromaStride};
+    const size_t offsets[2] = {0, lumaSize};
+    sp<Allocation> out = createYuv(rs, Element::U8(rs), w, h, RS_YUV_NV21,
+                                   buf, strides, offsets, 2);
+
+    // Mid gray has no chroma, so every chroma sample is 128.
+    sp<Allocation> in = Allocation::createSized2D(rs, Element::RGBA_8888(rs), w, h);
+    uint8_t *rgba = new uint8_t[w * h * 4];
+    memset(rgba, 128, w * h * 4);
+    in->copy2DRangeFrom(0, 0, w, h, rgba);
+    delete [] rgba;
+
+    sp<ScriptIntrinsicRgbToYuv> s = new ScriptIntrinsicRgbToYuv(rs, Element::U8_4(rs));
+    s->setInput(in);
+    s->forEach(out);
+    rs->finish();
+
+    bool failed = false;
+    for (size_t ct = 0; ct < lumaSize; ct++) {
+        if (buf[ct] == fill) {
+            printf("RgbToYuv odd NV21: luma %zu not written\n", ct);
+            failed = true;
+            break;
+        }
+    }
+    for (size_t ct = 0; ct < chromaSize; ct++) {
+        if (buf[lumaSize + ct] != 128) {
+            printf("RgbToYuv odd NV21: chroma byte %zu is %u, expected 128\n",
+                   ct, buf[lumaSize + ct]);
+            failed = true;
+            break;
+        }
+    }
+    for (size_t ct = 0; ct < guard; ct++) {
+        if (buf[lumaSize + chromaSize + ct] != fill) {
+            printf("RgbToYuv odd NV21: wrote %zu bytes past the chroma plane\n", ct);
+            failed = true;
+            break;
+        }
+    }
+
+    s.clear();
+    out.clear();
+    in.clear();
+    rs->finish();
+    delete [] buf;
+    return failed;
+}
+
+// Sorts with many equal keys; equal keys keep their order and the
+// payload of original indices follows them.
+static bool testSortStable(sp<RS> rs) {
+    const uint32_t count = 10007;
+    int32_t *keys = new int32_t[count];
+    uint32_t *index = new uint32_t[count];
+    for (uint32_t ct = 0; ct < count; ct++) {
+        keys[ct] = (int32_t)((ct * 37) % 101) - 50;
+        index[ct] = ct;
+    }
+
+    sp<Allocation> k = Allocation::createSized(rs, Element::I32(rs), count);
+    sp<Allocation> v = Allocation::createSized(rs, Element::U32(rs), count);
+    k->copy1DFrom(keys);
+    v->copy1DFrom(index);
+
+    sp<ScriptIntrinsicSort> s = new ScriptIntrinsicSort(rs, Element::I32(rs));
+    s->setKeys(k);
+    s->setPayload(v);
+    s->sort(k);
+
+    int32_t *sorted = new int32_t[count];
+    uint32_t *order = new uint32_t[count];
+    k->copy1DTo(sorted);
+    v->copy1DTo(order);
+
+    bool failed = false;
+    for (uint32_t ct = 0; ct < count; ct++) {
+        if ((order[ct] >= count) || (keys[order[ct]] != sorted[ct])) {
+            printf("Sort: payload %u does not follow key %d\n", ct, sorted[ct]);
+            failed = true;
+            break;
+        }
+        if (ct && ((sorted[ct - 1] > sorted[ct]) ||
+                   ((sorted[ct - 1] == sorted[ct]) && (order[ct - 1] > order[ct])))) {
+            printf("Sort: entries %u and %u out of order\n", ct - 1, ct);
+            failed = true;
+            break;
+        }
+    }
+
+    delete [] keys;
+    delete [] index;
+    delete [] sorted;
+    delete [] order;
+    return failed;
+}
+
+// Float keys of both signs sort into numeric order.
+static bool testSortFloat(sp<RS> rs) {
+    const uint32_t count = 4099;
+    float *keys = new float[count];
+    for (uint32_t ct = 0; ct < count; ct++) {
+        keys[ct] = ((int32_t)((ct * 53) % 401) - 200) * 0.25f;
+    }
+
+    sp<Allocation> k = Allocation::createSized(rs, Element::F32(rs), count);
+    sp<Allocation> out = Allocation::createSized(rs, Element::F32(rs), count);
+    k->copy1DFrom(keys);
+
+    sp<ScriptIntrinsicSort> s = new ScriptIntrinsicSort(rs, Element::F32(rs));
+    s->setKeys(k);
+    s->sort(out);
+
+    float *sorted = new float[count];
+    out->copy1DTo(sorted);
+
+    bool failed = false;
+    for (uint32_t ct = 1; ct < count; ct++) {
+        if (sorted[ct - 1] > sorted[ct]) {
+            printf("Sort: float %u (%f) is above %u (%f)\n",
+                   ct - 1, sorted[ct - 1], ct, sorted[ct]);
+            failed = true;
+            break;
+        }
+    }
+    if ((sorted[0] != -50.f) || (sorted[count - 1] != 50.f)) {
+        printf("Sort: float range is %f to %f, expected -50 to 50\n",
+               sorted[0], sorted[count - 1]);
+        failed = true;
+    }
+
+    delete [] keys;
+    delete [] sorted;
+    return failed;
+}
+
+// Runs a sum scan of a w x h uint image and checks every row.
+static bool checkScanSum(sp<RS> rs, uint32_t w, uint32_t h, bool exclusive) {
+    const uint32_t rows = h ? h : 1;
+    const size_t count = (size_t)w * rows;
+    uint32_t *in = new uint32_t[count];
+    uint32_t *out = new uint32_t[count];
+    for (size_t ct = 0; ct < count; ct++) {
+        in[ct] = (ct * 7) % 13;
+    }
+
+    sp<const Type> t = Type::create(rs, Element::U32(rs), w, h, 0);
+    sp<Allocation> a = Allocation::createTyped(rs, t);
+    sp<Allocation> b = Allocation::createTyped(rs, t);
+    if (h) {
+        a->copy2DRangeFrom(0, 0, w, h, in);
+    } else {
+        a->copy1DFrom(in);
+    }
+
+    sp<ScriptIntrinsicScan> s = new ScriptIntrinsicScan(rs, Element::U32(rs));
+    s->setInput(a);
+    s->setOp(RS_SCAN_OP_SUM, exclusive);
+    s->scan(b);
+    if (h) {
+        b->copy2DRangeTo(0, 0, w, h, out);
+    } else {
+        b->copy1DTo(out);
+    }
+
+    bool failed = false;
+    for (size_t y = 0; (y < rows) && !failed; y++) {
+        uint32_t sum = 0;
+        for (size_t x = 0; x < w; x++) {
+            const size_t ct = y * w + x;
+            if (!exclusive) {
+                sum += in[ct];
+            }
+            if (out[ct] != sum) {
+                printf("Scan %ux%u %s: (%zu, %zu) is %u, expected %u\n", w, h,
+                       exclusive ? "exclusive" : "inclusive", x, y, out[ct], sum);
+                failed = true;
+                break;
+            }
+            if (exclusive) {
+                sum += in[ct];
+            }
+        }
+    }
+
+    delete [] in;
+    delete [] out;
+    return failed;
+}
+
+// A single wide row is cut into blocks whose carries must chain.
+static bool testScan(sp<RS> rs) {
+    bool failed = false;
+    failed |= checkScanSum(rs, 37, 5, false);
+    failed |= checkScanSum(rs, 37, 5, true);
+    failed |= checkScanSum(rs, 20011, 0, false);
+    failed |= checkScanSum(rs, 20011, 0, true);
+    return failed;
+}
+
+static bool testScanIntegral(sp<RS> rs) {
+    const uint32_t w = 37;
+    const uint32_t h = 23;
+    uint32_t *in = new uint32_t[w * h];
+    uint32_t *out = new uint32_t[w * h];
+    uint32_t *ref = new uint32_t[w * h];
+    for (uint32_t ct = 0; ct < w * h; ct++) {
+        in[ct] = (ct * 11) % 17;
+    }
+    for (uint32_t y = 0; y < h; y++) {
+        uint32_t row = 0;
+        for (uint32_t x = 0; x < w; x++) {
+            row += in[y * w + x];
+            ref[y * w + x] = row + (y ? ref[(y - 1) * w + x] : 0);
+        }
+    }
+
+    sp<const Type> t = Type::create(rs, Element::U32(rs), w, h, 0);
+    sp<Allocation> a = Allocation::createTyped(rs, t);
+    sp<Allocation> b = Allocation::createTyped(rs, t);
+    a->copy2DRangeFrom(0, 0, w, h, in);
+
+    sp<ScriptIntrinsicScan> s = new ScriptIntrinsicScan(rs, Element::U32(rs));
+    s->setInput(a);
+    s->setOp(RS_SCAN_OP_SUM, false);
+    s->integral(b);
+    b->copy2DRangeTo(0, 0, w, h, out);
+
+    bool failed = false;
+    for (uint32_t ct = 0; ct < w * h; ct++) {
+        if (out[ct] != ref[ct]) {
+            printf("Scan integral: (%u, %u) is %u, expected %u\n",
+                   ct % w, ct / w, out[ct], ref[ct]);
+            failed = true;
+            break;
+        }
+    }
+
+    delete [] in;
+    delete [] out;
+    delete [] ref;
+    return failed;
+}
+
+// Dilating a single lit pixel with an asymmetric mask must light the mask
+// shape around it, with the mask center on the pixel.
+static bool testMorphologyMask(sp<RS> rs) {
+    const uint32_t w = 9;
+    const uint32_t h = 9;
+    const uint8_t mask[9] = {
+        1, 0, 0,
+        0, 1, 1,
+        0, 0, 0
+    };
+    uint8_t *in = new uint8_t[w * h];
+    uint8_t *out = new uint8_t[w * h];
+    memset(in, 0, w * h);
+    in[4 * w + 4] = 255;
+
+    sp<Allocation> m = Allocation::createSized2D(rs, Element::U8(rs), 3, 3);
+    m->copy2DRangeFrom(0, 0, 3, 3, mask);
+    sp<Allocation> a = Allocation::createSized2D(rs, Element::U8(rs), w, h);
+    sp<Allocation> b = Allocation::createSized2D(rs, Element::U8(rs), w, h);
+    a->copy2DRangeFrom(0, 0, w, h, in);
+
+    sp<ScriptIntrinsicMorphology> s = new ScriptIntrinsicMorphology(rs, Element::U8(rs));
+    s->setInput(a);
+    s->setMask(m);
+    s->dilate(b);
+    b->copy2DRangeTo(0, 0, w, h, out);
+
+    bool failed = false;
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            int32_t mx = (int32_t)x - 4 + 1;
+            int32_t my = (int32_t)y - 4 + 1;
+            bool lit = (mx >= 0) && (mx < 3) && (my >= 0) && (my < 3) && mask[my * 3 + mx];
+            if (out[y * w + x] != (lit ? 255 : 0)) {
+                printf("Morphology dilate: (%u, %u) is %u, expected %u\n",
+                       x, y, out[y * w + x], lit ? 255 : 0);
+                failed = true;
+            }
+        }
+    }
+
+    delete [] in;
+    delete [] out;
+    return failed;
+}
+
+// Converts an odd sized image to NV21 and back.  Colors are constant over
+// each 2x2 block, so only quantization separates the result from the input.
+static bool testYuvRoundTripOdd(sp<RS> rs) {
+    const uint32_t w = 17;
+    const uint32_t h = 9;
+    const size_t lumaSize = w * h;
+    const size_t chromaStride = w + 1;
+    const size_t chromaSize = chromaStride * ((h + 1) / 2);
+    const int tolerance = 4;
+
+    uint8_t *rgba = new uint8_t[w * h * 4];
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint8_t *p = rgba + (y * w + x) * 4;
+            p[0] = 64 + ((x / 2) * 13) % 128;
+            p[1] = 64 + ((y / 2) * 29) % 128;
+            p[2] = 96 + ((x / 2 + y / 2) * 7) % 64;
+            p[3] = 255;
+        }
+    }
+
+    uint8_t *buf = new uint8_t[lumaSize + chromaSize];
+    memset(buf, 0, lumaSize + chromaSize);
+    const size_t strides[2] = {w, chromaStride};
+    const size_t offsets[2] = {0, lumaSize};
+    sp<Allocation> yuv = createYuv(rs, Element::U8(rs), w, h, RS_YUV_NV21,
+                                   buf, strides, offsets, 2);
+
+    sp<Allocation> in = Allocation::createSized2D(rs, Element::RGBA_8888(rs), w, h);
+    sp<Allocation> out = Allocation::createSized2D(rs, Element::RGBA_8888(rs), w, h);
+    in->copy2DRangeFrom(0, 0, w, h, rgba);
+
+    sp<ScriptIntrinsicRgbToYuv> toYuv = new ScriptIntrinsicRgbToYuv(rs, Element::U8_4(rs));
+    toYuv->setInput(in);
+    toYuv->forEach(yuv);
+    sp<ScriptIntrinsicYuvToRGB> toRgb = new ScriptIntrinsicYuvToRGB(rs, Element::U8_4(rs));
+    toRgb->setInput(yuv);
+    toRgb->forEach(out);
+
+    uint8_t *result = new uint8_t[w * h * 4];
+    out->copy2DRangeTo(0, 0, w, h, result);
+
+    bool failed = false;
+    for (uint32_t ct = 0; (ct < w * h * 4) && !failed; ct++) {
+        if (abs((int)result[ct] - (int)rgba[ct]) > tolerance) {
+            printf("YUV round trip: (%u, %u) channel %u is %u, expected %u\n",
+                   (ct / 4) % w, (ct / 4) / w, ct % 4, result[ct], rgba[ct]);
+            failed = true;
+        }
+    }
+
+    toYuv.clear();
+    toRgb.clear();
+    yuv.clear();
+    rs->finish();
+    delete [] rgba;
+    delete [] result;
+    delete [] buf;
+    return failed;
+}
+
+// Scalar reference for the premultiplied modes the uchar4 path implements.
+static void blendReference(uint32_t mode, const uint8_t *src, const uint8_t *dst,
+                           uint8_t *out) {
+    float s[4], d[4], r[4];
+    for (int c = 0; c < 4; c++) {
+        s[c] = src[c] / 255.f;
+        d[c] = dst[c] / 255.f;
+    }
+    for (int c = 0; c < 4; c++) {
+        switch (mode) {
+        case 0: r[c] = 0.f; break;
+        case 1: r[c] = s[c]; break;
+        case 2: r[c] = d[c]; break;
+        case 3: r[c] = s[c] + d[c] * (1.f - s[3]); break;
+        case 4: r[c] = d[c] + s[c] * (1.f - d[3]); break;
+        case 5: r[c] = s[c] * d[3]; break;
+        case 6: r[c] = d[c] * s[3]; break;
+        case 7: r[c] = s[c] * (1.f - d[3]); break;
+        case 8: r[c] = d[c] * (1.f - s[3]); break;
+        case 9: r[c] = (c == 3) ? d[3] : (s[c] * d[3] + d[c] * (1.f - s[3])); break;
+        // The uchar4 path keeps the destination alpha for both atops.
+        case 10: r[c] = (c == 3) ? d[3] : (d[c] * s[3] + s[c] * (1.f - d[3])); break;
+        case 14: r[c] = s[c] * d[c]; break;
+        case 34: r[c] = s[c] + d[c]; break;
+        case 35: r[c] = d[c] - s[c]; break;
+        default: r[c] = 0.f; break;
+        }
+        r[c] = r[c] < 0.f ? 0.f : (r[c] > 1.f ? 1.f : r[c]);
+        out[c] = (uint8_t)(r[c] * 255.f + 0.5f);
+    }
+    if (mode == 11) {
+        for (int c = 0; c < 4; c++) {
+            out[c] = src[c] ^ dst[c];
+        }
+    }
+}
+
+// The uchar4 path rounds with shifts, so allow a couple of steps.
+static bool testBlendModes(sp<RS> rs) {
+    static const uint32_t modes[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 14, 34, 35};
+    const uint32_t count = 37;
+    const int tolerance = 2;
+
+    uint8_t *src = new uint8_t[count * 4];
+    uint8_t *dst = new uint8_t[count * 4];
+    uint8_t *out = new uint8_t[count * 4];
+    for (uint32_t ct = 0; ct < count; ct++) {
+        uint8_t sa = (ct * 41) % 256;
+        uint8_t da = 255 - (ct * 23) % 256;
+        src[ct * 4 + 3] = sa;
+        dst[ct * 4 + 3] = da;
+        for (int c = 0; c < 3; c++) {
+            src[ct * 4 + c] = sa ? (ct * 17 + c * 61) % (sa + 1) : 0;
+            dst[ct * 4 + c] = da ? (ct * 29 + c * 43) % (da + 1) : 0;
+        }
+    }
+
+    sp<Allocation> in = Allocation::createSized(rs, Element::U8_4(rs), count);
+    sp<Allocation> a = Allocation::createSized(rs, Element::U8_4(rs), count);
+    in->copy1DFrom(src);
+    sp<ScriptIntrinsicBlend> s = new ScriptIntrinsicBlend(rs, Element::U8_4(rs));
+
+    bool failed = false;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        a->copy1DFrom(dst);
+        s->blend(modes[m], in, a);
+        a->copy1DTo(out);
+        for (uint32_t ct = 0; ct < count; ct++) {
+            uint8_t ref[4];
+            blendReference(modes[m], src + ct * 4, dst + ct * 4, ref);
+            bool bad = false;
+            for (int c = 0; c < 4; c++) {
+                bad |= abs((int)out[ct * 4 + c] - (int)ref[c]) > tolerance;
+            }
+            if (bad) {
+                printf("Blend mode %u: pixel %u is %u %u %u %u, expected %u %u %u %u\n",
+                       modes[m], ct, out[ct * 4], out[ct * 4 + 1], out[ct * 4 + 2],
+                       out[ct * 4 + 3], ref[0], ref[1], ref[2], ref[3]);
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    delete [] src;
+    delete [] dst;
+    delete [] out;
+    return failed;
+}
+
+// Copies into a read-only file mapping and launches writing it are
+// rejected, leaving the mapping and the file as they were.
+static bool testReadOnlyFile(sp<RS> rs) {
+    const uint32_t count = 64;
+    const char *dir = getenv("TMPDIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/rstest-intrinsics-XXXXXX", dir ? dir : "/data/local/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("Read-only file: unable to create %s\n", path);
+        return true;
+    }
+    uint8_t data[count * 4];
+    for (uint32_t ct = 0; ct < count * 4; ct++) {
+        data[ct] = ct * 3;
+    }
+    bool failed = write(fd, data, sizeof(data)) != (ssize_t)sizeof(data);
+    close(fd);
+
+    sp<const Type> t = Type::create(rs, Element::U8_4(rs), count, 0, 0);
+    sp<Allocation> a = Allocation::createFromFile(rs, t, path, 0,
+                                                  RS_ALLOCATION_FILE_READ_ONLY);
+    if (failed || !a.get()) {
+        printf("Read-only file: unable to map %s\n", path);
+        unlink(path);
+        return true;
+    }
+
+    uint8_t zero[count * 4];
+    memset(zero, 0, sizeof(zero));
+    a->copy1DRangeFrom(0, count, zero);
+
+    sp<Allocation> in = Allocation::createSized(rs, Element::U8_4(rs), count);
+    in->copy1DFrom(zero);
+    sp<ScriptIntrinsicBlend> s = new ScriptIntrinsicBlend(rs, Element::U8_4(rs));
+    s->blendSrc(in, a);
+
+    uint8_t result[count * 4];
+    a->copy1DTo(result);
+    if (memcmp(result, data, sizeof(data))) {
+        printf("Read-only file: the allocation was written\n");
+        failed = true;
+    }
+
+    s.clear();
+    a.clear();
+    rs->finish();
+    fd = open(path, O_RDONLY);
+    if ((fd < 0) || (read(fd, result, sizeof(result)) != (ssize_t)sizeof(result)) ||
+        memcmp(result, data, sizeof(data))) {
+        printf("Read-only file: the file was written\n");
+        failed = true;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(path);
+    return failed;
+}
+
+// Sparse allocations refuse views and YUV types.  A launch skipping
+// unallocated bricks reads only the brick that was written.
+static bool testSparse(sp<RS> rs) {
+    const uint32_t w = 64;
+    const uint32_t h = 64;
+    const uint32_t brick = 16;
+    bool failed = false;
+
+    sp<const Type> t = Type::create(rs, Element::U8_4(rs), w, h, 0);
+    sp<Allocation> a = Allocation::createSparse(rs, t, brick, brick);
+    if (!a.get()) {
+        printf("Sparse: creation failed\n");
+        return true;
+    }
+    if (a->createView(0, 0, brick, brick).get()) {
+        printf("Sparse: a view was created\n");
+        failed = true;
+    }
+    RsType yuvId = rsTypeCreate(rs->getContext(), Element::U8(rs)->getID(), w, h, 0,
+                                false, false, RS_YUV_NV21);
+    sp<const Type> yuvType = new Type(yuvId, rs);
+    if (Allocation::createSparse(rs, yuvType, brick, brick).get()) {
+        printf("Sparse: a YUV allocation was created\n");
+        failed = true;
+    }
+
+    uint8_t *fill = new uint8_t[w * h * 4];
+    memset(fill, 0x11, brick * brick * 4);
+    a->copy2DRangeFrom(brick, brick, brick, brick, fill);
+
+    memset(fill, 0x55, w * h * 4);
+    sp<Allocation> out = Allocation::createSized2D(rs, Element::U8_4(rs), w, h);
+    out->copy2DRangeFrom(0, 0, w, h, fill);
+
+    sp<ScriptIntrinsicBlend> s = new ScriptIntrinsicBlend(rs, Element::U8_4(rs));
+    RsScriptCall sc;
+    memset(&sc, 0, sizeof(sc));
+    sc.flags = RS_FOR_EACH_SKIP_UNALLOCATED;
+    rsScriptForEach(rs->getContext(), s->getID(), 1, a->getID(), out->getID(),
+                    NULL, 0, &sc, sizeof(sc));
+    out->copy2DRangeTo(0, 0, w, h, fill);
+
+    for (uint32_t ct = 0; ct < w * h * 4; ct++) {
+        uint32_t x = (ct / 4) % w;
+        uint32_t y = (ct / 4) / w;
+        bool written = (x / brick == 1) && (y / brick == 1);
+        if (fill[ct] != (written ? 0x11 : 0x55)) {
+            printf("Sparse: (%u, %u) is 0x%02x, expected 0x%02x\n",
+                   x, y, fill[ct], written ? 0x11 : 0x55);
+            failed = true;
+            break;
+        }
+    }
+
+    delete [] fill;
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    sp<RS> rs = new RS();
+    if (!rs->init()) {
+        printf("RS init failed\n");
+        return 1;
+    }
+
+    bool failed = false;
+    failed |= testRgbToYuvOddNV21(rs);
+    failed |= testYuvRoundTripOdd(rs);
+    failed |= testSortStable(rs);
+    failed |= testSortFloat(rs);
+    failed |= testScan(rs);
+    failed |= testScanIntegral(rs);
+    failed |= testMorphologyMask(rs);
+    failed |= testBlendModes(rs);
+    failed |= testReadOnlyFile(rs);
+    failed |= testSparse(rs);
+
+    if (failed) {
+        printf("TEST FAILED!\n");
+    } else {
+        printf("TEST PASSED!\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,28 @@
+# The replay tool is built for the target rather than the host: replaying
+# needs the CPU driver (libRSDriver and libbcc), which only builds for the
+# device, and the host libRS is the serialization-only static library with
+# no driver behind it.  Push the trace and run rstest-replay on a device or
+# an emulator.
+
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	replay.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libRS \
+	libcutils \
+	libutils
+
+LOCAL_MODULE:= rstest-replay
+
+LOCAL_MODULE_TAGS := tests
+
+intermediates := $(call intermediates-dir-for,STATIC_LIBRARIES,libRS,TARGET,)
+
+LOCAL_C_INCLUDES += frameworks/rs
+LOCAL_C_INCLUDES += $(intermediates)
+
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a command stream captured with debug.rs.capture against the CPU
+// driver and reports how long each command took.  The driver only builds
+// for the device, so the tool runs there too; see Android.mk.
+//
+// usage: rstest-replay [-v] [-s] trace
+//   -v  print the time of every command as it is replayed
+//   -s  replay on a synchronous context, timing only the work done by
+//       each command rather than including the fifo round trip
+
+#include "rs.h"
+#include "rsCapture.h"
+#include "rsgApiStructs.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+using namespace android;
+using namespace android::renderscript;
+
+// Matches RS_VERSION in the C++ API.
+static const uint32_t kTargetApi = 18;
+static const uint32_t kApiCount = sizeof(gApiNames) / sizeof(gApiNames[0]);
+// The last slot collects allocation snapshots.
+static const uint32_t kStatCount = kApiCount + 1;
+
+struct CommandStats {
+    uint32_t count;
+    uint64_t totalNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+};
+
+static volatile bool gMessageRun = false;
+
+static uint64_t getTimeNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void * messageThreadProc(void *vrsc) {
+    RsContext rsc = (RsContext)vrsc;
+    size_t rbufSize = 256;
+    char *rbuf = (char *)malloc(rbufSize);
+
+    rsContextInitToClient(rsc);
+    gMessageRun = true;
+
+    while (gMessageRun) {
+        size_t receiveLen = 0;
+        uint32_t usrID = 0;
+        uint32_t subID = 0;
+        RsMessageToClientType r = rsContextPeekMessage(rsc, &receiveLen, sizeof(receiveLen),
+                                                       &usrID, sizeof(usrID));
+        if (receiveLen >= rbufSize) {
+            rbufSize = receiveLen + 32;
+            rbuf = (char *)realloc(rbuf, rbufSize);
+        }
+        rsContextGetMessage(rsc, rbuf, rbufSize, &receiveLen, sizeof(receiveLen),
+                            &subID, sizeof(subID));
+
+        if (r == RS_MESSAGE_TO_CLIENT_ERROR) {
+            printf("RS error: %s\n", rbuf);
+        } else if (r == RS_MESSAGE_TO_CLIENT_NONE) {
+            usleep(1000);
+        }
+    }
+    free(rbuf);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    bool synchronous = false;
+    const char *path = NULL;
+
+    for (int ct = 1; ct < argc; ct++) {
+        if (!strcmp(argv[ct], "-v")) {
+            verbose = true;
+        } else if (!strcmp(argv[ct], "-s")) {
+            synchronous = true;
+        } else {
+            path = argv[ct];
+        }
+    }
+    if (!path) {
+        printf("usage: %s [-v] [-s] trace\n", argv[0]);
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        printf("unable to read capture %s\n", path);
+        return 1;
+    }
+
+    RsDevice dev = rsDeviceCreate();
+    RsContext rsc = rsContextCreate(dev, 0, kTargetApi, RS_CONTEXT_TYPE_NORMAL, true, synchronous);
+    if (!rsc) {
+        printf("context creation failed\n");
+        return 1;
+    }
+
+    pthread_t messageThread;
+    pthread_create(&messageThread, NULL, messageThreadProc, rsc);
+    while (!gMessageRun) {
+        usleep(1000);
+    }
+
+    // Every command is followed by a finish so the time covers its
+    // execution.  Measure what an empty finish costs so it can be
+    // subtracted from the numbers below.
+    uint64_t finishNs = 0;
+    if (!synchronous) {
+        const int finishIters = 100;
+        uint64_t t0 = getTimeNs();
+        for (int ct = 0; ct < finishIters; ct++) {
+            rsContextFinish(rsc);
+        }
+        finishNs = (getTimeNs() - t0) / finishIters;
+    }
+
+    CommandStats *stats = (CommandStats *)calloc(kStatCount, sizeof(CommandStats));
+    bool recording = false;
+    uint32_t index = 0;
+    uint64_t replayNs = 0;
+
+    while (reader.next()) {
+        uint32_t slot = kApiCount;
+        if (reader.getRecordType() == RS_CAPTURE_RECORD_COMMAND) {
+            slot = reader.getCommandID();
+            if (slot >= kApiCount) {
+                printf("corrupt capture, command %u at record %u\n", slot, index);
+                break;
+            }
+        }
+
+        uint64_t t0 = getTimeNs();
+        reader.replay(rsc);
+        if (slot == RS_CMD_ID_CommandBufferBeginRecording) {
+            recording = true;
+        } else if (slot == RS_CMD_ID_CommandBufferEndRecording) {
+            recording = false;
+        }
+        if (!synchronous && !recording) {
+            // A finish issued while recording would end up in the buffer.
+            rsContextFinish(rsc);
+        }
+        uint64_t ns = getTimeNs() - t0;
+
+        CommandStats *s = &stats[slot];
+        if (!s->count || ns < s->minNs) {
+            s->minNs = ns;
+        }
+        if (ns > s->maxNs) {
+            s->maxNs = ns;
+        }
+        s->count++;
+        s->totalNs += ns;
+        replayNs += ns;
+
+        if (verbose) {
+            printf("%u %s %.3f us\n", index, reader.getCommandName(), ns / 1000.0);
+        }
+        index++;
+    }
+
+    printf("records = %u\n", index);
+    printf("total replay time: %.3f ms\n", replayNs / 1000000.0);
+    printf("finish overhead per command: %.3f us\n", finishNs / 1000.0);
+    printf("command,count,total_us,avg_us,min_us,max_us\n");
+    for (uint32_t ct = 1; ct < kStatCount; ct++) {
+        const CommandStats *s = &stats[ct];
+        if (!s->count) {
+            continue;
+        }
+        printf("%s,%u,%.3f,%.3f,%.3f,%.3f\n",
+               (ct == kApiCount) ? "AllocationSnapshot" : gApiNames[ct],
+               s->count, s->totalNs / 1000.0, s->totalNs / 1000.0 / s->count,
+               s->minNs / 1000.0, s->maxNs / 1000.0);
+    }
+    free(stats);
+
+    gMessageRun = false;
+    rsContextDeinitToClient(rsc);
+    pthread_join(messageThread, NULL);
+    rsContextDestroy(rsc);
+    rsDeviceDestroy(dev);
+    return 0;
+}